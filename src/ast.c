@@ -0,0 +1,283 @@
+#include "ast.h"
+#include "intern.h"
+#include "preprocessor.h"
+#include <string.h>
+
+/* What an operand refers to, for ast_dump(). */
+enum operand {
+    OPERAND_NONE,
+    OPERAND_NODE,
+    OPERAND_LIST,
+    OPERAND_PAIR,
+    OPERAND_TRIPLE,
+    OPERAND_TOKEN,
+    OPERAND_FLAGS,
+    OPERAND_COUNT,
+};
+
+static const struct {
+    const char *name;
+    uint8_t lhs;
+    uint8_t rhs;
+} kind_info[NUM_AST_KINDS] = {
+    [AST_NONE] = {"none", OPERAND_NONE, OPERAND_NONE},
+    [AST_TRANSLATION_UNIT] = {"translation-unit", OPERAND_LIST, OPERAND_NONE},
+    [AST_DECL] = {"decl", OPERAND_NODE, OPERAND_NODE},
+    [AST_FUNC_DEF] = {"func-def", OPERAND_NODE, OPERAND_NODE},
+    [AST_TYPEDEF] = {"typedef", OPERAND_NODE, OPERAND_NONE},
+    [AST_TAG_DECL] = {"tag-decl", OPERAND_NODE, OPERAND_NONE},
+    [AST_STATIC_ASSERT] = {"static-assert", OPERAND_NODE, OPERAND_TOKEN},
+    [AST_DECL_LIST] = {"decl-list", OPERAND_LIST, OPERAND_NONE},
+    [AST_DECL_SPEC] = {"decl-spec", OPERAND_FLAGS, OPERAND_NODE},
+    [AST_STRUCT] = {"struct", OPERAND_TOKEN, OPERAND_LIST},
+    [AST_UNION] = {"union", OPERAND_TOKEN, OPERAND_LIST},
+    [AST_FIELD] = {"field", OPERAND_NODE, OPERAND_NODE},
+    [AST_ENUM] = {"enum", OPERAND_TOKEN, OPERAND_LIST},
+    [AST_ENUMERATOR] = {"enumerator", OPERAND_NODE, OPERAND_NONE},
+    [AST_TYPEDEF_NAME] = {"typedef-name", OPERAND_NONE, OPERAND_NONE},
+    [AST_POINTER] = {"pointer", OPERAND_NODE, OPERAND_FLAGS},
+    [AST_ARRAY] = {"array", OPERAND_NODE, OPERAND_NODE},
+    [AST_FUNCTION] = {"function", OPERAND_NODE, OPERAND_LIST},
+    [AST_FUNCTION_VARIADIC] = {"function-variadic", OPERAND_NODE,
+                               OPERAND_LIST},
+    [AST_FUNCTION_NO_PROTOTYPE] = {"function-no-prototype", OPERAND_NODE,
+                                   OPERAND_LIST},
+    [AST_PARAM] = {"param", OPERAND_NODE, OPERAND_NONE},
+    [AST_COMPOUND] = {"compound", OPERAND_LIST, OPERAND_NONE},
+    [AST_EXPR_STMT] = {"expr-stmt", OPERAND_NODE, OPERAND_NONE},
+    [AST_IF] = {"if", OPERAND_NODE, OPERAND_PAIR},
+    [AST_SWITCH] = {"switch", OPERAND_NODE, OPERAND_NODE},
+    [AST_WHILE] = {"while", OPERAND_NODE, OPERAND_NODE},
+    [AST_DO] = {"do", OPERAND_NODE, OPERAND_NODE},
+    [AST_FOR] = {"for", OPERAND_TRIPLE, OPERAND_NODE},
+    [AST_GOTO] = {"goto", OPERAND_NONE, OPERAND_NONE},
+    [AST_CONTINUE] = {"continue", OPERAND_NONE, OPERAND_NONE},
+    [AST_BREAK] = {"break", OPERAND_NONE, OPERAND_NONE},
+    [AST_RETURN] = {"return", OPERAND_NODE, OPERAND_NONE},
+    [AST_LABEL] = {"label", OPERAND_NODE, OPERAND_NONE},
+    [AST_CASE] = {"case", OPERAND_NODE, OPERAND_NODE},
+    [AST_DEFAULT] = {"default", OPERAND_NODE, OPERAND_NONE},
+    [AST_IDENT] = {"ident", OPERAND_NONE, OPERAND_NONE},
+    [AST_INT_CONST] = {"int-const", OPERAND_NONE, OPERAND_NONE},
+    [AST_FLOAT_CONST] = {"float-const", OPERAND_NONE, OPERAND_NONE},
+    [AST_CHAR_CONST] = {"char-const", OPERAND_NONE, OPERAND_NONE},
+    [AST_STRING] = {"string", OPERAND_COUNT, OPERAND_NONE},
+    [AST_CALL] = {"call", OPERAND_NODE, OPERAND_LIST},
+    [AST_INDEX] = {"index", OPERAND_NODE, OPERAND_NODE},
+    [AST_MEMBER] = {"member", OPERAND_NODE, OPERAND_TOKEN},
+    [AST_PTR_MEMBER] = {"ptr-member", OPERAND_NODE, OPERAND_TOKEN},
+    [AST_COMPOUND_LITERAL] = {"compound-literal", OPERAND_NODE,
+                              OPERAND_NODE},
+    [AST_POST_INC] = {"post-inc", OPERAND_NODE, OPERAND_NONE},
+    [AST_POST_DEC] = {"post-dec", OPERAND_NODE, OPERAND_NONE},
+    [AST_PRE_INC] = {"pre-inc", OPERAND_NODE, OPERAND_NONE},
+    [AST_PRE_DEC] = {"pre-dec", OPERAND_NODE, OPERAND_NONE},
+    [AST_ADDR] = {"addr", OPERAND_NODE, OPERAND_NONE},
+    [AST_DEREF] = {"deref", OPERAND_NODE, OPERAND_NONE},
+    [AST_PLUS] = {"plus", OPERAND_NODE, OPERAND_NONE},
+    [AST_NEG] = {"neg", OPERAND_NODE, OPERAND_NONE},
+    [AST_BIT_NOT] = {"bit-not", OPERAND_NODE, OPERAND_NONE},
+    [AST_NOT] = {"not", OPERAND_NODE, OPERAND_NONE},
+    [AST_SIZEOF_EXPR] = {"sizeof-expr", OPERAND_NODE, OPERAND_NONE},
+    [AST_SIZEOF_TYPE] = {"sizeof-type", OPERAND_NODE, OPERAND_NONE},
+    [AST_ALIGNOF] = {"alignof", OPERAND_NODE, OPERAND_NONE},
+    [AST_CAST] = {"cast", OPERAND_NODE, OPERAND_NODE},
+    [AST_MUL] = {"mul", OPERAND_NODE, OPERAND_NODE},
+    [AST_DIV] = {"div", OPERAND_NODE, OPERAND_NODE},
+    [AST_MOD] = {"mod", OPERAND_NODE, OPERAND_NODE},
+    [AST_ADD] = {"add", OPERAND_NODE, OPERAND_NODE},
+    [AST_SUB] = {"sub", OPERAND_NODE, OPERAND_NODE},
+    [AST_SHL] = {"shl", OPERAND_NODE, OPERAND_NODE},
+    [AST_SHR] = {"shr", OPERAND_NODE, OPERAND_NODE},
+    [AST_LT] = {"lt", OPERAND_NODE, OPERAND_NODE},
+    [AST_GT] = {"gt", OPERAND_NODE, OPERAND_NODE},
+    [AST_LE] = {"le", OPERAND_NODE, OPERAND_NODE},
+    [AST_GE] = {"ge", OPERAND_NODE, OPERAND_NODE},
+    [AST_EQ] = {"eq", OPERAND_NODE, OPERAND_NODE},
+    [AST_NE] = {"ne", OPERAND_NODE, OPERAND_NODE},
+    [AST_BIT_AND] = {"bit-and", OPERAND_NODE, OPERAND_NODE},
+    [AST_BIT_XOR] = {"bit-xor", OPERAND_NODE, OPERAND_NODE},
+    [AST_BIT_OR] = {"bit-or", OPERAND_NODE, OPERAND_NODE},
+    [AST_LOG_AND] = {"log-and", OPERAND_NODE, OPERAND_NODE},
+    [AST_LOG_OR] = {"log-or", OPERAND_NODE, OPERAND_NODE},
+    [AST_ASSIGN] = {"assign", OPERAND_NODE, OPERAND_NODE},
+    [AST_MUL_ASSIGN] = {"mul-assign", OPERAND_NODE, OPERAND_NODE},
+    [AST_DIV_ASSIGN] = {"div-assign", OPERAND_NODE, OPERAND_NODE},
+    [AST_MOD_ASSIGN] = {"mod-assign", OPERAND_NODE, OPERAND_NODE},
+    [AST_ADD_ASSIGN] = {"add-assign", OPERAND_NODE, OPERAND_NODE},
+    [AST_SUB_ASSIGN] = {"sub-assign", OPERAND_NODE, OPERAND_NODE},
+    [AST_SHL_ASSIGN] = {"shl-assign", OPERAND_NODE, OPERAND_NODE},
+    [AST_SHR_ASSIGN] = {"shr-assign", OPERAND_NODE, OPERAND_NODE},
+    [AST_AND_ASSIGN] = {"and-assign", OPERAND_NODE, OPERAND_NODE},
+    [AST_XOR_ASSIGN] = {"xor-assign", OPERAND_NODE, OPERAND_NODE},
+    [AST_OR_ASSIGN] = {"or-assign", OPERAND_NODE, OPERAND_NODE},
+    [AST_COMMA] = {"comma", OPERAND_NODE, OPERAND_NODE},
+    [AST_COND] = {"cond", OPERAND_NODE, OPERAND_PAIR},
+    [AST_INIT_LIST] = {"init-list", OPERAND_LIST, OPERAND_NONE},
+    [AST_DESIGNATION] = {"designation", OPERAND_LIST, OPERAND_NODE},
+    [AST_DESIG_FIELD] = {"desig-field", OPERAND_NONE, OPERAND_NONE},
+    [AST_DESIG_INDEX] = {"desig-index", OPERAND_NODE, OPERAND_NONE},
+};
+
+static const char *spec_names[] = {
+    "void", "char", "short", "int", "long", "long", "float", "double",
+    "signed", "unsigned", "_Bool", "_Complex", "typedef", "extern", "static",
+    "auto", "register", "_Thread_local", "inline", "_Noreturn", "const",
+    "volatile", "restrict", "_Atomic",
+};
+
+static void grow(struct ast *ast, struct arena *arena);
+static void print_token(const struct ast *ast, const struct preprocessor *pp,
+                        uint32_t token, FILE *fp);
+static void dump(const struct ast *ast, const struct preprocessor *pp,
+                 uint32_t i, int depth, FILE *fp);
+
+void ast_init(struct ast *ast, struct arena *arena,
+              const struct token_array *tokarr, size_t nodes) {
+    ast->capacity = nodes < 16 ? 16 : nodes;
+    ast->kinds = arena_alloc(arena, ast->capacity, 1);
+    ast->tokens = arena_alloc(arena, sizeof(uint32_t) * ast->capacity,
+                              _Alignof(uint32_t));
+    ast->data = arena_alloc(arena, sizeof(struct ast_data) * ast->capacity,
+                            _Alignof(struct ast_data));
+    ast->extra_capacity = ast->capacity / 2;
+    ast->extra = arena_alloc(arena, sizeof(uint32_t) * ast->extra_capacity,
+                             _Alignof(uint32_t));
+    ast->token_array = tokarr->tokens;
+    ast->num_tokens = tokarr->len;
+    ast->root = 0;
+
+    /* Node 0 and list 0 stand for none. */
+    ast->kinds[0] = AST_NONE;
+    ast->tokens[0] = AST_NO_TOKEN;
+    ast->data[0].lhs = 0;
+    ast->data[0].rhs = 0;
+    ast->len = 1;
+    ast->extra[0] = 0;
+    ast->extra_len = 1;
+}
+
+uint32_t ast_add(struct ast *ast, struct arena *arena, enum ast_kind kind,
+                 uint32_t token, uint32_t lhs, uint32_t rhs) {
+    const uint32_t i = ast->len;
+
+    if (ast->len == ast->capacity) grow(ast, arena);
+    ast->kinds[i] = kind;
+    ast->tokens[i] = token;
+    ast->data[i].lhs = lhs;
+    ast->data[i].rhs = rhs;
+    ast->len++;
+    return i;
+}
+
+uint32_t ast_add_list(struct ast *ast, struct arena *arena,
+                      const uint32_t *nodes, size_t len, bool counted) {
+    const size_t need = ast->extra_len + len + 1;
+    const uint32_t list = ast->extra_len;
+
+    if (need > ast->extra_capacity) {
+        size_t capacity = 2 * ast->extra_capacity;
+        if (capacity < need) capacity = need;
+        ast->extra = arena_grow(arena, ast->extra,
+                                sizeof(uint32_t) * ast->extra_capacity,
+                                sizeof(uint32_t) * capacity,
+                                _Alignof(uint32_t));
+        ast->extra_capacity = capacity;
+    }
+    if (counted) ast->extra[ast->extra_len++] = len;
+    memcpy(ast->extra + ast->extra_len, nodes, sizeof(uint32_t) * len);
+    ast->extra_len += len;
+    return list;
+}
+
+size_t ast_size(const struct ast *ast) {
+    return ast->len * (sizeof(uint8_t) + sizeof(uint32_t)
+                       + sizeof(struct ast_data))
+           + ast->extra_len * sizeof(uint32_t);
+}
+
+const char *ast_kind_name(enum ast_kind kind) {
+    return kind < NUM_AST_KINDS ? kind_info[kind].name : "invalid";
+}
+
+void ast_dump(const struct ast *ast, const struct preprocessor *pp,
+              uint32_t i, FILE *fp) {
+    dump(ast, pp, i, 0, fp);
+}
+
+/* The arrays grow together. */
+static void grow(struct ast *ast, struct arena *arena) {
+    const size_t capacity = 2 * ast->capacity;
+
+    ast->kinds = arena_grow(arena, ast->kinds, ast->capacity, capacity, 1);
+    ast->tokens = arena_grow(arena, ast->tokens,
+                             sizeof(uint32_t) * ast->capacity,
+                             sizeof(uint32_t) * capacity, _Alignof(uint32_t));
+    ast->data = arena_grow(arena, ast->data,
+                           sizeof(struct ast_data) * ast->capacity,
+                           sizeof(struct ast_data) * capacity,
+                           _Alignof(struct ast_data));
+    ast->capacity = capacity;
+}
+
+static void print_token(const struct ast *ast, const struct preprocessor *pp,
+                        uint32_t token, FILE *fp) {
+    const struct token *tok;
+
+    if (token == AST_NO_TOKEN || token >= ast->num_tokens) return;
+    tok = &ast->token_array[token];
+    if (tok->type == TOKEN_IDENTIFER)
+        fprintf(fp, " %s", atom_spelling(tok->atom));
+    else if (pp)
+        fprintf(fp, " %.*s", (int)tok->len, preprocessor_spelling(pp, tok));
+    else
+        fprintf(fp, " %s", token_type_name(tok->type));
+}
+
+static void dump(const struct ast *ast, const struct preprocessor *pp,
+                 uint32_t i, int depth, FILE *fp) {
+    const enum ast_kind kind = ast->kinds[i];
+    const uint32_t operands[2] = {ast->data[i].lhs, ast->data[i].rhs};
+    const uint8_t shapes[2] = {kind_info[kind].lhs, kind_info[kind].rhs};
+
+    fprintf(fp, "%*s%s", 2 * depth, "", ast_kind_name(kind));
+    if (kind == AST_STRING) {
+        for (uint32_t k = 0; k < operands[0]; k++)
+            print_token(ast, pp, ast->tokens[i] + k, fp);
+    } else if (kind != AST_STRUCT && kind != AST_UNION && kind != AST_ENUM
+               && kind != AST_DECL_SPEC) {
+        print_token(ast, pp, ast->tokens[i], fp);
+    }
+    for (int k = 0; k < 2; k++) {
+        if (shapes[k] == OPERAND_TOKEN) print_token(ast, pp, operands[k], fp);
+        if (shapes[k] != OPERAND_FLAGS) continue;
+        for (size_t bit = 0; bit < sizeof(spec_names) / sizeof(*spec_names);
+             bit++)
+            if (operands[k] & (1u << bit)) fprintf(fp, " %s", spec_names[bit]);
+    }
+    fputc('\n', fp);
+
+    for (int k = 0; k < 2; k++) {
+        const uint32_t op = operands[k];
+        switch (shapes[k]) {
+        case OPERAND_NODE:
+            if (op) dump(ast, pp, op, depth + 1, fp);
+            break;
+        case OPERAND_LIST:
+            for (size_t j = 0; j < ast_list_len(ast, op); j++)
+                dump(ast, pp, ast_list(ast, op)[j], depth + 1, fp);
+            break;
+        case OPERAND_PAIR:
+        case OPERAND_TRIPLE:
+            for (int j = 0; j < (shapes[k] == OPERAND_PAIR ? 2 : 3); j++) {
+                if (ast->extra[op + j])
+                    dump(ast, pp, ast->extra[op + j], depth + 1, fp);
+                else
+                    fprintf(fp, "%*snone\n", 2 * (depth + 1), "");
+            }
+            break;
+        default:
+            break;
+        }
+    }
+}
@@ -0,0 +1,278 @@
+#ifndef AST_H
+#define AST_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "lexer.h"
+#include "utils.h"
+
+struct preprocessor;
+
+/* Abstract syntax tree of a translation unit, stored flat. Node i is its
+   kind kinds[i], its main token tokens[i], an index into the token array
+   the tree was parsed from, and two 32-bit operands data[i].lhs and
+   data[i].rhs. Operands refer to nodes, tokens, and lists by index, as
+   listed for each kind below.
+
+   A list is a run of extra: its length, then the indices of its nodes. A
+   pair or triple is two or three node indices in extra, with no length.
+   Node 0 and list 0 are never used, so 0 stands for a missing operand. */
+enum ast_kind {
+    AST_NONE,
+
+    /* lhs: list of external declarations. */
+    AST_TRANSLATION_UNIT,
+
+    /* Declarations. The main token is the name declared, or AST_NO_TOKEN
+       where there is none. */
+    /* Object or function. lhs: type, rhs: initializer or 0. */
+    AST_DECL,
+    /* lhs: type, a function type; rhs: body. */
+    AST_FUNC_DEF,
+    /* lhs: type. */
+    AST_TYPEDEF,
+    /* Declaration of a tag or of enumerators only. lhs: AST_DECL_SPEC. */
+    AST_TAG_DECL,
+    /* lhs: constant expression; rhs: token of the message. */
+    AST_STATIC_ASSERT,
+    /* Declarations in the first clause of a for. lhs: list. */
+    AST_DECL_LIST,
+
+    /* Types, built from the declaration specifiers outwards. */
+    /* Main token: first specifier; lhs: AST_SPEC_* flags; rhs: struct,
+       union, enum, or typedef name specifier, or 0. */
+    AST_DECL_SPEC,
+    /* Main token: the keyword; lhs: tag token or AST_NO_TOKEN; rhs: list
+       of AST_FIELD and AST_STATIC_ASSERT, or 0 without a member list. */
+    AST_STRUCT,
+    AST_UNION,
+    /* lhs: type; rhs: bit-field width or 0. */
+    AST_FIELD,
+    /* Main token: the keyword; lhs: tag token or AST_NO_TOKEN; rhs: list of
+       AST_ENUMERATOR, or 0. */
+    AST_ENUM,
+    /* lhs: value or 0. */
+    AST_ENUMERATOR,
+    /* Main token: the name. */
+    AST_TYPEDEF_NAME,
+    /* lhs: pointed-to type; rhs: AST_SPEC_* qualifier flags. */
+    AST_POINTER,
+    /* lhs: element type; rhs: length or 0. */
+    AST_ARRAY,
+    /* lhs: return type; rhs: list of AST_PARAM. A function declared with
+       () has no prototype, and one declared with (void) an empty list. */
+    AST_FUNCTION,
+    AST_FUNCTION_VARIADIC,
+    AST_FUNCTION_NO_PROTOTYPE,
+    /* lhs: type. */
+    AST_PARAM,
+
+    /* Statements. */
+    /* lhs: list of declarations and statements. */
+    AST_COMPOUND,
+    /* lhs: expression, or 0 for a null statement. */
+    AST_EXPR_STMT,
+    /* lhs: condition; rhs: pair of the then and else (or 0) branches. */
+    AST_IF,
+    /* lhs: controlling expression; rhs: body. */
+    AST_SWITCH,
+    AST_WHILE,
+    /* lhs: body; rhs: condition. */
+    AST_DO,
+    /* lhs: triple of the first clause (an expression, AST_DECL_LIST, or
+       0), the condition, and the step (or 0); rhs: body. */
+    AST_FOR,
+    /* Main token: the label. */
+    AST_GOTO,
+    AST_CONTINUE,
+    AST_BREAK,
+    /* lhs: value or 0. */
+    AST_RETURN,
+    /* Main token: the label; lhs: statement. */
+    AST_LABEL,
+    /* lhs: value; rhs: statement. */
+    AST_CASE,
+    /* lhs: statement. */
+    AST_DEFAULT,
+
+    /* Expressions. The main token is the operator, or the token of a
+       primary expression. */
+    AST_IDENT,
+    AST_INT_CONST,
+    AST_FLOAT_CONST,
+    AST_CHAR_CONST,
+    /* lhs: number of adjacent string literal tokens, concatenated. */
+    AST_STRING,
+    /* lhs: callee; rhs: list of arguments. */
+    AST_CALL,
+    /* lhs: array; rhs: index. */
+    AST_INDEX,
+    /* lhs: operand; rhs: token of the member name. */
+    AST_MEMBER,
+    AST_PTR_MEMBER,
+    /* lhs: type; rhs: AST_INIT_LIST. */
+    AST_COMPOUND_LITERAL,
+    /* Unary operators. lhs: operand. */
+    AST_POST_INC,
+    AST_POST_DEC,
+    AST_PRE_INC,
+    AST_PRE_DEC,
+    AST_ADDR,
+    AST_DEREF,
+    AST_PLUS,
+    AST_NEG,
+    AST_BIT_NOT,
+    AST_NOT,
+    AST_SIZEOF_EXPR,
+    /* lhs: type. */
+    AST_SIZEOF_TYPE,
+    AST_ALIGNOF,
+    /* lhs: type; rhs: operand. */
+    AST_CAST,
+    /* Binary operators, in order of their tokens. lhs and rhs: operands. */
+    AST_MUL,
+    AST_DIV,
+    AST_MOD,
+    AST_ADD,
+    AST_SUB,
+    AST_SHL,
+    AST_SHR,
+    AST_LT,
+    AST_GT,
+    AST_LE,
+    AST_GE,
+    AST_EQ,
+    AST_NE,
+    AST_BIT_AND,
+    AST_BIT_XOR,
+    AST_BIT_OR,
+    AST_LOG_AND,
+    AST_LOG_OR,
+    AST_ASSIGN,
+    AST_MUL_ASSIGN,
+    AST_DIV_ASSIGN,
+    AST_MOD_ASSIGN,
+    AST_ADD_ASSIGN,
+    AST_SUB_ASSIGN,
+    AST_SHL_ASSIGN,
+    AST_SHR_ASSIGN,
+    AST_AND_ASSIGN,
+    AST_XOR_ASSIGN,
+    AST_OR_ASSIGN,
+    AST_COMMA,
+    /* lhs: condition; rhs: pair of the second and third operands. */
+    AST_COND,
+
+    /* Initializers. */
+    /* lhs: list of initializers and AST_DESIGNATION. */
+    AST_INIT_LIST,
+    /* lhs: list of AST_DESIG_FIELD and AST_DESIG_INDEX; rhs: initializer. */
+    AST_DESIGNATION,
+    /* Main token: the member name. */
+    AST_DESIG_FIELD,
+    /* lhs: index. */
+    AST_DESIG_INDEX,
+
+    NUM_AST_KINDS,
+};
+
+#define AST_NO_TOKEN UINT32_MAX
+
+/* Declaration specifiers, in the lhs of AST_DECL_SPEC. */
+/* Type specifiers. long is counted in two bits. */
+#define AST_SPEC_VOID           0x00000001
+#define AST_SPEC_CHAR           0x00000002
+#define AST_SPEC_SHORT          0x00000004
+#define AST_SPEC_INT            0x00000008
+#define AST_SPEC_LONG           0x00000010
+#define AST_SPEC_LONG_LONG      0x00000020
+#define AST_SPEC_FLOAT          0x00000040
+#define AST_SPEC_DOUBLE         0x00000080
+#define AST_SPEC_SIGNED         0x00000100
+#define AST_SPEC_UNSIGNED       0x00000200
+#define AST_SPEC_BOOL           0x00000400
+#define AST_SPEC_COMPLEX        0x00000800
+/* Storage classes. */
+#define AST_SPEC_TYPEDEF        0x00001000
+#define AST_SPEC_EXTERN         0x00002000
+#define AST_SPEC_STATIC         0x00004000
+#define AST_SPEC_AUTO           0x00008000
+#define AST_SPEC_REGISTER       0x00010000
+#define AST_SPEC_THREAD_LOCAL   0x00020000
+/* Function specifiers. */
+#define AST_SPEC_INLINE         0x00040000
+#define AST_SPEC_NORETURN       0x00080000
+/* Type qualifiers, also in the rhs of AST_POINTER. */
+#define AST_SPEC_CONST          0x00100000
+#define AST_SPEC_VOLATILE       0x00200000
+#define AST_SPEC_RESTRICT       0x00400000
+#define AST_SPEC_ATOMIC         0x00800000
+
+#define AST_SPEC_TYPES          0x00000fff
+#define AST_SPEC_STORAGE        0x0003f000
+#define AST_SPEC_QUALIFIERS     0x00f00000
+
+struct ast_data {
+    uint32_t lhs;
+    uint32_t rhs;
+};
+
+struct ast {
+    size_t len;
+    size_t capacity;
+    uint8_t *kinds;
+    uint32_t *tokens;
+    struct ast_data *data;
+
+    size_t extra_len;
+    size_t extra_capacity;
+    uint32_t *extra;
+
+    /* Tokens the tree was parsed from. */
+    const struct token *token_array;
+    size_t num_tokens;
+
+    /* The AST_TRANSLATION_UNIT. */
+    uint32_t root;
+};
+
+/* All arrays are allocated from arena, with room for about nodes nodes. */
+void ast_init(struct ast *ast, struct arena *arena,
+              const struct token_array *tokarr, size_t nodes);
+
+uint32_t ast_add(struct ast *ast, struct arena *arena, enum ast_kind kind,
+                 uint32_t token, uint32_t lhs, uint32_t rhs);
+/* Add a list of len nodes, or a pair or triple when not counted. Returns its
+   index in extra. */
+uint32_t ast_add_list(struct ast *ast, struct arena *arena,
+                      const uint32_t *nodes, size_t len, bool counted);
+
+static inline size_t ast_list_len(const struct ast *ast, uint32_t list) {
+    return list ? ast->extra[list] : 0;
+}
+
+static inline const uint32_t *ast_list(const struct ast *ast, uint32_t list) {
+    return &ast->extra[list + 1];
+}
+
+/* Main token of node i, which must have one. */
+static inline const struct token *ast_token(const struct ast *ast,
+                                            uint32_t i) {
+    return &ast->token_array[ast->tokens[i]];
+}
+
+/* Bytes taken by the tree. */
+size_t ast_size(const struct ast *ast);
+
+/* Name of a kind, e.g. "func-def". */
+const char *ast_kind_name(enum ast_kind kind);
+
+/* Print the tree rooted at node i, one node per line, indented by depth.
+   Tokens are spelled from the sources of the preprocessor, if any. */
+void ast_dump(const struct ast *ast, const struct preprocessor *pp,
+              uint32_t i, FILE *fp);
+
+#endif
@@ -0,0 +1,1177 @@
+#include <dirent.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "ast.h"
+#include "bytecode.h"
+#include "compiler.h"
+#include "intern.h"
+#include "lexer.h"
+#include "parser.h"
+#include "preprocessor.h"
+#include "scan.h"
+#include "source.h"
+#include "thread_pool.h"
+#include "token_cache.h"
+#include "token_store.h"
+#include "utils.h"
+#include "vm.h"
+
+/* Lexer benchmark. Generates deterministic synthetic corpora and prints one
+   tab-separated line per run:
+
+   corpus  jobs  isa  bytes  tokens  seconds  mb_per_s  tokens_per_s
+   allocs_per_token  peak_rss_kb
+
+   Allocations are counted by wrapping malloc, calloc and realloc at link
+   time (see the bench target in the Makefile). Peak RSS is the high-water
+   mark of the process, reset before each run where the kernel allows.
+
+   The first corpus is also lexed with a warm token cache, as corpus
+   "<name>+cache", which measures loading its tokens.
+
+   A second table measures the parser on a corpus of C functions:
+
+   corpus  bytes  tokens  nodes  seconds  nodes_per_s  tokens_per_s
+   ast_bytes_per_token
+
+   A third runs small programs on the VM, compiled with no checks, with
+   overflow checks, with memory checks, and with both, and gives the time
+   relative to the unchecked run:
+
+   program  checks  instructions  seconds  insns_per_s  relative  result
+
+   A run whose result differs from that of the first is reported on
+   stderr.
+
+   A fourth builds strings out of spans of the identifier corpus, with
+   struct string and with the heap-only, byte-at-a-time string it replaced:
+   one short string per span, as for a token; one long string appended a
+   span at a time; and one appended a byte at a time:
+
+   workload  impl  bytes  strings  seconds  mb_per_s  allocs_per_string
+   result
+
+   With --check, it only makes random edits of small corpora, re-lexes
+   them incrementally and checks the tokens against lexing from scratch and
+   through a token store, then runs random hot loops on the VM, interpreted
+   and compiled by its second tier, with and without memory checks, and
+   reports each corpus or program whose results differ, exiting with 1 if
+   any do. */
+
+#define DEFAULT_SIZE_MB 8
+#define REPEAT 5
+#define CHECK_PROGRAMS 300
+#define CHECK_EDITS 500
+
+struct corpus {
+    const char *name;
+    void (*generate)(struct string *out, size_t size);
+};
+
+/* Volatile, as the compiler takes the calls to malloc in this file for
+   ones that cannot change it. */
+static volatile size_t num_allocs;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size) {
+    num_allocs++;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size) {
+    num_allocs++;
+    return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    num_allocs++;
+    return __real_realloc(ptr, size);
+}
+
+/* xorshift64*, so that corpora are the same on every run. */
+static uint64_t rng_state;
+
+static void rng_seed(uint64_t seed) {
+    rng_state = seed;
+}
+
+static uint32_t rng(uint32_t n) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return (uint32_t)((rng_state * 0x2545f4914f6cdd1dull) >> 32) % n;
+}
+
+static void append(struct string *out, const char *s) {
+    string_append_n(out, s, strlen(s));
+}
+
+static void append_identifier(struct string *out) {
+    static const char *const words[] = {
+        "node", "count", "buffer", "index", "value", "next", "table", "len",
+        "result", "context", "state", "offset", "tmp", "i", "j", "x",
+    };
+    const int parts = 1 + rng(3);
+
+    for (int k = 0; k < parts; k++) {
+        if (k) string_append(out, '_');
+        append(out, words[rng(sizeof(words) / sizeof(words[0]))]);
+    }
+    if (rng(2)) string_append(out, '0' + rng(10));
+}
+
+static void gen_identifiers(struct string *out, size_t size) {
+    while (out->len < size) {
+        for (int k = rng(6); k > 0; k--) append(out, "    ");
+        append_identifier(out);
+        append(out, " = ");
+        append_identifier(out);
+        append(out, rng(2) ? " + " : "->");
+        append_identifier(out);
+        append(out, ";\n");
+    }
+}
+
+static void gen_numbers(struct string *out, size_t size) {
+    static const char *const numbers[] = {
+        "0", "7", "42", "123456789", "18446744073709551615u", "0x1F3Au",
+        "0XDEADBEEFull", "0777", "10l", "3.14159", "1e10", "6.02214076e23",
+        "1.5f", ".5", "2.L", "0x1.8p3", "1E-9", "255u",
+    };
+
+    while (out->len < size) {
+        append(out, "x = ");
+        for (int k = 0; k < 6; k++) {
+            if (k) append(out, " + ");
+            append(out, numbers[rng(sizeof(numbers) / sizeof(numbers[0]))]);
+        }
+        append(out, ";\n");
+    }
+}
+
+static void gen_strings(struct string *out, size_t size) {
+    static const char *const pieces[] = {
+        "hello, world", "\\n", "\\t", "\\\"quoted\\\"", "%d items", "\\x41",
+        "\\101", "a somewhat longer run of plain text in a string literal",
+    };
+
+    while (out->len < size) {
+        append(out, "puts(\"");
+        for (int k = 1 + rng(6); k > 0; k--)
+            append(out, pieces[rng(sizeof(pieces) / sizeof(pieces[0]))]);
+        append(out, rng(4) ? "\");\n" : "\" \"continued\");\n");
+    }
+}
+
+static void gen_punctuators(struct string *out, size_t size) {
+    static const char *const puncts[] = {
+        "[", "]", "(", ")", "{", "}", ".", "->", "++", "--", "&", "*", "+",
+        "-", "~", "!", "/", "%", "<<", ">>", "<", ">", "<=", ">=", "==",
+        "!=", "^", "|", "&&", "||", "?", ":", ";", "...", "=", "*=", "/=",
+        "%=", "+=", "-=", "<<=", ">>=", "&=", "^=", "|=", ",", "#", "##",
+    };
+
+    while (out->len < size) {
+        for (int k = 0; k < 40; k++) {
+            const char *const p = puncts[rng(sizeof(puncts)
+                                             / sizeof(puncts[0]))];
+            append(out, p);
+            /* Keep / from starting a comment with the next one. */
+            if (!strcmp(p, "/")) string_append(out, ' ');
+        }
+        string_append(out, '\n');
+    }
+}
+
+static void gen_long_line(struct string *out, size_t size) {
+    while (out->len < size) {
+        append_identifier(out);
+        append(out, rng(2) ? " = 42 + \"s\"; " : "(x, 1.5) ; ");
+    }
+    string_append(out, '\n');
+}
+
+static void gen_expr(struct string *out, int depth) {
+    static const char *const operands[] = {
+        "a", "b", "n", "i", "sum", "p->value", "arr[i]", "42", "0xff", "1u",
+    };
+    static const char *const operators[] = {
+        " + ", " - ", " * ", " / ", " << ", " & ", " | ", " < ", " == ",
+        " && ",
+    };
+
+    switch (depth > 0 ? rng(6) : 0) {
+    case 0:
+        append(out, operands[rng(sizeof(operands) / sizeof(operands[0]))]);
+        break;
+    case 1:
+        string_append(out, '(');
+        gen_expr(out, depth - 1);
+        string_append(out, ')');
+        break;
+    case 2:
+        /* Spaced so that two minus signs do not make a --. */
+        append(out, rng(2) ? "(long)" : " -");
+        gen_expr(out, depth - 1);
+        break;
+    case 3:
+        append(out, "helper(");
+        gen_expr(out, depth - 1);
+        append(out, ", ");
+        gen_expr(out, depth - 1);
+        string_append(out, ')');
+        break;
+    default:
+        gen_expr(out, depth - 1);
+        append(out, operators[rng(sizeof(operators) / sizeof(operators[0]))]);
+        gen_expr(out, depth - 1);
+    }
+}
+
+static void gen_functions(struct string *out, size_t size) {
+    char buf[64];
+
+    append(out, "int helper(int x, int y);\n"
+                "typedef struct node { int value; struct node *next; } "
+                "node_t;\n");
+    for (unsigned k = 0; out->len < size; k++) {
+        snprintf(buf, sizeof(buf), "static int fn%u(node_t *p, int n) {\n",
+                 k);
+        append(out, buf);
+        append(out, "    int a = 1, b = 2, i, sum = 0;\n"
+                    "    int arr[16];\n"
+                    "    for (i = 0; i < n; i++) {\n"
+                    "        if (");
+        gen_expr(out, 3);
+        append(out, ")\n            sum += ");
+        gen_expr(out, 4);
+        append(out, ";\n        else\n            sum -= ");
+        gen_expr(out, 3);
+        append(out, ";\n        p = p->next;\n    }\n    while (");
+        gen_expr(out, 2);
+        append(out, ") {\n        a = ");
+        gen_expr(out, 4);
+        append(out, ";\n        b++;\n    }\n    return sum ? sum : ");
+        gen_expr(out, 2);
+        append(out, ";\n}\n");
+    }
+}
+
+/* Operand of the loops of --check: a variable, or a constant, on either
+   side, which the second tier folds into the operation reading it. */
+static void gen_loop_operand(struct string *out) {
+    static const char *const vars[] = {"s", "t", "i", "(int)u", "a[i & 7]"};
+    char buf[16];
+
+    if (rng(3)) {
+        append(out, vars[rng(sizeof(vars) / sizeof(vars[0]))]);
+    } else {
+        snprintf(buf, sizeof(buf), "%d", (int)rng(201) - 100);
+        append(out, buf);
+    }
+}
+
+static void gen_loop_expr(struct string *out, int depth) {
+    static const char *const operators[] = {
+        " + ", " - ", " * ", " & ", " | ", " ^ ", " < ", " <= ", " > ",
+        " >= ", " == ", " != ",
+    };
+
+    switch (depth > 0 ? rng(5) : 0) {
+    case 0:
+        gen_loop_operand(out);
+        break;
+    case 1:
+        /* Division by a positive divisor, which cannot trap. */
+        string_append(out, '(');
+        gen_loop_expr(out, depth - 1);
+        append(out, rng(2) ? ") / (((" : ") % (((");
+        gen_loop_expr(out, depth - 1);
+        append(out, ") & 15) + 1)");
+        break;
+    case 2:
+        string_append(out, '(');
+        gen_loop_expr(out, depth - 1);
+        append(out, ") << (");
+        gen_loop_expr(out, depth - 1);
+        append(out, " & 7)");
+        break;
+    default:
+        string_append(out, '(');
+        gen_loop_expr(out, depth - 1);
+        append(out, operators[rng(sizeof(operators) / sizeof(operators[0]))]);
+        gen_loop_expr(out, depth - 1);
+        string_append(out, ')');
+    }
+}
+
+/* A loop run often enough for the second tier to compile it, whose main
+   returns a checksum of its variables. */
+static void gen_loop(struct string *out) {
+    static const char *const statements[] = {
+        "s += ", "t ^= ", "u = u * 33 + ", "a[i & 7] += ", "if (",
+    };
+
+    append(out, "int main(void) {\n"
+                "    int s = 0, t = 1, i;\n"
+                "    unsigned u = 7;\n"
+                "    int a[8];\n"
+                "    for (i = 0; i < 8; i++) a[i] = i;\n"
+                "    for (i = 0; i < 3000; i++) {\n");
+    for (uint32_t k = 0, n = 1 + rng(4); k < n; k++) {
+        const uint32_t st = rng(sizeof(statements) / sizeof(statements[0]));
+
+        append(out, statements[st]);
+        gen_loop_expr(out, 3);
+        append(out, st == 4 ? ") s++; else t--;\n" : ";\n");
+    }
+    append(out, "    }\n"
+                "    return s ^ t ^ (int)u ^ a[3];\n"
+                "}\n");
+}
+
+static const struct corpus corpora[] = {
+    {"identifiers", gen_identifiers},
+    {"numbers", gen_numbers},
+    {"strings", gen_strings},
+    {"punctuators", gen_punctuators},
+    {"long-line", gen_long_line},
+};
+
+/* Programs of the VM benchmark, whose main returns a checksum. */
+struct program_source {
+    const char *name;
+    const char *text;
+};
+
+static const struct program_source programs[] = {
+    {"fib",
+     "static int fib(int n) { return n < 2 ? n : fib(n - 1) + fib(n - 2); }\n"
+     "int main(void) { return fib(30) & 0xff; }\n"},
+    {"loops",
+     "int main(void) {\n"
+     "    unsigned long long sum = 0;\n"
+     "    for (int i = 0; i < 3000; i++)\n"
+     "        for (int j = 0; j < 10000; j++)\n"
+     "            sum += i ^ j;\n"
+     "    return sum & 0xff;\n"
+     "}\n"},
+    {"sieve",
+     "static char composite[1 << 20];\n"
+     "int main(void) {\n"
+     "    int count = 0;\n"
+     "    for (int k = 0; k < 10; k++) {\n"
+     "        count = 0;\n"
+     "        for (int i = 0; i < 1 << 20; i++) composite[i] = 0;\n"
+     "        for (int i = 2; i < 1 << 20; i++) {\n"
+     "            if (composite[i]) continue;\n"
+     "            count++;\n"
+     "            for (int j = 2 * i; j < 1 << 20; j += i) composite[j] = 1;\n"
+     "        }\n"
+     "    }\n"
+     "    return count & 0xff;\n"
+     "}\n"},
+    {"matmul",
+     "#define N 120\n"
+     "static double a[N][N], b[N][N], c[N][N];\n"
+     "int main(void) {\n"
+     "    for (int i = 0; i < N; i++)\n"
+     "        for (int j = 0; j < N; j++) {\n"
+     "            a[i][j] = i + j;\n"
+     "            b[i][j] = i - j;\n"
+     "        }\n"
+     "    for (int i = 0; i < N; i++)\n"
+     "        for (int j = 0; j < N; j++) {\n"
+     "            double s = 0;\n"
+     "            for (int k = 0; k < N; k++) s += a[i][k] * b[k][j];\n"
+     "            c[i][j] = s;\n"
+     "        }\n"
+     "    return (int)c[N - 1][N - 2] & 0xff;\n"
+     "}\n"},
+    {"list",
+     "#include <stdlib.h>\n"
+     "struct node { struct node *next; long value; };\n"
+     "int main(void) {\n"
+     "    struct node *head = NULL;\n"
+     "    long sum = 0;\n"
+     "    for (int i = 0; i < 20000; i++) {\n"
+     "        struct node *n = malloc(sizeof(*n));\n"
+     "        n->next = head;\n"
+     "        n->value = i;\n"
+     "        head = n;\n"
+     "    }\n"
+     "    for (int k = 0; k < 200; k++)\n"
+     "        for (struct node *n = head; n; n = n->next) sum += n->value;\n"
+     "    while (head) {\n"
+     "        struct node *next = head->next;\n"
+     "        free(head);\n"
+     "        head = next;\n"
+     "    }\n"
+     "    return sum & 0xff;\n"
+     "}\n"},
+    {"trees",
+     "#include <stdlib.h>\n"
+     "struct tree { struct tree *left, *right; };\n"
+     "static struct tree *make(int depth) {\n"
+     "    struct tree *t = malloc(sizeof(*t));\n"
+     "    t->left = depth ? make(depth - 1) : NULL;\n"
+     "    t->right = depth ? make(depth - 1) : NULL;\n"
+     "    return t;\n"
+     "}\n"
+     "static int check(struct tree *t) {\n"
+     "    int n = 1;\n"
+     "    if (t->left) n += check(t->left) + check(t->right);\n"
+     "    free(t);\n"
+     "    return n;\n"
+     "}\n"
+     "int main(void) {\n"
+     "    int n = 0;\n"
+     "    for (int i = 0; i < 20; i++) n += check(make(14));\n"
+     "    return n & 0xff;\n"
+     "}\n"},
+    {"pointers",
+     "static int data[4096];\n"
+     "static void reverse(int *p, int *q) {\n"
+     "    while (p < q) {\n"
+     "        int t = *p;\n"
+     "        *p++ = *--q;\n"
+     "        *q = t;\n"
+     "    }\n"
+     "}\n"
+     "int main(void) {\n"
+     "    int sum = 0;\n"
+     "    for (int i = 0; i < 4096; i++) data[i] = i;\n"
+     "    for (int k = 0; k < 2000; k++) reverse(data, data + 4096);\n"
+     "    for (int *p = data; p < data + 4096; p += 3) sum ^= *p;\n"
+     "    return sum & 0xff;\n"
+     "}\n"},
+    {"indirect",
+     "static int inc(int x) { return x + 1; }\n"
+     "static int dec(int x) { return x - 1; }\n"
+     "int main(void) {\n"
+     "    int (*const ops[2])(int) = {inc, dec};\n"
+     "    int x = 0;\n"
+     "    for (int i = 0; i < 1000000; i++) x = ops[i >> 16 & 1](x);\n"
+     "    return x & 0xff;\n"
+     "}\n"},
+};
+
+/* Checks, specialization and tiering of the runs of the VM benchmark. */
+static const struct {
+    const char *name;
+    enum overflow_policy overflow;
+    bool memory_checks;
+    bool specialize;
+    bool tiering;
+} vm_modes[] = {
+    {"none", OVERFLOW_NONE, false, false, false},
+    {"none", OVERFLOW_NONE, false, true, false},
+    {"none", OVERFLOW_NONE, false, true, true},
+    {"overflow", OVERFLOW_WARN, false, true, false},
+    {"memory", OVERFLOW_NONE, true, true, false},
+    {"memory", OVERFLOW_NONE, true, true, true},
+    {"all", OVERFLOW_WARN, true, false, false},
+    {"all", OVERFLOW_WARN, true, true, false},
+    {"all", OVERFLOW_WARN, true, true, true},
+};
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void reset_peak_rss(void) {
+    FILE *const fp = fopen("/proc/self/clear_refs", "w");
+    if (fp == NULL) return;
+    fputs("5", fp);
+    fclose(fp);
+}
+
+static long peak_rss_kb(void) {
+    char line[256];
+    long kb = -1;
+    FILE *const fp = fopen("/proc/self/status", "r");
+
+    if (fp == NULL) return -1;
+    while (fgets(line, sizeof(line), fp))
+        if (sscanf(line, "VmHWM: %ld kB", &kb) == 1) break;
+    fclose(fp);
+    return kb;
+}
+
+static void run(const char *name, const struct source *src, size_t jobs,
+                enum scan_isa isa) {
+    double best = 0;
+    size_t tokens = 0;
+    size_t allocs = 0;
+    long rss;
+
+    reset_peak_rss();
+    for (int k = 0; k < REPEAT; k++) {
+        struct arena arena;
+        struct token_array tokarr;
+        double start, elapsed;
+
+        intern_clear();
+        arena_init(&arena);
+        num_allocs = 0;
+
+        start = now();
+        tokarr = jobs > 1 ? lexer_parallel(src, &arena, jobs)
+                          : lexer(src, &arena);
+        elapsed = now() - start;
+
+        allocs = num_allocs;
+        tokens = tokarr.len;
+        if (k == 0 || elapsed < best) best = elapsed;
+        arena_destroy(&arena);
+    }
+    rss = peak_rss_kb();
+
+    printf("%s\t%zu\t%s\t%zu\t%zu\t%.6f\t%.1f\t%.0f\t%.6f\t%ld\n",
+           name, jobs, scan_isa_name(isa),
+           src->len, tokens, best, src->len / best / 1e6, tokens / best,
+           tokens ? (double)allocs / tokens : 0.0, rss);
+    fflush(stdout);
+}
+
+/* Run with the tokens of src in a temporary token cache. */
+static void run_cached(const char *name, const struct source *src,
+                       enum scan_isa isa) {
+    char dir[] = "/tmp/cisc-bench-XXXXXX";
+    char label[64];
+    struct arena arena;
+    DIR *d;
+    struct dirent *ent;
+
+    if (mkdtemp(dir) == NULL || token_cache_open(dir, (size_t)-1)) return;
+
+    arena_init(&arena);
+    lexer(src, &arena);
+    arena_destroy(&arena);
+    snprintf(label, sizeof(label), "%s+cache", name);
+    run(label, src, 1, isa);
+    token_cache_close();
+
+    d = opendir(dir);
+    while (d && (ent = readdir(d))) {
+        char path[sizeof(dir) + 256];
+        if (ent->d_name[0] == '.') continue;
+        snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name);
+        unlink(path);
+    }
+    if (d) closedir(d);
+    rmdir(dir);
+}
+
+static void run_parser(const char *name, const struct source *src) {
+    struct arena lex_arena;
+    struct token_array tokarr;
+    double best = 0;
+    size_t nodes = 0;
+    size_t bytes = 0;
+
+    intern_clear();
+    arena_init(&lex_arena);
+    tokarr = lexer(src, &lex_arena);
+
+    for (int k = 0; k < REPEAT; k++) {
+        struct arena arena;
+        struct ast ast;
+        double start, elapsed;
+
+        arena_init(&arena);
+        start = now();
+        if (parse(NULL, &tokarr, &arena, &ast)) {
+            arena_destroy(&arena);
+            break;
+        }
+        elapsed = now() - start;
+
+        nodes = ast.len;
+        bytes = ast_size(&ast);
+        if (k == 0 || elapsed < best) best = elapsed;
+        arena_destroy(&arena);
+    }
+
+    printf("%s\t%zu\t%zu\t%zu\t%.6f\t%.0f\t%.0f\t%.2f\n",
+           name, src->len, tokarr.len, nodes, best, nodes / best,
+           tokarr.len / best, tokarr.len ? (double)bytes / tokarr.len : 0.0);
+    fflush(stdout);
+    arena_destroy(&lex_arena);
+}
+
+/* Write text to a new temporary file, whose path is put in path. Returns
+   0 on success. */
+static int write_program(const char *text, char path[]) {
+    const int fd = mkstemps(path, 2);
+
+    if (fd < 0) return -1;
+    if (write(fd, text, strlen(text)) < 0) {
+        close(fd);
+        unlink(path);
+        return -1;
+    }
+    close(fd);
+    return 0;
+}
+
+/* Compile and link the program at path into prog, which is initialized,
+   in mode. Returns 0 on success. */
+static int compile_program(const char *path, size_t mode,
+                           struct preprocessor *pp, struct arena *arena,
+                           struct program *prog) {
+    struct token_array tokarr;
+    struct ast ast;
+
+    prog->overflow = vm_modes[mode].overflow;
+    prog->memory_checks = vm_modes[mode].memory_checks;
+    prog->specialize = vm_modes[mode].specialize;
+    prog->tiering = vm_modes[mode].tiering;
+    if (preprocess(pp, path, arena, &tokarr)
+        || parse(pp, &tokarr, arena, &ast)
+        || compile(pp, &ast, arena, prog) || program_link(prog))
+        return -1;
+    return 0;
+}
+
+/* Compile a program from a temporary file, and time running it. Returns
+   the best time, or 0 if it failed; baseline is that of the first mode,
+   and *expected its result, which that of each mode is checked against. */
+static double run_program(const struct program_source *ps, size_t mode,
+                          double baseline, int *expected) {
+    char path[] = "/tmp/cisc-bench-XXXXXX.c";
+    struct preprocessor pp;
+    struct arena arena;
+    struct program prog;
+    double best = 0;
+    uint64_t steps = 0;
+    int result = 0;
+
+    if (write_program(ps->text, path)) return 0;
+    preprocessor_init(&pp, 1);
+    arena_init(&arena);
+    program_init(&prog);
+    if (compile_program(path, mode, &pp, &arena, &prog)) goto out;
+
+    for (int k = 0; k < REPEAT; k++) {
+        struct vm vm;
+        char *args[] = {path, NULL};
+        double start, elapsed;
+        int status;
+
+        vm_init(&vm, &prog);
+        start = now();
+        status = vm_run(&vm, 1, args, &result);
+        elapsed = now() - start;
+        steps = vm.steps;
+        vm_destroy(&vm);
+        if (status) {
+            best = 0;
+            goto out;
+        }
+        if (k == 0 || elapsed < best) best = elapsed;
+    }
+
+    printf("%s\t%s\t%s\t%s\t%" PRIu64 "\t%.6f\t%.0f\t%.3f\t%d\n",
+           ps->name, vm_modes[mode].name,
+           vm_modes[mode].specialize ? "yes" : "no",
+           vm_modes[mode].tiering ? "yes" : "no", steps, best,
+           steps / best, baseline ? best / baseline : 1.0, result);
+    fflush(stdout);
+    if (!baseline) *expected = result;
+    else if (result != *expected)
+        fprintf(stderr, "%s: result %d in mode %zu, but %d in mode 0\n",
+                ps->name, result, mode, *expected);
+out:
+    program_destroy(&prog);
+    arena_destroy(&arena);
+    preprocessor_destroy(&pp);
+    unlink(path);
+    return best;
+}
+
+/* Run the program at path once in mode, setting *result. Returns 0 on
+   success. */
+static int run_once(const char *path, size_t mode, int *result) {
+    struct preprocessor pp;
+    struct arena arena;
+    struct program prog;
+    int status;
+
+    preprocessor_init(&pp, 1);
+    arena_init(&arena);
+    program_init(&prog);
+    status = compile_program(path, mode, &pp, &arena, &prog);
+    if (status == 0) {
+        struct vm vm;
+        char *args[] = {(char *)path, NULL};
+
+        vm_init(&vm, &prog);
+        status = vm_run(&vm, 1, args, result);
+        vm_destroy(&vm);
+    }
+    program_destroy(&prog);
+    arena_destroy(&arena);
+    preprocessor_destroy(&pp);
+    return status;
+}
+
+/* Run count random loops in each tiered mode and in the mode before it,
+   which is the same but interpreted, and report those whose results
+   differ, or that fail, on stderr. Returns how many do. */
+static int run_check(size_t count) {
+    int failed = 0;
+
+    for (size_t k = 0; k < count; k++) {
+        char path[] = "/tmp/cisc-check-XXXXXX.c";
+        struct string text;
+
+        string_init(&text);
+        rng_seed(0x9e3779b97f4a7c15ull + k);
+        gen_loop(&text);
+        if (write_program(text.arr, path)) {
+            string_destroy(&text);
+            return failed + 1;
+        }
+        for (size_t m = 1; m < sizeof(vm_modes) / sizeof(vm_modes[0]); m++) {
+            int interpreted = 0, tiered = 0;
+
+            if (!vm_modes[m].tiering) continue;
+            if (run_once(path, m - 1, &interpreted)
+                || run_once(path, m, &tiered) || interpreted != tiered) {
+                fprintf(stderr, "program %zu, checks %s: interpreted %d, "
+                                "tiered %d\n%s", k, vm_modes[m].name,
+                        interpreted, tiered, text.arr);
+                failed++;
+                break;
+            }
+        }
+        unlink(path);
+        string_destroy(&text);
+    }
+    printf("%zu programs checked, %d differ\n", count, failed);
+    return failed;
+}
+
+/* Field by field, as the padding of struct token is undefined. */
+static bool same_token(const struct token *a, const struct token *b) {
+    return a->type == b->type && a->atom == b->atom && a->offset == b->offset
+           && a->len == b->len && a->flags == b->flags && a->file == b->file
+           && a->int_value == b->int_value;
+}
+
+/* Make a random edit of src, lexed into tokarr. Either a run of tokens is
+   replaced by a run copied from elsewhere in src, with a space on each
+   side so that every token still lexes as it did, or, if bytes, up to
+   three bytes by up to two random pieces, which may open or close a
+   comment or a literal, splice lines, or make no token at all. The bytes
+   replaced are saved into old. */
+static void gen_edit(struct source *src, const struct token_array *tokarr,
+                     bool bytes, struct string *old,
+                     struct lexer_edit *edit) {
+    static const char *const pieces[] = {
+        "\"", "'", "/", "*", "/*", "*/", "//", "\\", "\\\n", "\n", " ", "a",
+        "1", ".", "e", "+", "#",
+    };
+    const struct token *const toks = tokarr->tokens;
+    struct string text;
+
+    string_init(&text);
+    if (bytes) {
+        /* Anywhere, just past a token, or at the start of a line, where
+           a splice or a quote changes the tokens before the edit. */
+        edit->offset = rng(src->len + 1);
+        if (tokarr->len && rng(3) == 0) {
+            const struct token *const tok = &toks[rng(tokarr->len)];
+            edit->offset = tok->offset + tok->len + rng(3);
+            if (edit->offset > src->len) edit->offset = src->len;
+        } else if (rng(2)) {
+            while (edit->offset > 0 && src->buf[edit->offset-1] != '\n')
+                edit->offset--;
+        }
+        edit->old_len = rng((src->len - edit->offset < 3
+                             ? src->len - edit->offset : 3) + 1);
+        for (int k = rng(3); k > 0; k--)
+            append(&text, pieces[rng(sizeof(pieces) / sizeof(pieces[0]))]);
+    } else {
+        const size_t i = rng(tokarr->len + 1);
+        const size_t j = i + rng((tokarr->len - i < 4
+                                  ? tokarr->len - i : 4) + 1);
+        const size_t k = rng(tokarr->len + 1);
+        const size_t l = k + rng((tokarr->len - k < 4
+                                  ? tokarr->len - k : 4) + 1);
+
+        edit->offset = i < tokarr->len ? toks[i].offset : src->len;
+        edit->old_len = j > i ? toks[j-1].offset + toks[j-1].len
+                                - edit->offset : 0;
+        string_append(&text, ' ');
+        if (l > k)
+            string_append_n(&text, src->buf + toks[k].offset,
+                            toks[l-1].offset + toks[l-1].len
+                            - toks[k].offset);
+        string_append(&text, ' ');
+    }
+    edit->new_len = text.len;
+
+    string_clear(old);
+    string_append_n(old, src->buf + edit->offset, edit->old_len);
+    source_edit(src, edit->offset, edit->old_len, text.arr, text.len);
+    string_destroy(&text);
+}
+
+/* Whether the tokens of tokarr come back out of a token store the same,
+   one made from the array at once or, if grow, appended to from empty, and
+   token_store_find() finds the same tokens as a scan of the array. */
+static bool check_store(const struct token_array *tokarr, bool grow) {
+    struct arena arena;
+    struct token_store store;
+    struct token tok;
+    size_t from = 0;
+    bool same;
+    const enum token_type type = tokarr->len
+        ? tokarr->tokens[rng(tokarr->len)].type : TOKEN_EOF;
+
+    arena_init(&arena);
+    if (grow) {
+        token_store_init(&store, &arena, 0, true);
+        for (size_t i = 0; i < tokarr->len; i++)
+            token_store_append(&store, &arena, &tokarr->tokens[i]);
+    } else {
+        token_store_from_array(&store, &arena, tokarr, true);
+    }
+
+    same = store.len == tokarr->len;
+    for (size_t i = 0; same && i < tokarr->len; i++) {
+        token_store_get(&store, i, &tok);
+        same = same_token(&tok, &tokarr->tokens[i]);
+    }
+    for (size_t i = 0; same && i <= tokarr->len; i++) {
+        if (i < tokarr->len && tokarr->tokens[i].type != type) continue;
+        same = token_store_find(&store, from, type) == i;
+        from = i + 1;
+    }
+    arena_destroy(&arena);
+    return same;
+}
+
+/* Make count random edits of each corpus, in token and in preprocessing
+   token mode, re-lex each with lexer_relex() and check the result against
+   lexing the edited source from scratch, and its round trip through a
+   token store. Edits of random bytes, which may not lex, are made in
+   preprocessing token mode only, where an error is returned rather than
+   reported. Reports each corpus whose tokens differ on stderr, and returns
+   how many do. */
+static int run_relex_check(size_t count) {
+    int failed = 0;
+
+    for (size_t i = 0; i < sizeof(corpora) / sizeof(corpora[0]); i++) {
+        for (int pp_tokens = 0; pp_tokens <= 1; pp_tokens++) {
+            struct string text, old;
+            struct source src;
+            struct arena arena;
+            struct token_array tokarr;
+            const int before = failed;
+
+            string_init(&text);
+            string_init(&old);
+            rng_seed(0x9e3779b97f4a7c15ull + i);
+            corpora[i].generate(&text, 1024);
+            src.buf = malloc(text.len + 1);
+            memcpy((char *)src.buf, text.arr, text.len + 1);
+            src.len = text.len;
+            src.mapped = false;
+            src.id = 0;
+            string_destroy(&text);
+
+            intern_clear();
+            arena_init(&arena);
+            if (pp_tokens) lexer_pp(&src, &arena, 1, &tokarr);
+            else tokarr = lexer(&src, &arena);
+
+            for (size_t k = 0; k < count; k++) {
+                struct arena scratch;
+                struct token_array expected;
+                struct lexer_edit edit;
+                int relexed, lexed = 0;
+
+                gen_edit(&src, &tokarr, pp_tokens && rng(2), &old, &edit);
+                relexed = lexer_relex(&src, pp_tokens, &edit, &arena,
+                                      &tokarr);
+                arena_init(&scratch);
+                if (pp_tokens) lexed = lexer_pp(&src, &scratch, 1, &expected);
+                else expected = lexer(&src, &scratch);
+
+                if (relexed != lexed || (relexed == 0
+                                         && expected.len != tokarr.len)) {
+                    fprintf(stderr, "%s, %s tokens, edit %zu: re-lexing "
+                                    "returns %d with %zu tokens, lexing "
+                                    "%d with %zu\n", corpora[i].name,
+                            pp_tokens ? "preprocessing" : "C", k, relexed,
+                            tokarr.len, lexed, expected.len);
+                    failed++;
+                    arena_destroy(&scratch);
+                    break;
+                }
+                if (relexed) {
+                    /* Neither lexes: undo the edit. */
+                    source_edit(&src, edit.offset, edit.new_len, old.arr,
+                                old.len);
+                    arena_destroy(&scratch);
+                    continue;
+                }
+                for (size_t t = 0; t < tokarr.len; t++) {
+                    if (same_token(&tokarr.tokens[t], &expected.tokens[t]))
+                        continue;
+                    fprintf(stderr, "%s, %s tokens, edit %zu: token %zu at "
+                                    "offset %" PRIu32 " differs\n",
+                            corpora[i].name, pp_tokens ? "preprocessing" : "C",
+                            k, t, expected.tokens[t].offset);
+                    failed++;
+                    break;
+                }
+                arena_destroy(&scratch);
+                if (!check_store(&tokarr, k % 2)) {
+                    fprintf(stderr, "%s, %s tokens, edit %zu: token store "
+                                    "differs\n", corpora[i].name,
+                            pp_tokens ? "preprocessing" : "C", k);
+                    failed++;
+                }
+                if (failed != before) break;
+            }
+
+            arena_destroy(&arena);
+            source_close(&src);
+            string_destroy(&old);
+        }
+    }
+    printf("%zu edits checked, %d differ\n",
+           count * 2 * (sizeof(corpora) / sizeof(corpora[0])), failed);
+    return failed;
+}
+
+/* The string struct string replaced, as the baseline of the string
+   benchmark: always on the heap, and appended to a byte at a time by a
+   function of its own, as it was in utils.c. */
+struct heap_string {
+    size_t len;
+    size_t capacity;
+    char *arr;
+};
+
+__attribute__((noinline))
+static void heap_string_append(struct heap_string *str, char c) {
+    if (str->capacity == 0) {
+        str->arr = malloc(16);
+        str->capacity = 16;
+    } else if (str->len + 1 == str->capacity) {
+        str->arr = realloc(str->arr, 2 * str->capacity);
+        str->capacity *= 2;
+    }
+    str->arr[str->len++] = c;
+    str->arr[str->len] = '\0';
+}
+
+enum string_workload {
+    STRING_SHORT,
+    STRING_SPANS,
+    STRING_BYTES,
+};
+
+static const char *const string_workloads[] = {"short", "spans", "bytes"};
+
+/* Build the strings of workload w out of the spans of text with the given
+   lengths. Returns a checksum, the same for both implementations. */
+static size_t build_strings(enum string_workload w, bool baseline,
+                            const char *text, const uint8_t *spans,
+                            size_t num_spans) {
+    const char *p = text;
+    size_t sum = 0;
+
+    if (baseline) {
+        struct heap_string str = {0, 0, NULL};
+
+        for (size_t i = 0; i < num_spans; p += spans[i++]) {
+            for (size_t j = 0; j < spans[i]; j++)
+                heap_string_append(&str, p[j]);
+            if (w == STRING_SHORT) {
+                sum += (unsigned char)str.arr[str.len - 1];
+                free(str.arr);
+                str = (struct heap_string){0, 0, NULL};
+            }
+        }
+        sum += str.len;
+        free(str.arr);
+    } else {
+        struct string str;
+
+        string_init(&str);
+        for (size_t i = 0; i < num_spans; p += spans[i++]) {
+            if (w == STRING_BYTES)
+                for (size_t j = 0; j < spans[i]; j++)
+                    string_append(&str, p[j]);
+            else
+                string_append_n(&str, p, spans[i]);
+            if (w == STRING_SHORT) {
+                sum += (unsigned char)str.arr[str.len - 1];
+                string_destroy(&str);
+                string_init(&str);
+            }
+        }
+        sum += str.len;
+        string_destroy(&str);
+    }
+    return sum;
+}
+
+static void run_strings(enum string_workload w, bool baseline,
+                        const char *text, size_t len) {
+    /* Spans of an identifier or punctuator, or of a longer run. */
+    const uint32_t max_span = w == STRING_SHORT ? STRING_INLINE_SIZE - 1 : 64;
+    uint8_t *const spans = malloc(len);
+    size_t num_spans = 0;
+    size_t bytes = 0;
+    size_t strings;
+    size_t allocs = 0;
+    size_t result = 0;
+    double best = 0;
+
+    rng_seed(0x9e3779b97f4a7c15ull + w);
+    while (1) {
+        const uint8_t span = 1 + rng(max_span);
+        if (bytes + span > len) break;
+        spans[num_spans++] = span;
+        bytes += span;
+    }
+    strings = w == STRING_SHORT ? num_spans : 1;
+
+    for (int k = 0; k < REPEAT; k++) {
+        double start, elapsed;
+
+        num_allocs = 0;
+        start = now();
+        result = build_strings(w, baseline, text, spans, num_spans);
+        elapsed = now() - start;
+        allocs = num_allocs;
+        if (k == 0 || elapsed < best) best = elapsed;
+    }
+
+    printf("%s\t%s\t%zu\t%zu\t%.6f\t%.1f\t%.3f\t%zu\n",
+           string_workloads[w], baseline ? "baseline" : "string", bytes,
+           strings, best, bytes / best / 1e6, (double)allocs / strings,
+           result);
+    fflush(stdout);
+    free(spans);
+}
+
+int main(int argc, char *argv[]) {
+    size_t size = (size_t)DEFAULT_SIZE_MB << 20;
+    enum scan_isa isa = SCAN_AVX2;
+    size_t max_jobs = thread_pool_num_cpus();
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--size") && i + 1 < argc)
+            size = strtoul(argv[++i], NULL, 10) << 20;
+        else if (!strcmp(argv[i], "--isa") && i + 1 < argc) {
+            i++;
+            isa = !strcmp(argv[i], "scalar") ? SCAN_SCALAR
+                  : !strcmp(argv[i], "sse2") ? SCAN_SSE2 : SCAN_AVX2;
+        } else if (!strcmp(argv[i], "--jobs") && i + 1 < argc)
+            max_jobs = strtoul(argv[++i], NULL, 10);
+        else if (!strcmp(argv[i], "--check")) {
+            const int failed = run_relex_check(CHECK_EDITS);
+            return failed + run_check(CHECK_PROGRAMS) ? 1 : 0;
+        }
+        else {
+            fprintf(stderr, "usage: %s [--size MB] [--isa scalar|sse2|avx2] "
+                            "[--jobs N] [--check]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    isa = scan_select(isa);
+
+    printf("corpus\tjobs\tisa\tbytes\ttokens\tseconds\tmb_per_s\ttokens_per_s\t"
+           "allocs_per_token\tpeak_rss_kb\n");
+
+    for (size_t i = 0; i < sizeof(corpora) / sizeof(corpora[0]); i++) {
+        struct string text;
+        struct source src;
+
+        string_init(&text);
+        rng_seed(0x9e3779b97f4a7c15ull + i);
+        corpora[i].generate(&text, size);
+
+        src.buf = text.arr;
+        src.len = text.len;
+        src.mapped = false;
+        src.id = 0;
+
+        /* Lexer throughput, then its scaling with threads on the first
+           corpus. */
+        run(corpora[i].name, &src, 1, isa);
+        if (i == 0) {
+            for (size_t jobs = 2; jobs <= max_jobs; jobs *= 2)
+                run(corpora[i].name, &src, jobs, isa);
+            run_cached(corpora[i].name, &src, isa);
+        }
+
+        string_destroy(&text);
+    }
+
+    /* Parser throughput. */
+    {
+        struct string text;
+        struct source src;
+
+        printf("\ncorpus\tbytes\ttokens\tnodes\tseconds\tnodes_per_s\t"
+               "tokens_per_s\tast_bytes_per_token\n");
+        string_init(&text);
+        rng_seed(0x9e3779b97f4a7c15ull);
+        gen_functions(&text, size);
+        src.buf = text.arr;
+        src.len = text.len;
+        src.mapped = false;
+        src.id = 0;
+        run_parser("functions", &src);
+        string_destroy(&text);
+    }
+
+    /* Interpreter throughput. */
+    printf("\nprogram\tchecks\tspecialized\ttiered\tinstructions\t"
+           "seconds\tinsns_per_s\trelative\tresult\n");
+    for (size_t i = 0; i < sizeof(programs) / sizeof(programs[0]); i++) {
+        int expected;
+        const double baseline = run_program(&programs[i], 0, 0, &expected);
+
+        for (size_t m = 1; baseline && m < sizeof(vm_modes)
+                                             / sizeof(vm_modes[0]); m++)
+            run_program(&programs[i], m, baseline, &expected);
+    }
+
+    /* String throughput, against the baseline. */
+    {
+        struct string text;
+
+        printf("\nworkload\timpl\tbytes\tstrings\tseconds\tmb_per_s\t"
+               "allocs_per_string\tresult\n");
+        string_init(&text);
+        rng_seed(0x9e3779b97f4a7c15ull);
+        gen_identifiers(&text, size);
+        for (int w = STRING_SHORT; w <= STRING_BYTES; w++) {
+            run_strings(w, true, text.arr, text.len);
+            run_strings(w, false, text.arr, text.len);
+        }
+        string_destroy(&text);
+    }
+
+    return 0;
+}
@@ -0,0 +1,1099 @@
+#include "bytecode.h"
+#include "host.h"
+#include "intern.h"
+#include "stats.h"
+#include <dlfcn.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+static const char *const opcode_names[NUM_OPCODES] = {
+#define OPCODE_NAME(name, format) #name,
+    OPCODES(OPCODE_NAME)
+#undef OPCODE_NAME
+};
+
+static const uint8_t opcode_formats[NUM_OPCODES] = {
+#define OPCODE_FORMAT(name, format) FORMAT_##format,
+    OPCODES(OPCODE_FORMAT)
+#undef OPCODE_FORMAT
+};
+
+/* Sequences of the superinstructions, each of up to 4 opcodes, ending at
+   the first NOP. */
+#define COMPARE_AND_BRANCH(cmp)                                             \
+    {OP_##cmp##_JZ, {OP_##cmp, OP_JZ}},                                     \
+    {OP_##cmp##_JNZ, {OP_##cmp, OP_JNZ}}
+#define CONSTANT_COMPARE_AND_BRANCH(cmp)                                    \
+    {OP_LOADI_##cmp##_JZ, {OP_LOADI, OP_##cmp, OP_JZ}},                     \
+    {OP_LOADI_##cmp##_JNZ, {OP_LOADI, OP_##cmp, OP_JNZ}}
+#define INDEXED(access) {OP_ADD_U64_##access, {OP_ADD_U64, OP_##access}}
+#define LOAD_ADD_STORE(load, add, store)                                    \
+    {OP_##load##_##add##_##store, {OP_##load, OP_##add, OP_##store}}
+
+static const struct {
+    uint16_t op;
+    uint16_t seq[4];
+} superinstructions[] = {
+    COMPARE_AND_BRANCH(EQ_I),
+    COMPARE_AND_BRANCH(NE_I),
+    COMPARE_AND_BRANCH(LT_I),
+    COMPARE_AND_BRANCH(LT_U),
+    COMPARE_AND_BRANCH(LE_I),
+    COMPARE_AND_BRANCH(LE_U),
+    COMPARE_AND_BRANCH(EQ_P),
+    COMPARE_AND_BRANCH(NE_P),
+    COMPARE_AND_BRANCH(LT_P),
+    COMPARE_AND_BRANCH(LE_P),
+    CONSTANT_COMPARE_AND_BRANCH(EQ_I),
+    CONSTANT_COMPARE_AND_BRANCH(NE_I),
+    CONSTANT_COMPARE_AND_BRANCH(LT_I),
+    CONSTANT_COMPARE_AND_BRANCH(LT_U),
+    CONSTANT_COMPARE_AND_BRANCH(LE_I),
+    CONSTANT_COMPARE_AND_BRANCH(LE_U),
+    /* The step and test of a for loop over an int. */
+    {OP_ADDI_I32_LT_I_JNZ, {OP_ADDI_I32, OP_LT_I, OP_JNZ}},
+    {OP_ADDIC_I32_LT_I_JNZ, {OP_ADDIC_I32, OP_LT_I, OP_JNZ}},
+    {OP_ADDI_I32_LOADI_LT_I_JNZ, {OP_ADDI_I32, OP_LOADI, OP_LT_I, OP_JNZ}},
+    {OP_ADDIC_I32_LOADI_LT_I_JNZ, {OP_ADDIC_I32, OP_LOADI, OP_LT_I, OP_JNZ}},
+    INDEXED(LOAD_I8),
+    INDEXED(LOAD_U8),
+    INDEXED(LOAD_I16),
+    INDEXED(LOAD_U16),
+    INDEXED(LOAD_I32),
+    INDEXED(LOAD_U32),
+    INDEXED(LOAD_64),
+    INDEXED(STORE_8),
+    INDEXED(STORE_16),
+    INDEXED(STORE_32),
+    INDEXED(STORE_64),
+    INDEXED(LOADC_I8),
+    INDEXED(LOADC_U8),
+    INDEXED(LOADC_I16),
+    INDEXED(LOADC_U16),
+    INDEXED(LOADC_I32),
+    INDEXED(LOADC_U32),
+    INDEXED(LOADC_64),
+    INDEXED(STOREC_8),
+    INDEXED(STOREC_16),
+    INDEXED(STOREC_32),
+    INDEXED(STOREC_64),
+    LOAD_ADD_STORE(LOAD_I32, ADD_I32, STORE_32),
+    LOAD_ADD_STORE(LOAD_I32, ADDI_I32, STORE_32),
+    LOAD_ADD_STORE(LOAD_64, ADD_I64, STORE_64),
+    LOAD_ADD_STORE(LOAD_64, ADDI_I64, STORE_64),
+    LOAD_ADD_STORE(LOADC_I32, ADDC_I32, STOREC_32),
+    LOAD_ADD_STORE(LOADC_I32, ADDIC_I32, STOREC_32),
+    LOAD_ADD_STORE(LOADC_64, ADDC_I64, STOREC_64),
+    LOAD_ADD_STORE(LOADC_64, ADDIC_I64, STOREC_64),
+};
+
+#undef COMPARE_AND_BRANCH
+#undef CONSTANT_COMPARE_AND_BRANCH
+#undef INDEXED
+#undef LOAD_ADD_STORE
+
+#ifndef NO_STATS
+static const char *superinstruction_label(size_t i);
+#endif
+
+STATS_COUNTER_ARRAY(superinstructions_made, "bytecode.superinstructions",
+                    NUM_OPCODES - OP_EQ_I_JZ, superinstruction_label);
+
+static void *grow(void *arr, size_t *capacity, size_t len, size_t size);
+static void *grow_by(void *arr, size_t *capacity, size_t len, size_t n,
+                     size_t size);
+static int merge_unit(struct program *prog, const struct program *unit,
+                      uint32_t *functions, uint32_t *globals);
+static int resolve_host(struct program *prog);
+static void *host_symbol(void *const libs[2], const char *name);
+static int check_host_call(const struct program *prog,
+                           const struct call_site *site);
+static uint32_t find_signature(struct program *prog,
+                               const struct call_site *site);
+static int check_function(const struct program *prog,
+                          const struct function *fn, bool *data);
+static int check_insn(const struct program *prog, const struct function *fn,
+                      size_t i, const bool *data);
+static int check_target(const struct function *fn, size_t i, int64_t offset,
+                        const bool *data);
+static bool unchecked_access(enum opcode op);
+static const uint16_t *superinstruction_sequence(enum opcode op);
+static void specialize(struct program *prog);
+static size_t match_sequence(const struct program *prog, size_t i,
+                             size_t end, const uint16_t *seq);
+static void dump_insn(const struct program *prog, size_t i, FILE *fp);
+
+/* Make room in arr, of elements of size size, for one more than len. */
+static void *grow(void *arr, size_t *capacity, size_t len, size_t size) {
+    if (len < *capacity) return arr;
+    *capacity = *capacity ? 2 * *capacity : 64;
+    return realloc(arr, size * *capacity);
+}
+
+/* Make room in arr for n more than len. */
+static void *grow_by(void *arr, size_t *capacity, size_t len, size_t n,
+                     size_t size) {
+    if (len + n <= *capacity) return arr;
+    if (*capacity == 0) *capacity = 64;
+    while (*capacity < len + n) *capacity *= 2;
+    return realloc(arr, size * *capacity);
+}
+
+void program_init(struct program *prog) {
+    memset(prog, 0, sizeof(struct program));
+    prog->main = -1;
+    prog->overflow = OVERFLOW_WARN;
+    prog->memory_checks = true;
+    prog->specialize = true;
+    prog->tiering = false;
+}
+
+void program_destroy(struct program *prog) {
+    free(prog->units);
+    if (prog->image) {
+        munmap(prog->image, prog->image_size);
+        return;
+    }
+    free(prog->code);
+    free(prog->code_tokens);
+    free(prog->functions);
+    free(prog->globals);
+    free(prog->data);
+    free(prog->relocs);
+    free(prog->constants);
+    free(prog->call_sites);
+    free(prog->arg_classes);
+    free(prog->host_signatures);
+    free(prog->switches);
+    free(prog->switch_cases);
+    free(prog->frame_slots);
+    free(prog->overflow_sites);
+}
+
+uint32_t program_add_insn(struct program *prog, struct insn insn,
+                          uint32_t token) {
+    size_t capacity = prog->code_capacity;
+
+    prog->code = grow(prog->code, &prog->code_capacity, prog->code_len,
+                      sizeof(struct insn));
+    prog->code_tokens = grow(prog->code_tokens, &capacity, prog->code_len,
+                             sizeof(uint32_t));
+    prog->code[prog->code_len] = insn;
+    prog->code_tokens[prog->code_len] = token;
+    return prog->code_len++;
+}
+
+uint32_t program_add_function(struct program *prog, uint32_t name) {
+    struct function *fn;
+
+    prog->functions = grow(prog->functions, &prog->functions_capacity,
+                           prog->num_functions, sizeof(struct function));
+    fn = &prog->functions[prog->num_functions];
+    memset(fn, 0, sizeof(struct function));
+    fn->name = name;
+    return prog->num_functions++;
+}
+
+uint32_t program_add_global(struct program *prog, uint32_t name) {
+    struct global *g;
+
+    prog->globals = grow(prog->globals, &prog->globals_capacity,
+                         prog->num_globals, sizeof(struct global));
+    g = &prog->globals[prog->num_globals];
+    memset(g, 0, sizeof(struct global));
+    g->name = name;
+    return prog->num_globals++;
+}
+
+uint32_t program_add_constant(struct program *prog, uint64_t value) {
+    /* Constants are mostly few and repeated, e.g. the same mask or double
+       in a loop: reuse one among the latest. */
+    for (size_t i = prog->num_constants; i > 0
+         && i + 16 > prog->num_constants; i--)
+        if (prog->constants[i - 1] == value) return i - 1;
+
+    prog->constants = grow(prog->constants, &prog->constants_capacity,
+                           prog->num_constants, sizeof(uint64_t));
+    prog->constants[prog->num_constants] = value;
+    return prog->num_constants++;
+}
+
+uint32_t program_add_call_site(struct program *prog, uint32_t function,
+                               const uint8_t *classes, uint32_t num_args,
+                               enum value_class ret) {
+    struct call_site *site;
+
+    prog->call_sites = grow(prog->call_sites, &prog->call_sites_capacity,
+                            prog->num_call_sites, sizeof(struct call_site));
+    site = &prog->call_sites[prog->num_call_sites];
+    site->function = function;
+    site->num_args = num_args;
+    site->classes = prog->num_arg_classes;
+    site->ret = ret;
+    site->signature = NO_SIGNATURE;
+    for (uint32_t i = 0; i < num_args; i++) {
+        prog->arg_classes = grow(prog->arg_classes,
+                                 &prog->arg_classes_capacity,
+                                 prog->num_arg_classes, 1);
+        prog->arg_classes[prog->num_arg_classes++] = classes[i];
+    }
+    return prog->num_call_sites++;
+}
+
+uint32_t program_add_switch(struct program *prog,
+                            const struct switch_case *cases,
+                            uint32_t num_cases, int32_t default_target) {
+    struct switch_table *table;
+
+    prog->switches = grow(prog->switches, &prog->switches_capacity,
+                          prog->num_switches, sizeof(struct switch_table));
+    table = &prog->switches[prog->num_switches];
+    table->cases = prog->num_switch_cases;
+    table->num_cases = num_cases;
+    table->default_target = default_target;
+    for (uint32_t i = 0; i < num_cases; i++) {
+        prog->switch_cases = grow(prog->switch_cases,
+                                  &prog->switch_cases_capacity,
+                                  prog->num_switch_cases,
+                                  sizeof(struct switch_case));
+        prog->switch_cases[prog->num_switch_cases++] = cases[i];
+    }
+    return prog->num_switches++;
+}
+
+uint32_t program_add_frame_slot(struct program *prog, uint32_t offset,
+                                uint32_t size, uint32_t name,
+                                uint8_t elem_size) {
+    struct frame_slot *slot;
+
+    prog->frame_slots = grow(prog->frame_slots, &prog->frame_slots_capacity,
+                             prog->num_frame_slots,
+                             sizeof(struct frame_slot));
+    slot = &prog->frame_slots[prog->num_frame_slots];
+    slot->offset = offset;
+    slot->size = size;
+    slot->name = name;
+    slot->elem_size = elem_size;
+    return prog->num_frame_slots++;
+}
+
+void program_add_overflow_site(struct program *prog, uint32_t code,
+                               uint32_t type) {
+    prog->overflow_sites = grow(prog->overflow_sites,
+                                &prog->overflow_sites_capacity,
+                                prog->num_overflow_sites,
+                                sizeof(struct overflow_site));
+    prog->overflow_sites[prog->num_overflow_sites].code = code;
+    prog->overflow_sites[prog->num_overflow_sites++].type = type;
+}
+
+uint32_t program_alloc_data(struct program *prog, size_t size, size_t align) {
+    const size_t offset = (prog->data_size + align - 1) & ~(align - 1);
+
+    if (offset + size > prog->data_capacity) {
+        size_t capacity = prog->data_capacity ? prog->data_capacity : 4096;
+        while (capacity < offset + size) capacity *= 2;
+        prog->data = realloc(prog->data, capacity);
+        memset(prog->data + prog->data_capacity, 0,
+               capacity - prog->data_capacity);
+        prog->data_capacity = capacity;
+    }
+    prog->data_size = offset + size;
+    return offset;
+}
+
+void program_add_reloc(struct program *prog, uint32_t offset,
+                       enum reloc_kind kind, uint32_t target, int64_t addend) {
+    struct reloc *r;
+
+    prog->relocs = grow(prog->relocs, &prog->relocs_capacity,
+                        prog->num_relocs, sizeof(struct reloc));
+    r = &prog->relocs[prog->num_relocs++];
+    r->offset = offset;
+    r->kind = kind;
+    r->target = target;
+    r->addend = addend;
+}
+
+void program_add_unit(struct program *prog, const struct token *tokens,
+                      struct preprocessor *pp) {
+    struct program_unit *u;
+
+    prog->units = grow(prog->units, &prog->units_capacity, prog->num_units,
+                       sizeof(struct program_unit));
+    u = &prog->units[prog->num_units++];
+    u->code = prog->code_len;
+    u->tokens = tokens;
+    u->pp = pp;
+}
+
+int program_merge(struct program *prog, const struct program *units,
+                  size_t n) {
+    /* Index + 1 of the function and of the global with external linkage
+       of each name, or 0. */
+    const size_t num_atoms = atom_count() + 1;
+    uint32_t *const functions = calloc(num_atoms, sizeof(uint32_t));
+    uint32_t *const globals = calloc(num_atoms, sizeof(uint32_t));
+    int status = 0;
+
+    for (size_t i = 0; i < prog->num_functions; i++)
+        if (!prog->functions[i].internal)
+            functions[prog->functions[i].name] = i + 1;
+    for (size_t i = 0; i < prog->num_globals; i++)
+        if (!prog->globals[i].internal)
+            globals[prog->globals[i].name] = i + 1;
+    for (size_t i = 0; i < n; i++)
+        if (merge_unit(prog, &units[i], functions, globals)) status = -1;
+
+    free(functions);
+    free(globals);
+    return status;
+}
+
+/* Append unit to prog, as program_merge() does, given the index + 1 of
+   the functions and globals of prog with external linkage by name. */
+static int merge_unit(struct program *prog, const struct program *unit,
+                      uint32_t *functions, uint32_t *globals) {
+    uint32_t *const function_map = malloc(sizeof(uint32_t)
+                                          * (unit->num_functions + 1));
+    uint32_t *const global_map = malloc(sizeof(uint32_t)
+                                        * (unit->num_globals + 1));
+    const uint32_t code = prog->code_len;
+    const uint32_t constants = prog->num_constants;
+    const uint32_t call_sites = prog->num_call_sites;
+    const uint32_t classes = prog->num_arg_classes;
+    const uint32_t switches = prog->num_switches;
+    const uint32_t cases = prog->num_switch_cases;
+    const uint32_t slots = prog->num_frame_slots;
+    uint32_t data = 0;
+    size_t capacity;
+    int status = 0;
+
+    /* Resolve each function and global to the one of prog it is, which is
+       appended unless a previous unit has it. The definition, if any,
+       is kept. */
+    for (size_t i = 0; i < unit->num_functions; i++) {
+        const struct function *const fn = &unit->functions[i];
+        uint32_t *const slot = fn->internal ? NULL : &functions[fn->name];
+        struct function *dest;
+
+        if (slot && *slot) {
+            function_map[i] = *slot - 1;
+            dest = &prog->functions[*slot - 1];
+            if (fn->defined && dest->defined) {
+                fprintf(stderr, "cisc: error: multiple definition of "
+                                "'%s'\n", atom_spelling(fn->name));
+                status = -1;
+            }
+            if (!fn->defined || dest->defined) continue;
+        } else {
+            function_map[i] = program_add_function(prog, fn->name);
+            if (slot) *slot = function_map[i] + 1;
+            dest = &prog->functions[function_map[i]];
+        }
+        *dest = *fn;
+        if (dest->defined) {
+            dest->code += code;
+            dest->slots += slots;
+        }
+    }
+    if (unit->data_size) {
+        data = program_alloc_data(prog, unit->data_size, 16);
+        memcpy(prog->data + data, unit->data, unit->data_size);
+    }
+    for (size_t i = 0; i < unit->num_globals; i++) {
+        const struct global *const g = &unit->globals[i];
+        uint32_t *const slot = g->internal ? NULL : &globals[g->name];
+        struct global *dest;
+
+        if (slot && *slot) {
+            global_map[i] = *slot - 1;
+            dest = &prog->globals[*slot - 1];
+            if (g->defined && dest->defined) {
+                fprintf(stderr, "cisc: error: multiple definition of "
+                                "'%s'\n", atom_spelling(g->name));
+                status = -1;
+            }
+            if (!g->defined || dest->defined) continue;
+        } else {
+            global_map[i] = program_add_global(prog, g->name);
+            if (slot) *slot = global_map[i] + 1;
+            dest = &prog->globals[global_map[i]];
+        }
+        *dest = *g;
+        if (dest->defined) dest->offset += data;
+    }
+    for (size_t i = 0; i < unit->num_relocs; i++) {
+        const struct reloc *const r = &unit->relocs[i];
+
+        program_add_reloc(prog, r->offset + data, r->kind,
+                          r->kind == RELOC_GLOBAL ? global_map[r->target]
+                                                  : function_map[r->target],
+                          r->addend);
+    }
+
+    prog->constants = grow_by(prog->constants, &prog->constants_capacity,
+                              prog->num_constants, unit->num_constants,
+                              sizeof(uint64_t));
+    if (unit->num_constants)
+        memcpy(prog->constants + constants, unit->constants,
+               sizeof(uint64_t) * unit->num_constants);
+    prog->num_constants += unit->num_constants;
+
+    prog->arg_classes = grow_by(prog->arg_classes,
+                                &prog->arg_classes_capacity,
+                                prog->num_arg_classes,
+                                unit->num_arg_classes, 1);
+    if (unit->num_arg_classes)
+        memcpy(prog->arg_classes + classes, unit->arg_classes,
+               unit->num_arg_classes);
+    prog->num_arg_classes += unit->num_arg_classes;
+    prog->call_sites = grow_by(prog->call_sites, &prog->call_sites_capacity,
+                               prog->num_call_sites, unit->num_call_sites,
+                               sizeof(struct call_site));
+    for (size_t i = 0; i < unit->num_call_sites; i++) {
+        struct call_site *const site = &prog->call_sites[call_sites + i];
+
+        *site = unit->call_sites[i];
+        if (site->function != UINT32_MAX)
+            site->function = function_map[site->function];
+        site->classes += classes;
+    }
+    prog->num_call_sites += unit->num_call_sites;
+
+    prog->switch_cases = grow_by(prog->switch_cases,
+                                 &prog->switch_cases_capacity,
+                                 prog->num_switch_cases,
+                                 unit->num_switch_cases,
+                                 sizeof(struct switch_case));
+    if (unit->num_switch_cases)
+        memcpy(prog->switch_cases + cases, unit->switch_cases,
+               sizeof(struct switch_case) * unit->num_switch_cases);
+    prog->num_switch_cases += unit->num_switch_cases;
+    prog->switches = grow_by(prog->switches, &prog->switches_capacity,
+                             prog->num_switches, unit->num_switches,
+                             sizeof(struct switch_table));
+    for (size_t i = 0; i < unit->num_switches; i++) {
+        prog->switches[switches + i] = unit->switches[i];
+        prog->switches[switches + i].cases += cases;
+    }
+    prog->num_switches += unit->num_switches;
+
+    /* The code and its tokens, which grow together as in
+       program_add_insn(). */
+    capacity = prog->code_capacity;
+    prog->code = grow_by(prog->code, &prog->code_capacity, prog->code_len,
+                         unit->code_len, sizeof(struct insn));
+    prog->code_tokens = grow_by(prog->code_tokens, &capacity, prog->code_len,
+                                unit->code_len, sizeof(uint32_t));
+    if (unit->code_len) {
+        memcpy(prog->code + code, unit->code,
+               sizeof(struct insn) * unit->code_len);
+        memcpy(prog->code_tokens + code, unit->code_tokens,
+               sizeof(uint32_t) * unit->code_len);
+    }
+    prog->code_len += unit->code_len;
+    for (size_t i = code; i < prog->code_len; i++) {
+        struct insn *const insn = &prog->code[i];
+
+        switch (insn->op) {
+        case OP_LOADK: insn->imm += constants; break;
+        case OP_ADDR_GLOBAL: insn->imm = global_map[insn->imm]; break;
+        case OP_ADDR_FUNC: insn->imm = function_map[insn->imm]; break;
+        /* The immediate of a CALL is the index of its call site until the
+           program is linked. */
+        case OP_CALL: insn->imm += call_sites; break;
+        case OP_SWITCH: insn->imm += switches; break;
+        case OP_CALL_PTR: insn[1].imm += call_sites; i++; break;
+        default:
+            if (opcode_format(insn->op) == FORMAT_ABX) i++;
+            break;
+        }
+    }
+
+    for (size_t i = 0; i < unit->num_frame_slots; i++) {
+        const struct frame_slot *const slot = &unit->frame_slots[i];
+
+        program_add_frame_slot(prog, slot->offset, slot->size, slot->name,
+                               slot->elem_size);
+    }
+    for (size_t i = 0; i < unit->num_overflow_sites; i++)
+        program_add_overflow_site(prog, code + unit->overflow_sites[i].code,
+                                  unit->overflow_sites[i].type);
+
+    for (size_t i = 0; i < unit->num_units; i++) {
+        program_add_unit(prog, unit->units[i].tokens, unit->units[i].pp);
+        prog->units[prog->num_units - 1].code = code + unit->units[i].code;
+    }
+    if (unit->main >= 0) prog->main = function_map[unit->main];
+
+    free(function_map);
+    free(global_map);
+    return status;
+}
+
+int program_link(struct program *prog) {
+    int status = resolve_host(prog);
+
+    for (size_t i = 0; i < prog->code_len; i++) {
+        struct insn *const insn = &prog->code[i];
+        const struct call_site *site;
+
+        if (opcode_format(insn->op) == FORMAT_ABX) {
+            i++;
+            continue;
+        }
+        if (insn->op != OP_CALL) continue;
+
+        site = &prog->call_sites[insn->imm];
+        if (prog->functions[site->function].defined) {
+            insn->imm = site->function;
+        } else {
+            insn->op = OP_CALL_HOST;
+            if (check_host_call(prog, site)) status = -1;
+        }
+    }
+    /* Indirect calls may be to host functions too; those that cannot be
+       are errors when made. */
+    for (size_t i = 0; status == 0 && i < prog->num_call_sites; i++) {
+        struct call_site *const site = &prog->call_sites[i];
+
+        if (site->function == UINT32_MAX
+            || !prog->functions[site->function].defined)
+            site->signature = find_signature(prog, site);
+    }
+    if (status == 0 && prog->specialize) specialize(prog);
+    return status;
+}
+
+int program_relink(struct program *prog) {
+    int status = resolve_host(prog);
+
+    for (size_t i = 0; i < prog->num_host_signatures; i++) {
+        struct host_signature *const sig = &prog->host_signatures[i];
+
+        if (host_signature_init(sig, prog, sig->classes, sig->num_args,
+                                sig->ret)) {
+            fprintf(stderr, "cisc: error: cannot call host functions with "
+                            "signature %zu\n", i);
+            status = -1;
+        }
+    }
+    return status;
+}
+
+int program_check(const struct program *prog) {
+    /* Whether each instruction is the data of an ABX one before it. */
+    bool *data;
+    int status = 0;
+
+    if (prog->main >= 0 && !prog->functions[prog->main].defined) return -1;
+    for (size_t i = 0; i < prog->num_globals; i++) {
+        const struct global *const g = &prog->globals[i];
+
+        if (g->defined
+            && (g->offset > prog->data_size
+                || g->size > prog->data_size - g->offset))
+            return -1;
+    }
+    for (size_t i = 0; i < prog->num_relocs; i++) {
+        const struct reloc *const r = &prog->relocs[i];
+
+        if (r->offset > prog->data_size || prog->data_size - r->offset < 8
+            || (r->kind == RELOC_GLOBAL ? r->target >= prog->num_globals
+                : r->kind != RELOC_FUNCTION
+                  || r->target >= prog->num_functions))
+            return -1;
+    }
+    for (size_t i = 0; i < prog->num_arg_classes; i++)
+        if (prog->arg_classes[i] > CLASS_MEMORY) return -1;
+    for (size_t i = 0; i < prog->num_call_sites; i++) {
+        const struct call_site *const site = &prog->call_sites[i];
+
+        if ((site->function != UINT32_MAX
+             && site->function >= prog->num_functions)
+            || site->classes > prog->num_arg_classes
+            || site->num_args > prog->num_arg_classes - site->classes
+            || site->ret > CLASS_MEMORY
+            || (site->signature != NO_SIGNATURE
+                && site->signature >= prog->num_host_signatures))
+            return -1;
+    }
+    for (size_t i = 0; i < prog->num_host_signatures; i++) {
+        const struct host_signature *const sig = &prog->host_signatures[i];
+
+        if (sig->classes > prog->num_arg_classes
+            || sig->num_args > prog->num_arg_classes - sig->classes
+            || sig->ret > CLASS_MEMORY)
+            return -1;
+    }
+    for (size_t i = 0; i < prog->num_switches; i++)
+        if (prog->switches[i].cases > prog->num_switch_cases
+            || prog->switches[i].num_cases
+               > prog->num_switch_cases - prog->switches[i].cases)
+            return -1;
+    for (size_t i = 0; i < prog->code_len; i++)
+        if (prog->code_tokens[i] != UINT32_MAX
+            && prog->code_tokens[i] >= prog->num_locations)
+            return -1;
+
+    data = calloc(prog->code_len + 1, sizeof(bool));
+    for (size_t i = 0; status == 0 && i < prog->num_functions; i++)
+        status = check_function(prog, &prog->functions[i], data);
+    free(data);
+    return status;
+}
+
+/* Whether fn, if defined, has its code, registers, frame and slots in
+   range, and each of its instructions is well formed. Marks the data
+   words of its code in data. */
+static int check_function(const struct program *prog,
+                          const struct function *fn, bool *data) {
+    const size_t end = (size_t)fn->code + fn->code_len;
+
+    if (!fn->defined) return 0;
+    if (fn->code_len == 0 || end > prog->code_len
+        || fn->num_params > fn->num_regs
+        || fn->slots > prog->num_frame_slots
+        || fn->num_slots > prog->num_frame_slots - fn->slots)
+        return -1;
+    for (size_t i = fn->slots; i < fn->slots + fn->num_slots; i++) {
+        const struct frame_slot *const slot = &prog->frame_slots[i];
+
+        if (slot->offset > fn->frame_size
+            || slot->size > fn->frame_size - slot->offset)
+            return -1;
+    }
+    /* The data words first, which may not be jumped to. */
+    for (size_t i = fn->code; i < end; i++) {
+        if (prog->code[i].op >= NUM_OPCODES) return -1;
+        if (opcode_format(prog->code[i].op) == FORMAT_ABX) {
+            if (i + 1 == end) return -1;
+            data[++i] = true;
+        }
+    }
+    for (size_t i = fn->code; i < end; i++) {
+        if (check_insn(prog, fn, i, data)) return -1;
+        if (opcode_format(prog->code[i].op) == FORMAT_ABX) i++;
+    }
+    return 0;
+}
+
+/* Whether instruction i of fn refers only to registers of fn and to
+   elements of prog that exist, jumps only to instructions of fn, and does
+   not run past its end. A superinstruction must be followed by the rest
+   of its sequence, which it runs, and which may start others. */
+static int check_insn(const struct program *prog, const struct function *fn,
+                      size_t i, const bool *data) {
+    const struct insn *const insn = &prog->code[i];
+    const uint16_t *const seq = superinstruction_sequence(insn->op);
+    const size_t end = (size_t)fn->code + fn->code_len;
+    const uint32_t regs = fn->num_regs;
+    const struct call_site *site;
+    const struct switch_table *table;
+
+    for (size_t k = 1; seq && k < 4 && seq[k] != OP_NOP; k++)
+        if (i + k >= end || opcode_first(prog->code[i + k].op) != seq[k])
+            return -1;
+    /* If memory is checked, so is every access. */
+    if (prog->memory_checks) {
+        if (unchecked_access(insn->op)) return -1;
+        for (size_t k = 0; seq && k < 4 && seq[k] != OP_NOP; k++)
+            if (unchecked_access(seq[k])) return -1;
+    }
+
+    switch (opcode_format(insn->op)) {
+    case FORMAT_NONE:
+    case FORMAT_I:
+        break;
+    case FORMAT_A:
+    case FORMAT_AI:
+        if (insn->a >= regs) return -1;
+        break;
+    case FORMAT_AB:
+    case FORMAT_ABX:
+        if (insn->a >= regs || insn->b >= regs) return -1;
+        break;
+    case FORMAT_ABC:
+        if (insn->a >= regs || insn->b >= regs || insn->c >= regs)
+            return -1;
+        break;
+    case FORMAT_ABI:
+        if (insn->a >= regs
+            || insn->b >= (insn->op == OP_ADDRC_LOCAL ? fn->num_slots : regs))
+            return -1;
+        break;
+    case FORMAT_AK:
+        if (insn->a >= regs || (uint32_t)insn->imm >= prog->num_constants)
+            return -1;
+        break;
+    case FORMAT_AG:
+        if (insn->a >= regs || (uint32_t)insn->imm >= prog->num_globals)
+            return -1;
+        break;
+    case FORMAT_AF:
+        if (insn->a >= regs || (uint32_t)insn->imm >= prog->num_functions)
+            return -1;
+        break;
+    case FORMAT_AS:
+        if (insn->a >= regs || (uint32_t)insn->imm >= prog->num_call_sites)
+            return -1;
+        break;
+    case FORMAT_AT:
+        if (insn->a >= regs || (uint32_t)insn->imm >= prog->num_switches)
+            return -1;
+        break;
+    }
+
+    switch ((enum opcode)insn->op) {
+    case OP_ADDR_LOCAL:
+        if (insn->imm < 0 || (uint32_t)insn->imm > fn->frame_size)
+            return -1;
+        break;
+    case OP_ZERO:
+        if (insn->imm < 0) return -1;
+        break;
+    case OP_COPY:
+        if (insn[1].imm < 0) return -1;
+        break;
+    case OP_JMP:
+    case OP_JZ:
+    case OP_JNZ:
+        if (check_target(fn, i, insn->imm, data)) return -1;
+        break;
+    case OP_SWITCH:
+        table = &prog->switches[insn->imm];
+        for (uint32_t k = 0; k < table->num_cases; k++)
+            if (check_target(fn, i,
+                             prog->switch_cases[table->cases + k].target,
+                             data))
+                return -1;
+        if (check_target(fn, i, table->default_target, data)) return -1;
+        break;
+    case OP_CALL:
+        if (!prog->functions[insn->imm].defined) return -1;
+        break;
+    /* The arguments of a call, and its result, are in registers from
+       a. */
+    case OP_CALL_HOST:
+        site = &prog->call_sites[insn->imm];
+        if (site->function == UINT32_MAX
+            || prog->functions[site->function].defined
+            || site->num_args > regs - insn->a)
+            return -1;
+        break;
+    case OP_CALL_PTR:
+        if ((uint32_t)insn[1].imm >= prog->num_call_sites
+            || prog->call_sites[insn[1].imm].num_args > regs - insn->a)
+            return -1;
+        break;
+    default:
+        break;
+    }
+
+    /* Every other instruction goes on to the next. */
+    switch ((enum opcode)insn->op) {
+    case OP_JMP:
+    case OP_SWITCH:
+    case OP_RET:
+    case OP_RET_VOID:
+    case OP_HALT:
+        return 0;
+    default:
+        return i + (opcode_format(insn->op) == FORMAT_ABX ? 2 : 1) < end
+               ? 0 : -1;
+    }
+}
+
+/* Whether a jump by offset from instruction i is to an instruction of
+   fn. */
+static int check_target(const struct function *fn, size_t i, int64_t offset,
+                        const bool *data) {
+    const int64_t target = (int64_t)i + offset;
+
+    return target < fn->code || target >= (int64_t)fn->code + fn->code_len
+           || data[target] ? -1 : 0;
+}
+
+/* Whether op is a load or store without a memory check. */
+static bool unchecked_access(enum opcode op) {
+    return (op >= OP_LOAD_I8 && op <= OP_LOAD_64)
+           || (op >= OP_STORE_8 && op <= OP_STORE_64);
+}
+
+/* Look up the functions and globals the program uses but does not define
+   among those of the host. */
+static int resolve_host(struct program *prog) {
+    /* The C library and the math library, rather than every symbol of the
+       process, which has cisc's own. */
+    void *const libs[2] = {dlopen("libc.so.6", RTLD_LAZY),
+                           dlopen("libm.so.6", RTLD_LAZY)};
+    int status = 0;
+
+    for (size_t i = 0; i < prog->num_functions; i++) {
+        struct function *const fn = &prog->functions[i];
+
+        if (fn->defined || fn->host) continue;
+        fn->host = host_symbol(libs, atom_spelling(fn->name));
+        if (!fn->host) {
+            fprintf(stderr, "cisc: error: undefined reference to '%s'\n",
+                    atom_spelling(fn->name));
+            status = -1;
+        }
+    }
+    for (size_t i = 0; i < prog->num_globals; i++) {
+        struct global *const g = &prog->globals[i];
+
+        if (g->defined || g->host) continue;
+        g->host = host_symbol(libs, atom_spelling(g->name));
+        if (!g->host) {
+            fprintf(stderr, "cisc: error: undefined reference to '%s'\n",
+                    atom_spelling(g->name));
+            status = -1;
+        }
+    }
+    for (size_t i = 0; i < 2; i++)
+        if (libs[i]) dlclose(libs[i]);
+    return status;
+}
+
+static void *host_symbol(void *const libs[2], const char *name) {
+    void *sym = NULL;
+
+    for (size_t i = 0; i < 2 && !sym; i++)
+        if (libs[i]) sym = dlsym(libs[i], name);
+    return sym;
+}
+
+/* Whether a call can be made to a host function: all arguments are passed
+   in registers, but for a few on the stack, and none is a structure. */
+static int check_host_call(const struct program *prog,
+                           const struct call_site *site) {
+    const char *const name = atom_spelling(
+        prog->functions[site->function].name);
+    size_t ints = 0;
+    size_t floats = 0;
+    size_t stack = 0;
+
+    for (uint32_t i = 0; i < site->num_args; i++) {
+        const uint8_t class = prog->arg_classes[site->classes + i];
+
+        if (class == CLASS_MEMORY) {
+            fprintf(stderr, "cisc: error: cannot pass a structure to host "
+                            "function '%s'\n", name);
+            return -1;
+        }
+        if (class == CLASS_F32 || class == CLASS_F64) {
+            if (++floats > HOST_FLOAT_REGS) stack++;
+        } else if (++ints > HOST_INT_REGS) {
+            stack++;
+        }
+    }
+    if (site->ret == CLASS_MEMORY) {
+        fprintf(stderr, "cisc: error: cannot return a structure from host "
+                        "function '%s'\n", name);
+        return -1;
+    }
+    if (stack > HOST_STACK_ARGS) {
+        fprintf(stderr, "cisc: error: too many arguments to host function "
+                        "'%s'\n", name);
+        return -1;
+    }
+    return 0;
+}
+
+/* Index of the signature of a call, made if it is the first of its
+   signature, or NO_SIGNATURE if a host function cannot be called so. */
+static uint32_t find_signature(struct program *prog,
+                               const struct call_site *site) {
+    const uint8_t *const classes = prog->arg_classes + site->classes;
+    struct host_signature *sig;
+
+    for (size_t i = 0; i < prog->num_host_signatures; i++) {
+        sig = &prog->host_signatures[i];
+        if (sig->num_args == site->num_args && sig->ret == site->ret
+            && !memcmp(prog->arg_classes + sig->classes, classes,
+                       site->num_args))
+            return i;
+    }
+    prog->host_signatures = grow(prog->host_signatures,
+                                 &prog->host_signatures_capacity,
+                                 prog->num_host_signatures,
+                                 sizeof(struct host_signature));
+    sig = &prog->host_signatures[prog->num_host_signatures];
+    if (host_signature_init(sig, prog, site->classes, site->num_args,
+                            site->ret))
+        return NO_SIGNATURE;
+    return prog->num_host_signatures++;
+}
+
+/* Make a superinstruction at each instruction that starts one of their
+   sequences, the longest if several. Sequences may overlap: the
+   instructions after the first of one keep their opcodes, and so may start
+   another. */
+static void specialize(struct program *prog) {
+    for (size_t f = 0; f < prog->num_functions; f++) {
+        const struct function *const fn = &prog->functions[f];
+        const size_t end = fn->code + fn->code_len;
+
+        if (!fn->defined) continue;
+        for (size_t i = fn->code; i < end; i++) {
+            size_t best = 0;
+            size_t best_len = 0;
+
+            if (opcode_format(prog->code[i].op) == FORMAT_ABX) {
+                i++;
+                continue;
+            }
+            for (size_t k = 0; k < sizeof(superinstructions)
+                                   / sizeof(superinstructions[0]); k++) {
+                const size_t len = match_sequence(prog, i, end,
+                                                  superinstructions[k].seq);
+                if (len > best_len) {
+                    best = k;
+                    best_len = len;
+                }
+            }
+            if (!best_len) continue;
+            prog->code[i].op = superinstructions[best].op;
+            STATS_ADD(superinstructions_made,
+                      superinstructions[best].op - OP_EQ_I_JZ, 1);
+        }
+    }
+}
+
+/* Length of the sequence seq if the code at i, before end, is made of it,
+   and 0 otherwise. A branch must test the result of the instruction before
+   it, which the superinstruction branches on directly. */
+static size_t match_sequence(const struct program *prog, size_t i,
+                             size_t end, const uint16_t *seq) {
+    size_t len = 0;
+
+    for (; len < 4 && seq[len] != OP_NOP; len++) {
+        const struct insn *insn;
+
+        if (i + len >= end) return 0;
+        insn = &prog->code[i + len];
+        if (insn->op != seq[len]) return 0;
+        if ((insn->op == OP_JZ || insn->op == OP_JNZ)
+            && insn->a != insn[-1].a)
+            return 0;
+    }
+    return len;
+}
+
+#ifndef NO_STATS
+static const char *superinstruction_label(size_t i) {
+    return opcode_name(OP_EQ_I_JZ + i);
+}
+#endif
+
+const char *opcode_name(enum opcode op) {
+    return opcode_names[op];
+}
+
+enum opcode_format opcode_format(enum opcode op) {
+    return opcode_formats[op];
+}
+
+enum opcode opcode_first(enum opcode op) {
+    const uint16_t *const seq = superinstruction_sequence(op);
+
+    return seq ? seq[0] : op;
+}
+
+/* Sequence of the superinstruction op, or NULL if it is not one. */
+static const uint16_t *superinstruction_sequence(enum opcode op) {
+    for (size_t k = 0; op >= OP_EQ_I_JZ && k < sizeof(superinstructions)
+                                               / sizeof(superinstructions[0]);
+         k++)
+        if (superinstructions[k].op == op) return superinstructions[k].seq;
+    return NULL;
+}
+
+void program_dump(const struct program *prog, FILE *fp) {
+    for (size_t i = 0; i < prog->num_functions; i++) {
+        const struct function *const fn = &prog->functions[i];
+
+        if (!fn->defined) continue;
+        fprintf(fp, "%s: params %u, registers %u, frame %u\n",
+                atom_spelling(fn->name), fn->num_params, fn->num_regs,
+                fn->frame_size);
+        for (size_t j = fn->code; j < fn->code + fn->code_len; j++) {
+            dump_insn(prog, j, fp);
+            if (opcode_format(prog->code[j].op) == FORMAT_ABX) j++;
+        }
+    }
+}
+
+static void dump_insn(const struct program *prog, size_t i, FILE *fp) {
+    const struct insn *const insn = &prog->code[i];
+    const char *name;
+
+    /* The names of superinstructions are longer than the column. */
+    if (fprintf(fp, "%6zu  %-12s", i, opcode_name(insn->op)) > 20)
+        fputc(' ', fp);
+    switch (opcode_format(insn->op)) {
+    case FORMAT_NONE:
+        break;
+    case FORMAT_A:
+        fprintf(fp, "r%u", insn->a);
+        break;
+    case FORMAT_AB:
+        fprintf(fp, "r%u, r%u", insn->a, insn->b);
+        break;
+    case FORMAT_ABC:
+        fprintf(fp, "r%u, r%u, r%u", insn->a, insn->b, insn->c);
+        break;
+    case FORMAT_ABI:
+        if (insn->op == OP_ADDRC_LOCAL)
+            fprintf(fp, "r%u, s%u, %d", insn->a, insn->b, (int16_t)insn->c);
+        else
+            fprintf(fp, "r%u, r%u, %d", insn->a, insn->b, (int16_t)insn->c);
+        break;
+    case FORMAT_AI:
+        if (insn->op == OP_JZ || insn->op == OP_JNZ)
+            fprintf(fp, "r%u, -> %zu", insn->a, i + insn->imm);
+        else
+            fprintf(fp, "r%u, %d", insn->a, insn->imm);
+        break;
+    case FORMAT_AK:
+        fprintf(fp, "r%u, 0x%llx", insn->a,
+                (unsigned long long)prog->constants[insn->imm]);
+        break;
+    case FORMAT_AG:
+        name = prog->globals[insn->imm].name
+               ? atom_spelling(prog->globals[insn->imm].name) : "";
+        fprintf(fp, "r%u, g%d %s", insn->a, insn->imm, name);
+        break;
+    case FORMAT_AF:
+        fprintf(fp, "r%u, %s", insn->a,
+                atom_spelling(prog->functions[insn->imm].name));
+        break;
+    case FORMAT_AS:
+        fprintf(fp, "r%u, %s", insn->a,
+                atom_spelling(prog->functions[
+                    prog->call_sites[insn->imm].function].name));
+        break;
+    case FORMAT_AT: {
+        const struct switch_table *const t = &prog->switches[insn->imm];
+
+        fprintf(fp, "r%u, default -> %zu", insn->a, i + t->default_target);
+        for (uint32_t k = 0; k < t->num_cases; k++) {
+            const struct switch_case *const sc
+                = &prog->switch_cases[t->cases + k];
+            fprintf(fp, ", %lld -> %zu", (long long)sc->value,
+                    i + sc->target);
+        }
+        break;
+    }
+    case FORMAT_I:
+        fprintf(fp, "-> %zu", i + insn->imm);
+        break;
+    case FORMAT_ABX:
+        fprintf(fp, "r%u, r%u, %d", insn->a, insn->b, insn[1].imm);
+        break;
+    }
+    fputc('\n', fp);
+}
@@ -0,0 +1,554 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "utils.h"
+
+struct host_signature;
+struct preprocessor;
+struct token;
+
+/* Register bytecode. A function works on its own array of 64-bit
+   registers: its parameters come first, then its local variables that live
+   in registers, then temporaries. Objects whose address is needed live in
+   its frame instead, a block of memory allocated on entry.
+
+   A register holds a value in canonical form for its type: an integer
+   narrower than 64 bits sign- or zero-extended to 64 bits as the type is
+   signed or not, a float in the low 32 bits, a pointer as an address.
+   Opcodes are typed, so that e.g. ADD_I32 adds two ints and sign-extends
+   the sum, and ADD_U32 zero-extends it.
+
+   Operands of each opcode, by format:
+   - ABC: registers a, b, c.
+   - AB: registers a, b.
+   - A: register a.
+   - ABI: registers a, b, and c a signed 16-bit immediate.
+   - AI: register a, and imm a signed 32-bit immediate: a constant, a frame
+     offset, or a jump offset from the instruction itself.
+   - AK, AG, AF, AS, AT: register a, and imm the index of a constant, a
+     global, a function, a call site, or a switch table.
+   - I: imm.
+   - ABX: registers a, b, and imm in the next instruction, which is not
+     executed.
+
+   Typed groups go I32, U32, I64, U64, F32, F64, or only the integer ones;
+   comparisons go I (signed, or equality of integers and pointers), U, F32,
+   F64.
+
+   The checked opcodes, ADDC_I32 and so on, compute the same result as
+   their unchecked counterparts when it fits in the type, and otherwise
+   handle the overflow by the policy of the program. Unsigned arithmetic
+   that wraps around is an overflow too; negation, division and left shift
+   are only checked when signed.
+
+   The checked loads and stores, LOADC_I8 and so on, check the access
+   against the object the pointer was derived from, as described in vm.h.
+   ADDRC_LOCAL takes the place of ADDR_LOCAL when memory is checked: it
+   gives the address c bytes into slot b of the frame, tagged as a pointer
+   to the object of the slot, and b is not a register.
+   SUB_P and the comparisons EQ_P and so on subtract and compare the
+   addresses of pointers without their tags, which they may not both
+   have.
+
+   The opcodes from EQ_I_JZ on are superinstructions, named after the
+   sequences of instructions program_link() fuses into them. One takes the
+   place of the opcode of the first instruction of its sequence, and runs
+   the whole sequence in one dispatch, each instruction with its own
+   operands; the others are left as they are, for jumps into the
+   sequence. */
+#define OPCODES(X)                                                          \
+    X(NOP, NONE)                                                            \
+    X(MOV, AB)                                                              \
+    X(LOADI, AI)                                                            \
+    X(LOADK, AK)                                                            \
+    X(ADDR_LOCAL, AI)                                                       \
+    X(ADDR_GLOBAL, AG)                                                      \
+    X(ADDR_FUNC, AF)                                                        \
+    X(ADDRC_LOCAL, ABI)                                                     \
+    X(ADD_I32, ABC) X(ADD_U32, ABC) X(ADD_I64, ABC) X(ADD_U64, ABC)         \
+    X(ADD_F32, ABC) X(ADD_F64, ABC)                                         \
+    X(SUB_I32, ABC) X(SUB_U32, ABC) X(SUB_I64, ABC) X(SUB_U64, ABC)         \
+    X(SUB_F32, ABC) X(SUB_F64, ABC)                                         \
+    X(MUL_I32, ABC) X(MUL_U32, ABC) X(MUL_I64, ABC) X(MUL_U64, ABC)         \
+    X(MUL_F32, ABC) X(MUL_F64, ABC)                                         \
+    X(DIV_I32, ABC) X(DIV_U32, ABC) X(DIV_I64, ABC) X(DIV_U64, ABC)         \
+    X(DIV_F32, ABC) X(DIV_F64, ABC)                                         \
+    X(MOD_I32, ABC) X(MOD_U32, ABC) X(MOD_I64, ABC) X(MOD_U64, ABC)         \
+    X(NEG_I32, AB) X(NEG_U32, AB) X(NEG_I64, AB) X(NEG_U64, AB)             \
+    X(NEG_F32, AB) X(NEG_F64, AB)                                           \
+    X(SHL_I32, ABC) X(SHL_U32, ABC) X(SHL_I64, ABC) X(SHL_U64, ABC)         \
+    X(SHR_I32, ABC) X(SHR_U32, ABC) X(SHR_I64, ABC) X(SHR_U64, ABC)         \
+    X(BNOT_I32, AB) X(BNOT_U32, AB) X(BNOT_I64, AB) X(BNOT_U64, AB)         \
+    X(ADDI_I32, ABI) X(ADDI_U32, ABI) X(ADDI_I64, ABI) X(ADDI_U64, ABI)     \
+    X(MULI_I64, ABI)                                                        \
+    X(ADDC_I32, ABC) X(ADDC_U32, ABC) X(ADDC_I64, ABC) X(ADDC_U64, ABC)     \
+    X(SUBC_I32, ABC) X(SUBC_U32, ABC) X(SUBC_I64, ABC) X(SUBC_U64, ABC)     \
+    X(MULC_I32, ABC) X(MULC_U32, ABC) X(MULC_I64, ABC) X(MULC_U64, ABC)     \
+    X(ADDIC_I32, ABI) X(ADDIC_U32, ABI) X(ADDIC_I64, ABI) X(ADDIC_U64, ABI) \
+    X(NEGC_I32, AB) X(NEGC_I64, AB)                                         \
+    X(DIVC_I32, ABC) X(DIVC_I64, ABC)                                       \
+    X(SHLC_I32, ABC) X(SHLC_I64, ABC)                                       \
+    X(AND, ABC)                                                             \
+    X(OR, ABC)                                                              \
+    X(XOR, ABC)                                                             \
+    X(EQ_I, ABC) X(EQ_U, ABC) X(EQ_F32, ABC) X(EQ_F64, ABC)                 \
+    X(NE_I, ABC) X(NE_U, ABC) X(NE_F32, ABC) X(NE_F64, ABC)                 \
+    X(LT_I, ABC) X(LT_U, ABC) X(LT_F32, ABC) X(LT_F64, ABC)                 \
+    X(LE_I, ABC) X(LE_U, ABC) X(LE_F32, ABC) X(LE_F64, ABC)                 \
+    X(NOT, AB)                                                              \
+    X(BOOL, AB)                                                             \
+    X(BOOL_F32, AB)                                                         \
+    X(BOOL_F64, AB)                                                         \
+    X(SEXT8, AB) X(SEXT16, AB) X(SEXT32, AB)                                \
+    X(ZEXT8, AB) X(ZEXT16, AB) X(ZEXT32, AB)                                \
+    X(I64_TO_F32, AB) X(U64_TO_F32, AB) X(I64_TO_F64, AB) X(U64_TO_F64, AB) \
+    X(F32_TO_I64, AB) X(F32_TO_U64, AB) X(F64_TO_I64, AB) X(F64_TO_U64, AB) \
+    X(F32_TO_F64, AB) X(F64_TO_F32, AB)                                     \
+    X(LOAD_I8, ABI) X(LOAD_U8, ABI) X(LOAD_I16, ABI) X(LOAD_U16, ABI)       \
+    X(LOAD_I32, ABI) X(LOAD_U32, ABI) X(LOAD_64, ABI)                       \
+    X(STORE_8, ABI) X(STORE_16, ABI) X(STORE_32, ABI) X(STORE_64, ABI)      \
+    X(LOADC_I8, ABI) X(LOADC_U8, ABI) X(LOADC_I16, ABI) X(LOADC_U16, ABI)   \
+    X(LOADC_I32, ABI) X(LOADC_U32, ABI) X(LOADC_64, ABI)                    \
+    X(STOREC_8, ABI) X(STOREC_16, ABI) X(STOREC_32, ABI) X(STOREC_64, ABI)  \
+    X(SUB_P, ABC)                                                           \
+    X(EQ_P, ABC) X(NE_P, ABC) X(LT_P, ABC) X(LE_P, ABC)                     \
+    X(COPY, ABX)                                                            \
+    X(ZERO, AI)                                                             \
+    X(JMP, I)                                                               \
+    X(JZ, AI)                                                               \
+    X(JNZ, AI)                                                              \
+    X(SWITCH, AT)                                                           \
+    X(CALL, AF)                                                             \
+    X(CALL_HOST, AS)                                                        \
+    X(CALL_PTR, ABX)                                                        \
+    X(RET, A)                                                               \
+    X(RET_VOID, NONE)                                                       \
+    X(HALT, A)                                                              \
+    X(EQ_I_JZ, ABC) X(EQ_I_JNZ, ABC)                                        \
+    X(NE_I_JZ, ABC) X(NE_I_JNZ, ABC)                                        \
+    X(LT_I_JZ, ABC) X(LT_I_JNZ, ABC)                                        \
+    X(LT_U_JZ, ABC) X(LT_U_JNZ, ABC)                                        \
+    X(LE_I_JZ, ABC) X(LE_I_JNZ, ABC)                                        \
+    X(LE_U_JZ, ABC) X(LE_U_JNZ, ABC)                                        \
+    X(EQ_P_JZ, ABC) X(EQ_P_JNZ, ABC)                                        \
+    X(NE_P_JZ, ABC) X(NE_P_JNZ, ABC)                                        \
+    X(LT_P_JZ, ABC) X(LT_P_JNZ, ABC)                                        \
+    X(LE_P_JZ, ABC) X(LE_P_JNZ, ABC)                                        \
+    X(LOADI_EQ_I_JZ, AI) X(LOADI_EQ_I_JNZ, AI)                              \
+    X(LOADI_NE_I_JZ, AI) X(LOADI_NE_I_JNZ, AI)                              \
+    X(LOADI_LT_I_JZ, AI) X(LOADI_LT_I_JNZ, AI)                              \
+    X(LOADI_LT_U_JZ, AI) X(LOADI_LT_U_JNZ, AI)                              \
+    X(LOADI_LE_I_JZ, AI) X(LOADI_LE_I_JNZ, AI)                              \
+    X(LOADI_LE_U_JZ, AI) X(LOADI_LE_U_JNZ, AI)                              \
+    X(ADDI_I32_LT_I_JNZ, ABI) X(ADDIC_I32_LT_I_JNZ, ABI)                    \
+    X(ADDI_I32_LOADI_LT_I_JNZ, ABI)                                         \
+    X(ADDIC_I32_LOADI_LT_I_JNZ, ABI)                                        \
+    X(ADD_U64_LOAD_I8, ABC) X(ADD_U64_LOAD_U8, ABC)                         \
+    X(ADD_U64_LOAD_I16, ABC) X(ADD_U64_LOAD_U16, ABC)                       \
+    X(ADD_U64_LOAD_I32, ABC) X(ADD_U64_LOAD_U32, ABC)                       \
+    X(ADD_U64_LOAD_64, ABC)                                                 \
+    X(ADD_U64_STORE_8, ABC) X(ADD_U64_STORE_16, ABC)                        \
+    X(ADD_U64_STORE_32, ABC) X(ADD_U64_STORE_64, ABC)                       \
+    X(ADD_U64_LOADC_I8, ABC) X(ADD_U64_LOADC_U8, ABC)                       \
+    X(ADD_U64_LOADC_I16, ABC) X(ADD_U64_LOADC_U16, ABC)                     \
+    X(ADD_U64_LOADC_I32, ABC) X(ADD_U64_LOADC_U32, ABC)                     \
+    X(ADD_U64_LOADC_64, ABC)                                                \
+    X(ADD_U64_STOREC_8, ABC) X(ADD_U64_STOREC_16, ABC)                      \
+    X(ADD_U64_STOREC_32, ABC) X(ADD_U64_STOREC_64, ABC)                     \
+    X(LOAD_I32_ADD_I32_STORE_32, ABI)                                       \
+    X(LOAD_I32_ADDI_I32_STORE_32, ABI)                                      \
+    X(LOAD_64_ADD_I64_STORE_64, ABI)                                        \
+    X(LOAD_64_ADDI_I64_STORE_64, ABI)                                       \
+    X(LOADC_I32_ADDC_I32_STOREC_32, ABI)                                    \
+    X(LOADC_I32_ADDIC_I32_STOREC_32, ABI)                                   \
+    X(LOADC_64_ADDC_I64_STOREC_64, ABI)                                     \
+    X(LOADC_64_ADDIC_I64_STOREC_64, ABI)
+
+enum opcode {
+#define OPCODE_ENUM(name, format) OP_##name,
+    OPCODES(OPCODE_ENUM)
+#undef OPCODE_ENUM
+    NUM_OPCODES
+};
+
+enum opcode_format {
+    FORMAT_NONE,
+    FORMAT_A,
+    FORMAT_AB,
+    FORMAT_ABC,
+    FORMAT_ABI,
+    FORMAT_AI,
+    FORMAT_AK,
+    FORMAT_AG,
+    FORMAT_AF,
+    FORMAT_AS,
+    FORMAT_AT,
+    FORMAT_I,
+    FORMAT_ABX,
+};
+
+struct insn {
+    uint16_t op;
+    uint16_t a;
+    union {
+        struct {
+            uint16_t b;
+            uint16_t c;
+        };
+        int32_t imm;
+    };
+};
+
+/* Registers a function may use, and their contents. */
+#define MAX_REGS 65536
+
+union reg {
+    int64_t i;
+    uint64_t u;
+    double d;
+    float f;
+    void *p;
+};
+
+/* Canonical form of a float, and of a double. */
+static inline union reg f32(float f) {
+    union reg r;
+
+    r.u = 0;
+    r.f = f;
+    return r;
+}
+
+static inline union reg f64(double d) {
+    union reg r;
+
+    r.d = d;
+    return r;
+}
+
+/* How a value is passed to or returned from a host function. */
+enum value_class {
+    CLASS_VOID,
+    CLASS_I8,
+    CLASS_U8,
+    CLASS_I16,
+    CLASS_U16,
+    CLASS_I32,
+    CLASS_U32,
+    /* 64-bit integers, and pointers, which are passed untagged, to data and
+       to functions, which may be of the program. */
+    CLASS_I64,
+    CLASS_PTR,
+    CLASS_FUNCTION,
+    CLASS_F32,
+    CLASS_F64,
+    /* A structure or union, which is passed by address. */
+    CLASS_MEMORY,
+};
+
+struct function {
+    /* Atom of the name. */
+    uint32_t name;
+    /* Defined in the program; the others are called on the host. */
+    bool defined;
+    /* Has internal linkage: a function of another translation unit of the
+       same name is another function. */
+    bool internal;
+    /* Registers holding the arguments, which are the first, and registers
+       in all. */
+    uint32_t num_params;
+    uint32_t num_regs;
+    /* Bytes of memory of the frame. */
+    uint32_t frame_size;
+    /* Instructions code[code, code + code_len) of the program. */
+    uint32_t code;
+    uint32_t code_len;
+    /* Objects of the frame, frame_slots[slots, slots + num_slots), if
+       memory is checked. */
+    uint32_t slots;
+    uint32_t num_slots;
+    /* Address of a host function, set by program_link(). */
+    void *host;
+};
+
+/* Object with static storage duration: a variable, a string literal, or a
+   compound literal at file scope. */
+struct global {
+    /* Atom of the name, or ATOM_NONE. */
+    uint32_t name;
+    /* Defined in the program, at data[offset, offset + size); the others
+       are objects of the host, whose address is set by program_link(). */
+    bool defined;
+    /* Has internal linkage, or no linkage, as a static local or a string
+       literal. */
+    bool internal;
+    uint32_t offset;
+    uint32_t size;
+    /* Size of the scalars the object is made of, if all of the same size,
+       or 0. */
+    uint8_t elem_size;
+    void *host;
+};
+
+/* A pointer stored in the initial data: to the global or function target,
+   plus addend. */
+enum reloc_kind {
+    RELOC_GLOBAL,
+    RELOC_FUNCTION,
+};
+
+struct reloc {
+    uint32_t offset;
+    enum reloc_kind kind;
+    uint32_t target;
+    int64_t addend;
+};
+
+/* Call of a function: its callee, if direct, and how the arguments are
+   passed to and the result returned from a host function. The classes of
+   the num_args arguments are arg_classes[classes, classes + num_args). */
+struct call_site {
+    uint32_t function;
+    uint32_t num_args;
+    uint32_t classes;
+    enum value_class ret;
+    /* Index of its signature in host_signatures, if it may call a host
+       function, or NO_SIGNATURE; set by program_link(). */
+    uint32_t signature;
+};
+
+#define NO_SIGNATURE UINT32_MAX
+
+/* Case of a switch, to the instruction at offset target from the
+   SWITCH. */
+struct switch_case {
+    int64_t value;
+    int32_t target;
+};
+
+/* Cases [cases, cases + num_cases) of switch_cases, by increasing value. */
+struct switch_table {
+    uint32_t cases;
+    uint32_t num_cases;
+    int32_t default_target;
+};
+
+/* What happens when checked integer arithmetic overflows. Under
+   OVERFLOW_NONE, arithmetic is compiled unchecked and wraps silently. */
+enum overflow_policy {
+    OVERFLOW_NONE,
+    /* Stop with a runtime error. */
+    OVERFLOW_TRAP,
+    /* Wrap, and warn the first time each instruction overflows. */
+    OVERFLOW_WARN,
+    /* Give the nearest representable value. */
+    OVERFLOW_SATURATE,
+};
+
+/* Largest value of integer class cls (0 to 3 for I32, U32, I64, U64, as
+   in the typed groups) if dir > 0, and smallest otherwise, in canonical
+   form. */
+static inline uint64_t overflow_limit(int cls, int dir) {
+    switch (cls) {
+    case 0: return dir > 0 ? (uint64_t)INT32_MAX : (uint64_t)INT32_MIN;
+    case 1: return dir > 0 ? UINT32_MAX : 0;
+    case 2: return dir > 0 ? (uint64_t)INT64_MAX : (uint64_t)INT64_MIN;
+    default: return dir > 0 ? UINT64_MAX : 0;
+    }
+}
+
+/* Object of a frame: a variable whose address is taken, an array or a
+   structure, or a temporary, at [offset, offset + size) of the frame. Its
+   name is an atom, or ATOM_NONE, and elem_size is as in struct global. */
+struct frame_slot {
+    uint32_t offset;
+    uint32_t size;
+    uint32_t name;
+    uint8_t elem_size;
+};
+
+/* Checked instruction code, whose operands have the integer type of kind
+   type (enum type_kind), for diagnostics. */
+struct overflow_site {
+    uint32_t code;
+    uint32_t type;
+};
+
+/* Translation unit the code from code on, up to that of the next unit,
+   was compiled from: code_tokens index tokens, which were read by pp. */
+struct program_unit {
+    uint32_t code;
+    const struct token *tokens;
+    struct preprocessor *pp;
+};
+
+/* Where an instruction was compiled from, in a program loaded from a
+   snapshot, which has no tokens: a line of the file whose path is the
+   atom path. */
+struct program_location {
+    uint32_t path;
+    uint32_t line;
+};
+
+/* A compiled program. Functions, globals, and the call sites and switch
+   tables of the code all refer to each other by index, so the program is
+   independent of where it is loaded. */
+struct program {
+    struct insn *code;
+    size_t code_len;
+    size_t code_capacity;
+    /* Token each instruction was compiled from, for diagnostics: its index
+       in the tokens of its unit, or in a program loaded from a snapshot, in
+       locations. */
+    uint32_t *code_tokens;
+
+    struct function *functions;
+    size_t num_functions;
+    size_t functions_capacity;
+
+    struct global *globals;
+    size_t num_globals;
+    size_t globals_capacity;
+
+    /* Initial contents of the defined globals. */
+    uint8_t *data;
+    size_t data_size;
+    size_t data_capacity;
+    struct reloc *relocs;
+    size_t num_relocs;
+    size_t relocs_capacity;
+
+    /* 64-bit constants of LOADK. */
+    uint64_t *constants;
+    size_t num_constants;
+    size_t constants_capacity;
+
+    struct call_site *call_sites;
+    size_t num_call_sites;
+    size_t call_sites_capacity;
+    uint8_t *arg_classes;
+    size_t num_arg_classes;
+    size_t arg_classes_capacity;
+    /* Distinct signatures of the calls to host functions, as described in
+       host.h. */
+    struct host_signature *host_signatures;
+    size_t num_host_signatures;
+    size_t host_signatures_capacity;
+
+    struct switch_table *switches;
+    size_t num_switches;
+    size_t switches_capacity;
+    struct switch_case *switch_cases;
+    size_t num_switch_cases;
+    size_t switch_cases_capacity;
+
+    struct frame_slot *frame_slots;
+    size_t num_frame_slots;
+    size_t frame_slots_capacity;
+
+    /* Index of main, or -1. */
+    int64_t main;
+    /* Set before compiling, OVERFLOW_WARN by default; and whether memory
+       accesses are checked, true by default. */
+    enum overflow_policy overflow;
+    bool memory_checks;
+    /* Set before linking, true by default: whether to make superinstructions
+       and to cache the callees of indirect calls. */
+    bool specialize;
+    /* Set before running, false by default: whether the VM compiles hot
+       functions to its second tier. */
+    bool tiering;
+    /* Types of the checked instructions, by increasing code. */
+    struct overflow_site *overflow_sites;
+    size_t num_overflow_sites;
+    size_t overflow_sites_capacity;
+    /* Translation units the code was compiled from, by increasing code. */
+    struct program_unit *units;
+    size_t num_units;
+    size_t units_capacity;
+
+    /* Set in a program loaded from a snapshot: the locations of its code,
+       and the mapping of the snapshot, which its arrays point into, and
+       which program_destroy() unmaps instead of freeing them. */
+    struct program_location *locations;
+    size_t num_locations;
+    void *image;
+    size_t image_size;
+};
+
+void program_init(struct program *prog);
+void program_destroy(struct program *prog);
+
+/* Append to the arrays of prog, returning the index of the new element. */
+uint32_t program_add_insn(struct program *prog, struct insn insn,
+                          uint32_t token);
+uint32_t program_add_function(struct program *prog, uint32_t name);
+uint32_t program_add_global(struct program *prog, uint32_t name);
+uint32_t program_add_constant(struct program *prog, uint64_t value);
+uint32_t program_add_call_site(struct program *prog, uint32_t function,
+                               const uint8_t *classes, uint32_t num_args,
+                               enum value_class ret);
+uint32_t program_add_switch(struct program *prog,
+                            const struct switch_case *cases,
+                            uint32_t num_cases, int32_t default_target);
+uint32_t program_add_frame_slot(struct program *prog, uint32_t offset,
+                                uint32_t size, uint32_t name,
+                                uint8_t elem_size);
+void program_add_overflow_site(struct program *prog, uint32_t code,
+                               uint32_t type);
+/* Allocate size bytes of zeroed data aligned to align, returning their
+   offset. */
+uint32_t program_alloc_data(struct program *prog, size_t size, size_t align);
+void program_add_reloc(struct program *prog, uint32_t offset,
+                       enum reloc_kind kind, uint32_t target, int64_t addend);
+/* Start a translation unit at the end of the code. */
+void program_add_unit(struct program *prog, const struct token *tokens,
+                      struct preprocessor *pp);
+
+/* Append the programs compiled from the translation units units[0, n), in
+   order, to prog, and resolve each function and global with external
+   linkage to one of that name: the definition, if a unit has one.
+   Instructions, relocations and call sites are renumbered to refer to the
+   appended functions, globals, constants, call sites and switch tables.
+   Reports names defined by several units on stderr, and returns -1 if
+   there are any. The units are left as they are. */
+int program_merge(struct program *prog, const struct program *units,
+                  size_t n);
+
+/* Resolve the functions and globals the program uses but does not define
+   to those of the host, looked up by name, and bind each direct call to its
+   callee: a CALL, whose immediate is the index of its call site until then,
+   to a function of the program, or a CALL_HOST, and find the signature of
+   each call that may be to a host function. Then, if prog->specialize is
+   set, make superinstructions. Reports what cannot be resolved on
+   stderr, and returns -1 if anything cannot. */
+int program_link(struct program *prog);
+/* Resolve the functions and globals of the host again, and remake the
+   stubs of the host signatures, in a program linked by another process,
+   as one loaded from a snapshot. Reports what cannot be resolved on stderr,
+   and returns -1 if anything cannot. */
+int program_relink(struct program *prog);
+/* Check that the program, linked by another process, as one loaded from a
+   snapshot, is one the VM can run without reading or jumping out of its
+   arrays: that every instruction is of a known opcode, with its registers
+   in those of its function, its indexes in the arrays they index, and its
+   jumps to instructions of its function, which it does not run past the
+   end of; and that the functions, globals, relocations, call sites and
+   switch tables refer only to what exists. Returns -1 if not. */
+int program_check(const struct program *prog);
+
+const char *opcode_name(enum opcode op);
+enum opcode_format opcode_format(enum opcode op);
+/* Opcode of the first instruction of the sequence of a superinstruction,
+   or op itself if it is not one. */
+enum opcode opcode_first(enum opcode op);
+
+/* Print the code of every defined function. */
+void program_dump(const struct program *prog, FILE *fp);
+
+#endif
@@ -1,14 +1,286 @@
+#include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ast.h"
+#include "bytecode.h"
+#include "compiler.h"
 #include "lexer.h"
+#include "parser.h"
+#include "preprocessor.h"
+#include "snapshot.h"
+#include "stats.h"
+#include "thread_pool.h"
+#include "token_cache.h"
+#include "utils.h"
+#include "vm.h"
+
+/* A translation unit, preprocessed, parsed and compiled on its own into
+   prog, which the programs of all units are then merged from. When units
+   are compiled concurrently, their diagnostics are kept until all are
+   done, to be reported in the order of the files. */
+struct unit {
+    const char *path;
+    /* Kept alive for the whole run, since tokens refer to their spellings
+       in the files it has read. */
+    struct preprocessor pp;
+    /* Everything the front end allocates for the unit. */
+    struct arena arena;
+    struct token_array tokens;
+    struct ast ast;
+    struct program *prog;
+    /* Stop after parsing. */
+    bool parse_only;
+    char *diagnostics;
+    size_t diagnostics_len;
+    int status;
+};
+
+/* Spellings of the overflow policies, as --overflow takes them. */
+static const char *const overflow_names[] = {
+    [OVERFLOW_NONE] = "none",
+    [OVERFLOW_TRAP] = "trap",
+    [OVERFLOW_WARN] = "warn",
+    [OVERFLOW_SATURATE] = "saturate",
+};
+
+static void compile_unit(void *arg);
 
 int main(int argc, char *argv[]) {
-    if (argc <= 1) {
+    /* Input files: the first argument that is not an option, and those
+       right after it that end in .c. */
+    const char *paths[argc];
+    size_t num_paths = 0;
+    /* Threads to compile the files on, or, for a single file, to lex it
+       with; 0 means one per CPU. By default, one per CPU for several files
+       and 1 for a single one. */
+    const char *jobs_arg = NULL;
+    size_t jobs;
+    /* Print statistics to stderr at exit. */
+    bool stats = false;
+    /* Chrome trace-event output. */
+    const char *trace_path = NULL;
+    /* Print the syntax tree to stdout. */
+    bool dump_ast = false;
+    /* Print the compiled program to stdout instead of running it. */
+    bool dump_bytecode = false;
+    /* Save the linked program to a snapshot instead of running it. */
+    const char *snapshot_path = NULL;
+    /* -I and -D options, in order. */
+    const char *include_dirs[argc];
+    size_t num_include_dirs = 0;
+    const char *defines[argc];
+    size_t num_defines = 0;
+    /* Token cache directory, off unless given here or by CISC_TOKEN_CACHE,
+       and its size limit. */
+    const char *cache_dir = getenv("CISC_TOKEN_CACHE");
+    size_t cache_size = TOKEN_CACHE_DEFAULT_SIZE;
+
+    /* Handling of integer overflow in the program, and whether given. */
+    enum overflow_policy overflow = OVERFLOW_WARN;
+    bool overflow_given = false;
+    /* Check the memory accesses of the program. */
+    bool memory_checks = true;
+    /* Make superinstructions and cache the callees of indirect calls. */
+    bool specialize = true;
+    /* Compile hot functions to the second tier of the VM. */
+    bool tiering = false;
+    /* Arguments after the input files, and after a "--" that ends them,
+       are passed to the program, whose argv[0] is the first file. */
+    char *args[argc];
+    int num_args = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strncmp(argv[i], "-I", 2) && (argv[i][2] || i + 1 < argc))
+            include_dirs[num_include_dirs++] = argv[i][2] ? argv[i] + 2
+                                                          : argv[++i];
+        else if (!strncmp(argv[i], "-D", 2) && (argv[i][2] || i + 1 < argc))
+            defines[num_defines++] = argv[i][2] ? argv[i] + 2 : argv[++i];
+        else if (!strcmp(argv[i], "--jobs") && i + 1 < argc)
+            jobs_arg = argv[++i];
+        else if (!strcmp(argv[i], "--stats"))
+            stats = true;
+        else if (!strcmp(argv[i], "--dump-ast"))
+            dump_ast = true;
+        else if (!strcmp(argv[i], "--dump-bytecode"))
+            dump_bytecode = true;
+        else if (!strcmp(argv[i], "--emit-snapshot") && i + 1 < argc)
+            snapshot_path = argv[++i];
+        else if (!strcmp(argv[i], "--overflow") && i + 1 < argc) {
+            i++;
+            overflow_given = true;
+            if (!strcmp(argv[i], "trap")) overflow = OVERFLOW_TRAP;
+            else if (!strcmp(argv[i], "warn")) overflow = OVERFLOW_WARN;
+            else if (!strcmp(argv[i], "saturate"))
+                overflow = OVERFLOW_SATURATE;
+            else if (!strcmp(argv[i], "none")) overflow = OVERFLOW_NONE;
+            else {
+                fprintf(stderr, "%s: unknown overflow policy\n", argv[i]);
+                overflow_given = false;
+            }
+        } else if (!strcmp(argv[i], "--no-memory-checks"))
+            memory_checks = false;
+        else if (!strcmp(argv[i], "--no-specialize"))
+            specialize = false;
+        else if (!strcmp(argv[i], "--tiering"))
+            tiering = true;
+        else if (!strcmp(argv[i], "--trace") && i + 1 < argc)
+            trace_path = argv[++i];
+        else if (!strcmp(argv[i], "--token-cache") && i + 1 < argc)
+            cache_dir = argv[++i];
+        else if (!strcmp(argv[i], "--token-cache-size") && i + 1 < argc)
+            cache_size = strtoul(argv[++i], NULL, 10) << 20;
+        else if (!strcmp(argv[i], "--no-token-cache"))
+            cache_dir = NULL;
+        else {
+            size_t len;
+
+            args[num_args++] = argv[i];
+            paths[num_paths++] = argv[i++];
+            while (i < argc && (len = strlen(argv[i])) > 2
+                   && !strcmp(argv[i] + len - 2, ".c"))
+                paths[num_paths++] = argv[i++];
+            if (i < argc && !strcmp(argv[i], "--")) i++;
+            while (i < argc) args[num_args++] = argv[i++];
+            break;
+        }
+    }
+    jobs = jobs_arg ? strtoul(jobs_arg, NULL, 10) : num_paths > 1 ? 0 : 1;
+    if (jobs == 0) jobs = thread_pool_num_cpus();
+
+    if (num_paths == 0) {
         printf("please specify input file\n");
         return 0;
     }
 
-    FILE *fp = fopen(argv[1], "r");
-    struct token_array token_array = lexer(fp);
+    if (trace_path) stats_enable_trace();
+    if (cache_dir && *cache_dir && token_cache_open(cache_dir, cache_size))
+        fprintf(stderr, "%s: cannot use as token cache\n", cache_dir);
+
+    /* A snapshot is run as it is, and has no units to compile. */
+    const bool snapshot = num_paths == 1 && snapshot_check(paths[0]);
+    const size_t num_units = snapshot ? 0 : num_paths;
+    struct unit *const units = calloc(num_units, sizeof(struct unit));
+    struct program *const progs = calloc(num_units, sizeof(struct program));
+    const bool concurrent = num_units > 1 && jobs > 1;
+    int status = 0;
+
+    for (size_t i = 0; i < num_units; i++) {
+        struct unit *const u = &units[i];
+
+        u->path = paths[i];
+        preprocessor_init(&u->pp, num_units > 1 ? 1 : jobs);
+        for (size_t j = 0; j < num_include_dirs; j++)
+            preprocessor_add_include_dir(&u->pp, include_dirs[j]);
+        for (size_t j = 0; j < num_defines; j++)
+            preprocessor_define(&u->pp, defines[j]);
+        if (concurrent)
+            u->pp.diagnostics = open_memstream(&u->diagnostics,
+                                               &u->diagnostics_len);
+        arena_init(&u->arena);
+        u->prog = &progs[i];
+        program_init(u->prog);
+        u->prog->overflow = overflow;
+        u->prog->memory_checks = memory_checks;
+        u->parse_only = dump_ast;
+    }
+    if (concurrent) {
+        struct thread_pool pool;
+
+        thread_pool_init(&pool, jobs < num_units ? jobs : num_units);
+        for (size_t i = 0; i < num_units; i++)
+            thread_pool_submit(&pool, compile_unit, &units[i]);
+        thread_pool_wait(&pool);
+        thread_pool_destroy(&pool);
+    } else {
+        for (size_t i = 0; i < num_units; i++) compile_unit(&units[i]);
+    }
+    for (size_t i = 0; i < num_units; i++) {
+        struct unit *const u = &units[i];
+
+        if (concurrent) {
+            fclose(u->pp.diagnostics);
+            u->pp.diagnostics = stderr;
+            fwrite(u->diagnostics, 1, u->diagnostics_len, stderr);
+            free(u->diagnostics);
+        }
+        if (u->status) status = 1;
+        else if (dump_ast) ast_dump(&u->ast, &u->pp, u->ast.root, stdout);
+    }
+
+    struct program prog;
+    if (snapshot) {
+        /* The code was compiled for the options saved with it, which it
+           cannot be run with others of. */
+        if (snapshot_load(&prog, paths[0])) {
+            status = 1;
+        } else if (overflow_given && overflow != prog.overflow) {
+            fprintf(stderr, "%s: snapshot made with --overflow %s cannot "
+                            "be run with --overflow %s\n", paths[0],
+                    overflow_names[prog.overflow], overflow_names[overflow]);
+            status = 1;
+        } else if (!memory_checks && prog.memory_checks) {
+            fprintf(stderr, "%s: snapshot made with memory checks cannot be "
+                            "run with --no-memory-checks\n", paths[0]);
+            status = 1;
+        } else if (!specialize && prog.specialize) {
+            fprintf(stderr, "%s: snapshot made specialized cannot be run "
+                            "with --no-specialize\n", paths[0]);
+            status = 1;
+        }
+    } else {
+        /* One program is made of all units, with their symbols resolved
+           to each other, then to the host. */
+        program_init(&prog);
+        prog.overflow = overflow;
+        prog.memory_checks = memory_checks;
+        prog.specialize = specialize;
+        if (status == 0 && !dump_ast
+            && program_merge(&prog, progs, num_units))
+            status = 1;
+        if (status == 0 && !dump_ast && program_link(&prog)) status = 1;
+    }
+    prog.tiering = tiering;
+    if (status == 0 && snapshot_path && !dump_ast) {
+        if (snapshot_save(&prog, snapshot_path)) status = 1;
+    } else if (status == 0 && dump_bytecode) {
+        program_dump(&prog, stdout);
+    } else if (status == 0 && !dump_ast) {
+        /* The exit status is that of the program. */
+        struct vm vm;
+        int exit_status;
+
+        vm_init(&vm, &prog);
+        status = vm_run(&vm, num_args, args, &exit_status);
+        vm_destroy(&vm);
+        if (status == 0) status = exit_status;
+        else status = 1;
+    }
+    program_destroy(&prog);
+
+    for (size_t i = 0; i < num_units; i++) {
+        program_destroy(&progs[i]);
+        arena_destroy(&units[i].arena);
+        preprocessor_destroy(&units[i].pp);
+    }
+    free(progs);
+    free(units);
+    token_cache_close();
+
+    if (stats) stats_print(stderr);
+    if (trace_path && stats_write_trace(trace_path)) {
+        perror(trace_path);
+        return 1;
+    }
+    return status;
+}
+
+static void compile_unit(void *arg) {
+    struct unit *const u = arg;
 
-    return 0;
+    u->status = preprocess(&u->pp, u->path, &u->arena, &u->tokens);
+    if (u->status == 0)
+        u->status = parse(&u->pp, &u->tokens, &u->arena, &u->ast);
+    if (u->status == 0 && !u->parse_only)
+        u->status = compile(&u->pp, &u->ast, &u->arena, u->prog);
 }
@@ -0,0 +1,3924 @@
+#include "compiler.h"
+#include "intern.h"
+#include "number.h"
+#include "preprocessor.h"
+#include "stats.h"
+#include "type.h"
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum symbol_kind {
+    SYMBOL_TYPEDEF,
+    SYMBOL_ENUM_CONST,
+    SYMBOL_FUNCTION,
+    SYMBOL_GLOBAL,
+    /* Local variable in a register, or in the frame. */
+    SYMBOL_REGISTER,
+    SYMBOL_LOCAL,
+};
+
+struct symbol {
+    enum symbol_kind kind;
+    struct type *type;
+    uint32_t name;
+    /* Register, frame offset, or index of the function or global in the
+       program, which is only added once used or defined (-1 until then);
+       or value of an enumeration constant. */
+    int64_t index;
+    /* A function has a body, or a global has storage, or an
+       initializer. */
+    bool defined;
+    bool initialized;
+    /* A function or global declared static at file scope first. */
+    bool internal;
+};
+
+/* Change to the binding of an identifier or a tag, undone at the end of
+   its scope. */
+struct binding {
+    uint32_t atom;
+    bool tag;
+    void *old;
+};
+
+struct label {
+    uint32_t atom;
+    uint32_t token;
+    /* Instruction, or -1 until the label is seen; and jumps to it until
+       then. */
+    int32_t target;
+    int32_t jumps;
+};
+
+struct switch_state {
+    struct type *type;
+    struct switch_case *cases;
+    size_t num_cases;
+    size_t cases_capacity;
+    int32_t default_target;
+};
+
+/* State of the function being compiled. */
+struct function_state {
+    uint32_t index;
+    struct type *type;
+    /* First instruction, a placeholder loading the address of the frame
+       into frame_reg if the function uses it. */
+    uint32_t start;
+    uint32_t frame_reg;
+    bool uses_frame;
+    /* Register holding the address of a returned structure, or -1. */
+    int64_t sret_reg;
+
+    /* Registers: those below var_top are taken by variables, and those
+       from there to next_reg by temporaries. */
+    uint32_t var_top;
+    uint32_t next_reg;
+    uint32_t num_regs;
+    /* Frame memory, allocated like registers. Each allocation is a slot,
+       from frame_slots[slots] of the program on, if memory is checked. */
+    uint32_t frame_top;
+    uint32_t frame_size;
+    uint32_t slots;
+
+    /* Last instruction that is the target of a jump: one before it may
+       not be changed by looking at the next. */
+    uint32_t last_target;
+
+    struct label *labels;
+    size_t num_labels;
+    size_t labels_capacity;
+    /* Chains of jumps of the innermost break and continue, or NULL where
+       they are not allowed. */
+    int32_t *breaks;
+    int32_t *continues;
+    struct switch_state *sw;
+};
+
+/* Where an expression's value is. */
+enum value_kind {
+    VALUE_VOID,
+    /* Constant: an integer in canonical form, a floating value, or an
+       address: that of global or function index, plus the integer. */
+    VALUE_CONST,
+    /* Value in register reg. */
+    VALUE_REG,
+    /* Object: a variable living in register reg, or at offset from the
+       address in register reg (or from 0 if reg is NO_REG), from the
+       frame, or from global index. */
+    VALUE_VAR,
+    VALUE_MEM,
+    VALUE_LOCAL,
+    VALUE_GLOBAL,
+    /* Function designator. */
+    VALUE_FUNCTION,
+};
+
+enum const_base {
+    BASE_NONE,
+    BASE_GLOBAL,
+    BASE_FUNCTION,
+};
+
+struct value {
+    enum value_kind kind;
+    struct type *type;
+    uint32_t reg;
+    int64_t offset;
+    union {
+        uint64_t u;
+        double d;
+    };
+    enum const_base base;
+    uint32_t index;
+};
+
+#define NO_REG UINT32_MAX
+
+/* Types of structure, union, and enumeration specifiers with a body, by
+   node, so that each is declared once if it is compiled again, e.g. in
+   the operand of sizeof. */
+struct record_entry {
+    uint32_t node;
+    struct type *type;
+};
+
+/* Initialization of an object: at offset base of the frame, or of the
+   data of the program if global; or only measuring the length of an array
+   of unknown length. */
+struct init_target {
+    bool global;
+    bool measure;
+    uint32_t base;
+};
+
+struct compiler {
+    struct preprocessor *pp;
+    const struct ast *ast;
+    const struct token *toks;
+    struct arena *arena;
+    struct program *prog;
+    int errors;
+    /* Token of the construct being compiled, for instructions and
+       errors. */
+    uint32_t token;
+
+    /* Scopes: the innermost binding of each identifier and tag, by atom,
+       and the symbol each identifier with linkage has across scopes. */
+    struct symbol **symbols;
+    struct type **tags;
+    struct symbol **linkage;
+    size_t num_atoms;
+    struct binding *bindings;
+    size_t num_bindings;
+    size_t bindings_capacity;
+    size_t scope;
+
+    struct record_entry *records;
+    size_t records_capacity;
+    size_t num_records;
+
+    /* While positive, no code is emitted: emitted records that some would
+       have been, to tell whether an expression is constant. While quiet
+       is, errors are not reported either, and nothing is defined. */
+    int no_code;
+    bool emitted;
+    int quiet;
+
+    /* Identifiers, by atom, whose address is taken in the function. */
+    bool *addressed;
+
+    struct function_state *fn;
+};
+
+STATS_COUNTER(insns, "compiler.insns");
+STATS_PHASE(compile_phase, "compiler");
+
+static void error(struct compiler *c, const char *fmt, ...);
+static void warning(struct compiler *c, const char *fmt, ...);
+static void diagnose(struct compiler *c, const char *severity,
+                     const char *fmt, va_list ap);
+static uint32_t node_kind(const struct compiler *c, uint32_t node);
+static uint32_t lhs_of(const struct compiler *c, uint32_t node);
+static uint32_t rhs_of(const struct compiler *c, uint32_t node);
+static void set_token(struct compiler *c, uint32_t node);
+static uint32_t decl_flags(const struct compiler *c, uint32_t type);
+
+static uint32_t emit(struct compiler *c, enum opcode op, uint32_t a,
+                     uint32_t b, uint32_t cc);
+static uint32_t emit_imm(struct compiler *c, enum opcode op, uint32_t a,
+                         int32_t imm);
+static int32_t emit_jump(struct compiler *c, enum opcode op, uint32_t a,
+                         int32_t chain);
+static void emit_jump_to(struct compiler *c, enum opcode op, uint32_t a,
+                         uint32_t target);
+static uint32_t here(struct compiler *c);
+static void patch(struct compiler *c, int32_t chain, uint32_t target);
+static int32_t join(struct compiler *c, int32_t a, int32_t b);
+static void mark_target(struct compiler *c);
+static uint32_t temp(struct compiler *c);
+static uint32_t alloc_frame(struct compiler *c, const struct type *type,
+                            uint32_t name);
+static void emit_addr_local(struct compiler *c, uint32_t dst,
+                            uint32_t offset);
+
+static size_t scope_begin(const struct compiler *c);
+static void scope_end(struct compiler *c, size_t mark);
+static void push_binding(struct compiler *c, uint32_t atom, bool tag,
+                         void *old);
+static void bind(struct compiler *c, uint32_t atom, struct symbol *sym);
+static void bind_tag(struct compiler *c, uint32_t atom, struct type *type);
+static bool tag_in_scope(const struct compiler *c, uint32_t atom);
+static struct symbol *new_symbol(struct compiler *c, enum symbol_kind kind,
+                                 struct type *type, uint32_t name);
+static uint32_t function_index(struct compiler *c, struct symbol *sym);
+static uint32_t global_index(struct compiler *c, struct symbol *sym);
+static struct type *record_lookup(const struct compiler *c, uint32_t node);
+static void record_add(struct compiler *c, uint32_t node, struct type *type);
+
+static struct type *resolve_type(struct compiler *c, uint32_t node);
+static struct type *spec_type(struct compiler *c, uint32_t node);
+static struct type *record_type(struct compiler *c, uint32_t node);
+static struct type *enum_type(struct compiler *c, uint32_t node);
+static struct type *adjust_param(struct compiler *c, struct type *type);
+
+static void compile_external(struct compiler *c, uint32_t node,
+                             uint32_t prev);
+static void compile_function(struct compiler *c, uint32_t node,
+                             uint32_t prev);
+static void compile_global(struct compiler *c, uint32_t node);
+static void compile_local(struct compiler *c, uint32_t node);
+static struct symbol *declare_linkage(struct compiler *c, uint32_t name,
+                                      struct type *type, bool internal);
+static void compile_typedef(struct compiler *c, uint32_t node);
+static void compile_static_assert(struct compiler *c, uint32_t node);
+static uint32_t static_object(struct compiler *c, struct type **type,
+                              uint32_t init, uint32_t name);
+
+static struct type *complete_array(struct compiler *c, struct type *type,
+                                   uint32_t init);
+static void init_local(struct compiler *c, struct type *type,
+                       uint32_t offset, uint32_t init);
+static size_t init_object(struct compiler *c, struct init_target *t,
+                          struct type *type, size_t offset, uint32_t init);
+static size_t init_items(struct compiler *c, struct init_target *t,
+                         struct type *type, size_t offset,
+                         const uint32_t *items, size_t n, size_t *pos,
+                         bool braced);
+static void init_element(struct compiler *c, struct init_target *t,
+                         struct type *type, size_t offset,
+                         const uint32_t *items, size_t n, size_t *pos);
+static void init_designated(struct compiler *c, struct init_target *t,
+                            struct type *type, size_t offset,
+                            const uint32_t *desigs, size_t num_desigs,
+                            uint32_t init);
+static void init_scalar(struct compiler *c, struct init_target *t,
+                        struct type *type, size_t offset, uint32_t init);
+static size_t init_string(struct compiler *c, struct init_target *t,
+                          struct type *type, size_t offset, uint32_t init);
+static bool is_string_init(const struct compiler *c, struct type *type,
+                           uint32_t init);
+
+static void compile_stmt(struct compiler *c, uint32_t node);
+static void compile_compound(struct compiler *c, uint32_t node);
+static void compile_if(struct compiler *c, uint32_t node);
+static void compile_switch(struct compiler *c, uint32_t node);
+static void compile_loop(struct compiler *c, uint32_t node);
+static void compile_return(struct compiler *c, uint32_t node);
+static void compile_goto(struct compiler *c, uint32_t node);
+static void compile_label(struct compiler *c, uint32_t node);
+static void compile_case(struct compiler *c, uint32_t node);
+static int compare_cases(const void *a, const void *b);
+static struct label *find_label(struct compiler *c, uint32_t atom);
+static void end_statement(struct compiler *c);
+
+static struct value compile_expr(struct compiler *c, uint32_t node);
+static void compile_void(struct compiler *c, uint32_t node);
+static int32_t jump_if(struct compiler *c, uint32_t node, bool sense);
+static int32_t jump_on(struct compiler *c, struct value v, bool sense);
+static struct value compile_ident(struct compiler *c, uint32_t node);
+static struct value compile_string(struct compiler *c, uint32_t node);
+static struct value compile_char(struct compiler *c, uint32_t node);
+static struct value compile_call(struct compiler *c, uint32_t node);
+static struct value compile_member(struct compiler *c, uint32_t node);
+static struct value compile_unary(struct compiler *c, uint32_t node);
+static struct value compile_incdec(struct compiler *c, uint32_t node,
+                                   bool used);
+static struct value compile_cast(struct compiler *c, uint32_t node);
+static struct value compile_binary(struct compiler *c, uint32_t node);
+static struct value compile_assign(struct compiler *c, uint32_t node);
+static struct value compile_cond(struct compiler *c, uint32_t node);
+static struct value compile_logical(struct compiler *c, uint32_t node);
+static struct value compile_compound_literal(struct compiler *c,
+                                            uint32_t node);
+static struct value arith(struct compiler *c, enum ast_kind kind,
+                          struct value l, struct value r);
+static int overflow_dir(enum ast_kind kind, int cls, uint64_t x, uint64_t y,
+                        uint64_t *r);
+static uint64_t fold_overflow(struct compiler *c, const struct type *type,
+                              uint64_t wrapped, int dir);
+static void mark_checked(struct compiler *c, uint32_t insn,
+                         const struct type *type);
+static struct value compare(struct compiler *c, enum ast_kind kind,
+                            struct value l, struct value r);
+static struct value pointer_add(struct compiler *c, struct value ptr,
+                                struct value n, bool sub);
+static struct value pointer_diff(struct compiler *c, struct value l,
+                                 struct value r);
+static struct value peek(struct compiler *c, uint32_t node);
+static struct type *type_of(struct compiler *c, uint32_t node);
+static int64_t eval_int(struct compiler *c, uint32_t node);
+static struct value eval_const(struct compiler *c, uint32_t node,
+                               struct type *type);
+
+static struct value int_const(struct type *type, uint64_t u);
+static struct value reg_value(struct type *type, uint32_t reg);
+static bool is_lvalue(const struct value *v);
+static bool is_null_const(const struct value *v);
+static struct value rvalue(struct compiler *c, struct value v);
+static uint32_t to_reg(struct compiler *c, struct value v);
+static void load_const(struct compiler *c, uint32_t dst,
+                       const struct value *v);
+static bool const_truth(const struct value *v);
+static struct value convert(struct compiler *c, struct value v,
+                            struct type *type);
+static struct value assign_convert(struct compiler *c, struct value v,
+                                   struct type *type);
+static enum opcode int_conversion(const struct type *from,
+                                  const struct type *to);
+static struct value address_of(struct compiler *c, struct value v);
+static struct value deref(struct compiler *c, struct value ptr);
+static uint32_t mem_base(struct compiler *c, const struct value *v,
+                         int16_t *disp);
+static uint32_t add_offset(struct compiler *c, uint32_t reg, int64_t offset);
+static struct value store(struct compiler *c, struct value dst,
+                          struct value v);
+static void move_to(struct compiler *c, uint32_t dst, struct value v);
+static void copy_object(struct compiler *c, uint32_t dst, uint32_t src,
+                        size_t size);
+static uint64_t truncate_int(const struct type *type, uint64_t u);
+static int type_class(const struct type *type);
+static uint8_t elem_size(const struct type *type);
+static int compare_class(const struct type *type);
+static enum value_class value_class_of(const struct type *type);
+static bool writes_a(enum opcode op);
+static const char *op_name(enum ast_kind kind);
+static const char *spell(struct compiler *c, const struct type *type);
+static uint32_t read_char(const char **s, const char *end, bool wide,
+                          bool *universal);
+static size_t prefix_size(const struct compiler *c, uint32_t token,
+                          struct type **elem);
+static size_t decode_string(struct compiler *c, uint32_t node,
+                            struct string *buf, struct type **elem);
+static uint32_t string_global(struct compiler *c, const struct string *buf,
+                              size_t align);
+
+int compile(struct preprocessor *pp, const struct ast *ast,
+            struct arena *arena, struct program *prog) {
+    const uint32_t items = ast->data[ast->root].lhs;
+#ifndef NO_STATS
+    const size_t code_start = prog->code_len;
+#endif
+    struct compiler c;
+    uint32_t prev = 0;
+    uint32_t main_atom;
+
+    STATS_BEGIN(compile_phase);
+    memset(&c, 0, sizeof(c));
+    c.pp = pp;
+    c.ast = ast;
+    c.toks = ast->token_array;
+    c.arena = arena;
+    c.prog = prog;
+    c.token = AST_NO_TOKEN;
+    c.num_atoms = atom_count() + 1;
+    c.symbols = calloc(c.num_atoms, sizeof(struct symbol *));
+    c.tags = calloc(c.num_atoms, sizeof(struct type *));
+    c.linkage = calloc(c.num_atoms, sizeof(struct symbol *));
+    c.addressed = calloc(c.num_atoms, sizeof(bool));
+    program_add_unit(prog, ast->token_array, pp);
+
+    for (size_t i = 0; i < ast_list_len(ast, items); i++) {
+        const uint32_t item = ast_list(ast, items)[i];
+
+        compile_external(&c, item, prev);
+        prev = item;
+    }
+
+    main_atom = atom_lookup("main", 4);
+    if (main_atom != ATOM_NONE && main_atom < c.num_atoms
+        && c.linkage[main_atom]
+        && c.linkage[main_atom]->kind == SYMBOL_FUNCTION
+        && c.linkage[main_atom]->defined)
+        prog->main = c.linkage[main_atom]->index;
+
+    free(c.symbols);
+    free(c.tags);
+    free(c.linkage);
+    free(c.addressed);
+    free(c.bindings);
+    free(c.records);
+
+    STATS_ADD_ATOMIC(insns, 0, prog->code_len - code_start);
+    STATS_END(compile_phase);
+    return c.errors ? -1 : 0;
+}
+
+static void error(struct compiler *c, const char *fmt, ...) {
+    va_list ap;
+
+    if (c->quiet) return;
+    c->errors++;
+    va_start(ap, fmt);
+    diagnose(c, "error", fmt, ap);
+    va_end(ap);
+}
+
+static void warning(struct compiler *c, const char *fmt, ...) {
+    va_list ap;
+
+    if (c->quiet) return;
+    va_start(ap, fmt);
+    diagnose(c, "warning", fmt, ap);
+    va_end(ap);
+}
+
+static void diagnose(struct compiler *c, const char *severity,
+                     const char *fmt, va_list ap) {
+    FILE *const out = c->pp ? c->pp->diagnostics : stderr;
+
+    if (c->pp && c->token != AST_NO_TOKEN) {
+        const struct token *const tok = &c->toks[c->token];
+
+        fprintf(out, "%s:%zu:%zu: %s: ", preprocessor_file_path(c->pp, tok),
+                preprocessor_line(c->pp, tok),
+                preprocessor_column(c->pp, tok), severity);
+    } else {
+        fprintf(out, "cisc: %s: ", severity);
+    }
+    vfprintf(out, fmt, ap);
+    fputc('\n', out);
+}
+
+static uint32_t node_kind(const struct compiler *c, uint32_t node) {
+    return c->ast->kinds[node];
+}
+
+static uint32_t lhs_of(const struct compiler *c, uint32_t node) {
+    return c->ast->data[node].lhs;
+}
+
+static uint32_t rhs_of(const struct compiler *c, uint32_t node) {
+    return c->ast->data[node].rhs;
+}
+
+static void set_token(struct compiler *c, uint32_t node) {
+    if (c->ast->tokens[node] != AST_NO_TOKEN) c->token = c->ast->tokens[node];
+}
+
+/* AST_SPEC_* flags of the declaration specifiers a type is built from. */
+static uint32_t decl_flags(const struct compiler *c, uint32_t type) {
+    while (node_kind(c, type) != AST_DECL_SPEC) type = lhs_of(c, type);
+    return lhs_of(c, type);
+}
+
+/* Code is only emitted inside a function, and not while no_code is
+   positive; then the index returned is UINT32_MAX. */
+static uint32_t emit(struct compiler *c, enum opcode op, uint32_t a,
+                     uint32_t b, uint32_t cc) {
+    struct insn insn;
+
+    if (c->no_code || !c->fn) {
+        c->emitted = true;
+        return UINT32_MAX;
+    }
+    insn.op = op;
+    insn.a = a;
+    insn.b = b;
+    insn.c = cc;
+    return program_add_insn(c->prog, insn, c->token);
+}
+
+static uint32_t emit_imm(struct compiler *c, enum opcode op, uint32_t a,
+                         int32_t imm) {
+    struct insn insn;
+
+    if (c->no_code || !c->fn) {
+        c->emitted = true;
+        return UINT32_MAX;
+    }
+    insn.op = op;
+    insn.a = a;
+    insn.imm = imm;
+    return program_add_insn(c->prog, insn, c->token);
+}
+
+/* Jumps not yet placed are chained through their immediates, which are the
+   index of the previous jump of the chain, or -1. Returns the new head. */
+static int32_t emit_jump(struct compiler *c, enum opcode op, uint32_t a,
+                         int32_t chain) {
+    const uint32_t i = emit_imm(c, op, a, chain);
+
+    return i == UINT32_MAX ? chain : (int32_t)i;
+}
+
+static void emit_jump_to(struct compiler *c, enum opcode op, uint32_t a,
+                         uint32_t target) {
+    const uint32_t i = here(c);
+
+    emit_imm(c, op, a, (int32_t)(target - i));
+}
+
+static uint32_t here(struct compiler *c) {
+    return c->prog->code_len;
+}
+
+/* Point every jump of chain at target, which is then a jump target. */
+static void patch(struct compiler *c, int32_t chain, uint32_t target) {
+    struct insn *const code = c->prog->code;
+
+    if (chain < 0) return;
+    while (chain >= 0) {
+        const int32_t next = code[chain].imm;
+
+        code[chain].imm = (int32_t)(target - (uint32_t)chain);
+        chain = next;
+    }
+    if (c->fn && target > c->fn->last_target) c->fn->last_target = target;
+}
+
+static int32_t join(struct compiler *c, int32_t a, int32_t b) {
+    int32_t i = b;
+
+    if (a < 0) return b;
+    if (b < 0) return a;
+    while (c->prog->code[i].imm >= 0) i = c->prog->code[i].imm;
+    c->prog->code[i].imm = a;
+    return b;
+}
+
+/* The next instruction is a jump target, as that of a backward jump. */
+static void mark_target(struct compiler *c) {
+    if (c->fn) c->fn->last_target = here(c);
+}
+
+static uint32_t temp(struct compiler *c) {
+    struct function_state *const fn = c->fn;
+
+    if (!fn) return 0;
+    if (fn->next_reg >= MAX_REGS - 1) {
+        error(c, "function needs too many registers");
+        return fn->next_reg;
+    }
+    if (++fn->next_reg > fn->num_regs) fn->num_regs = fn->next_reg;
+    return fn->next_reg - 1;
+}
+
+/* Allocate an object of type in the frame, the variable name or a
+   temporary if ATOM_NONE, returning its offset. */
+static uint32_t alloc_frame(struct compiler *c, const struct type *type,
+                            uint32_t name) {
+    struct function_state *const fn = c->fn;
+    size_t offset;
+
+    if (!fn) {
+        c->emitted = true;
+        return 0;
+    }
+    offset = (fn->frame_top + type->align - 1) & ~(type->align - 1);
+    if (offset + type->size > INT32_MAX) {
+        error(c, "frame of function is too large");
+        return 0;
+    }
+    fn->frame_top = offset + type->size;
+    if (fn->frame_top > fn->frame_size) fn->frame_size = fn->frame_top;
+    fn->uses_frame = true;
+    if (c->prog->memory_checks && !c->no_code)
+        program_add_frame_slot(c->prog, offset, type->size, name,
+                               elem_size(type));
+    return offset;
+}
+
+/* Load the address offset bytes into the frame into dst. If memory is
+   checked, it is tagged with the slot it is in, the last allocated: slots
+   freed at the end of a block are allocated again above those still in
+   use. */
+static void emit_addr_local(struct compiler *c, uint32_t dst,
+                            uint32_t offset) {
+    const struct program *const prog = c->prog;
+
+    if (c->fn && prog->memory_checks && !c->no_code)
+        for (size_t i = prog->num_frame_slots; i > c->fn->slots;) {
+            const struct frame_slot *const slot = &prog->frame_slots[--i];
+            const uint32_t k = i - c->fn->slots;
+
+            if (offset - slot->offset > slot->size) continue;
+            if (k > UINT16_MAX) break;
+            if (offset - slot->offset <= INT16_MAX) {
+                emit(c, OP_ADDRC_LOCAL, dst, k, offset - slot->offset);
+            } else {
+                emit(c, OP_ADDRC_LOCAL, dst, k, 0);
+                move_to(c, dst, reg_value(&type_ulong,
+                                          add_offset(c, dst, offset
+                                                     - slot->offset)));
+            }
+            return;
+        }
+    emit_imm(c, OP_ADDR_LOCAL, dst, offset);
+}
+
+static size_t scope_begin(const struct compiler *c) {
+    return c->num_bindings;
+}
+
+static void scope_end(struct compiler *c, size_t mark) {
+    while (c->num_bindings > mark) {
+        const struct binding *const b = &c->bindings[--c->num_bindings];
+
+        if (b->tag) c->tags[b->atom] = b->old;
+        else c->symbols[b->atom] = b->old;
+    }
+}
+
+static void push_binding(struct compiler *c, uint32_t atom, bool tag,
+                         void *old) {
+    if (c->num_bindings == c->bindings_capacity) {
+        c->bindings_capacity = c->bindings_capacity
+                               ? c->bindings_capacity * 2 : 256;
+        c->bindings = realloc(c->bindings,
+                              sizeof(struct binding) * c->bindings_capacity);
+    }
+    c->bindings[c->num_bindings].atom = atom;
+    c->bindings[c->num_bindings].tag = tag;
+    c->bindings[c->num_bindings].old = old;
+    c->num_bindings++;
+}
+
+static void bind(struct compiler *c, uint32_t atom, struct symbol *sym) {
+    push_binding(c, atom, false, c->symbols[atom]);
+    c->symbols[atom] = sym;
+}
+
+static void bind_tag(struct compiler *c, uint32_t atom, struct type *type) {
+    push_binding(c, atom, true, c->tags[atom]);
+    c->tags[atom] = type;
+}
+
+static bool tag_in_scope(const struct compiler *c, uint32_t atom) {
+    for (size_t i = c->num_bindings; i > c->scope; i--)
+        if (c->bindings[i - 1].tag && c->bindings[i - 1].atom == atom)
+            return true;
+    return false;
+}
+
+static struct symbol *new_symbol(struct compiler *c, enum symbol_kind kind,
+                                 struct type *type, uint32_t name) {
+    struct symbol *const sym = arena_alloc(c->arena, sizeof(struct symbol),
+                                           _Alignof(struct symbol));
+
+    memset(sym, 0, sizeof(struct symbol));
+    sym->kind = kind;
+    sym->type = type;
+    sym->name = name;
+    sym->index = -1;
+    return sym;
+}
+
+/* Index of a function or global in the program, which is added when first
+   needed. While quiet, as in the operand of sizeof, nothing is needed. */
+static uint32_t function_index(struct compiler *c, struct symbol *sym) {
+    if (sym->index < 0) {
+        if (c->quiet) return 0;
+        sym->index = program_add_function(c->prog, sym->name);
+        c->prog->functions[sym->index].internal = sym->internal;
+    }
+    return sym->index;
+}
+
+static uint32_t global_index(struct compiler *c, struct symbol *sym) {
+    if (sym->index < 0) {
+        if (c->quiet) return 0;
+        sym->index = program_add_global(c->prog, sym->name);
+        c->prog->globals[sym->index].internal = sym->internal;
+    }
+    return sym->index;
+}
+
+static struct type *record_lookup(const struct compiler *c, uint32_t node) {
+    if (!c->records_capacity) return NULL;
+    for (size_t i = node & (c->records_capacity - 1);;
+         i = (i + 1) & (c->records_capacity - 1)) {
+        if (c->records[i].node == node) return c->records[i].type;
+        if (!c->records[i].node) return NULL;
+    }
+}
+
+static void record_add(struct compiler *c, uint32_t node, struct type *type) {
+    if ((c->num_records + 1) * 2 > c->records_capacity) {
+        const struct record_entry *const old = c->records;
+        const size_t old_capacity = c->records_capacity;
+
+        c->records_capacity = old_capacity ? old_capacity * 2 : 64;
+        c->records = calloc(c->records_capacity, sizeof(struct record_entry));
+        c->num_records = 0;
+        for (size_t i = 0; i < old_capacity; i++)
+            if (old[i].node) record_add(c, old[i].node, old[i].type);
+        free((void *)old);
+    }
+    for (size_t i = node & (c->records_capacity - 1);;
+         i = (i + 1) & (c->records_capacity - 1)) {
+        if (!c->records[i].node) {
+            c->records[i].node = node;
+            c->records[i].type = type;
+            c->num_records++;
+            return;
+        }
+    }
+}
+
+static struct type *resolve_type(struct compiler *c, uint32_t node) {
+    struct type *type;
+
+    set_token(c, node);
+    switch (node_kind(c, node)) {
+    case AST_DECL_SPEC:
+        return spec_type(c, node);
+    case AST_POINTER:
+        return type_pointer(c->arena, resolve_type(c, lhs_of(c, node)));
+    case AST_ARRAY: {
+        struct type *const elem = resolve_type(c, lhs_of(c, node));
+        int64_t len;
+
+        if (elem->incomplete || elem->kind == TYPE_VOID
+            || elem->kind == TYPE_FUNCTION) {
+            error(c, "array type has incomplete element type '%s'",
+                  spell(c, elem));
+            return type_array(c->arena, &type_int, 0, true);
+        }
+        if (!rhs_of(c, node)) return type_array(c->arena, elem, 0, true);
+        len = eval_int(c, rhs_of(c, node));
+        if (len < 0) {
+            error(c, "size of array is negative");
+            len = 0;
+        }
+        return type_array(c->arena, elem, len, false);
+    }
+    case AST_FUNCTION:
+    case AST_FUNCTION_VARIADIC:
+    case AST_FUNCTION_NO_PROTOTYPE: {
+        const uint32_t list = rhs_of(c, node);
+        const size_t n = ast_list_len(c->ast, list);
+        struct type **params = NULL;
+        struct type *ret = resolve_type(c, lhs_of(c, node));
+
+        set_token(c, node);
+        if (ret->kind == TYPE_ARRAY || ret->kind == TYPE_FUNCTION) {
+            error(c, "function cannot return '%s'", spell(c, ret));
+            ret = &type_int;
+        }
+        if (n) params = malloc(sizeof(struct type *) * n);
+        for (size_t i = 0; i < n; i++) {
+            const uint32_t param = ast_list(c->ast, list)[i];
+
+            params[i] = adjust_param(c, resolve_type(c, lhs_of(c, param)));
+            if (params[i]->kind == TYPE_VOID) {
+                set_token(c, param);
+                error(c, "parameter has incomplete type 'void'");
+                params[i] = &type_int;
+            }
+        }
+        type = type_function(c->arena, ret, params, n,
+                             node_kind(c, node) == AST_FUNCTION_VARIADIC,
+                             node_kind(c, node) != AST_FUNCTION_NO_PROTOTYPE);
+        free(params);
+        return type;
+    }
+    default:
+        error(c, "expected type");
+        return &type_int;
+    }
+}
+
+static struct type *spec_type(struct compiler *c, uint32_t node) {
+    const uint32_t flags = lhs_of(c, node) & AST_SPEC_TYPES;
+    const uint32_t ref = rhs_of(c, node);
+    const bool is_unsigned = flags & AST_SPEC_UNSIGNED;
+
+    if (ref) {
+        const struct symbol *sym;
+
+        switch (node_kind(c, ref)) {
+        case AST_STRUCT:
+        case AST_UNION:
+            return record_type(c, ref);
+        case AST_ENUM:
+            return enum_type(c, ref);
+        default:
+            sym = c->symbols[ast_token(c->ast, ref)->atom];
+            if (!sym || sym->kind != SYMBOL_TYPEDEF) {
+                set_token(c, ref);
+                error(c, "unknown type name '%s'",
+                      atom_spelling(ast_token(c->ast, ref)->atom));
+                return &type_int;
+            }
+            return sym->type;
+        }
+    }
+
+    if (flags & AST_SPEC_COMPLEX) error(c, "complex types are not supported");
+    if (flags & AST_SPEC_VOID) return &type_void;
+    if (flags & AST_SPEC_BOOL) return &type_bool;
+    if (flags & AST_SPEC_CHAR)
+        return flags & AST_SPEC_SIGNED ? &type_schar
+               : is_unsigned ? &type_uchar : &type_char;
+    if (flags & AST_SPEC_SHORT)
+        return is_unsigned ? &type_ushort : &type_short;
+    if (flags & AST_SPEC_LONG_LONG)
+        return is_unsigned ? &type_ullong : &type_llong;
+    if (flags & AST_SPEC_DOUBLE)
+        return flags & AST_SPEC_LONG ? &type_ldouble : &type_double;
+    if (flags & AST_SPEC_FLOAT) return &type_float;
+    if (flags & AST_SPEC_LONG) return is_unsigned ? &type_ulong : &type_long;
+    return is_unsigned ? &type_uint : &type_int;
+}
+
+/* Type of a structure or union specifier. One with a member list declares
+   its tag in the current scope, completing an incomplete type declared
+   there before; one without refers to the visible declaration of its tag,
+   or declares it incomplete. */
+static struct type *record_type(struct compiler *c, uint32_t node) {
+    const uint32_t tag_token = lhs_of(c, node);
+    const uint32_t tag = tag_token == AST_NO_TOKEN
+                         ? ATOM_NONE : c->toks[tag_token].atom;
+    const enum type_kind kind = node_kind(c, node) == AST_STRUCT
+                                ? TYPE_STRUCT : TYPE_UNION;
+    const uint32_t list = rhs_of(c, node);
+    struct member *members;
+    size_t num_members = 0;
+    struct type *type;
+
+    if (!list) {
+        if (tag != ATOM_NONE && c->tags[tag]) {
+            if (c->tags[tag]->kind != kind)
+                error(c, "'%s' defined as wrong kind of tag",
+                      atom_spelling(tag));
+            return c->tags[tag];
+        }
+        type = type_record(c->arena, kind, tag);
+        if (tag != ATOM_NONE) bind_tag(c, tag, type);
+        return type;
+    }
+    if ((type = record_lookup(c, node))) return type;
+
+    if (tag != ATOM_NONE && tag_in_scope(c, tag)
+        && c->tags[tag]->kind == kind && c->tags[tag]->incomplete) {
+        type = c->tags[tag];
+    } else {
+        if (tag != ATOM_NONE && tag_in_scope(c, tag))
+            error(c, "redefinition of '%s %s'",
+                  kind == TYPE_STRUCT ? "struct" : "union",
+                  atom_spelling(tag));
+        type = type_record(c->arena, kind, tag);
+        if (tag != ATOM_NONE) bind_tag(c, tag, type);
+    }
+    record_add(c, node, type);
+
+    members = malloc(sizeof(struct member) * ast_list_len(c->ast, list));
+    for (size_t i = 0; i < ast_list_len(c->ast, list); i++) {
+        const uint32_t field = ast_list(c->ast, list)[i];
+        const uint32_t name = c->ast->tokens[field];
+        struct member *const m = &members[num_members];
+        const bool last = i + 1 == ast_list_len(c->ast, list);
+
+        if (node_kind(c, field) == AST_STATIC_ASSERT) {
+            compile_static_assert(c, field);
+            continue;
+        }
+        m->type = resolve_type(c, lhs_of(c, field));
+        m->name = name == AST_NO_TOKEN ? ATOM_NONE : c->toks[name].atom;
+        m->offset = 0;
+        set_token(c, field);
+        if (rhs_of(c, field)) {
+            error(c, "bit-fields are not supported");
+            continue;
+        }
+        if (m->name == ATOM_NONE && !type_is_record(m->type)) {
+            error(c, "declaration does not declare anything");
+            continue;
+        }
+        if (m->type->kind == TYPE_FUNCTION) {
+            error(c, "field '%s' declared as a function",
+                  atom_spelling(m->name));
+            continue;
+        }
+        /* A flexible array member takes no room. */
+        if (m->type->incomplete
+            && !(m->type->kind == TYPE_ARRAY && last && kind == TYPE_STRUCT
+                 && num_members)) {
+            error(c, "field has incomplete type '%s'", spell(c, m->type));
+            continue;
+        }
+        num_members++;
+    }
+    type_complete(type, c->arena, members, num_members);
+    free(members);
+    return type;
+}
+
+/* Enumerations have type int, as do their constants. */
+static struct type *enum_type(struct compiler *c, uint32_t node) {
+    const uint32_t tag_token = lhs_of(c, node);
+    const uint32_t tag = tag_token == AST_NO_TOKEN
+                         ? ATOM_NONE : c->toks[tag_token].atom;
+    const uint32_t list = rhs_of(c, node);
+    int64_t value = 0;
+
+    if (!list || record_lookup(c, node)) return &type_int;
+    record_add(c, node, &type_int);
+    if (tag != ATOM_NONE) bind_tag(c, tag, &type_int);
+
+    for (size_t i = 0; i < ast_list_len(c->ast, list); i++) {
+        const uint32_t e = ast_list(c->ast, list)[i];
+        const uint32_t name = ast_token(c->ast, e)->atom;
+        struct symbol *sym;
+
+        if (lhs_of(c, e)) value = eval_int(c, lhs_of(c, e));
+        set_token(c, e);
+        if (value < INT32_MIN || value > INT32_MAX)
+            error(c, "enumerator value for '%s' is not an integer constant "
+                  "in range of int", atom_spelling(name));
+        sym = new_symbol(c, SYMBOL_ENUM_CONST, &type_int, name);
+        sym->index = (int32_t)value;
+        bind(c, name, sym);
+        value++;
+    }
+    return &type_int;
+}
+
+/* Parameters of array and function type are adjusted to pointers. */
+static struct type *adjust_param(struct compiler *c, struct type *type) {
+    if (type->kind == TYPE_ARRAY) return type_pointer(c->arena, type->base);
+    if (type->kind == TYPE_FUNCTION) return type_pointer(c->arena, type);
+    return type;
+}
+
+static void compile_external(struct compiler *c, uint32_t node,
+                             uint32_t prev) {
+    set_token(c, node);
+    switch (node_kind(c, node)) {
+    case AST_FUNC_DEF:
+        compile_function(c, node, prev);
+        break;
+    case AST_DECL:
+        compile_global(c, node);
+        break;
+    case AST_TYPEDEF:
+        compile_typedef(c, node);
+        break;
+    case AST_TAG_DECL:
+        resolve_type(c, lhs_of(c, node));
+        break;
+    case AST_STATIC_ASSERT:
+        compile_static_assert(c, node);
+        break;
+    default:
+        error(c, "expected declaration");
+        break;
+    }
+}
+
+/* Compile the definition of a function, whose nodes, with those of its
+   declaration specifiers, are all after prev. */
+static void compile_function(struct compiler *c, uint32_t node,
+                             uint32_t prev) {
+    const uint32_t type_node = lhs_of(c, node);
+    const uint32_t name = ast_token(c->ast, node)->atom;
+    const uint32_t params = rhs_of(c, type_node);
+    struct type *const type = resolve_type(c, type_node);
+    struct function_state fs;
+    struct symbol *sym;
+    struct function *fn;
+    size_t mark;
+    size_t old_scope;
+    uint32_t first_param;
+
+    set_token(c, node);
+    sym = declare_linkage(c, name, type,
+                          decl_flags(c, type_node) & AST_SPEC_STATIC);
+    if (sym->defined) error(c, "redefinition of '%s'", atom_spelling(name));
+    sym->defined = true;
+    if (type->variadic) {
+        error(c, "definitions of variadic functions are not supported");
+        return;
+    }
+    if (type->base->incomplete) {
+        error(c, "return type is an incomplete type");
+        return;
+    }
+
+    /* Variables whose address is taken live in the frame. */
+    for (uint32_t i = prev + 1; i < node; i++)
+        if (node_kind(c, i) == AST_ADDR
+            && node_kind(c, lhs_of(c, i)) == AST_IDENT)
+            c->addressed[ast_token(c->ast, lhs_of(c, i))->atom] = true;
+
+    memset(&fs, 0, sizeof(fs));
+    fs.index = function_index(c, sym);
+    fs.type = type;
+    fs.sret_reg = -1;
+    c->fn = &fs;
+    fs.start = here(c);
+    fs.slots = c->prog->num_frame_slots;
+    if (type_is_record(type->base)) fs.sret_reg = temp(c);
+    first_param = fs.next_reg;
+    for (size_t i = 0; i < type->len; i++) temp(c);
+    fs.frame_reg = temp(c);
+    fs.var_top = fs.next_reg;
+    emit(c, OP_NOP, 0, 0, 0);
+
+    mark = scope_begin(c);
+    old_scope = c->scope;
+    c->scope = mark;
+    for (size_t i = 0; i < type->len; i++) {
+        const uint32_t param = ast_list(c->ast, params)[i];
+        const uint32_t reg = first_param + i;
+        struct type *const t = type->params[i];
+        struct symbol *p;
+        uint32_t pname;
+
+        if (c->ast->tokens[param] == AST_NO_TOKEN) continue;
+        pname = ast_token(c->ast, param)->atom;
+        set_token(c, param);
+        if (type_is_record(t) || c->addressed[pname]) {
+            const uint32_t offset = alloc_frame(c, t, pname);
+            struct value dst;
+
+            memset(&dst, 0, sizeof(dst));
+            dst.kind = VALUE_LOCAL;
+            dst.type = t;
+            dst.offset = offset;
+            if (type_is_record(t))
+                copy_object(c, to_reg(c, address_of(c, dst)), reg, t->size);
+            else
+                store(c, dst, reg_value(t, reg));
+            p = new_symbol(c, SYMBOL_LOCAL, t, pname);
+            p->index = offset;
+        } else {
+            p = new_symbol(c, SYMBOL_REGISTER, t, pname);
+            p->index = reg;
+        }
+        bind(c, pname, p);
+        end_statement(c);
+    }
+
+    compile_compound(c, rhs_of(c, node));
+
+    /* Falling off the end of main returns 0. */
+    set_token(c, node);
+    if (name == atom_lookup("main", 4)) {
+        emit_imm(c, OP_LOADI, fs.var_top, 0);
+        emit(c, OP_RET, fs.var_top, 0, 0);
+        if (fs.num_regs <= fs.var_top) fs.num_regs = fs.var_top + 1;
+    } else {
+        emit(c, OP_RET_VOID, 0, 0, 0);
+    }
+    for (size_t i = 0; i < fs.num_labels; i++) {
+        if (fs.labels[i].target < 0) {
+            c->token = fs.labels[i].token;
+            error(c, "label '%s' used but not defined",
+                  atom_spelling(fs.labels[i].atom));
+        }
+    }
+    scope_end(c, mark);
+    c->scope = old_scope;
+
+    fn = &c->prog->functions[fs.index];
+    fn->defined = true;
+    fn->num_params = first_param + type->len;
+    fn->num_regs = fs.num_regs;
+    fn->frame_size = (fs.frame_size + 15) & ~15u;
+    fn->code = fs.start;
+    fn->code_len = here(c) - fs.start;
+    fn->slots = fs.slots;
+    fn->num_slots = c->prog->num_frame_slots - fs.slots;
+    if (fs.uses_frame) {
+        struct insn *const insn = &c->prog->code[fs.start];
+
+        insn->op = OP_ADDR_LOCAL;
+        insn->a = fs.frame_reg;
+        insn->imm = 0;
+    } else {
+        fn->code++;
+        fn->code_len--;
+    }
+
+    for (uint32_t i = prev + 1; i < node; i++)
+        if (node_kind(c, i) == AST_ADDR
+            && node_kind(c, lhs_of(c, i)) == AST_IDENT)
+            c->addressed[ast_token(c->ast, lhs_of(c, i))->atom] = false;
+    free(fs.labels);
+    c->fn = NULL;
+}
+
+static void compile_global(struct compiler *c, uint32_t node) {
+    const uint32_t type_node = lhs_of(c, node);
+    const uint32_t init = rhs_of(c, node);
+    const uint32_t flags = decl_flags(c, type_node);
+    uint32_t name;
+    struct type *type = resolve_type(c, type_node);
+    struct symbol *sym;
+    struct global *g;
+
+    set_token(c, node);
+    if (c->ast->tokens[node] == AST_NO_TOKEN) return;
+    name = ast_token(c->ast, node)->atom;
+    if (type->kind == TYPE_FUNCTION) {
+        if (init) error(c, "function '%s' is initialized like a variable",
+                        atom_spelling(name));
+        declare_linkage(c, name, type, flags & AST_SPEC_STATIC);
+        return;
+    }
+    if (init && type->kind == TYPE_ARRAY && type->incomplete)
+        type = complete_array(c, type, init);
+    sym = declare_linkage(c, name, type, flags & AST_SPEC_STATIC);
+    if ((flags & AST_SPEC_EXTERN) && !init) return;
+
+    type = sym->type;
+    if (type->incomplete) {
+        /* A tentative definition of an array of unknown length defines one
+           element. */
+        if (type->kind != TYPE_ARRAY) {
+            error(c, "storage size of '%s' isn't known", atom_spelling(name));
+            return;
+        }
+        type = sym->type = type_array(c->arena, type->base, 1, false);
+    }
+    if (!sym->defined) {
+        const uint32_t index = global_index(c, sym);
+        const uint32_t offset = program_alloc_data(c->prog, type->size,
+                                                   type->align);
+
+        g = &c->prog->globals[index];
+        g->defined = true;
+        g->offset = offset;
+        g->size = type->size;
+        g->elem_size = elem_size(type);
+        sym->defined = true;
+    }
+    if (init) {
+        struct init_target t;
+
+        if (sym->initialized) {
+            error(c, "redefinition of '%s'", atom_spelling(name));
+            return;
+        }
+        sym->initialized = true;
+        t.global = true;
+        t.measure = false;
+        t.base = c->prog->globals[sym->index].offset;
+        init_object(c, &t, type, 0, init);
+    }
+}
+
+static void compile_local(struct compiler *c, uint32_t node) {
+    const uint32_t type_node = lhs_of(c, node);
+    const uint32_t init = rhs_of(c, node);
+    const uint32_t flags = decl_flags(c, type_node);
+    struct type *type = resolve_type(c, type_node);
+    struct symbol *sym;
+    uint32_t name;
+
+    set_token(c, node);
+    if (c->ast->tokens[node] == AST_NO_TOKEN) return;
+    name = ast_token(c->ast, node)->atom;
+    if (type->kind == TYPE_FUNCTION || (flags & AST_SPEC_EXTERN)) {
+        if (init) error(c, "'%s' has both 'extern' and initializer",
+                        atom_spelling(name));
+        declare_linkage(c, name, type, false);
+        return;
+    }
+    if (init && type->kind == TYPE_ARRAY && type->incomplete)
+        type = complete_array(c, type, init);
+
+    if (flags & AST_SPEC_STATIC) {
+        sym = new_symbol(c, SYMBOL_GLOBAL, type, name);
+        sym->index = static_object(c, &type, init, name);
+        sym->type = type;
+        sym->defined = true;
+        bind(c, name, sym);
+        return;
+    }
+    if (type->incomplete || type->kind == TYPE_VOID) {
+        error(c, "storage size of '%s' isn't known", atom_spelling(name));
+        return;
+    }
+
+    if (type_is_scalar(type) && !c->addressed[name]) {
+        sym = new_symbol(c, SYMBOL_REGISTER, type, name);
+        sym->index = temp(c);
+        c->fn->var_top = c->fn->next_reg;
+        bind(c, name, sym);
+        if (init) {
+            uint32_t expr = init;
+
+            if (node_kind(c, init) == AST_INIT_LIST) {
+                const uint32_t list = lhs_of(c, init);
+
+                if (ast_list_len(c->ast, list) != 1
+                    || node_kind(c, ast_list(c->ast, list)[0])
+                       == AST_DESIGNATION
+                    || node_kind(c, ast_list(c->ast, list)[0])
+                       == AST_INIT_LIST) {
+                    error(c, "invalid initializer for scalar '%s'",
+                          atom_spelling(name));
+                    return;
+                }
+                expr = ast_list(c->ast, list)[0];
+            }
+            move_to(c, sym->index,
+                    assign_convert(c, rvalue(c, compile_expr(c, expr)),
+                                   type));
+        }
+    } else {
+        sym = new_symbol(c, SYMBOL_LOCAL, type, name);
+        sym->index = alloc_frame(c, type, name);
+        bind(c, name, sym);
+        if (init) init_local(c, type, sym->index, init);
+    }
+    end_statement(c);
+}
+
+/* Declare a function or object with linkage, which refers to the same
+   entity in every scope it is declared in. */
+static struct symbol *declare_linkage(struct compiler *c, uint32_t name,
+                                      struct type *type, bool internal) {
+    struct symbol *sym = c->linkage[name];
+    const enum symbol_kind kind = type->kind == TYPE_FUNCTION
+                                  ? SYMBOL_FUNCTION : SYMBOL_GLOBAL;
+
+    if (sym) {
+        if (sym->kind != kind || !type_equal(sym->type, type)) {
+            error(c, "conflicting types for '%s'", atom_spelling(name));
+        } else if ((type->kind == TYPE_ARRAY && sym->type->incomplete)
+                   || (kind == SYMBOL_FUNCTION && type->prototyped
+                       && !sym->type->prototyped)) {
+            /* The later declaration completes the type. */
+            if (!sym->defined) sym->type = type;
+        }
+    } else {
+        sym = new_symbol(c, kind, type, name);
+        sym->internal = internal;
+        c->linkage[name] = sym;
+    }
+    bind(c, name, sym);
+    return sym;
+}
+
+static void compile_typedef(struct compiler *c, uint32_t node) {
+    struct type *const type = resolve_type(c, lhs_of(c, node));
+    const uint32_t name = ast_token(c->ast, node)->atom;
+
+    bind(c, name, new_symbol(c, SYMBOL_TYPEDEF, type, name));
+}
+
+static void compile_static_assert(struct compiler *c, uint32_t node) {
+    const int64_t value = eval_int(c, lhs_of(c, node));
+
+    set_token(c, node);
+    if (!value) {
+        const uint32_t msg = rhs_of(c, node);
+
+        if (msg != AST_NO_TOKEN && c->pp)
+            error(c, "static assertion failed: %.*s", (int)c->toks[msg].len,
+                  preprocessor_spelling(c->pp, &c->toks[msg]));
+        else
+            error(c, "static assertion failed");
+    }
+}
+
+/* Define an object with static storage duration and no linkage, returning
+   its global index, and completing *type from init. */
+static uint32_t static_object(struct compiler *c, struct type **type,
+                              uint32_t init, uint32_t name) {
+    struct init_target t;
+    uint32_t index;
+    struct function_state *const fn = c->fn;
+
+    if ((*type)->incomplete || (*type)->kind == TYPE_VOID) {
+        error(c, "storage size of '%s' isn't known",
+              name ? atom_spelling(name) : "compound literal");
+        return 0;
+    }
+    index = program_add_global(c->prog, name);
+    c->prog->globals[index].internal = true;
+    t.global = true;
+    t.measure = false;
+    t.base = program_alloc_data(c->prog, (*type)->size, (*type)->align);
+    c->prog->globals[index].defined = true;
+    c->prog->globals[index].offset = t.base;
+    c->prog->globals[index].size = (*type)->size;
+    c->prog->globals[index].elem_size = elem_size(*type);
+    /* The initializer is constant, as if at file scope. */
+    c->fn = NULL;
+    if (init) init_object(c, &t, *type, 0, init);
+    c->fn = fn;
+    return index;
+}
+
+/* Complete an array of unknown length from the elements of init. */
+static struct type *complete_array(struct compiler *c, struct type *type,
+                                   uint32_t init) {
+    struct init_target t;
+    size_t len;
+
+    t.global = false;
+    t.measure = true;
+    t.base = 0;
+    len = init_object(c, &t, type, 0, init);
+    return type_array(c->arena, type->base, len, false);
+}
+
+/* Initialize an object at offset of the frame. An aggregate is cleared
+   first, so that only the elements given need be stored. */
+static void init_local(struct compiler *c, struct type *type,
+                       uint32_t offset, uint32_t init) {
+    struct init_target t;
+
+    if (!type_is_scalar(type)
+        && (node_kind(c, init) == AST_INIT_LIST
+            || is_string_init(c, type, init))) {
+        const uint32_t mark = c->fn->next_reg;
+        const uint32_t r = temp(c);
+
+        emit_addr_local(c, r, offset);
+        emit_imm(c, OP_ZERO, r, type->size);
+        c->fn->next_reg = mark;
+    }
+    t.global = false;
+    t.measure = false;
+    t.base = offset;
+    init_object(c, &t, type, 0, init);
+}
+
+/* Initialize the object of type at offset from the target with init.
+   Returns the number of elements initialized if it is an array. */
+static size_t init_object(struct compiler *c, struct init_target *t,
+                          struct type *type, size_t offset, uint32_t init) {
+    if (init) set_token(c, init);
+    if (node_kind(c, init) == AST_INIT_LIST) {
+        const uint32_t list = lhs_of(c, init);
+        const size_t n = ast_list_len(c->ast, list);
+        const uint32_t *const items = ast_list(c->ast, list);
+        size_t pos = 0;
+
+        if (type_is_scalar(type)) {
+            if (n > 1) error(c, "excess elements in scalar initializer");
+            if (n && node_kind(c, items[0]) == AST_DESIGNATION) {
+                set_token(c, items[0]);
+                error(c, "designator in initializer for scalar type");
+            } else {
+                init_object(c, t, type, offset, n ? items[0] : 0);
+            }
+            return 0;
+        }
+        if (n == 1 && is_string_init(c, type, items[0]))
+            return init_string(c, t, type, offset, items[0]);
+        if (!type_is_record(type) && type->kind != TYPE_ARRAY) {
+            error(c, "invalid initializer");
+            return 0;
+        }
+        return init_items(c, t, type, offset, items, n, &pos, true);
+    }
+    if (init && is_string_init(c, type, init))
+        return init_string(c, t, type, offset, init);
+    if (type->kind == TYPE_ARRAY) {
+        error(c, "array must be initialized with a brace-enclosed "
+              "initializer");
+        return 0;
+    }
+    init_scalar(c, t, type, offset, init);
+    return 0;
+}
+
+/* Initialize the elements of an aggregate from items[*pos, n), up to the
+   end of the list if braced, or else, as when its braces are elided, until
+   it is full or a designator is reached. Returns its length if an array. */
+static size_t init_items(struct compiler *c, struct init_target *t,
+                         struct type *type, size_t offset,
+                         const uint32_t *items, size_t n, size_t *pos,
+                         bool braced) {
+    const bool is_array = type->kind == TYPE_ARRAY;
+    const size_t limit = is_array ? (type->incomplete ? SIZE_MAX : type->len)
+                         : type->num_members;
+    size_t index = 0;
+    size_t len = 0;
+
+    while (*pos < n) {
+        const uint32_t item = items[*pos];
+        struct type *elem;
+        size_t elem_offset;
+
+        set_token(c, item);
+        if (node_kind(c, item) == AST_DESIGNATION) {
+            const uint32_t desigs = lhs_of(c, item);
+            const uint32_t d = ast_list(c->ast, desigs)[0];
+            size_t skip = 1;
+
+            /* The designator belongs to the enclosing list. */
+            if (!braced) break;
+            set_token(c, d);
+            if (is_array) {
+                const int64_t i = node_kind(c, d) == AST_DESIG_INDEX
+                                  ? eval_int(c, lhs_of(c, d)) : -1;
+
+                if (node_kind(c, d) != AST_DESIG_INDEX) {
+                    error(c, "field name not in record or union "
+                          "initializer");
+                    return len;
+                }
+                if (i < 0 || (size_t)i >= limit) {
+                    error(c, "array index in initializer exceeds array "
+                          "bounds");
+                    return len;
+                }
+                index = i;
+                elem = type->base;
+                elem_offset = index * elem->size;
+            } else {
+                const uint32_t name = ast_token(c->ast, d)->atom;
+                size_t off;
+
+                if (node_kind(c, d) != AST_DESIG_FIELD) {
+                    error(c, "array index in non-array initializer");
+                    return len;
+                }
+                for (index = 0; index < type->num_members; index++) {
+                    const struct member *const m = &type->members[index];
+
+                    if (m->name == name) break;
+                    /* A member of an anonymous member is designated
+                       through it. */
+                    if (m->name == ATOM_NONE
+                        && type_member(m->type, name, &off)) {
+                        skip = 0;
+                        break;
+                    }
+                }
+                if (index == type->num_members) {
+                    error(c, "unknown field '%s' specified in initializer",
+                          atom_spelling(name));
+                    return len;
+                }
+                elem = type->members[index].type;
+                elem_offset = type->members[index].offset;
+            }
+            init_designated(c, t, elem, offset + elem_offset,
+                            ast_list(c->ast, desigs) + skip,
+                            ast_list_len(c->ast, desigs) - skip,
+                            rhs_of(c, item));
+            (*pos)++;
+        } else {
+            if (index >= limit) {
+                if (braced) {
+                    error(c, "excess elements in %s initializer",
+                          is_array ? "array" : type->kind == TYPE_STRUCT
+                          ? "struct" : "union");
+                    *pos = n;
+                }
+                break;
+            }
+            if (is_array) {
+                elem = type->base;
+                elem_offset = index * elem->size;
+            } else {
+                elem = type->members[index].type;
+                elem_offset = type->members[index].offset;
+            }
+            if (elem->incomplete) {
+                error(c, "initialization of flexible array member");
+                *pos = n;
+                break;
+            }
+            init_element(c, t, elem, offset + elem_offset, items, n, pos);
+        }
+        index++;
+        if (index > len) len = index;
+        /* Only one member of a union is initialized. */
+        if (type->kind == TYPE_UNION) index = limit;
+    }
+    return len;
+}
+
+/* Initialize a subobject with the next items, the braces of an aggregate
+   around them being optional. */
+static void init_element(struct compiler *c, struct init_target *t,
+                         struct type *type, size_t offset,
+                         const uint32_t *items, size_t n, size_t *pos) {
+    const uint32_t item = items[*pos];
+
+    if (node_kind(c, item) == AST_INIT_LIST || type_is_scalar(type)
+        || is_string_init(c, type, item)
+        || (type_is_record(type) && type_of(c, item) == type)) {
+        init_object(c, t, type, offset, item);
+        (*pos)++;
+        return;
+    }
+    init_items(c, t, type, offset, items, n, pos, false);
+}
+
+/* Initialize the subobject designated by the rest of a designation. */
+static void init_designated(struct compiler *c, struct init_target *t,
+                            struct type *type, size_t offset,
+                            const uint32_t *desigs, size_t num_desigs,
+                            uint32_t init) {
+    size_t pos = 0;
+
+    for (size_t i = 0; i < num_desigs; i++) {
+        const uint32_t d = desigs[i];
+
+        set_token(c, d);
+        if (node_kind(c, d) == AST_DESIG_INDEX) {
+            int64_t index;
+
+            if (type->kind != TYPE_ARRAY) {
+                error(c, "array index in non-array initializer");
+                return;
+            }
+            index = eval_int(c, lhs_of(c, d));
+            if (index < 0 || (!type->incomplete && (size_t)index
+                                                   >= type->len)) {
+                error(c, "array index in initializer exceeds array bounds");
+                return;
+            }
+            type = type->base;
+            offset += index * type->size;
+        } else {
+            const uint32_t name = ast_token(c->ast, d)->atom;
+            const struct member *m;
+            size_t off;
+
+            if (!type_is_record(type)
+                || !(m = type_member(type, name, &off))) {
+                error(c, "unknown field '%s' specified in initializer",
+                      atom_spelling(name));
+                return;
+            }
+            type = m->type;
+            offset += off;
+        }
+    }
+    init_element(c, t, type, offset, &init, 1, &pos);
+}
+
+/* Initialize a scalar, or a structure or union from an expression of its
+   type; with 0 for init, to zero. */
+static void init_scalar(struct compiler *c, struct init_target *t,
+                        struct type *type, size_t offset, uint32_t init) {
+    if (t->measure) return;
+
+    if (t->global) {
+        struct value v = init ? eval_const(c, init, type)
+                         : int_const(type, 0);
+        uint8_t *const p = c->prog->data + t->base + offset;
+
+        if (v.kind != VALUE_CONST) return;
+        if (v.base != BASE_NONE) {
+            if (type->size != 8) {
+                error(c, "initializer element is not computable at load "
+                      "time");
+                return;
+            }
+            program_add_reloc(c->prog, t->base + offset,
+                              v.base == BASE_GLOBAL ? RELOC_GLOBAL
+                              : RELOC_FUNCTION, v.index, v.u);
+        } else if (type->kind == TYPE_FLOAT) {
+            const float f = v.d;
+
+            memcpy(p, &f, 4);
+        } else if (type_is_floating(type)) {
+            memcpy(p, &v.d, 8);
+        } else {
+            /* Little-endian, as the host is. */
+            memcpy(p, &v.u, type->size);
+        }
+    } else {
+        const uint32_t mark = c->fn->next_reg;
+        struct value dst;
+        struct value v;
+
+        memset(&dst, 0, sizeof(dst));
+        dst.kind = VALUE_LOCAL;
+        dst.type = type;
+        dst.offset = t->base + offset;
+        v = init ? rvalue(c, compile_expr(c, init)) : int_const(type, 0);
+        store(c, dst, assign_convert(c, v, type));
+        c->fn->next_reg = mark;
+    }
+}
+
+/* Initialize an array of characters from a string literal. Returns its
+   length, with the terminating null character. */
+static size_t init_string(struct compiler *c, struct init_target *t,
+                          struct type *type, size_t offset, uint32_t init) {
+    struct string buf;
+    struct type *elem;
+    size_t len;
+    size_t n;
+
+    string_init(&buf);
+    len = decode_string(c, init, &buf, &elem);
+    if (t->measure) {
+        string_destroy(&buf);
+        return len;
+    }
+    n = len;
+    if (!type->incomplete && n > type->len) {
+        /* The null character is dropped if there is no room for it. */
+        if (n - 1 > type->len)
+            error(c, "initializer-string for array is too long");
+        n = type->len;
+    }
+    if (t->global) {
+        memcpy(c->prog->data + t->base + offset, buf.arr, n * elem->size);
+    } else if (n) {
+        const uint32_t mark = c->fn->next_reg;
+        const uint32_t dst = temp(c);
+        const uint32_t src = temp(c);
+
+        emit_addr_local(c, dst, t->base + offset);
+        emit_imm(c, OP_ADDR_GLOBAL, src,
+                 string_global(c, &buf, elem->align));
+        copy_object(c, dst, src, n * elem->size);
+        c->fn->next_reg = mark;
+    }
+    string_destroy(&buf);
+    return len;
+}
+
+/* Whether init is a string literal initializing an array of type. */
+static bool is_string_init(const struct compiler *c, struct type *type,
+                           uint32_t init) {
+    struct type *elem;
+
+    if (type->kind != TYPE_ARRAY || node_kind(c, init) != AST_STRING)
+        return false;
+    return type_is_integer(type->base)
+           && type->base->size == prefix_size(c, c->ast->tokens[init],
+                                              &elem);
+}
+
+static void compile_stmt(struct compiler *c, uint32_t node) {
+    struct function_state *const fn = c->fn;
+
+    set_token(c, node);
+    switch (node_kind(c, node)) {
+    case AST_COMPOUND:
+        compile_compound(c, node);
+        break;
+    case AST_EXPR_STMT:
+        if (lhs_of(c, node)) compile_void(c, lhs_of(c, node));
+        end_statement(c);
+        break;
+    case AST_IF:
+        compile_if(c, node);
+        break;
+    case AST_SWITCH:
+        compile_switch(c, node);
+        break;
+    case AST_WHILE:
+    case AST_DO:
+    case AST_FOR:
+        compile_loop(c, node);
+        break;
+    case AST_GOTO:
+        compile_goto(c, node);
+        break;
+    case AST_CONTINUE:
+        if (!fn->continues)
+            error(c, "continue statement not within a loop");
+        else
+            *fn->continues = emit_jump(c, OP_JMP, 0, *fn->continues);
+        break;
+    case AST_BREAK:
+        if (!fn->breaks)
+            error(c, "break statement not within loop or switch");
+        else
+            *fn->breaks = emit_jump(c, OP_JMP, 0, *fn->breaks);
+        break;
+    case AST_RETURN:
+        compile_return(c, node);
+        break;
+    case AST_LABEL:
+        compile_label(c, node);
+        break;
+    case AST_CASE:
+    case AST_DEFAULT:
+        compile_case(c, node);
+        break;
+    case AST_DECL:
+        compile_local(c, node);
+        break;
+    case AST_DECL_LIST:
+        for (size_t i = 0; i < ast_list_len(c->ast, lhs_of(c, node)); i++)
+            compile_stmt(c, ast_list(c->ast, lhs_of(c, node))[i]);
+        break;
+    case AST_TYPEDEF:
+        compile_typedef(c, node);
+        break;
+    case AST_TAG_DECL:
+        resolve_type(c, lhs_of(c, node));
+        break;
+    case AST_STATIC_ASSERT:
+        compile_static_assert(c, node);
+        break;
+    default:
+        error(c, "expected statement");
+        break;
+    }
+}
+
+/* A block releases the registers and frame memory of its variables at its
+   end, for the blocks after it to reuse. */
+static void compile_compound(struct compiler *c, uint32_t node) {
+    struct function_state *const fn = c->fn;
+    const uint32_t list = lhs_of(c, node);
+    const size_t mark = scope_begin(c);
+    const size_t old_scope = c->scope;
+    const uint32_t var_top = fn->var_top;
+    const uint32_t frame_top = fn->frame_top;
+
+    c->scope = mark;
+    for (size_t i = 0; i < ast_list_len(c->ast, list); i++)
+        compile_stmt(c, ast_list(c->ast, list)[i]);
+    scope_end(c, mark);
+    c->scope = old_scope;
+    fn->var_top = var_top;
+    fn->next_reg = var_top;
+    fn->frame_top = frame_top;
+}
+
+static void compile_if(struct compiler *c, uint32_t node) {
+    const uint32_t pair = rhs_of(c, node);
+    const uint32_t then = c->ast->extra[pair];
+    const uint32_t otherwise = c->ast->extra[pair + 1];
+    int32_t chain = jump_if(c, lhs_of(c, node), false);
+
+    end_statement(c);
+    compile_stmt(c, then);
+    if (otherwise) {
+        const int32_t skip = emit_jump(c, OP_JMP, 0, -1);
+
+        patch(c, chain, here(c));
+        compile_stmt(c, otherwise);
+        chain = skip;
+    }
+    patch(c, chain, here(c));
+}
+
+/* A switch jumps through a table of its cases, sorted by value, which is
+   searched by bisection. */
+static int compare_cases(const void *a, const void *b) {
+    const int64_t x = ((const struct switch_case *)a)->value;
+    const int64_t y = ((const struct switch_case *)b)->value;
+
+    return x < y ? -1 : x > y;
+}
+
+static void compile_switch(struct compiler *c, uint32_t node) {
+    struct function_state *const fn = c->fn;
+    int32_t *const old_breaks = fn->breaks;
+    struct switch_state *const old_sw = fn->sw;
+    struct switch_state sw;
+    int32_t breaks = -1;
+    struct value v = rvalue(c, compile_expr(c, lhs_of(c, node)));
+    uint32_t insn;
+    uint32_t end;
+
+    if (!type_is_integer(v.type)) {
+        error(c, "switch quantity not an integer");
+        v = int_const(&type_int, 0);
+    }
+    memset(&sw, 0, sizeof(sw));
+    sw.type = type_promote(v.type);
+    sw.default_target = -1;
+    v = convert(c, v, sw.type);
+    insn = emit_imm(c, OP_SWITCH, to_reg(c, v), 0);
+    end_statement(c);
+
+    fn->breaks = &breaks;
+    fn->sw = &sw;
+    compile_stmt(c, rhs_of(c, node));
+    fn->breaks = old_breaks;
+    fn->sw = old_sw;
+
+    end = here(c);
+    patch(c, breaks, end);
+    mark_target(c);
+    qsort(sw.cases, sw.num_cases, sizeof(struct switch_case), compare_cases);
+    for (size_t i = 0; i < sw.num_cases; i++) {
+        if (i && sw.cases[i].value == sw.cases[i - 1].value) {
+            set_token(c, node);
+            error(c, "duplicate case value '%lld'",
+                  (long long)sw.cases[i].value);
+        }
+        sw.cases[i].target -= insn;
+    }
+    if (insn != UINT32_MAX)
+        c->prog->code[insn].imm = program_add_switch(
+            c->prog, sw.cases, sw.num_cases,
+            (sw.default_target >= 0 ? (uint32_t)sw.default_target : end)
+            - insn);
+    free(sw.cases);
+}
+
+static void compile_case(struct compiler *c, uint32_t node) {
+    struct switch_state *const sw = c->fn->sw;
+
+    if (!sw) {
+        error(c, "%s label not within a switch statement",
+              node_kind(c, node) == AST_CASE ? "case" : "'default'");
+    } else if (node_kind(c, node) == AST_CASE) {
+        const int64_t value = eval_int(c, lhs_of(c, node));
+
+        if (sw->num_cases == sw->cases_capacity) {
+            sw->cases_capacity = sw->cases_capacity
+                                 ? sw->cases_capacity * 2 : 16;
+            sw->cases = realloc(sw->cases, sizeof(struct switch_case)
+                                           * sw->cases_capacity);
+        }
+        sw->cases[sw->num_cases].value = truncate_int(sw->type, value);
+        sw->cases[sw->num_cases].target = here(c);
+        sw->num_cases++;
+    } else {
+        if (sw->default_target >= 0)
+            error(c, "multiple default labels in one switch");
+        sw->default_target = here(c);
+    }
+    mark_target(c);
+    compile_stmt(c, node_kind(c, node) == AST_CASE ? rhs_of(c, node)
+                                                  : lhs_of(c, node));
+}
+
+/* Loops test their condition at the bottom, so that each iteration takes
+   one conditional jump. */
+static void compile_loop(struct compiler *c, uint32_t node) {
+    struct function_state *const fn = c->fn;
+    const enum ast_kind kind = node_kind(c, node);
+    int32_t *const old_breaks = fn->breaks;
+    int32_t *const old_continues = fn->continues;
+    int32_t breaks = -1;
+    int32_t continues = -1;
+    uint32_t cond = 0;
+    uint32_t step = 0;
+    uint32_t body;
+    int32_t entry = -1;
+    uint32_t top;
+    const size_t mark = scope_begin(c);
+    const size_t old_scope = c->scope;
+    const uint32_t var_top = fn->var_top;
+    const uint32_t frame_top = fn->frame_top;
+
+    if (kind == AST_FOR) {
+        const uint32_t triple = lhs_of(c, node);
+        const uint32_t init = c->ast->extra[triple];
+
+        c->scope = mark;
+        if (init && node_kind(c, init) == AST_DECL_LIST) {
+            compile_stmt(c, init);
+        } else if (init) {
+            compile_void(c, init);
+            end_statement(c);
+        }
+        cond = c->ast->extra[triple + 1];
+        step = c->ast->extra[triple + 2];
+        body = rhs_of(c, node);
+    } else if (kind == AST_WHILE) {
+        cond = lhs_of(c, node);
+        body = rhs_of(c, node);
+    } else {
+        cond = rhs_of(c, node);
+        body = lhs_of(c, node);
+    }
+
+    if (kind != AST_DO && cond) entry = emit_jump(c, OP_JMP, 0, -1);
+    top = here(c);
+    mark_target(c);
+    fn->breaks = &breaks;
+    fn->continues = &continues;
+    compile_stmt(c, body);
+    fn->breaks = old_breaks;
+    fn->continues = old_continues;
+
+    patch(c, continues, here(c));
+    set_token(c, node);
+    if (step) {
+        compile_void(c, step);
+        end_statement(c);
+    }
+    patch(c, entry, here(c));
+    if (cond) patch(c, jump_if(c, cond, true), top);
+    else emit_jump_to(c, OP_JMP, 0, top);
+    end_statement(c);
+    patch(c, breaks, here(c));
+
+    if (kind == AST_FOR) {
+        scope_end(c, mark);
+        c->scope = old_scope;
+        fn->var_top = var_top;
+        fn->next_reg = var_top;
+        fn->frame_top = frame_top;
+    }
+}
+
+static void compile_return(struct compiler *c, uint32_t node) {
+    struct function_state *const fn = c->fn;
+    struct type *const ret = fn->type->base;
+    const uint32_t expr = lhs_of(c, node);
+    struct value v;
+
+    if (!expr) {
+        if (ret->kind != TYPE_VOID)
+            error(c, "'return' with no value, in function returning "
+                  "non-void");
+        emit(c, OP_RET_VOID, 0, 0, 0);
+        return;
+    }
+    if (ret->kind == TYPE_VOID) {
+        v = rvalue(c, compile_expr(c, expr));
+        if (v.kind != VALUE_VOID)
+            error(c, "'return' with a value, in function returning void");
+        emit(c, OP_RET_VOID, 0, 0, 0);
+    } else if (type_is_record(ret)) {
+        v = assign_convert(c, rvalue(c, compile_expr(c, expr)), ret);
+        copy_object(c, fn->sret_reg, to_reg(c, address_of(c, v)),
+                    ret->size);
+        emit(c, OP_RET_VOID, 0, 0, 0);
+    } else {
+        v = assign_convert(c, rvalue(c, compile_expr(c, expr)), ret);
+        emit(c, OP_RET, to_reg(c, v), 0, 0);
+    }
+    end_statement(c);
+}
+
+static void compile_goto(struct compiler *c, uint32_t node) {
+    struct label *const l = find_label(c, ast_token(c->ast, node)->atom);
+
+    if (l->target >= 0) emit_jump_to(c, OP_JMP, 0, l->target);
+    else l->jumps = emit_jump(c, OP_JMP, 0, l->jumps);
+}
+
+static void compile_label(struct compiler *c, uint32_t node) {
+    struct label *const l = find_label(c, ast_token(c->ast, node)->atom);
+
+    if (l->target >= 0) {
+        error(c, "duplicate label '%s'", atom_spelling(l->atom));
+    } else {
+        l->target = here(c);
+        l->token = c->token;
+        patch(c, l->jumps, l->target);
+        mark_target(c);
+    }
+    compile_stmt(c, lhs_of(c, node));
+}
+
+static struct label *find_label(struct compiler *c, uint32_t atom) {
+    struct function_state *const fn = c->fn;
+    struct label *l;
+
+    for (size_t i = 0; i < fn->num_labels; i++)
+        if (fn->labels[i].atom == atom) return &fn->labels[i];
+    if (fn->num_labels == fn->labels_capacity) {
+        fn->labels_capacity = fn->labels_capacity
+                              ? fn->labels_capacity * 2 : 8;
+        fn->labels = realloc(fn->labels,
+                             sizeof(struct label) * fn->labels_capacity);
+    }
+    l = &fn->labels[fn->num_labels++];
+    l->atom = atom;
+    l->token = c->token;
+    l->target = -1;
+    l->jumps = -1;
+    return l;
+}
+
+/* Temporaries do not outlive the statement they are used in. */
+static void end_statement(struct compiler *c) {
+    c->fn->next_reg = c->fn->var_top;
+}
+
+static struct value compile_expr(struct compiler *c, uint32_t node) {
+    static struct type *const int_types[] = {
+        &type_int, &type_uint, &type_long, &type_ulong, &type_llong,
+        &type_ullong,
+    };
+    const struct token *tok;
+    struct value v;
+
+    set_token(c, node);
+    switch (node_kind(c, node)) {
+    case AST_IDENT:
+        return compile_ident(c, node);
+    case AST_INT_CONST:
+        tok = ast_token(c->ast, node);
+        return int_const(int_types[tok->const_type], tok->int_value);
+    case AST_FLOAT_CONST:
+        tok = ast_token(c->ast, node);
+        v = int_const(tok->const_type == CONST_FLOAT ? &type_float
+                      : tok->const_type == CONST_DOUBLE ? &type_double
+                      : &type_ldouble, 0);
+        v.d = tok->const_type == CONST_FLOAT ? (float)tok->float_value
+              : tok->float_value;
+        return v;
+    case AST_CHAR_CONST:
+        return compile_char(c, node);
+    case AST_STRING:
+        return compile_string(c, node);
+    case AST_CALL:
+        return compile_call(c, node);
+    case AST_INDEX:
+        v = pointer_add(c, rvalue(c, compile_expr(c, lhs_of(c, node))),
+                        rvalue(c, compile_expr(c, rhs_of(c, node))), false);
+        set_token(c, node);
+        return deref(c, v);
+    case AST_MEMBER:
+    case AST_PTR_MEMBER:
+        return compile_member(c, node);
+    case AST_COMPOUND_LITERAL:
+        return compile_compound_literal(c, node);
+    case AST_POST_INC:
+    case AST_POST_DEC:
+    case AST_PRE_INC:
+    case AST_PRE_DEC:
+        return compile_incdec(c, node, true);
+    case AST_ADDR:
+    case AST_DEREF:
+    case AST_PLUS:
+    case AST_NEG:
+    case AST_BIT_NOT:
+    case AST_NOT:
+    case AST_SIZEOF_EXPR:
+    case AST_SIZEOF_TYPE:
+    case AST_ALIGNOF:
+        return compile_unary(c, node);
+    case AST_CAST:
+        return compile_cast(c, node);
+    case AST_LOG_AND:
+    case AST_LOG_OR:
+        return compile_logical(c, node);
+    case AST_COMMA:
+        compile_void(c, lhs_of(c, node));
+        return rvalue(c, compile_expr(c, rhs_of(c, node)));
+    case AST_COND:
+        return compile_cond(c, node);
+    default:
+        if (node_kind(c, node) >= AST_MUL && node_kind(c, node) <= AST_BIT_OR)
+            return compile_binary(c, node);
+        if (node_kind(c, node) >= AST_ASSIGN
+            && node_kind(c, node) <= AST_OR_ASSIGN)
+            return compile_assign(c, node);
+        error(c, "expected expression");
+        return int_const(&type_int, 0);
+    }
+}
+
+/* Compile an expression for its side effects only. */
+static void compile_void(struct compiler *c, uint32_t node) {
+    switch (node_kind(c, node)) {
+    case AST_POST_INC:
+    case AST_POST_DEC:
+        compile_incdec(c, node, false);
+        break;
+    case AST_COMMA:
+        compile_void(c, lhs_of(c, node));
+        compile_void(c, rhs_of(c, node));
+        break;
+    default:
+        compile_expr(c, node);
+        break;
+    }
+}
+
+/* Compile a condition into jumps taken if its truth is sense, returning
+   their chain; otherwise, execution falls through. */
+static int32_t jump_if(struct compiler *c, uint32_t node, bool sense) {
+    int32_t skip;
+    int32_t chain;
+
+    switch (node_kind(c, node)) {
+    case AST_LOG_AND:
+    case AST_LOG_OR:
+        /* a && b is true if both are, and a || b false if both are. */
+        if (sense == (node_kind(c, node) == AST_LOG_OR))
+            return join(c, jump_if(c, lhs_of(c, node), sense),
+                        jump_if(c, rhs_of(c, node), sense));
+        skip = jump_if(c, lhs_of(c, node), !sense);
+        chain = jump_if(c, rhs_of(c, node), sense);
+        patch(c, skip, here(c));
+        return chain;
+    case AST_NOT:
+        return jump_if(c, lhs_of(c, node), !sense);
+    default:
+        return jump_on(c, rvalue(c, compile_expr(c, node)), sense);
+    }
+}
+
+static int32_t jump_on(struct compiler *c, struct value v, bool sense) {
+    uint32_t r;
+
+    v = rvalue(c, v);
+    if (!type_is_scalar(v.type)) {
+        error(c, "used '%s' where scalar is required", spell(c, v.type));
+        return -1;
+    }
+    if (v.kind == VALUE_CONST)
+        return const_truth(&v) == sense ? emit_jump(c, OP_JMP, 0, -1) : -1;
+    if (type_is_floating(v.type)) v = convert(c, v, &type_bool);
+    r = to_reg(c, v);
+    return emit_jump(c, sense ? OP_JNZ : OP_JZ, r, -1);
+}
+
+static struct value compile_ident(struct compiler *c, uint32_t node) {
+    const uint32_t name = ast_token(c->ast, node)->atom;
+    struct symbol *const sym = c->symbols[name];
+    struct value v;
+
+    memset(&v, 0, sizeof(v));
+    if (!sym || sym->kind == SYMBOL_TYPEDEF) {
+        error(c, sym ? "unexpected type name '%s'" : "'%s' undeclared",
+              atom_spelling(name));
+        return int_const(&type_int, 0);
+    }
+    v.type = sym->type;
+    switch (sym->kind) {
+    case SYMBOL_ENUM_CONST:
+        return int_const(&type_int, sym->index);
+    case SYMBOL_FUNCTION:
+        v.kind = VALUE_FUNCTION;
+        v.index = function_index(c, sym);
+        break;
+    case SYMBOL_GLOBAL:
+        v.kind = VALUE_GLOBAL;
+        v.index = global_index(c, sym);
+        break;
+    case SYMBOL_REGISTER:
+        v.kind = VALUE_VAR;
+        v.reg = sym->index;
+        break;
+    default:
+        v.kind = VALUE_LOCAL;
+        v.offset = sym->index;
+        break;
+    }
+    return v;
+}
+
+/* A string literal is an anonymous global array. */
+static struct value compile_string(struct compiler *c, uint32_t node) {
+    struct string buf;
+    struct type *elem;
+    struct value v;
+    size_t len;
+
+    string_init(&buf);
+    len = decode_string(c, node, &buf, &elem);
+    memset(&v, 0, sizeof(v));
+    v.kind = VALUE_GLOBAL;
+    v.type = type_array(c->arena, elem, len, false);
+    if (!c->quiet) v.index = string_global(c, &buf, elem->align);
+    string_destroy(&buf);
+    return v;
+}
+
+/* Value of a character constant, as GCC gives it: a plain one is a char,
+   which is signed, and the characters of a multi-character one are packed
+   into an int. A wide one has the value of its last character. */
+static struct value compile_char(struct compiler *c, uint32_t node) {
+    const struct token *const tok = ast_token(c->ast, node);
+    const char *s = preprocessor_spelling(c->pp, tok);
+    const char *const end = s + tok->len - 1;
+    struct type *elem;
+    const size_t size = prefix_size(c, c->ast->tokens[node], &elem);
+    uint64_t value = 0;
+    size_t n = 0;
+
+    while (*s != '\'') s++;
+    s++;
+    while (s < end) {
+        bool universal;
+        const uint32_t ch = read_char(&s, end, size > 1, &universal);
+
+        if (size > 1) value = ch;
+        else if (n++ == 0) value = (int64_t)(signed char)ch;
+        else value = (int64_t)(int32_t)((uint32_t)value << 8 | (ch & 0xff));
+    }
+    return int_const(size > 1 ? elem : &type_int, value);
+}
+
+/* Arguments are evaluated, then moved into consecutive registers above the
+   temporaries, which become the first registers of the callee. A
+   structure argument is passed by address, and copied by the callee; one
+   returned is stored at an address passed before the arguments. */
+static struct value compile_call(struct compiler *c, uint32_t node) {
+    const uint32_t list = rhs_of(c, node);
+    const size_t n = ast_list_len(c->ast, list);
+    struct value f = compile_expr(c, lhs_of(c, node));
+    struct value *args;
+    uint8_t *classes;
+    struct type *ft;
+    struct type *ret;
+    struct value v;
+    uint32_t callee = 0;
+    uint32_t base;
+    uint32_t offset = 0;
+    uint32_t site;
+    size_t k = 0;
+
+    set_token(c, node);
+    if (f.kind == VALUE_FUNCTION) {
+        ft = f.type;
+    } else {
+        f = rvalue(c, f);
+        if (f.type->kind != TYPE_POINTER
+            || f.type->base->kind != TYPE_FUNCTION) {
+            error(c, "called object is not a function or function "
+                  "pointer");
+            return int_const(&type_int, 0);
+        }
+        ft = f.type->base;
+    }
+    ret = ft->base;
+    if (ft->prototyped && (n < ft->len || (n > ft->len && !ft->variadic))) {
+        error(c, "too %s arguments to function", n < ft->len ? "few"
+                                                              : "many");
+        return int_const(ret->kind == TYPE_VOID ? &type_int : ret, 0);
+    }
+    if (ret->incomplete && ret->kind != TYPE_VOID) {
+        error(c, "calling function with incomplete return type '%s'",
+              spell(c, ret));
+        return int_const(&type_int, 0);
+    }
+
+    args = malloc(sizeof(struct value) * (n + 1));
+    classes = malloc(n + 1);
+    for (size_t i = 0; i < n; i++) {
+        const uint32_t arg = ast_list(c->ast, list)[i];
+        struct type *type;
+
+        v = rvalue(c, compile_expr(c, arg));
+        set_token(c, arg);
+        if (ft->prototyped && i < ft->len) {
+            type = ft->params[i];
+        } else if (v.type->kind == TYPE_FLOAT) {
+            type = &type_double;
+        } else if (type_is_arithmetic(v.type)) {
+            type = type_promote(v.type);
+        } else {
+            type = v.type;
+        }
+        v = assign_convert(c, v, type);
+        if (type_is_record(type)) v = address_of(c, v);
+        if (v.kind == VALUE_VOID) {
+            error(c, "invalid use of void expression");
+            v = int_const(&type_int, 0);
+        }
+        classes[i] = value_class_of(type);
+        args[i] = v;
+    }
+    set_token(c, node);
+    if (f.kind != VALUE_FUNCTION) callee = to_reg(c, f);
+    if (type_is_record(ret)) offset = alloc_frame(c, ret, ATOM_NONE);
+
+    k = type_is_record(ret);
+    base = temp(c);
+    for (size_t i = 1; i < k + n; i++) temp(c);
+    if (k) emit_addr_local(c, base, offset);
+    for (size_t i = 0; i < n; i++) move_to(c, base + k + i, args[i]);
+    free(args);
+
+    if (c->no_code || !c->fn) {
+        c->emitted = true;
+    } else {
+        site = program_add_call_site(c->prog, f.kind == VALUE_FUNCTION
+                                              ? f.index : UINT32_MAX,
+                                     classes, n, value_class_of(ret));
+        if (f.kind == VALUE_FUNCTION) {
+            emit_imm(c, OP_CALL, base, site);
+        } else {
+            emit(c, OP_CALL_PTR, base, callee, 0);
+            emit_imm(c, OP_NOP, 0, site);
+        }
+    }
+    free(classes);
+    /* The arguments are dead, and the result is in base. */
+    if (c->fn) c->fn->next_reg = base + 1;
+
+    memset(&v, 0, sizeof(v));
+    v.type = ret;
+    if (ret->kind == TYPE_VOID) {
+        v.kind = VALUE_VOID;
+    } else if (type_is_record(ret)) {
+        v.kind = VALUE_LOCAL;
+        v.offset = offset;
+    } else {
+        v.kind = VALUE_REG;
+        v.reg = base;
+    }
+    return v;
+}
+
+static struct value compile_member(struct compiler *c, uint32_t node) {
+    const uint32_t name = c->toks[rhs_of(c, node)].atom;
+    struct value v = compile_expr(c, lhs_of(c, node));
+    const struct member *m;
+    size_t offset;
+
+    set_token(c, node);
+    if (node_kind(c, node) == AST_PTR_MEMBER) {
+        v = rvalue(c, v);
+        if (v.type->kind != TYPE_POINTER || !type_is_record(v.type->base)) {
+            error(c, "invalid type argument of '->' (have '%s')",
+                  spell(c, v.type));
+            return int_const(&type_int, 0);
+        }
+        v = deref(c, v);
+    }
+    if (!type_is_record(v.type)) {
+        error(c, "request for member '%s' in something not a structure or "
+              "union", atom_spelling(name));
+        return int_const(&type_int, 0);
+    }
+    if (v.type->incomplete) {
+        error(c, "invalid use of incomplete type '%s'", spell(c, v.type));
+        return int_const(&type_int, 0);
+    }
+    m = type_member(v.type, name, &offset);
+    if (!m) {
+        error(c, "'%s' has no member named '%s'", spell(c, v.type),
+              atom_spelling(name));
+        return int_const(&type_int, 0);
+    }
+    v.offset += offset;
+    v.type = m->type;
+    return v;
+}
+
+static struct value compile_unary(struct compiler *c, uint32_t node) {
+    const enum ast_kind kind = node_kind(c, node);
+    struct type *type;
+    struct value v;
+    uint32_t d;
+
+    switch (kind) {
+    case AST_SIZEOF_EXPR:
+    case AST_SIZEOF_TYPE:
+    case AST_ALIGNOF:
+        type = kind == AST_SIZEOF_EXPR ? type_of(c, lhs_of(c, node))
+               : resolve_type(c, lhs_of(c, node));
+        set_token(c, node);
+        if (type->incomplete || type->kind == TYPE_FUNCTION) {
+            error(c, "invalid application of '%s' to %s type '%s'",
+                  kind == AST_ALIGNOF ? "_Alignof" : "sizeof",
+                  type->kind == TYPE_FUNCTION ? "a function"
+                  : "incomplete", spell(c, type));
+            return int_const(&type_ulong, 1);
+        }
+        return int_const(&type_ulong, kind == AST_ALIGNOF ? type->align
+                                                           : type->size);
+    case AST_ADDR:
+        v = compile_expr(c, lhs_of(c, node));
+        set_token(c, node);
+        if (v.kind != VALUE_FUNCTION && !is_lvalue(&v)) {
+            error(c, "lvalue required as unary '&' operand");
+            return int_const(&type_int, 0);
+        }
+        return address_of(c, v);
+    default:
+        break;
+    }
+
+    v = rvalue(c, compile_expr(c, lhs_of(c, node)));
+    set_token(c, node);
+    if (kind == AST_DEREF) {
+        if (v.type->kind != TYPE_POINTER) {
+            error(c, "invalid type argument of unary '*' (have '%s')",
+                  spell(c, v.type));
+            return int_const(&type_int, 0);
+        }
+        return deref(c, v);
+    }
+    if (kind == AST_NOT) {
+        if (!type_is_scalar(v.type)) {
+            error(c, "invalid operand to unary '!' (have '%s')",
+                  spell(c, v.type));
+            return int_const(&type_int, 0);
+        }
+        if (v.kind == VALUE_CONST)
+            return int_const(&type_int, !const_truth(&v));
+        if (type_is_floating(v.type)) v = convert(c, v, &type_bool);
+        d = temp(c);
+        emit(c, OP_NOT, d, to_reg(c, v), 0);
+        return reg_value(&type_int, d);
+    }
+
+    if (!type_is_arithmetic(v.type)
+        || (kind == AST_BIT_NOT && !type_is_integer(v.type))) {
+        error(c, "wrong type argument to unary %s",
+              kind == AST_PLUS ? "plus" : kind == AST_NEG ? "minus"
+              : "complement");
+        return int_const(&type_int, 0);
+    }
+    type = type_promote(v.type);
+    v = convert(c, v, type);
+    if (kind == AST_PLUS) return v;
+    if (v.kind == VALUE_CONST) {
+        uint64_t wrapped;
+        int dir;
+
+        if (type_is_floating(type)) {
+            v.d = -v.d;
+            return v;
+        }
+        if (kind == AST_NEG && c->prog->overflow != OVERFLOW_NONE
+            && !type_is_unsigned(type)
+            && (dir = overflow_dir(AST_SUB, type_class(type), 0, v.u,
+                                   &wrapped)))
+            return int_const(type, fold_overflow(c, type, wrapped, dir));
+        return int_const(type, kind == AST_NEG ? -v.u : ~v.u);
+    }
+    d = temp(c);
+    if (kind == AST_NEG && c->prog->overflow != OVERFLOW_NONE
+        && (type->kind == TYPE_INT || type->kind == TYPE_LONG
+            || type->kind == TYPE_LLONG))
+        mark_checked(c, emit(c, type->size == 8 ? OP_NEGC_I64 : OP_NEGC_I32,
+                             d, to_reg(c, v), 0), type);
+    else
+        emit(c, (kind == AST_NEG ? OP_NEG_I32 : OP_BNOT_I32)
+                + type_class(type), d, to_reg(c, v), 0);
+    return reg_value(type, d);
+}
+
+/* Increment or decrement, whose old value is kept if postfix and used. */
+static struct value compile_incdec(struct compiler *c, uint32_t node,
+                                   bool used) {
+    const enum ast_kind kind = node_kind(c, node);
+    const bool sub = kind == AST_POST_DEC || kind == AST_PRE_DEC;
+    struct value lv = compile_expr(c, lhs_of(c, node));
+    struct value old;
+    struct value v;
+
+    set_token(c, node);
+    if (!is_lvalue(&lv) || !type_is_scalar(lv.type)) {
+        error(c, "lvalue required as %s operand",
+              sub ? "decrement" : "increment");
+        return int_const(&type_int, 0);
+    }
+    old = rvalue(c, lv);
+    if (used && (kind == AST_POST_INC || kind == AST_POST_DEC)
+        && lv.kind == VALUE_VAR) {
+        const uint32_t t = temp(c);
+
+        emit(c, OP_MOV, t, old.reg, 0);
+        old = reg_value(lv.type, t);
+    }
+    if (lv.type->kind == TYPE_POINTER)
+        v = pointer_add(c, old, int_const(&type_int, 1), sub);
+    else
+        v = arith(c, sub ? AST_SUB : AST_ADD, old, int_const(&type_int, 1));
+    v = store(c, lv, convert(c, v, lv.type));
+    return kind == AST_POST_INC || kind == AST_POST_DEC ? old : v;
+}
+
+static struct value compile_cast(struct compiler *c, uint32_t node) {
+    struct type *const type = resolve_type(c, lhs_of(c, node));
+    struct value v = rvalue(c, compile_expr(c, rhs_of(c, node)));
+
+    set_token(c, node);
+    if (type->kind == TYPE_VOID) return convert(c, v, type);
+    if (!type_is_scalar(type)) {
+        error(c, "conversion to non-scalar type requested");
+        return v;
+    }
+    if (!type_is_scalar(v.type)) {
+        error(c, "invalid cast from '%s'", spell(c, v.type));
+        return int_const(type, 0);
+    }
+    if ((type->kind == TYPE_POINTER && type_is_floating(v.type))
+        || (type_is_floating(type) && v.type->kind == TYPE_POINTER)) {
+        error(c, "cannot convert between pointer and floating types");
+        return int_const(type, 0);
+    }
+    return convert(c, v, type);
+}
+
+static struct value compile_binary(struct compiler *c, uint32_t node) {
+    const enum ast_kind kind = node_kind(c, node);
+    const struct value l = rvalue(c, compile_expr(c, lhs_of(c, node)));
+    const struct value r = rvalue(c, compile_expr(c, rhs_of(c, node)));
+    const bool lp = l.type->kind == TYPE_POINTER;
+    const bool rp = r.type->kind == TYPE_POINTER;
+
+    set_token(c, node);
+    switch (kind) {
+    case AST_ADD:
+        if (lp || rp) return pointer_add(c, l, r, false);
+        break;
+    case AST_SUB:
+        if (lp && rp) return pointer_diff(c, l, r);
+        if (lp) return pointer_add(c, l, r, true);
+        break;
+    case AST_LT:
+    case AST_GT:
+    case AST_LE:
+    case AST_GE:
+    case AST_EQ:
+    case AST_NE:
+        return compare(c, kind, l, r);
+    default:
+        break;
+    }
+    return arith(c, kind, l, r);
+}
+
+static struct value compile_assign(struct compiler *c, uint32_t node) {
+    static const enum ast_kind ops[] = {
+        AST_MUL, AST_DIV, AST_MOD, AST_ADD, AST_SUB, AST_SHL, AST_SHR,
+        AST_BIT_AND, AST_BIT_XOR, AST_BIT_OR,
+    };
+    const enum ast_kind kind = node_kind(c, node);
+    const struct value lv = compile_expr(c, lhs_of(c, node));
+    struct value v;
+
+    set_token(c, node);
+    if (!is_lvalue(&lv)) {
+        error(c, "lvalue required as left operand of assignment");
+        return int_const(&type_int, 0);
+    }
+    if (lv.type->kind == TYPE_ARRAY || lv.type->kind == TYPE_VOID
+        || lv.type->incomplete) {
+        error(c, "assignment to expression with %s type",
+              lv.type->kind == TYPE_ARRAY ? "array" : "incomplete");
+        return int_const(&type_int, 0);
+    }
+    if (kind == AST_ASSIGN) {
+        v = rvalue(c, compile_expr(c, rhs_of(c, node)));
+        set_token(c, node);
+        return store(c, lv, assign_convert(c, v, lv.type));
+    }
+
+    /* The object is only located once. */
+    {
+        const enum ast_kind op = ops[kind - AST_MUL_ASSIGN];
+        const struct value old = rvalue(c, lv);
+        const struct value r = rvalue(c, compile_expr(c, rhs_of(c, node)));
+
+        set_token(c, node);
+        if (lv.type->kind == TYPE_POINTER
+            && (op == AST_ADD || op == AST_SUB))
+            v = pointer_add(c, old, r, op == AST_SUB);
+        else
+            v = arith(c, op, old, r);
+        return store(c, lv, convert(c, v, lv.type));
+    }
+}
+
+/* Type of the result of a conditional operator with operands a and b. */
+static struct type *cond_type(struct compiler *c, const struct value *a,
+                              const struct value *b) {
+    struct type *const x = a->type;
+    struct type *const y = b->type;
+
+    if (type_is_arithmetic(x) && type_is_arithmetic(y))
+        return type_common(x, y);
+    if (x->kind == TYPE_VOID || y->kind == TYPE_VOID) return &type_void;
+    if (x == y) return x;
+    if (x->kind == TYPE_POINTER && is_null_const(b)) return x;
+    if (y->kind == TYPE_POINTER && is_null_const(a)) return y;
+    if (x->kind == TYPE_POINTER && y->kind == TYPE_POINTER) {
+        if (x->base->kind == TYPE_VOID) return x;
+        if (y->base->kind == TYPE_VOID) return y;
+        return x;
+    }
+    error(c, "type mismatch in conditional expression");
+    return x;
+}
+
+/* Both operands are moved into the same register; a structure is handled
+   by its address. */
+static struct value compile_cond(struct compiler *c, uint32_t node) {
+    const uint32_t pair = rhs_of(c, node);
+    const uint32_t second = c->ast->extra[pair];
+    const uint32_t third = c->ast->extra[pair + 1];
+    const struct value sv = peek(c, second);
+    const struct value tv = peek(c, third);
+    struct value cond = rvalue(c, compile_expr(c, lhs_of(c, node)));
+    struct type *type;
+    struct value v;
+    int32_t chain;
+    int32_t skip = -1;
+    uint32_t d;
+
+    set_token(c, node);
+    type = cond_type(c, &sv, &tv);
+    if (cond.kind == VALUE_CONST && type_is_scalar(cond.type)) {
+        v = rvalue(c, compile_expr(c, const_truth(&cond) ? second : third));
+        return convert(c, v, type);
+    }
+
+    d = type->kind == TYPE_VOID ? 0 : temp(c);
+    chain = jump_on(c, cond, false);
+    for (int i = 0; i < 2; i++) {
+        v = convert(c, rvalue(c, compile_expr(c, i ? third : second)), type);
+        if (type_is_record(type)) move_to(c, d, address_of(c, v));
+        else if (type->kind != TYPE_VOID) move_to(c, d, v);
+        if (!i) {
+            skip = emit_jump(c, OP_JMP, 0, -1);
+            patch(c, chain, here(c));
+        }
+    }
+    patch(c, skip, here(c));
+
+    memset(&v, 0, sizeof(v));
+    v.type = type;
+    if (type->kind == TYPE_VOID) {
+        v.kind = VALUE_VOID;
+    } else if (type_is_record(type)) {
+        v.kind = VALUE_MEM;
+        v.reg = d;
+    } else {
+        v.kind = VALUE_REG;
+        v.reg = d;
+    }
+    return v;
+}
+
+static struct value compile_logical(struct compiler *c, uint32_t node) {
+    const bool is_and = node_kind(c, node) == AST_LOG_AND;
+    struct value l = rvalue(c, compile_expr(c, lhs_of(c, node)));
+    struct value v;
+    int32_t chain;
+    int32_t skip;
+    uint32_t d;
+
+    set_token(c, node);
+    if (!type_is_scalar(l.type)) {
+        error(c, "used '%s' where scalar is required", spell(c, l.type));
+        return int_const(&type_int, 0);
+    }
+    /* Folded if constant, as in a constant expression. */
+    if (l.kind == VALUE_CONST) {
+        if (const_truth(&l) != is_and) return int_const(&type_int, !is_and);
+        v = rvalue(c, compile_expr(c, rhs_of(c, node)));
+        if (!type_is_scalar(v.type)) {
+            error(c, "used '%s' where scalar is required", spell(c, v.type));
+            return int_const(&type_int, 0);
+        }
+        if (v.kind == VALUE_CONST)
+            return int_const(&type_int, const_truth(&v));
+        v = convert(c, v, &type_bool);
+        v.type = &type_int;
+        return v;
+    }
+
+    d = temp(c);
+    chain = join(c, jump_on(c, l, !is_and),
+                 jump_if(c, rhs_of(c, node), !is_and));
+    emit_imm(c, OP_LOADI, d, is_and);
+    skip = emit_jump(c, OP_JMP, 0, -1);
+    patch(c, chain, here(c));
+    emit_imm(c, OP_LOADI, d, !is_and);
+    patch(c, skip, here(c));
+    return reg_value(&type_int, d);
+}
+
+/* A compound literal is an unnamed object: in the frame, or static at file
+   scope. */
+static struct value compile_compound_literal(struct compiler *c,
+                                            uint32_t node) {
+    const uint32_t init = rhs_of(c, node);
+    struct type *type = resolve_type(c, lhs_of(c, node));
+    struct value v;
+
+    set_token(c, node);
+    if (type->kind == TYPE_ARRAY && type->incomplete)
+        type = complete_array(c, type, init);
+    memset(&v, 0, sizeof(v));
+    if (!c->fn) {
+        v.kind = VALUE_GLOBAL;
+        v.index = c->quiet ? 0 : static_object(c, &type, init, ATOM_NONE);
+    } else if (type->incomplete || type->kind == TYPE_VOID) {
+        error(c, "compound literal has incomplete type '%s'",
+              spell(c, type));
+        return int_const(&type_int, 0);
+    } else {
+        v.kind = VALUE_LOCAL;
+        v.offset = alloc_frame(c, type, ATOM_NONE);
+        if (!c->no_code) init_local(c, type, v.offset, init);
+    }
+    v.type = type;
+    return v;
+}
+
+/* Arithmetic, bitwise, and shift operators, with the usual arithmetic
+   conversions, folded if both operands are constant. */
+static struct value arith(struct compiler *c, enum ast_kind kind,
+                          struct value l, struct value r) {
+    const bool integer = kind == AST_MOD || kind == AST_SHL
+                         || kind == AST_SHR || kind == AST_BIT_AND
+                         || kind == AST_BIT_XOR || kind == AST_BIT_OR;
+    const bool checked = c->prog->overflow != OVERFLOW_NONE;
+    struct type *type;
+    enum opcode op;
+    int cls;
+    uint32_t insn;
+    uint32_t a;
+    uint32_t b;
+    uint32_t d;
+
+    l = rvalue(c, l);
+    r = rvalue(c, r);
+    if (!type_is_arithmetic(l.type) || !type_is_arithmetic(r.type)
+        || (integer && (!type_is_integer(l.type)
+                        || !type_is_integer(r.type)))) {
+        error(c, "invalid operands to binary %s (have '%s' and '%s')",
+              op_name(kind), spell(c, l.type), spell(c, r.type));
+        return int_const(&type_int, 0);
+    }
+    if (kind == AST_SHL || kind == AST_SHR) {
+        type = type_promote(l.type);
+        r = convert(c, r, type_promote(r.type));
+    } else {
+        type = type_common(l.type, r.type);
+        r = convert(c, r, type);
+    }
+    l = convert(c, l, type);
+    cls = type_class(type);
+
+    if (l.kind == VALUE_CONST && r.kind == VALUE_CONST
+        && l.base == BASE_NONE && r.base == BASE_NONE) {
+        const unsigned bits = type->size * 8;
+        const bool is_unsigned = type_is_unsigned(type);
+        uint64_t wrapped;
+        int dir;
+
+        if (type_is_floating(type)) {
+            double x = kind == AST_ADD ? l.d + r.d : kind == AST_SUB
+                       ? l.d - r.d : kind == AST_MUL ? l.d * r.d : l.d / r.d;
+
+            l.d = type->kind == TYPE_FLOAT ? (float)x : x;
+            return l;
+        }
+        if (checked && (dir = overflow_dir(kind, cls, l.u, r.u, &wrapped)))
+            return int_const(type, fold_overflow(c, type, wrapped, dir));
+        switch (kind) {
+        case AST_ADD: return int_const(type, l.u + r.u);
+        case AST_SUB: return int_const(type, l.u - r.u);
+        case AST_MUL: return int_const(type, l.u * r.u);
+        case AST_DIV:
+        case AST_MOD:
+            if (!r.u) break;
+            if (is_unsigned)
+                return int_const(type, kind == AST_DIV ? l.u / r.u
+                                                       : l.u % r.u);
+            if ((int64_t)r.u == -1)
+                return int_const(type, kind == AST_DIV ? -l.u : 0);
+            return int_const(type, kind == AST_DIV
+                                   ? (int64_t)l.u / (int64_t)r.u
+                                   : (int64_t)l.u % (int64_t)r.u);
+        case AST_SHL: return int_const(type, l.u << (r.u & (bits - 1)));
+        case AST_SHR:
+            return int_const(type, is_unsigned ? l.u >> (r.u & (bits - 1))
+                             : (uint64_t)((int64_t)l.u >> (r.u & (bits - 1))));
+        case AST_BIT_AND: return int_const(type, l.u & r.u);
+        case AST_BIT_XOR: return int_const(type, l.u ^ r.u);
+        default: return int_const(type, l.u | r.u);
+        }
+    }
+
+    if (cls < 4 && (kind == AST_ADD || kind == AST_SUB
+                    || (kind == AST_MUL && !checked))) {
+        struct value *const k = r.kind == VALUE_CONST ? &r : &l;
+        const struct value *const x = k == &r ? &l : &r;
+        const int64_t n = kind == AST_SUB ? -(int64_t)k->u : (int64_t)k->u;
+
+        /* An operand fitting in 16 bits is an immediate. Checked, an
+           unsigned one must fit as it is, since the immediate is added as
+           a signed number. */
+        if (k->kind == VALUE_CONST && k->base == BASE_NONE
+            && (kind != AST_SUB || k == &r) && (kind != AST_MUL || cls >= 2)
+            && n >= INT16_MIN && n <= INT16_MAX
+            && (!checked || !(cls & 1) || k->u <= INT16_MAX)) {
+            a = to_reg(c, *x);
+            d = temp(c);
+            insn = emit(c, kind == AST_MUL ? OP_MULI_I64
+                        : (checked ? OP_ADDIC_I32 : OP_ADDI_I32) + cls, d, a,
+                        (uint16_t)n);
+            if (checked && kind != AST_MUL) mark_checked(c, insn, type);
+            return reg_value(type, d);
+        }
+    }
+
+    switch (kind) {
+    case AST_MUL: op = (checked && cls < 4 ? OP_MULC_I32 : OP_MUL_I32) + cls;
+        break;
+    case AST_DIV:
+        op = checked && (cls == 0 || cls == 2) ? OP_DIVC_I32 + cls / 2
+             : OP_DIV_I32 + cls;
+        break;
+    case AST_MOD: op = OP_MOD_I32 + cls; break;
+    case AST_ADD: op = (checked && cls < 4 ? OP_ADDC_I32 : OP_ADD_I32) + cls;
+        break;
+    case AST_SUB: op = (checked && cls < 4 ? OP_SUBC_I32 : OP_SUB_I32) + cls;
+        break;
+    case AST_SHL:
+        op = checked && (cls == 0 || cls == 2) ? OP_SHLC_I32 + cls / 2
+             : OP_SHL_I32 + cls;
+        break;
+    case AST_SHR: op = OP_SHR_I32 + cls; break;
+    case AST_BIT_AND: op = OP_AND; break;
+    case AST_BIT_XOR: op = OP_XOR; break;
+    default: op = OP_OR; break;
+    }
+    a = to_reg(c, l);
+    b = to_reg(c, r);
+    d = temp(c);
+    insn = emit(c, op, d, a, b);
+    if (op >= OP_ADDC_I32 && op <= OP_SHLC_I64) mark_checked(c, insn, type);
+    return reg_value(type, d);
+}
+
+/* Direction in which x op y, of integer class cls, overflows: 1 if above
+   the largest value of the type, -1 if below the smallest, and 0 if it
+   does not, storing the wrapped result into *r. Negation is 0 - y. Only
+   the operations that are checked are: unsigned division and shifts do
+   not overflow. */
+static int overflow_dir(enum ast_kind kind, int cls, uint64_t x, uint64_t y,
+                        uint64_t *r) {
+    const bool is_signed = !(cls & 1);
+    const unsigned bits = cls < 2 ? 32 : 64;
+    /* Signed operands, which are sign-extended in canonical form. */
+    const int64_t sx = (int64_t)x;
+    const int64_t sy = (int64_t)y;
+    bool overflow;
+
+#define OVERFLOWS(type)                                                     \
+    do {                                                                    \
+        type v;                                                             \
+        overflow = kind == AST_ADD ? __builtin_add_overflow((type)x, (type)y, \
+                                                            &v)             \
+                   : kind == AST_SUB ? __builtin_sub_overflow((type)x,      \
+                                                              (type)y, &v)  \
+                   : __builtin_mul_overflow((type)x, (type)y, &v);          \
+        *r = (uint64_t)(int64_t)v;                                          \
+    } while (0)
+
+    switch (kind) {
+    case AST_ADD:
+    case AST_SUB:
+    case AST_MUL:
+        switch (cls) {
+        case 0: OVERFLOWS(int32_t); break;
+        case 1: OVERFLOWS(uint32_t); break;
+        case 2: OVERFLOWS(int64_t); break;
+        default: OVERFLOWS(uint64_t); break;
+        }
+        if (!overflow) return 0;
+        if (kind == AST_MUL)
+            return is_signed && (sx < 0) != (sy < 0) ? -1 : 1;
+        if (!is_signed) return kind == AST_ADD ? 1 : -1;
+        return (sy < 0) == (kind == AST_ADD) ? -1 : 1;
+    case AST_DIV:
+        if (!is_signed || sy != -1 || x != overflow_limit(cls, -1)) return 0;
+        *r = x;
+        return 1;
+    case AST_SHL:
+        if (!is_signed || !x) return 0;
+        *r = bits == 32 ? (uint64_t)(int32_t)((uint32_t)x << (y & 31))
+                        : x << (y & 63);
+        if (y < bits && (int64_t)*r >> y == sx) return 0;
+        return sx < 0 ? -1 : 1;
+    default:
+        return 0;
+    }
+#undef OVERFLOWS
+}
+
+/* Value of a constant expression that overflows, by the policy. */
+static uint64_t fold_overflow(struct compiler *c, const struct type *type,
+                              uint64_t wrapped, int dir) {
+    switch (c->prog->overflow) {
+    case OVERFLOW_TRAP:
+        error(c, "integer overflow in constant expression of type '%s'",
+              spell(c, type));
+        return wrapped;
+    case OVERFLOW_WARN:
+        warning(c, "integer overflow in constant expression of type '%s'",
+                spell(c, type));
+        return wrapped;
+    case OVERFLOW_SATURATE:
+        return overflow_limit(type_class(type), dir);
+    default:
+        return wrapped;
+    }
+}
+
+/* Record the type of the checked instruction insn, for its diagnostics. */
+static void mark_checked(struct compiler *c, uint32_t insn,
+                         const struct type *type) {
+    if (insn != UINT32_MAX)
+        program_add_overflow_site(c->prog, insn, type->kind);
+}
+
+/* Relational and equality operators, which give an int. */
+static struct value compare(struct compiler *c, enum ast_kind kind,
+                            struct value l, struct value r) {
+    struct type *type;
+    enum opcode op;
+    uint32_t a;
+    uint32_t b;
+    uint32_t d;
+    bool result;
+
+    l = rvalue(c, l);
+    r = rvalue(c, r);
+    if (type_is_arithmetic(l.type) && type_is_arithmetic(r.type)) {
+        type = type_common(l.type, r.type);
+    } else if (l.type->kind == TYPE_POINTER
+               && (r.type->kind == TYPE_POINTER || is_null_const(&r))) {
+        type = l.type;
+    } else if (r.type->kind == TYPE_POINTER && is_null_const(&l)) {
+        type = r.type;
+    } else {
+        error(c, "invalid operands to binary %s (have '%s' and '%s')",
+              op_name(kind), spell(c, l.type), spell(c, r.type));
+        return int_const(&type_int, 0);
+    }
+    l = convert(c, l, type);
+    r = convert(c, r, type);
+    if (kind == AST_GT || kind == AST_GE) {
+        const struct value t = l;
+
+        l = r;
+        r = t;
+        kind = kind == AST_GT ? AST_LT : AST_LE;
+    }
+
+    if (l.kind == VALUE_CONST && r.kind == VALUE_CONST && l.base == r.base
+        && (l.base == BASE_NONE || l.index == r.index)) {
+        if (type_is_floating(type)) {
+            result = kind == AST_LT ? l.d < r.d : kind == AST_LE ? l.d <= r.d
+                     : kind == AST_EQ ? l.d == r.d : l.d != r.d;
+        } else if (kind == AST_EQ || kind == AST_NE) {
+            result = (l.u == r.u) == (kind == AST_EQ);
+        } else if (type_is_unsigned(type)) {
+            result = kind == AST_LT ? l.u < r.u : l.u <= r.u;
+        } else {
+            result = kind == AST_LT ? (int64_t)l.u < (int64_t)r.u
+                     : (int64_t)l.u <= (int64_t)r.u;
+        }
+        return int_const(&type_int, result);
+    }
+
+    /* Against zero, a test of truth. */
+    if ((kind == AST_EQ || kind == AST_NE) && !type_is_floating(type)) {
+        const struct value *const zero = is_null_const(&r) ? &r
+                                         : is_null_const(&l) ? &l : NULL;
+
+        if (zero) {
+            a = to_reg(c, zero == &r ? l : r);
+            d = temp(c);
+            emit(c, kind == AST_EQ ? OP_NOT : OP_BOOL, d, a, 0);
+            return reg_value(&type_int, d);
+        }
+    }
+    switch (kind) {
+    case AST_EQ: op = OP_EQ_I; break;
+    case AST_NE: op = OP_NE_I; break;
+    case AST_LT: op = OP_LT_I; break;
+    default: op = OP_LE_I; break;
+    }
+    /* Pointers may have tags if memory is checked. */
+    if (type->kind == TYPE_POINTER && c->prog->memory_checks)
+        op = OP_EQ_P + (op - OP_EQ_I) / 4;
+    else
+        op += compare_class(type);
+    a = to_reg(c, l);
+    b = to_reg(c, r);
+    d = temp(c);
+    emit(c, op, d, a, b);
+    return reg_value(&type_int, d);
+}
+
+/* Pointer plus or minus an integer, in units of the pointed-to type. */
+static struct value pointer_add(struct compiler *c, struct value ptr,
+                                struct value n, bool sub) {
+    struct type *elem;
+    size_t size;
+    uint32_t index;
+    uint32_t p;
+    uint32_t d;
+
+    ptr = rvalue(c, ptr);
+    n = rvalue(c, n);
+    if (!sub && n.type->kind == TYPE_POINTER) {
+        const struct value t = ptr;
+
+        ptr = n;
+        n = t;
+    }
+    if (ptr.type->kind != TYPE_POINTER || !type_is_integer(n.type)) {
+        error(c, "invalid operands to binary %s (have '%s' and '%s')",
+              sub ? "-" : "+", spell(c, ptr.type), spell(c, n.type));
+        return ptr;
+    }
+    elem = ptr.type->base;
+    if (elem->incomplete)
+        error(c, "arithmetic on a pointer to an incomplete type");
+    size = elem->kind == TYPE_VOID || elem->kind == TYPE_FUNCTION
+           ? 1 : elem->size;
+    n = convert(c, n, &type_long);
+
+    if (n.kind == VALUE_CONST) {
+        const int64_t offset = (int64_t)n.u * (int64_t)size
+                               * (sub ? -1 : 1);
+
+        if (ptr.kind == VALUE_CONST) {
+            ptr.u += offset;
+            return ptr;
+        }
+        if (!offset) return ptr;
+        return reg_value(ptr.type, add_offset(c, to_reg(c, ptr), offset));
+    }
+    index = to_reg(c, n);
+    if (size != 1) {
+        const uint32_t scaled = temp(c);
+
+        if (size <= INT16_MAX) {
+            emit(c, OP_MULI_I64, scaled, index, size);
+        } else {
+            const uint32_t k = temp(c);
+
+            load_const(c, k, &(struct value){.kind = VALUE_CONST,
+                                             .type = &type_long, .u = size});
+            emit(c, OP_MUL_I64, scaled, index, k);
+        }
+        index = scaled;
+    }
+    p = to_reg(c, ptr);
+    d = temp(c);
+    emit(c, sub ? OP_SUB_U64 : OP_ADD_U64, d, p, index);
+    return reg_value(ptr.type, d);
+}
+
+/* Difference of two pointers, in elements. */
+static struct value pointer_diff(struct compiler *c, struct value l,
+                                 struct value r) {
+    struct type *const elem = l.type->base;
+    const size_t size = elem->kind == TYPE_VOID
+                        || elem->kind == TYPE_FUNCTION ? 1 : elem->size;
+    uint32_t a;
+    uint32_t b;
+    uint32_t d;
+
+    if (!type_equal(elem, r.type->base)) {
+        error(c, "invalid operands to binary - (have '%s' and '%s')",
+              spell(c, l.type), spell(c, r.type));
+        return int_const(&type_long, 0);
+    }
+    if (!size) {
+        error(c, "arithmetic on a pointer to an incomplete type");
+        return int_const(&type_long, 0);
+    }
+    if (l.kind == VALUE_CONST && r.kind == VALUE_CONST && l.base == r.base
+        && (l.base == BASE_NONE || l.index == r.index))
+        return int_const(&type_long, (int64_t)(l.u - r.u) / (int64_t)size);
+    a = to_reg(c, l);
+    b = to_reg(c, r);
+    d = temp(c);
+    emit(c, c->prog->memory_checks ? OP_SUB_P : OP_SUB_I64, d, a, b);
+    if (size != 1) {
+        const uint32_t k = temp(c);
+        const uint32_t q = temp(c);
+
+        load_const(c, k, &(struct value){.kind = VALUE_CONST,
+                                         .type = &type_long, .u = size});
+        emit(c, OP_DIV_I64, q, d, k);
+        d = q;
+    }
+    return reg_value(&type_long, d);
+}
+
+/* Compile an expression without emitting code, defining anything, or
+   reporting errors, to learn its type and whether it is constant. */
+static struct value peek(struct compiler *c, uint32_t node) {
+    const uint32_t token = c->token;
+    const bool emitted = c->emitted;
+    const uint32_t next_reg = c->fn ? c->fn->next_reg : 0;
+    const uint32_t frame_top = c->fn ? c->fn->frame_top : 0;
+    struct value v;
+
+    c->quiet++;
+    c->no_code++;
+    v = rvalue(c, compile_expr(c, node));
+    c->quiet--;
+    c->no_code--;
+    c->emitted = emitted;
+    c->token = token;
+    if (c->fn) {
+        c->fn->next_reg = next_reg;
+        c->fn->frame_top = frame_top;
+    }
+    return v;
+}
+
+/* Type of an expression, which is not evaluated, as the operand of
+   sizeof: arrays keep their type. */
+static struct type *type_of(struct compiler *c, uint32_t node) {
+    const uint32_t token = c->token;
+    const bool emitted = c->emitted;
+    const uint32_t next_reg = c->fn ? c->fn->next_reg : 0;
+    const uint32_t frame_top = c->fn ? c->fn->frame_top : 0;
+    struct type *type;
+
+    c->quiet++;
+    c->no_code++;
+    type = compile_expr(c, node).type;
+    c->quiet--;
+    c->no_code--;
+    c->emitted = emitted;
+    c->token = token;
+    if (c->fn) {
+        c->fn->next_reg = next_reg;
+        c->fn->frame_top = frame_top;
+    }
+    return type;
+}
+
+static int64_t eval_int(struct compiler *c, uint32_t node) {
+    const struct value v = eval_const(c, node, NULL);
+
+    if (v.kind == VALUE_CONST && !type_is_integer(v.type)) {
+        set_token(c, node);
+        error(c, "expression is not an integer constant expression");
+        return 0;
+    }
+    return v.u;
+}
+
+/* Value of a constant expression, converted to type unless NULL. */
+static struct value eval_const(struct compiler *c, uint32_t node,
+                               struct type *type) {
+    const bool emitted = c->emitted;
+    const uint32_t next_reg = c->fn ? c->fn->next_reg : 0;
+    const int errors = c->errors;
+    struct value v;
+    bool constant;
+
+    c->no_code++;
+    c->emitted = false;
+    v = rvalue(c, compile_expr(c, node));
+    if (type) v = assign_convert(c, v, type);
+    constant = !c->emitted && v.kind == VALUE_CONST;
+    c->no_code--;
+    c->emitted = emitted;
+    if (c->fn) c->fn->next_reg = next_reg;
+    if (!constant) {
+        set_token(c, node);
+        if (c->errors == errors)
+            error(c, type ? "initializer element is not constant"
+                  : "expression is not an integer constant expression");
+        return int_const(type && type_is_scalar(type) ? type : &type_int, 0);
+    }
+    return v;
+}
+
+static struct value int_const(struct type *type, uint64_t u) {
+    struct value v;
+
+    memset(&v, 0, sizeof(v));
+    v.kind = VALUE_CONST;
+    v.type = type;
+    v.u = truncate_int(type, u);
+    return v;
+}
+
+static struct value reg_value(struct type *type, uint32_t reg) {
+    struct value v;
+
+    memset(&v, 0, sizeof(v));
+    v.kind = VALUE_REG;
+    v.type = type;
+    v.reg = reg;
+    return v;
+}
+
+static bool is_lvalue(const struct value *v) {
+    return v->kind == VALUE_VAR || v->kind == VALUE_MEM
+           || v->kind == VALUE_LOCAL || v->kind == VALUE_GLOBAL;
+}
+
+static bool is_null_const(const struct value *v) {
+    return v->kind == VALUE_CONST && v->base == BASE_NONE && !v->u
+           && (type_is_integer(v->type)
+               || (v->type->kind == TYPE_POINTER
+                   && v->type->base->kind == TYPE_VOID));
+}
+
+/* Value of an expression: an object is loaded, and an array or function
+   decays to its address. Structures and unions stay objects. */
+static struct value rvalue(struct compiler *c, struct value v) {
+    struct value r;
+    int16_t disp;
+    uint32_t base;
+    enum opcode op;
+
+    switch (v.kind) {
+    case VALUE_VOID:
+    case VALUE_CONST:
+    case VALUE_REG:
+        return v;
+    case VALUE_FUNCTION:
+        return address_of(c, v);
+    case VALUE_VAR:
+        return reg_value(v.type, v.reg);
+    default:
+        break;
+    }
+    if (v.type->kind == TYPE_ARRAY) {
+        r = address_of(c, v);
+        r.type = type_pointer(c->arena, v.type->base);
+        return r;
+    }
+    if (v.type->kind == TYPE_FUNCTION) return address_of(c, v);
+    if (type_is_record(v.type)) return v;
+    if (v.type->kind == TYPE_VOID) {
+        memset(&r, 0, sizeof(r));
+        r.kind = VALUE_VOID;
+        r.type = &type_void;
+        return r;
+    }
+
+    switch (v.type->size) {
+    case 1: op = type_is_unsigned(v.type) ? OP_LOAD_U8 : OP_LOAD_I8; break;
+    case 2: op = type_is_unsigned(v.type) ? OP_LOAD_U16 : OP_LOAD_I16; break;
+    case 4:
+        op = type_is_unsigned(v.type) || v.type->kind == TYPE_FLOAT
+             ? OP_LOAD_U32 : OP_LOAD_I32;
+        break;
+    default: op = OP_LOAD_64; break;
+    }
+    if (c->prog->memory_checks) op += OP_LOADC_I8 - OP_LOAD_I8;
+    base = mem_base(c, &v, &disp);
+    r = reg_value(v.type, temp(c));
+    emit(c, op, r.reg, base, (uint16_t)disp);
+    return r;
+}
+
+/* Register holding the value of v, loaded into a temporary if needed. */
+static uint32_t to_reg(struct compiler *c, struct value v) {
+    uint32_t r;
+
+    v = rvalue(c, v);
+    switch (v.kind) {
+    case VALUE_REG:
+        return v.reg;
+    case VALUE_CONST:
+        r = temp(c);
+        load_const(c, r, &v);
+        return r;
+    default:
+        error(c, v.kind == VALUE_VOID
+              ? "void value not ignored as it ought to be"
+              : "invalid use of '%s' value", spell(c, v.type));
+        return temp(c);
+    }
+}
+
+static void load_const(struct compiler *c, uint32_t dst,
+                       const struct value *v) {
+    uint64_t bits = v->u;
+
+    if (v->base == BASE_FUNCTION) {
+        emit_imm(c, OP_ADDR_FUNC, dst, v->index);
+        return;
+    }
+    if (v->base == BASE_GLOBAL) {
+        emit_imm(c, OP_ADDR_GLOBAL, dst, v->index);
+        if (!v->u) return;
+        if ((int64_t)v->u >= INT16_MIN && (int64_t)v->u <= INT16_MAX) {
+            emit(c, OP_ADDI_U64, dst, dst, (uint16_t)v->u);
+        } else {
+            const uint32_t k = temp(c);
+
+            load_const(c, k, &(struct value){.kind = VALUE_CONST,
+                                             .type = &type_long, .u = v->u});
+            emit(c, OP_ADD_U64, dst, dst, k);
+        }
+        return;
+    }
+
+    if (v->type->kind == TYPE_FLOAT) {
+        const float f = v->d;
+        uint32_t b;
+
+        memcpy(&b, &f, 4);
+        bits = b;
+    } else if (type_is_floating(v->type)) {
+        memcpy(&bits, &v->d, 8);
+    }
+    if ((int64_t)bits == (int32_t)bits) {
+        emit_imm(c, OP_LOADI, dst, (int32_t)bits);
+    } else if (c->no_code || !c->fn) {
+        c->emitted = true;
+    } else {
+        emit_imm(c, OP_LOADK, dst, program_add_constant(c->prog, bits));
+    }
+}
+
+static bool const_truth(const struct value *v) {
+    if (v->base != BASE_NONE) return true;
+    return type_is_floating(v->type) ? v->d != 0 : v->u != 0;
+}
+
+/* Convert a value to type, as by a cast, folding constants. */
+static struct value convert(struct compiler *c, struct value v,
+                            struct type *type) {
+    struct type *from;
+    enum opcode op;
+    uint32_t r;
+    uint32_t d;
+
+    v = rvalue(c, v);
+    from = v.type;
+    if (type->kind == TYPE_VOID) {
+        memset(&v, 0, sizeof(v));
+        v.kind = VALUE_VOID;
+        v.type = &type_void;
+        return v;
+    }
+    if (v.kind == VALUE_VOID) {
+        error(c, "void value not ignored as it ought to be");
+        return int_const(type_is_scalar(type) ? type : &type_int, 0);
+    }
+    if (type_is_record(type) || type_is_record(from)) {
+        if (type != from)
+            error(c, "incompatible types when converting '%s' to '%s'",
+                  spell(c, from), spell(c, type));
+        return v;
+    }
+    if (type == from) return v;
+
+    if (v.kind == VALUE_CONST && v.base != BASE_NONE) {
+        if (type->kind == TYPE_BOOL) return int_const(type, 1);
+        if (type->size == 8 && !type_is_floating(type)) {
+            v.type = type;
+            return v;
+        }
+    } else if (v.kind == VALUE_CONST) {
+        if (type_is_floating(type)) {
+            double x = type_is_floating(from) ? v.d
+                       : type_is_unsigned(from) && from->size == 8
+                       ? (double)v.u : (double)(int64_t)v.u;
+
+            v.type = type;
+            v.d = type->kind == TYPE_FLOAT ? (float)x : x;
+            return v;
+        }
+        if (type_is_floating(from)) {
+            if (type->kind == TYPE_BOOL) return int_const(type, v.d != 0);
+            if (type_is_unsigned(type) && type->size == 8)
+                return int_const(type, (uint64_t)v.d);
+            return int_const(type, (int64_t)v.d);
+        }
+        return int_const(type, v.u);
+    }
+
+    r = to_reg(c, v);
+    if (type->kind == TYPE_BOOL) {
+        if (from->kind == TYPE_BOOL) return reg_value(type, r);
+        op = from->kind == TYPE_FLOAT ? OP_BOOL_F32
+             : type_is_floating(from) ? OP_BOOL_F64 : OP_BOOL;
+    } else if (type_is_floating(type)) {
+        const bool u64 = type_is_unsigned(from) && from->size == 8;
+
+        if (type_is_floating(from)) {
+            if ((from->kind == TYPE_FLOAT) == (type->kind == TYPE_FLOAT))
+                return reg_value(type, r);
+            op = from->kind == TYPE_FLOAT ? OP_F32_TO_F64 : OP_F64_TO_F32;
+        } else if (type->kind == TYPE_FLOAT) {
+            op = u64 ? OP_U64_TO_F32 : OP_I64_TO_F32;
+        } else {
+            op = u64 ? OP_U64_TO_F64 : OP_I64_TO_F64;
+        }
+    } else {
+        if (type_is_floating(from)) {
+            const bool u64 = type_is_unsigned(type) && type->size == 8;
+
+            d = temp(c);
+            if (from->kind == TYPE_FLOAT)
+                emit(c, u64 ? OP_F32_TO_U64 : OP_F32_TO_I64, d, r, 0);
+            else
+                emit(c, u64 ? OP_F64_TO_U64 : OP_F64_TO_I64, d, r, 0);
+            r = d;
+            from = u64 ? &type_ulong : &type_long;
+        }
+        op = int_conversion(from, type);
+        if (op == OP_NOP) return reg_value(type, r);
+    }
+    d = temp(c);
+    emit(c, op, d, r, 0);
+    return reg_value(type, d);
+}
+
+/* Conversion as if by assignment, which checks the types. */
+static struct value assign_convert(struct compiler *c, struct value v,
+                                   struct type *type) {
+    struct type *from;
+
+    v = rvalue(c, v);
+    from = v.type;
+    if (v.kind == VALUE_VOID) {
+        error(c, "void value not ignored as it ought to be");
+        return int_const(type_is_scalar(type) ? type : &type_int, 0);
+    }
+    if (type_is_arithmetic(type) && type_is_arithmetic(from))
+        return convert(c, v, type);
+    if (type->kind == TYPE_POINTER) {
+        if (from->kind == TYPE_POINTER || is_null_const(&v))
+            return convert(c, v, type);
+        error(c, type_is_integer(from)
+              ? "initialization of '%s' from '%s' makes pointer from "
+                "integer without a cast"
+              : "incompatible types when converting to '%s' from '%s'",
+              spell(c, type), spell(c, from));
+        return int_const(type, 0);
+    }
+    if (type->kind == TYPE_BOOL && from->kind == TYPE_POINTER)
+        return convert(c, v, type);
+    if (type_is_integer(type) && from->kind == TYPE_POINTER) {
+        error(c, "initialization of '%s' from '%s' makes integer from "
+              "pointer without a cast", spell(c, type), spell(c, from));
+        return int_const(type, 0);
+    }
+    if (type != from) {
+        error(c, "incompatible types when converting to '%s' from '%s'",
+              spell(c, type), spell(c, from));
+        return type_is_scalar(type) ? int_const(type, 0) : v;
+    }
+    return v;
+}
+
+/* Extension that converts an integer in canonical form to another type, or
+   OP_NOP if it is already in canonical form for it. */
+static enum opcode int_conversion(const struct type *from,
+                                  const struct type *to) {
+    const bool from_unsigned = type_is_unsigned(from);
+    const bool to_unsigned = type_is_unsigned(to);
+
+    if (to->size == 8) return OP_NOP;
+    if (from->size < to->size && (from_unsigned || !to_unsigned))
+        return OP_NOP;
+    if (from->size == to->size && from_unsigned == to_unsigned)
+        return OP_NOP;
+    switch (to->size) {
+    case 1: return to_unsigned ? OP_ZEXT8 : OP_SEXT8;
+    case 2: return to_unsigned ? OP_ZEXT16 : OP_SEXT16;
+    default: return to_unsigned ? OP_ZEXT32 : OP_SEXT32;
+    }
+}
+
+static struct value address_of(struct compiler *c, struct value v) {
+    struct value r;
+
+    memset(&r, 0, sizeof(r));
+    r.type = type_pointer(c->arena, v.type);
+    switch (v.kind) {
+    case VALUE_FUNCTION:
+        r.kind = VALUE_CONST;
+        r.base = BASE_FUNCTION;
+        r.index = v.index;
+        return r;
+    case VALUE_GLOBAL:
+        r.kind = VALUE_CONST;
+        r.base = BASE_GLOBAL;
+        r.index = v.index;
+        r.u = v.offset;
+        return r;
+    case VALUE_LOCAL:
+        r.kind = VALUE_REG;
+        r.reg = temp(c);
+        emit_addr_local(c, r.reg, v.offset);
+        return r;
+    case VALUE_MEM:
+        if (v.reg == NO_REG) {
+            r.kind = VALUE_CONST;
+            r.u = v.offset;
+            return r;
+        }
+        r.kind = VALUE_REG;
+        r.reg = v.offset ? add_offset(c, v.reg, v.offset) : v.reg;
+        return r;
+    case VALUE_VAR:
+        error(c, "address of register variable requested");
+        return int_const(r.type, 0);
+    default:
+        error(c, "lvalue required as unary '&' operand");
+        return int_const(r.type, 0);
+    }
+}
+
+/* Object a pointer points to. */
+static struct value deref(struct compiler *c, struct value ptr) {
+    struct value v;
+
+    ptr = rvalue(c, ptr);
+    memset(&v, 0, sizeof(v));
+    v.type = ptr.type->base;
+    if (ptr.kind == VALUE_CONST && ptr.base == BASE_GLOBAL) {
+        v.kind = VALUE_GLOBAL;
+        v.index = ptr.index;
+        v.offset = ptr.u;
+    } else if (ptr.kind == VALUE_CONST && ptr.base == BASE_FUNCTION) {
+        v.kind = VALUE_FUNCTION;
+        v.index = ptr.index;
+    } else if (ptr.kind == VALUE_CONST) {
+        v.kind = VALUE_MEM;
+        v.reg = NO_REG;
+        v.offset = ptr.u;
+    } else {
+        v.kind = VALUE_MEM;
+        v.reg = to_reg(c, ptr);
+    }
+    return v;
+}
+
+/* Base register and displacement addressing an object in memory. */
+static uint32_t mem_base(struct compiler *c, const struct value *v,
+                         int16_t *disp) {
+    const bool fits = v->offset >= INT16_MIN && v->offset <= INT16_MAX;
+    uint32_t r;
+
+    *disp = 0;
+    switch (v->kind) {
+    case VALUE_LOCAL:
+        if (!fits) {
+            r = temp(c);
+            emit_addr_local(c, r, v->offset);
+            return r;
+        }
+        if (c->fn) c->fn->uses_frame = true;
+        *disp = v->offset;
+        return c->fn ? c->fn->frame_reg : 0;
+    case VALUE_GLOBAL:
+        r = temp(c);
+        emit_imm(c, OP_ADDR_GLOBAL, r, v->index);
+        if (fits) *disp = v->offset;
+        else if (v->offset) r = add_offset(c, r, v->offset);
+        return r;
+    default:
+        if (v->reg == NO_REG) {
+            r = temp(c);
+            load_const(c, r, &(struct value){.kind = VALUE_CONST,
+                                             .type = &type_long,
+                                             .u = v->offset});
+            return r;
+        }
+        if (fits) {
+            *disp = v->offset;
+            return v->reg;
+        }
+        return add_offset(c, v->reg, v->offset);
+    }
+}
+
+static uint32_t add_offset(struct compiler *c, uint32_t reg, int64_t offset) {
+    const uint32_t r = temp(c);
+
+    if (offset >= INT16_MIN && offset <= INT16_MAX) {
+        emit(c, OP_ADDI_U64, r, reg, (uint16_t)offset);
+    } else {
+        const uint32_t k = temp(c);
+
+        load_const(c, k, &(struct value){.kind = VALUE_CONST,
+                                         .type = &type_long, .u = offset});
+        emit(c, OP_ADD_U64, r, reg, k);
+    }
+    return r;
+}
+
+/* Store v, already converted, into the object dst. Returns the value
+   stored, that of the assignment. */
+static struct value store(struct compiler *c, struct value dst,
+                          struct value v) {
+    static const enum opcode stores[] = {
+        OP_NOP, OP_STORE_8, OP_STORE_16, OP_NOP, OP_STORE_32, OP_NOP,
+        OP_NOP, OP_NOP, OP_STORE_64,
+    };
+    int16_t disp;
+    uint32_t base;
+    uint32_t r;
+
+    if (type_is_record(dst.type)) {
+        const uint32_t src = to_reg(c, address_of(c, v));
+
+        copy_object(c, to_reg(c, address_of(c, dst)), src, dst.type->size);
+        return dst;
+    }
+    if (dst.kind == VALUE_VAR) {
+        move_to(c, dst.reg, v);
+        return reg_value(dst.type, dst.reg);
+    }
+    r = to_reg(c, v);
+    base = mem_base(c, &dst, &disp);
+    emit(c, stores[dst.type->size]
+            + (c->prog->memory_checks ? OP_STOREC_8 - OP_STORE_8 : 0), r,
+         base, (uint16_t)disp);
+    return reg_value(dst.type, r);
+}
+
+/* Put a value into register dst. The instruction computing it into a
+   temporary just before writes dst instead, unless another path jumps
+   after it. */
+static void move_to(struct compiler *c, uint32_t dst, struct value v) {
+    struct function_state *const fn = c->fn;
+
+    v = rvalue(c, v);
+    if (v.kind == VALUE_CONST) {
+        load_const(c, dst, &v);
+        return;
+    }
+    if (v.kind != VALUE_REG) {
+        to_reg(c, v);
+        return;
+    }
+    if (v.reg == dst) return;
+    if (fn && !c->no_code && v.reg >= fn->var_top
+        && here(c) > fn->start + 1 && fn->last_target < here(c)) {
+        struct insn *const last = &c->prog->code[here(c) - 1];
+
+        if (writes_a(last->op) && last->a == v.reg) {
+            last->a = dst;
+            return;
+        }
+    }
+    emit(c, OP_MOV, dst, v.reg, 0);
+}
+
+static void copy_object(struct compiler *c, uint32_t dst, uint32_t src,
+                        size_t size) {
+    emit(c, OP_COPY, dst, src, 0);
+    emit_imm(c, OP_NOP, 0, size);
+}
+
+/* An integer in canonical form for type. */
+static uint64_t truncate_int(const struct type *type, uint64_t u) {
+    const bool is_unsigned = type_is_unsigned(type);
+
+    if (type->kind == TYPE_BOOL) return u != 0;
+    switch (type->size) {
+    case 1: return is_unsigned ? (uint8_t)u : (uint64_t)(int8_t)u;
+    case 2: return is_unsigned ? (uint16_t)u : (uint64_t)(int16_t)u;
+    case 4: return is_unsigned ? (uint32_t)u : (uint64_t)(int32_t)u;
+    default: return u;
+    }
+}
+
+/* Offset of the opcode for type in a group of typed opcodes: I32, U32,
+   I64, U64, F32, F64. */
+static int type_class(const struct type *type) {
+    if (type->kind == TYPE_FLOAT) return 4;
+    if (type_is_floating(type)) return 5;
+    return (type->size == 8 ? 2 : 0) + type_is_unsigned(type);
+}
+
+/* Size of the scalars an object of the type is made of, if all of the
+   same size, or 0, for struct global. */
+static uint8_t elem_size(const struct type *type) {
+    uint8_t size = 0;
+
+    while (type->kind == TYPE_ARRAY) type = type->base;
+    if (type_is_scalar(type)) return type->size;
+    if (!type_is_record(type)) return 0;
+    for (size_t i = 0; i < type->num_members; i++) {
+        const uint8_t m = elem_size(type->members[i].type);
+
+        if (!m || (size && m != size)) return 0;
+        size = m;
+    }
+    return size;
+}
+
+/* Offset in a group of comparisons: I, U, F32, F64. */
+static int compare_class(const struct type *type) {
+    if (type->kind == TYPE_FLOAT) return 2;
+    if (type_is_floating(type)) return 3;
+    return type_is_unsigned(type);
+}
+
+static enum value_class value_class_of(const struct type *type) {
+    switch (type->kind) {
+    case TYPE_VOID: return CLASS_VOID;
+    case TYPE_BOOL:
+    case TYPE_UCHAR: return CLASS_U8;
+    case TYPE_CHAR:
+    case TYPE_SCHAR: return CLASS_I8;
+    case TYPE_SHORT: return CLASS_I16;
+    case TYPE_USHORT: return CLASS_U16;
+    case TYPE_INT: return CLASS_I32;
+    case TYPE_UINT: return CLASS_U32;
+    case TYPE_FLOAT: return CLASS_F32;
+    case TYPE_DOUBLE:
+    case TYPE_LDOUBLE: return CLASS_F64;
+    case TYPE_STRUCT:
+    case TYPE_UNION: return CLASS_MEMORY;
+    case TYPE_POINTER:
+        return type->base->kind == TYPE_FUNCTION ? CLASS_FUNCTION
+                                                 : CLASS_PTR;
+    case TYPE_ARRAY: return CLASS_PTR;
+    default: return CLASS_I64;
+    }
+}
+
+/* Whether an instruction only writes register a, from its other
+   operands. */
+static bool writes_a(enum opcode op) {
+    switch (opcode_format(op)) {
+    case FORMAT_AB:
+    case FORMAT_ABC:
+    case FORMAT_AK:
+    case FORMAT_AG:
+        return true;
+    case FORMAT_AF:
+        return op == OP_ADDR_FUNC;
+    case FORMAT_ABI:
+        return (op < OP_STORE_8 || op > OP_STORE_64)
+               && (op < OP_STOREC_8 || op > OP_STOREC_64);
+    case FORMAT_AI:
+        return op == OP_LOADI || op == OP_ADDR_LOCAL;
+    default:
+        return false;
+    }
+}
+
+static const char *op_name(enum ast_kind kind) {
+    static const char *const names[] = {
+        "*", "/", "%", "+", "-", "<<", ">>", "<", ">", "<=", ">=", "==",
+        "!=", "&", "^", "|",
+    };
+
+    return kind >= AST_MUL && kind <= AST_BIT_OR ? names[kind - AST_MUL]
+                                                 : "?";
+}
+
+static const char *spell(struct compiler *c, const struct type *type) {
+    struct string str;
+    char *s;
+
+    string_init(&str);
+    type_spell(type, &str);
+    s = arena_alloc(c->arena, str.len + 1, 1);
+    memcpy(s, str.arr, str.len);
+    s[str.len] = '\0';
+    string_destroy(&str);
+    return s;
+}
+
+/* Read a character of a character constant or string literal, decoding
+   escape sequences, and in a wide one UTF-8. *universal tells whether it
+   was a universal character name, which a narrow one encodes in UTF-8. */
+static uint32_t read_char(const char **s, const char *end, bool wide,
+                          bool *universal) {
+    uint32_t ch = (unsigned char)*(*s)++;
+
+    *universal = false;
+    if (ch == '\\') {
+        int digits = 0;
+
+        ch = (unsigned char)*(*s)++;
+        switch (ch) {
+        case 'a': return '\a';
+        case 'b': return '\b';
+        case 'f': return '\f';
+        case 'n': return '\n';
+        case 'r': return '\r';
+        case 't': return '\t';
+        case 'v': return '\v';
+        case 'e': return 27;
+        case 'u':
+        case 'U':
+            *universal = true;
+            digits = ch == 'u' ? 4 : 8;
+            /* Fall through. */
+        case 'x':
+            for (ch = 0; *s < end && isxdigit((unsigned char)**s)
+                         && (!digits || digits--); (*s)++)
+                ch = ch * 16 + (isdigit((unsigned char)**s)
+                                ? **s - '0' : (**s | 0x20) - 'a' + 10);
+            return ch;
+        default:
+            if (ch >= '0' && ch <= '7') {
+                ch -= '0';
+                for (int i = 1; i < 3 && *s < end && **s >= '0'
+                                && **s <= '7'; i++)
+                    ch = ch * 8 + (*(*s)++ - '0');
+            }
+            return ch;
+        }
+    }
+    if (wide && ch >= 0xc0) {
+        const int n = ch >= 0xf0 ? 3 : ch >= 0xe0 ? 2 : 1;
+
+        ch &= 0x3f >> n;
+        for (int i = 0; i < n && *s < end; i++)
+            ch = ch << 6 | ((unsigned char)*(*s)++ & 0x3f);
+    }
+    return ch;
+}
+
+/* Size and type of the elements of a string literal or character constant,
+   by its prefix. */
+static size_t prefix_size(const struct compiler *c, uint32_t token,
+                          struct type **elem) {
+    const char *const s = preprocessor_spelling(c->pp, &c->toks[token]);
+
+    if (s[0] == 'L') {
+        *elem = &type_int;
+        return 4;
+    }
+    if (s[0] == 'U') {
+        *elem = &type_uint;
+        return 4;
+    }
+    if (s[0] == 'u' && s[1] != '8') {
+        *elem = &type_ushort;
+        return 2;
+    }
+    *elem = &type_char;
+    return 1;
+}
+
+/* Decode the adjacent string literals of node into buf, as the bytes of
+   their elements with the terminating null character. Returns the number
+   of elements. */
+static size_t decode_string(struct compiler *c, uint32_t node,
+                            struct string *buf, struct type **elem) {
+    const uint32_t first = c->ast->tokens[node];
+    const uint32_t n = lhs_of(c, node);
+    size_t size = 1;
+
+    *elem = &type_char;
+    for (uint32_t i = 0; i < n; i++) {
+        struct type *e;
+        const size_t s = prefix_size(c, first + i, &e);
+
+        if (s > size) {
+            size = s;
+            *elem = e;
+        }
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        const struct token *const tok = &c->toks[first + i];
+        const char *s = preprocessor_spelling(c->pp, tok);
+        const char *const end = s + tok->len - 1;
+
+        while (*s != '"') s++;
+        s++;
+        while (s < end) {
+            bool universal;
+            const uint32_t ch = read_char(&s, end, size > 1, &universal);
+
+            if (size == 1 && universal && ch >= 0x80) {
+                const int len = ch < 0x800 ? 2 : ch < 0x10000 ? 3 : 4;
+
+                string_append(buf, (char)((0xf00 >> len) | ch >> (6 * (len
+                                                                   - 1))));
+                for (int i = len - 2; i >= 0; i--)
+                    string_append(buf, (char)(0x80 | (ch >> (6 * i) & 0x3f)));
+            } else {
+                for (size_t b = 0; b < size; b++)
+                    string_append(buf, (char)(ch >> (8 * b)));
+            }
+        }
+    }
+    for (size_t b = 0; b < size; b++) string_append(buf, '\0');
+    return buf->len / size;
+}
+
+/* Add an anonymous global holding the bytes of buf. */
+static uint32_t string_global(struct compiler *c, const struct string *buf,
+                              size_t align) {
+    const uint32_t index = program_add_global(c->prog, ATOM_NONE);
+    const uint32_t offset = program_alloc_data(c->prog, buf->len, align);
+    struct global *const g = &c->prog->globals[index];
+
+    memcpy(c->prog->data + offset, buf->arr, buf->len);
+    g->defined = true;
+    g->internal = true;
+    g->offset = offset;
+    g->size = buf->len;
+    g->elem_size = align;
+    return index;
+}
@@ -0,0 +1,29 @@
+#ifndef COMPILER_H
+#define COMPILER_H
+
+#include "ast.h"
+#include "bytecode.h"
+#include "utils.h"
+
+struct preprocessor;
+
+/* Compile the translation unit ast, parsed by parse(), into prog, which is
+   then to be merged with those of the other units by program_merge(), if
+   any, and linked by program_link(). Types and symbols are allocated
+   from arena.
+
+   The compiler checks types as C does, and gives each local variable a
+   register, unless its address is taken or it is an array or a structure,
+   which live in the frame. Expressions are compiled to registers above
+   the variables, which are reused from one statement to the next.
+   Integer arithmetic is compiled to checked opcodes, and constant
+   expressions are checked as they are folded, unless prog->overflow is
+   OVERFLOW_NONE.
+
+   Bit-fields, variable length arrays, complex types, and definitions of
+   variadic functions are not supported. Errors are reported as by
+   parse(). Returns 0 on success and -1 on an error. */
+int compile(struct preprocessor *pp, const struct ast *ast,
+            struct arena *arena, struct program *prog);
+
+#endif
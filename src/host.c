@@ -0,0 +1,140 @@
+#include "host.h"
+#include "vm.h"
+#include <string.h>
+
+/* A host function is called through one of these types: the arguments
+   after the first are passed as variadic ones, so that the number of
+   floating registers used is set for a variadic function. */
+typedef uint64_t (*host_int_fn)(uint64_t, ...);
+typedef double (*host_double_fn)(uint64_t, ...);
+typedef float (*host_float_fn)(uint64_t, ...);
+
+/* Shapes of the calls the stubs are made for: the integer registers
+   loaded, the floating ones, and whether there are arguments on the
+   stack, which take the slots after the integer registers. */
+#define INT_ARG(k) (args[sig->ints[k]].u & sig->masks[k])
+#define FLOAT_ARG(k) args[sig->floats[k]].d
+#define INTS_3 INT_ARG(0), INT_ARG(1), INT_ARG(2)
+#define INTS_6 INTS_3, INT_ARG(3), INT_ARG(4), INT_ARG(5)
+#define FLOATS_0
+#define FLOATS_2 , FLOAT_ARG(0), FLOAT_ARG(1)
+#define FLOATS_8                                                            \
+    FLOATS_2, FLOAT_ARG(2), FLOAT_ARG(3), FLOAT_ARG(4), FLOAT_ARG(5),       \
+        FLOAT_ARG(6), FLOAT_ARG(7)
+#define STACK                                                               \
+    , INT_ARG(6), INT_ARG(7), INT_ARG(8), INT_ARG(9), INT_ARG(10),          \
+        INT_ARG(11), INT_ARG(12), INT_ARG(13)
+#define SHAPES(X)                                                           \
+    X(3_0, 3, 0, INTS_3 FLOATS_0)                                           \
+    X(6_0, 6, 0, INTS_6 FLOATS_0)                                           \
+    X(3_2, 3, 2, INTS_3 FLOATS_2)                                           \
+    X(6_2, 6, 2, INTS_6 FLOATS_2)                                           \
+    X(6_8, 6, 8, INTS_6 FLOATS_8)                                           \
+    X(STACK, 6, 8, INTS_6 FLOATS_8 STACK)
+
+static union reg canonical(enum value_class ret, uint64_t u);
+
+#define STUB(name, ints, floats, arguments)                                 \
+    static union reg int_##name(const struct host_signature *sig, void *fn, \
+                                const union reg *args) {                    \
+        return canonical(sig->ret, ((host_int_fn)fn)(arguments));           \
+    }                                                                       \
+    static union reg double_##name(const struct host_signature *sig,        \
+                                   void *fn, const union reg *args) {       \
+        return f64(((host_double_fn)fn)(arguments));                        \
+    }                                                                       \
+    static union reg float_##name(const struct host_signature *sig,         \
+                                  void *fn, const union reg *args) {        \
+        return f32(((host_float_fn)fn)(arguments));                         \
+    }
+SHAPES(STUB)
+#undef STUB
+
+static const struct {
+    uint8_t ints;
+    uint8_t floats;
+    /* Stubs returning an integer or pointer, a double, and a float. */
+    host_stub stubs[3];
+} shapes[] = {
+#define SHAPE_ENTRY(name, ints, floats, arguments)                          \
+    {ints, floats, {int_##name, double_##name, float_##name}},
+    SHAPES(SHAPE_ENTRY)
+#undef SHAPE_ENTRY
+};
+
+#undef INT_ARG
+#undef FLOAT_ARG
+#undef INTS_3
+#undef INTS_6
+#undef FLOATS_0
+#undef FLOATS_2
+#undef FLOATS_8
+#undef STACK
+#undef SHAPES
+
+/* Result of class ret, returned in the low bits of u. */
+static union reg canonical(enum value_class ret, uint64_t u) {
+    union reg r;
+
+    switch (ret) {
+    case CLASS_VOID: r.u = 0; break;
+    case CLASS_I8: r.i = (int8_t)u; break;
+    case CLASS_U8: r.u = (uint8_t)u; break;
+    case CLASS_I16: r.i = (int16_t)u; break;
+    case CLASS_U16: r.u = (uint16_t)u; break;
+    case CLASS_I32: r.i = (int32_t)u; break;
+    case CLASS_U32: r.u = (uint32_t)u; break;
+    default: r.u = u; break;
+    }
+    return r;
+}
+
+int host_signature_init(struct host_signature *sig,
+                        const struct program *prog, uint32_t classes,
+                        uint32_t num_args, enum value_class ret) {
+    size_t num_ints = 0;
+    size_t num_floats = 0;
+    size_t num_stack = 0;
+    size_t shape = 0;
+
+    memset(sig, 0, sizeof(struct host_signature));
+    sig->classes = classes;
+    sig->num_args = num_args;
+    sig->ret = ret;
+    if (ret == CLASS_MEMORY) return -1;
+
+    /* Arguments beyond the registers go on the stack in order, a floating
+       one as its bits. */
+    for (uint32_t i = 0; i < num_args; i++) {
+        const uint8_t class = prog->arg_classes[classes + i];
+        size_t slot;
+
+        if (class == CLASS_MEMORY) return -1;
+        if ((class == CLASS_F32 || class == CLASS_F64)
+            && num_floats < HOST_FLOAT_REGS) {
+            sig->floats[num_floats++] = i;
+            continue;
+        }
+        if (class != CLASS_F32 && class != CLASS_F64
+            && num_ints < HOST_INT_REGS) {
+            slot = num_ints++;
+        } else {
+            if (num_stack == HOST_STACK_ARGS) return -1;
+            slot = HOST_INT_REGS + num_stack++;
+        }
+        sig->ints[slot] = i;
+        sig->masks[slot] = class == CLASS_PTR ? VM_ADDRESS_MASK
+                                              : ~UINT64_C(0);
+        if (class == CLASS_PTR) sig->pointers |= UINT32_C(1) << i;
+        if (class == CLASS_FUNCTION) sig->functions |= UINT32_C(1) << i;
+    }
+
+    /* The smallest shape that fits. */
+    while (num_stack ? shape + 1 < sizeof(shapes) / sizeof(shapes[0])
+                     : num_ints > shapes[shape].ints
+                       || num_floats > shapes[shape].floats)
+        shape++;
+    sig->stub = shapes[shape].stubs[ret == CLASS_F64 ? 1
+                                    : ret == CLASS_F32 ? 2 : 0];
+    return 0;
+}
@@ -0,0 +1,58 @@
+#ifndef HOST_H
+#define HOST_H
+
+#include <stdint.h>
+
+#include "bytecode.h"
+
+/* Calls from the program to functions of the host. The host functions are
+   looked up once, when the program is linked, and so is how each distinct
+   signature of the calls to them, the classes of the arguments and of the
+   result, is passed: which argument goes in each register of the native
+   calling convention, and a stub made for that shape of call, which loads
+   them there and calls the function. A call then does no more than the
+   stub, with no lookup and no walk over the classes of its arguments.
+
+   A stub calls the host function as variadic, which is what the calling
+   convention requires of a call to a variadic function such as printf,
+   and works the same for the others. */
+#define HOST_INT_REGS 6
+#define HOST_FLOAT_REGS 8
+#define HOST_STACK_ARGS 8
+
+struct host_signature;
+
+/* Call host function fn with the arguments args of a call of signature
+   sig, returning its result in canonical form. */
+typedef union reg (*host_stub)(const struct host_signature *sig, void *fn,
+                               const union reg *args);
+
+struct host_signature {
+    host_stub stub;
+    /* Argument passed in each integer register, then on the stack, and the
+       mask of the bits passed: those of the address of a pointer, without
+       its tag, and none in a slot with no argument. */
+    uint8_t ints[HOST_INT_REGS + HOST_STACK_ARGS];
+    uint64_t masks[HOST_INT_REGS + HOST_STACK_ARGS];
+    /* Argument passed in each floating register. */
+    uint8_t floats[HOST_FLOAT_REGS];
+    /* Bit sets of the arguments that are pointers to data, and to
+       functions. */
+    uint32_t pointers;
+    uint32_t functions;
+    /* The arguments are arg_classes[classes, classes + num_args) of the
+       program. */
+    uint32_t classes;
+    uint32_t num_args;
+    enum value_class ret;
+};
+
+/* Make the signature of a call with num_args arguments of the classes
+   arg_classes[classes, ...) of prog, and a result of class ret. Returns -1
+   if a host function cannot be called so: with a structure, or with more
+   arguments than fit on the stack. */
+int host_signature_init(struct host_signature *sig,
+                        const struct program *prog, uint32_t classes,
+                        uint32_t num_args, enum value_class ret);
+
+#endif
@@ -0,0 +1,160 @@
+#include "intern.h"
+#include "utils.h"
+
+#include <pthread.h>
+#include <string.h>
+
+struct atom_entry {
+    const char *str;
+    uint32_t len;
+    uint32_t hash;
+};
+
+/* Open-addressed hash table with linear probing. A slot caches the hash of
+   its atom so that most mismatches are rejected without touching the
+   spelling. */
+struct slot {
+    uint32_t hash;
+    uint32_t atom;
+};
+
+/* Atoms are stored in chunks that never move, so that the spelling of an
+   atom can be read while other threads intern. */
+#define CHUNK_BITS 12
+#define CHUNK_SIZE (1u << CHUNK_BITS)
+#define MAX_CHUNKS 16384
+
+static struct atom_entry *chunks[MAX_CHUNKS];
+static uint32_t num_atoms;
+
+static struct slot *slots;
+static size_t num_slots;
+
+/* Spellings are packed into an arena. */
+static struct arena spellings;
+
+/* Held while the table is looked up or changed. */
+static pthread_mutex_t table_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct slot *find_slot(const char *str, size_t len, uint32_t hash);
+static void grow_slots(void);
+static const char *store_spelling(const char *str, size_t len);
+static struct atom_entry *entry(uint32_t atom);
+
+uint32_t intern(const char *str, size_t len) {
+    return intern_hashed(str, len, intern_hash(str, len));
+}
+
+uint32_t atom_lookup(const char *str, size_t len) {
+    const uint32_t hash = intern_hash(str, len);
+    uint32_t atom = ATOM_NONE;
+
+    pthread_mutex_lock(&table_lock);
+    if (num_slots) atom = find_slot(str, len, hash)->atom;
+    pthread_mutex_unlock(&table_lock);
+    return atom;
+}
+
+uint32_t intern_hash(const char *str, size_t len) {
+    return hash_bytes(str, len);
+}
+
+uint32_t intern_hashed(const char *str, size_t len, uint32_t hash) {
+    struct slot *slot;
+    struct atom_entry *e;
+    uint32_t atom;
+
+    pthread_mutex_lock(&table_lock);
+    if (2 * (num_atoms + 1) >= num_slots) grow_slots();
+
+    slot = find_slot(str, len, hash);
+    if (slot->atom != ATOM_NONE) {
+        atom = slot->atom;
+        pthread_mutex_unlock(&table_lock);
+        return atom;
+    }
+
+    atom = num_atoms + 1;
+    if (chunks[atom >> CHUNK_BITS] == NULL)
+        chunks[atom >> CHUNK_BITS] = malloc(sizeof(struct atom_entry)
+                                            * CHUNK_SIZE);
+    e = entry(atom);
+    e->str = store_spelling(str, len);
+    e->len = len;
+    e->hash = hash;
+
+    slot->hash = hash;
+    slot->atom = atom;
+    __atomic_store_n(&num_atoms, atom, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&table_lock);
+    return atom;
+}
+
+const char *atom_spelling(uint32_t atom) {
+    return entry(atom)->str;
+}
+
+size_t atom_len(uint32_t atom) {
+    return entry(atom)->len;
+}
+
+uint32_t atom_count(void) {
+    return __atomic_load_n(&num_atoms, __ATOMIC_ACQUIRE);
+}
+
+void intern_clear(void) {
+    arena_destroy(&spellings);
+
+    for (size_t i = 0; i < MAX_CHUNKS && chunks[i]; i++) {
+        free(chunks[i]);
+        chunks[i] = NULL;
+    }
+    num_atoms = 0;
+
+    free(slots);
+    slots = NULL;
+    num_slots = 0;
+}
+
+static struct slot *find_slot(const char *str, size_t len, uint32_t hash) {
+    const size_t mask = num_slots - 1;
+    size_t i = hash & mask;
+
+    while (1) {
+        struct slot *const slot = &slots[i];
+        if (slot->atom == ATOM_NONE)
+            return slot;
+        if (slot->hash == hash && entry(slot->atom)->len == len
+            && !memcmp(entry(slot->atom)->str, str, len))
+            return slot;
+        i = (i + 1) & mask;
+    }
+}
+
+static void grow_slots(void) {
+    struct slot *const old = slots;
+    const size_t old_num = num_slots;
+
+    num_slots = num_slots ? 2 * num_slots : 1024;
+    slots = calloc(num_slots, sizeof(struct slot));
+
+    for (size_t i = 0; i < old_num; i++) {
+        if (old[i].atom == ATOM_NONE) continue;
+        size_t j = old[i].hash & (num_slots - 1);
+        while (slots[j].atom != ATOM_NONE) j = (j + 1) & (num_slots - 1);
+        slots[j] = old[i];
+    }
+    free(old);
+}
+
+static const char *store_spelling(const char *str, size_t len) {
+    char *const dest = arena_alloc(&spellings, len + 1, 1);
+
+    memcpy(dest, str, len);
+    dest[len] = '\0';
+    return dest;
+}
+
+static struct atom_entry *entry(uint32_t atom) {
+    return &chunks[atom >> CHUNK_BITS][atom & (CHUNK_SIZE - 1)];
+}
@@ -0,0 +1,29 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Interning table. Every distinct spelling is mapped to a small integer
+   atom, so names can be compared as integers and each spelling is stored
+   only once. Atoms are numbered from 1 in order of first interning; 0 is
+   never a valid atom. */
+#define ATOM_NONE 0
+
+uint32_t intern(const char *str, size_t len);
+uint32_t atom_lookup(const char *str, size_t len);
+
+/* Interning in two steps, the hash apart. The table is thread-safe: atoms
+   can be interned and looked up, and their spellings read, from any
+   thread. */
+uint32_t intern_hash(const char *str, size_t len);
+uint32_t intern_hashed(const char *str, size_t len, uint32_t hash);
+
+/* The spelling of an atom is NUL-terminated and lives until intern_clear(). */
+const char *atom_spelling(uint32_t atom);
+size_t atom_len(uint32_t atom);
+uint32_t atom_count(void);
+
+void intern_clear(void);
+
+#endif
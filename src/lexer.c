@@ -1,14 +1,43 @@
 #include "lexer.h"
+#include "intern.h"
+#include "scan.h"
+#include "stats.h"
+#include "thread_pool.h"
+#include "token_cache.h"
 
-#include <ctype.h>
 #include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
-#include <assert.h>
 
 #define DEBUG 0
 
 #define ADV(c) ((*(c))++)
-#define APPADV(str, c) string_append(&(str), *((*(c))++))
+
+/* Smallest chunk worth a task of its own in lexer_parallel(). */
+#define MIN_CHUNK_SIZE 65536
+
+/* Lexer state carried from one line to the next. */
+struct lexer_mode {
+    bool bol;
+    bool space;
+    enum lexer_comment comment;
+};
+
+/* Chunk of the source lexed by one task of lexer_parallel(), from the given
+   start state. */
+struct lexer_chunk {
+    const struct source *src;
+    size_t begin;
+    size_t end;
+    bool pp_tokens;
+    struct lexer_mode start;
+    /* State at the end of the chunk. */
+    struct lexer_mode finish;
+    struct arena arena;
+    struct token_array tokarr;
+    bool error;
+};
 
 static const char *keyword_table[] = {
     "auto",
@@ -110,410 +139,1055 @@ static const char *punctuator_table[] = {
 
 static const enum token_type NUM_KEYWORDS = 44;
 
-static void token_array_init(struct token_array *tokarr);
-static void token_array_append(struct token_array *tokarr, struct token tok);
-
-static bool is_identifier_nondigit(int c);
-static bool is_identifier(int c);
-static bool is_nonzero_digit(int c);
-static bool is_octal_digit(int c);
-static bool is_simple_escape_sequence_character(int c);
-static bool is_floating_suffix(int c);
-
-static int read_keyword_or_identifier(char **c, struct token *tok);
-static int read_integer_constant(char **c, struct token *tok);
-static int read_floating_constant(char **c, struct token *tok);
-static int read_character_constant(char **c, struct token *tok);
-static int read_string_literal(char **c, struct token *tok);
-static int read_punctuator(char **c, struct token *tok);
-
-static int read_universal_character_name(char **c, struct string *str);
-static int read_c_char_sequence(char **c, struct string *str);
-static int read_s_char_sequence(char **c, struct string *str);
-
-static void debug_print_token(struct token t);
-
-struct token_array lexer(FILE *file) {
-    /* Current line. */
-    char *line = NULL;
-    size_t line_len = 0;
-    /* Current character. */
-    char *c;
-    /* Current token string. */
-    struct string str;
-    /* Current token. */
-    struct token tok;
-    /* Return. */
+#ifndef NO_STATS
+static const char *token_type_label(size_t i);
+#endif
+
+STATS_COUNTER_ARRAY(token_counts, "lexer.tokens", TOKEN_INDETERMINATE + 1,
+                    token_type_label);
+STATS_COUNTER(token_array_grows, "lexer.token_array_grows");
+STATS_COUNTER(refills, "lexer.refills");
+STATS_COUNTER(chunk_relexes, "lexer.chunk_relexes");
+STATS_COUNTER(edit_tokens, "lexer.edit_tokens");
+STATS_COUNTER(constant_diagnostics, "lexer.constant_diagnostics");
+STATS_COUNTER(refill_bytes, "lexer.refill_carry_bytes");
+STATS_PHASE(lex_phase, "lexer");
+STATS_PHASE(chunk_phase, "lexer.chunk");
+STATS_PHASE(merge_phase, "lexer.merge");
+
+/* Perfect hash of the keywords: keyword_hash() of every keyword is a
+   distinct slot, which holds its token type plus one. Zero means none. */
+static const unsigned char keyword_hash_table[128] = {
+     0,  0,  0,  0,  0,  0, 35, 28,  7, 13,  0, 32,  0, 38,  0,  0,
+    33,  0,  0, 23,  0, 24, 41, 25,  0,  0,  0,  0, 34, 11,  6,  0,
+     0,  0,  9,  0, 16,  0,  0,  0,  8,  0,  5,  0,  3, 39, 29, 17,
+     4,  0,  0,  0,  0,  0,  0,  0, 14,  0,  0, 18, 15,  0,  0, 43,
+     0,  0,  0,  0,  0,  0,  0, 44,  0,  0, 12,  0,  0,  0,  2, 26,
+     0,  0, 19,  0,  0, 22,  0,  0,  0,  0,  0, 20, 40, 21,  0, 42,
+    27,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0, 10,  0, 37,  0,  0, 31, 36,  0,  0,  0,  0,  1, 30,
+};
+
+/* Token class selected by the first character of a token. */
+enum char_class {
+    CLASS_INVALID,
+    CLASS_SPACE,
+    CLASS_IDENTIFIER,
+    CLASS_DIGIT,
+    CLASS_PERIOD,
+    CLASS_QUOTE,
+    CLASS_DOUBLE_QUOTE,
+    CLASS_PUNCTUATOR,
+};
+
+static const unsigned char char_class_table[256] = {
+    [' '] = CLASS_SPACE, ['\t'] = CLASS_SPACE, ['\n'] = CLASS_SPACE,
+    ['\v'] = CLASS_SPACE, ['\f'] = CLASS_SPACE, ['\r'] = CLASS_SPACE,
+    ['a' ... 'z'] = CLASS_IDENTIFIER,
+    ['A' ... 'Z'] = CLASS_IDENTIFIER,
+    ['_'] = CLASS_IDENTIFIER,
+    ['0' ... '9'] = CLASS_DIGIT,
+    ['.'] = CLASS_PERIOD,
+    ['\''] = CLASS_QUOTE,
+    ['\"'] = CLASS_DOUBLE_QUOTE,
+    ['['] = CLASS_PUNCTUATOR, [']'] = CLASS_PUNCTUATOR,
+    ['('] = CLASS_PUNCTUATOR, [')'] = CLASS_PUNCTUATOR,
+    ['{'] = CLASS_PUNCTUATOR, ['}'] = CLASS_PUNCTUATOR,
+    ['-'] = CLASS_PUNCTUATOR, ['+'] = CLASS_PUNCTUATOR,
+    ['&'] = CLASS_PUNCTUATOR, ['*'] = CLASS_PUNCTUATOR,
+    ['~'] = CLASS_PUNCTUATOR, ['!'] = CLASS_PUNCTUATOR,
+    ['/'] = CLASS_PUNCTUATOR, ['%'] = CLASS_PUNCTUATOR,
+    ['<'] = CLASS_PUNCTUATOR, ['>'] = CLASS_PUNCTUATOR,
+    ['='] = CLASS_PUNCTUATOR, ['^'] = CLASS_PUNCTUATOR,
+    ['|'] = CLASS_PUNCTUATOR, ['?'] = CLASS_PUNCTUATOR,
+    [':'] = CLASS_PUNCTUATOR, [';'] = CLASS_PUNCTUATOR,
+    [','] = CLASS_PUNCTUATOR, ['#'] = CLASS_PUNCTUATOR,
+};
+
+/* Character properties used inside tokens. */
+#define CHAR_IDENTIFIER     0x01
+#define CHAR_DIGIT          0x02
+#define CHAR_HEX_DIGIT      0x04
+#define CHAR_OCTAL_DIGIT    0x08
+
+static const unsigned char char_flag_table[256] = {
+    ['a' ... 'f'] = CHAR_IDENTIFIER | CHAR_HEX_DIGIT,
+    ['g' ... 'z'] = CHAR_IDENTIFIER,
+    ['A' ... 'F'] = CHAR_IDENTIFIER | CHAR_HEX_DIGIT,
+    ['G' ... 'Z'] = CHAR_IDENTIFIER,
+    ['_'] = CHAR_IDENTIFIER,
+    ['0' ... '7'] = CHAR_IDENTIFIER | CHAR_DIGIT | CHAR_HEX_DIGIT | CHAR_OCTAL_DIGIT,
+    ['8' ... '9'] = CHAR_IDENTIFIER | CHAR_DIGIT | CHAR_HEX_DIGIT,
+};
+
+static bool is_identifier(char c);
+static bool is_digit(char c);
+static bool is_hexadecimal_digit(char c);
+static bool is_octal_digit(char c);
+static bool is_simple_escape_sequence_character(char c);
+static bool is_floating_suffix(char c);
+
+static unsigned keyword_hash(const char *str, size_t len);
+static enum token_type keyword_lookup(const char *str, size_t len);
+
+static int read_token(const char **c, const char *end, struct token *tok);
+static int read_keyword_or_identifier(const char **c, const char *end, struct token *tok);
+static int read_number(const char **c, const char *end, struct token *tok);
+static int read_character_constant(const char **c, struct token *tok);
+static int read_string_literal(const char **c, const char *end, struct token *tok);
+static int read_punctuator(const char **c, struct token *tok);
+
+static int read_escape_sequence(const char **c);
+static int read_universal_character_name(const char **c);
+static int read_c_char_sequence(const char **c);
+static int read_s_char_sequence(const char **c, const char *end);
+
+static void read_pp_token(const char **c, const char *end, struct token *tok);
+
+static int lex_source(const struct source *src, struct arena *arena,
+                      size_t jobs, bool pp_tokens,
+                      struct token_array *tokarr);
+static void report_error(const struct source *src,
+                         const struct token_array *tokarr);
+static int lexer_scan(struct lexer_state *state, struct token *tok);
+static void skip_space(struct lexer_state *state);
+static bool is_splice(const char *p, const char *nl);
+static int lexer_refill(struct lexer_state *state);
+static void lexer_chunk(void *arg);
+
+static void debug_print_token(const char *buf, struct token t);
+
+const char *token_type_name(enum token_type type) {
+    if (type < NUM_KEYWORDS) return keyword_table[type];
+    if (type >= TOKEN_BRACKET_OPEN && type <= TOKEN_TWO_SHARP)
+        return punctuator_table[type - TOKEN_BRACKET_OPEN];
+
+    switch (type) {
+    case TOKEN_IDENTIFER: return "identifier";
+    case TOKEN_INT_CONST: return "integer-constant";
+    case TOKEN_FLOAT_CONST: return "floating-constant";
+    case TOKEN_CHAR_CONST: return "character-constant";
+    case TOKEN_STRING_LITERAL: return "string-literal";
+    case TOKEN_EOF: return "end-of-file";
+    default: return "indeterminate";
+    }
+}
+
+void lexer_init(struct lexer_state *state, const struct source *src) {
+    state->file = NULL;
+    state->buf = (char *)src->buf;
+    state->len = src->len;
+    state->capacity = 0;
+    state->base = 0;
+    state->pos = src->buf;
+    state->limit = src->buf + src->len;
+    state->eof = true;
+    state->partial = false;
+    state->file_id = src->id;
+    state->bol = true;
+    state->space = false;
+    state->comment = LEXER_NO_COMMENT;
+    state->defer_intern = false;
+    state->pp_tokens = false;
+    state->has_peeked = false;
+}
+
+void lexer_init_file(struct lexer_state *state, FILE *file) {
+    state->file = file;
+    state->buf = malloc(LEXER_WINDOW_SIZE);
+    state->buf[0] = '\0';
+    state->len = 0;
+    state->capacity = LEXER_WINDOW_SIZE;
+    state->base = 0;
+    state->pos = state->buf;
+    state->limit = state->buf;
+    state->eof = false;
+    state->partial = false;
+    state->file_id = 0;
+    state->bol = true;
+    state->space = false;
+    state->comment = LEXER_NO_COMMENT;
+    state->defer_intern = false;
+    state->pp_tokens = false;
+    state->has_peeked = false;
+}
+
+void lexer_destroy(struct lexer_state *state) {
+    if (state->file) free(state->buf);
+    state->buf = NULL;
+}
+
+int lexer_next(struct lexer_state *state, struct token *tok) {
+    if (state->has_peeked) {
+        state->has_peeked = false;
+        *tok = state->peeked;
+        return state->peeked_status;
+    }
+    return lexer_scan(state, tok);
+}
+
+int lexer_peek(struct lexer_state *state, struct token *tok) {
+    if (!state->has_peeked) {
+        state->peeked_status = lexer_scan(state, &state->peeked);
+        state->has_peeked = true;
+    }
+    *tok = state->peeked;
+    return state->peeked_status;
+}
+
+const char *lexer_spelling(const struct lexer_state *state,
+                           const struct token *tok) {
+    return state->buf + (tok->offset - state->base);
+}
+
+struct token_array lexer(const struct source *src, struct arena *arena) {
     struct token_array tokarr;
 
-    string_init(&str);
-    string_init(&tok.str);
-    token_array_init(&tokarr);
+    if (lex_source(src, arena, 1, false, &tokarr)) report_error(src, &tokarr);
+    return tokarr;
+}
+
+struct token_array lexer_parallel(const struct source *src,
+                                  struct arena *arena, size_t jobs) {
+    struct token_array tokarr;
 
-    while (getline(&line, &line_len, file) != EOF) {
-        c = line;
+    if (lex_source(src, arena, jobs, false, &tokarr))
+        report_error(src, &tokarr);
+    return tokarr;
+}
+
+int lexer_pp(const struct source *src, struct arena *arena, size_t jobs,
+             struct token_array *tokarr) {
+    return lex_source(src, arena, jobs, true, tokarr);
+}
+
+size_t lexer_error_offset(const struct source *src,
+                          const struct token_array *tokarr) {
+    const char *p = src->buf;
+    const char *const end = src->buf + src->len;
+
+    if (tokarr->len) {
+        const struct token *const last = &tokarr->tokens[tokarr->len - 1];
+        p += last->offset + last->len;
+    }
+
+    /* Skip the white space and whole comments after the last token. */
+    while (p != end) {
+        const char *close;
+
+        p += scan_space(p, end);
+        if (p[0] != '/' || (p[1] != '/' && p[1] != '*')) break;
+        if (p[1] == '/') {
+            close = memchr(p, '\n', end - p);
+            p = close ? close : end;
+            continue;
+        }
+        close = p + 2;
+        while ((close = memchr(close, '*', end - close)) && close[1] != '/')
+            close++;
+        if (close == NULL) break;
+        p = close + 2;
+    }
+    return p - src->buf;
+}
+
+/* Report an error lexing src on stderr, where it is. */
+static void report_error(const struct source *src,
+                         const struct token_array *tokarr) {
+    struct line_table lines;
+    size_t line;
+    size_t column;
+
+    line_table_init(&lines);
+    line_table_find(&lines, src, lexer_error_offset(src, tokarr), &line,
+                    &column);
+    fprintf(stderr, "%zu:%zu: error: invalid token\n", line, column);
+    line_table_destroy(&lines);
+}
+
+int lexer_relex(const struct source *src, bool pp_tokens,
+                const struct lexer_edit *edit, struct arena *arena,
+                struct token_array *tokarr) {
+    /* Shift of the bytes after the edit, and the end of the edit in src. */
+    const size_t delta = edit->new_len - edit->old_len;
+    const size_t edit_end = edit->offset + edit->new_len;
+    const size_t old_end = edit->offset + edit->old_len;
+    struct token *const old = tokarr->tokens;
+    const char *line = src->buf + edit->offset;
+    struct token_array fresh;
+    struct lexer_state state;
+    struct token tok;
+    size_t first = 0;
+    size_t last = tokarr->len;
+    size_t tail;
+    size_t len;
+
+    /* First token that may be changed by the edit: one that ends at or
+       after it, or up to two bytes before, where the edit may complete a
+       line splice, or that begins on its line, as an unterminated quote is
+       only told from a literal at the end of the line. Lexing resumes where
+       the token before it ends. */
+    while (line > src->buf && line[-1] != '\n') line--;
+    while (first < last) {
+        const size_t mid = first + (last - first) / 2;
+        if (old[mid].offset + old[mid].len + 2 < edit->offset
+            && old[mid].offset < (size_t)(line - src->buf))
+            first = mid + 1;
+        else last = mid;
+    }
+
+    lexer_init(&state, src);
+    state.pp_tokens = pp_tokens;
+    if (first > 0) {
+        state.pos = src->buf + old[first-1].offset + old[first-1].len;
+        state.bol = false;
+    }
+
+    /* Lex up to the first token that is also in the old stream: one that
+       starts past the edit at the shifted offset of an old token, with the
+       same type, length and flags. From the end of such a token on, both
+       streams see the same bytes from the same lexer state. */
+    fresh.len = 0;
+    fresh.capacity = 16;
+    fresh.tokens = malloc(sizeof(struct token) * fresh.capacity);
+    tail = first;
+    while (1) {
+        if (lexer_next(&state, &tok)) {
+            free(fresh.tokens);
+            return -1;
+        }
+        if (tok.type == TOKEN_EOF) {
+            tail = tokarr->len;
+            break;
+        }
+        if (tok.offset >= edit_end) {
+            while (tail < tokarr->len && (old[tail].offset < old_end
+                                          || old[tail].offset + delta
+                                             < tok.offset))
+                tail++;
+            if (tail < tokarr->len && old[tail].offset + delta == tok.offset
+                && old[tail].type == tok.type && old[tail].len == tok.len
+                && old[tail].flags == tok.flags)
+                break;
+        }
+        if (fresh.len == fresh.capacity) {
+            fresh.capacity *= 2;
+            fresh.tokens = realloc(fresh.tokens,
+                                   sizeof(struct token) * fresh.capacity);
+        }
+        fresh.tokens[fresh.len++] = tok;
+    }
+    STATS_ADD_ATOMIC(edit_tokens, 0, fresh.len);
+
+    /* Splice: tokens [first, tail) are replaced by the fresh ones, and the
+       rest shifted. */
+    len = first + fresh.len + (tokarr->len - tail);
+    if (len > tokarr->capacity) {
+        const size_t capacity = len > 2 * tokarr->capacity
+                                ? len : 2 * tokarr->capacity;
+        STATS_ADD_ATOMIC(token_array_grows, 0, 1);
+        tokarr->tokens = arena_grow(arena, tokarr->tokens,
+                                    sizeof(struct token) * tokarr->capacity,
+                                    sizeof(struct token) * capacity,
+                                    _Alignof(struct token));
+        tokarr->capacity = capacity;
+    }
+    if (first + fresh.len != tail)
+        memmove(tokarr->tokens + first + fresh.len, tokarr->tokens + tail,
+                sizeof(struct token) * (tokarr->len - tail));
+    memcpy(tokarr->tokens + first, fresh.tokens,
+           sizeof(struct token) * fresh.len);
+    if (delta)
+        for (size_t i = first + fresh.len; i < len; i++)
+            tokarr->tokens[i].offset += delta;
+    tokarr->len = len;
+
+    free(fresh.tokens);
+    return 0;
+}
+
+static int lex_source(const struct source *src, struct arena *arena,
+                      size_t jobs, bool pp_tokens,
+                      struct token_array *tokarr) {
+    /* Chunks. */
+    struct lexer_chunk *chunks;
+    size_t num_chunks;
+    /* Thread pool. */
+    struct thread_pool pool;
+    size_t len = 0;
+    size_t num_used = 0;
+    bool error = false;
+    uint64_t hash;
+
+    if (src->len > UINT32_MAX) {
+        token_array_init(tokarr, arena, 0);
+        return -1;
+    }
+    if (token_cache_load(src, pp_tokens, arena, &hash, tokarr) == 0)
+        return 0;
+
+    num_chunks = 4 * jobs < src->len / MIN_CHUNK_SIZE
+                 ? 4 * jobs : src->len / MIN_CHUNK_SIZE;
+    if (jobs <= 1 || num_chunks <= 1) {
+        /* Lexer state. */
+        struct lexer_state state;
+        /* Current token. */
+        struct token tok;
+
+        STATS_BEGIN(lex_phase);
+
+        /* Guess one token per eight bytes of source. */
+        token_array_init(tokarr, arena, src->len / 8 + 16);
+        lexer_init(&state, src);
+        state.pp_tokens = pp_tokens;
 
         while (1) {
-            while (isspace(*c)) c++;
-            if (*c == '\0') break;
-
-            tok.type = TOKEN_INDETERMINATE;
-            string_init(&tok.str);
-
-            if (read_keyword_or_identifier(&c, &tok)
-                && read_integer_constant(&c, &tok)
-                && read_floating_constant(&c, &tok)
-                && read_character_constant(&c, &tok)
-                && read_string_literal(&c, &tok)
-                && read_punctuator(&c, &tok)) {
-                printf("error\n");
-                return tokarr;
+            if (lexer_next(&state, &tok)) {
+                error = true;
+                break;
             }
+            if (tok.type == TOKEN_EOF) break;
 
-            token_array_append(&tokarr, tok);
+            STATS_ADD_ATOMIC(token_counts, tok.type, 1);
+            token_array_append(tokarr, arena, tok);
         }
+
+        STATS_END(lex_phase);
+        goto done;
     }
 
+    STATS_BEGIN(lex_phase);
+
+    /* Split the source just after new-lines, and lex each chunk as if it
+       started a line outside any comment. */
+    chunks = malloc(sizeof(struct lexer_chunk) * num_chunks);
+    for (size_t i = 0; i < num_chunks; i++) {
+        size_t end = src->len;
+        if (i + 1 < num_chunks) {
+            const char *nl;
+            end = src->len / num_chunks * (i + 1);
+            nl = memchr(src->buf + end, '\n', src->len - end);
+            end = nl ? (size_t)(nl - src->buf) + 1 : src->len;
+        }
+
+        chunks[i].src = src;
+        chunks[i].begin = i ? chunks[i-1].end : 0;
+        chunks[i].end = end > chunks[i].begin ? end : chunks[i].begin;
+        chunks[i].pp_tokens = pp_tokens;
+        chunks[i].start.bol = true;
+        chunks[i].start.space = i > 0;
+        chunks[i].start.comment = LEXER_NO_COMMENT;
+    }
+
+    scan_init();
+    thread_pool_init(&pool, jobs);
+    for (size_t i = 0; i < num_chunks; i++)
+        thread_pool_submit(&pool, lexer_chunk, &chunks[i]);
+    thread_pool_wait(&pool);
+    thread_pool_destroy(&pool);
+
+    STATS_BEGIN(merge_phase);
+
+    /* A chunk that does not start in the state the previous one ended in,
+       i.e. inside a comment or after a line splice, is lexed again from that
+       state. */
+    for (size_t i = 1; i < num_chunks && !chunks[i-1].error; i++) {
+        const struct lexer_mode *const prev = &chunks[i-1].finish;
+        if (prev->bol != chunks[i].start.bol
+            || prev->space != chunks[i].start.space
+            || prev->comment != chunks[i].start.comment) {
+            STATS_ADD_ATOMIC(chunk_relexes, 0, 1);
+            chunks[i].start = *prev;
+            arena_destroy(&chunks[i].arena);
+            lexer_chunk(&chunks[i]);
+        }
+    }
+
+    /* Concatenate the chunks up to the first error, interning identifiers in
+       order so that atoms are numbered as by a sequential run. */
+    while (num_used < num_chunks && !error) {
+        len += chunks[num_used].tokarr.len;
+        error = chunks[num_used++].error;
+    }
+    token_array_init(tokarr, arena, len + 1);
+    for (size_t i = 0; i < num_used; i++) {
+        memcpy(tokarr->tokens + tokarr->len, chunks[i].tokarr.tokens,
+               sizeof(struct token) * chunks[i].tokarr.len);
+        tokarr->len += chunks[i].tokarr.len;
+    }
+    for (size_t i = 0; i < num_chunks; i++)
+        arena_destroy(&chunks[i].arena);
+    free(chunks);
+
+    for (size_t i = 0; i < tokarr->len; i++) {
+        struct token *const tok = &tokarr->tokens[i];
+        STATS_ADD_ATOMIC(token_counts, tok->type, 1);
+        if (tok->type == TOKEN_IDENTIFER)
+            tok->atom = intern_hashed(src->buf + tok->offset, tok->len, tok->atom);
+    }
+    STATS_END(merge_phase);
+    STATS_END(lex_phase);
+
+done:
+    if (error) return -1;
+    token_cache_store(src, pp_tokens, hash, tokarr);
+
 #if DEBUG
-    for (size_t i = 0; i < tokarr.len; i++)
-        debug_print_token(tokarr.tokens[i]);
+    for (size_t i = 0; i < tokarr->len; i++)
+        debug_print_token(src->buf, tokarr->tokens[i]);
     fprintf(stderr, "\n");
 #endif
 
-    return tokarr;
+    return 0;
+}
+
+static void lexer_chunk(void *arg) {
+    struct lexer_chunk *const chunk = arg;
+    struct lexer_state state;
+    struct token tok;
+
+    STATS_BEGIN(chunk_phase);
+
+    arena_init(&chunk->arena);
+    token_array_init(&chunk->tokarr, &chunk->arena,
+                     (chunk->end - chunk->begin) / 8 + 16);
+    chunk->error = false;
+
+    lexer_init(&state, chunk->src);
+    state.pos = chunk->src->buf + chunk->begin;
+    state.limit = chunk->src->buf + chunk->end;
+    state.partial = chunk->end != chunk->src->len;
+    state.bol = chunk->start.bol;
+    state.space = chunk->start.space;
+    state.comment = chunk->start.comment;
+    state.defer_intern = true;
+    state.pp_tokens = chunk->pp_tokens;
+
+    while (1) {
+        if (lexer_next(&state, &tok)) {
+            chunk->error = true;
+            break;
+        }
+        if (tok.type == TOKEN_EOF) break;
+
+        token_array_append(&chunk->tokarr, &chunk->arena, tok);
+    }
+
+    chunk->finish.bol = state.bol;
+    chunk->finish.space = state.space;
+    chunk->finish.comment = state.comment;
+
+    STATS_END(chunk_phase);
 }
 
-static void token_array_init(struct token_array *tokarr) {
+static int lexer_scan(struct lexer_state *state, struct token *tok) {
+    const char *start;
+
+    /* Skip white spaces and comments, refilling the window at the end of its
+       lines. */
+    while (1) {
+        skip_space(state);
+        if (state->pos != state->limit) break;
+        if (state->eof) {
+            if (state->comment == LEXER_BLOCK_COMMENT && !state->partial)
+                return -1;
+            tok->type = TOKEN_EOF;
+            tok->atom = ATOM_NONE;
+            tok->offset = state->base + (state->pos - state->buf);
+            tok->len = 0;
+            tok->flags = TOKEN_FLAG_BOL;
+            tok->file = state->file_id;
+            tok->int_value = 0;
+            return 0;
+        }
+        if (lexer_refill(state)) return -1;
+    }
+
+    start = state->pos;
+    tok->atom = ATOM_NONE;
+    tok->offset = state->base + (start - state->buf);
+    tok->flags = (state->bol ? TOKEN_FLAG_BOL : 0)
+                 | (state->space ? TOKEN_FLAG_SPACE : 0);
+    tok->file = state->file_id;
+    tok->int_value = 0;
+
+    /* No token spans a new-line, so the token ends before the limit. */
+    if (read_token(&state->pos, state->limit, tok)) {
+        if (!state->pp_tokens) return -1;
+        state->pos = start;
+        read_pp_token(&state->pos, state->limit, tok);
+    }
+    state->bol = false;
+    state->space = false;
+
+    tok->len = state->base + (state->pos - state->buf) - tok->offset;
+
+    if (tok->type == TOKEN_IDENTIFER) {
+        const char *const spelling = state->buf + (tok->offset - state->base);
+        tok->atom = state->defer_intern ? intern_hash(spelling, tok->len)
+                                        : intern(spelling, tok->len);
+    }
+    return 0;
+}
+
+/* Skip white space, comments, and line splices up to the limit. A comment
+   still open at the limit is resumed by the next call. */
+static void skip_space(struct lexer_state *state) {
+    const char *p = state->pos;
+    const char *const limit = state->limit;
+    const char *q;
+    size_t n;
+
+    while (1) {
+        if (state->comment == LEXER_BLOCK_COMMENT) {
+            while ((q = memchr(p, '*', limit - p)) && q[1] != '/') p = q + 1;
+            if (q == NULL) {
+                p = limit;
+                break;
+            }
+            p = q + 2;
+            state->comment = LEXER_NO_COMMENT;
+        } else if (state->comment == LEXER_LINE_COMMENT) {
+            /* Up to the first new-line that does not end a line splice. */
+            while ((q = memchr(p, '\n', limit - p)) && is_splice(p, q)) p = q + 1;
+            if (q == NULL) {
+                p = limit;
+                break;
+            }
+            p = q;
+            state->comment = LEXER_NO_COMMENT;
+        }
+
+        n = scan_space(p, limit);
+        if (n) {
+            state->space = true;
+            if (memchr(p, '\n', n)) state->bol = true;
+            p += n;
+        }
+        if (p == limit || (*p != '/' && *p != '\\')) break;
+
+        if (p[0] == '/' && (p[1] == '*' || p[1] == '/')) {
+            state->comment = p[1] == '*' ? LEXER_BLOCK_COMMENT
+                                         : LEXER_LINE_COMMENT;
+            state->space = true;
+            p += 2;
+        } else if (p[0] == '\\' && p[1] == '\n')
+            p += 2;
+        else if (p[0] == '\\' && p[1] == '\r' && p[2] == '\n')
+            p += 3;
+        else
+            break;
+    }
+    state->pos = p;
+}
+
+/* Whether the new-line at nl ends a line splice, looking back no further
+   than p. */
+static bool is_splice(const char *p, const char *nl) {
+    if (nl > p && nl[-1] == '\r') nl--;
+    return nl > p && nl[-1] == '\\';
+}
+
+static int lexer_refill(struct lexer_state *state) {
+    const size_t consumed = state->pos - state->buf;
+    size_t n;
+
+    STATS_ADD_ATOMIC(refills, 0, 1);
+    STATS_ADD_ATOMIC(refill_bytes, 0, state->len - consumed);
+
+    /* Discard the consumed part of the window. */
+    memmove(state->buf, state->pos, state->len - consumed);
+    state->base += consumed;
+    state->len -= consumed;
+    state->pos = state->buf;
+
+    /* Read until the window holds a complete line or the input ends. */
+    while (1) {
+        if (state->len + 1 == state->capacity) {
+            state->buf = realloc(state->buf, 2 * state->capacity);
+            state->capacity *= 2;
+        }
+
+        n = fread(state->buf + state->len, 1,
+                  state->capacity - state->len - 1, state->file);
+        if (n == 0) {
+            if (ferror(state->file)) return -1;
+            state->eof = true;
+            state->limit = state->buf + state->len;
+            break;
+        }
+        state->len += n;
+        if (state->base + state->len > UINT32_MAX) return -1;
+
+        for (n = state->len; n > 0; n--)
+            if (state->buf[n-1] == '\n') break;
+        if (n > 0) {
+            state->limit = state->buf + n;
+            break;
+        }
+    }
+
+    state->buf[state->len] = '\0';
+    state->pos = state->buf;
+    return 0;
+}
+
+void token_array_init(struct token_array *tokarr, struct arena *arena,
+                      size_t capacity) {
     tokarr->len = 0;
-    tokarr->capacity = 8;
-    tokarr->tokens = malloc(sizeof(struct token) * 8);
+    tokarr->capacity = capacity;
+    tokarr->tokens = arena_alloc(arena, sizeof(struct token) * capacity,
+                                 _Alignof(struct token));
 }
 
-static void token_array_append(struct token_array *tokarr, struct token tok) {
+void token_array_append(struct token_array *tokarr, struct arena *arena,
+                        struct token tok) {
     if (tokarr->len == tokarr->capacity) {
-        tokarr->tokens = realloc(tokarr->tokens, sizeof(struct token) * tokarr->capacity*2);
+        STATS_ADD_ATOMIC(token_array_grows, 0, 1);
+        tokarr->tokens = arena_grow(arena, tokarr->tokens,
+                                    sizeof(struct token) * tokarr->capacity,
+                                    sizeof(struct token) * tokarr->capacity*2,
+                                    _Alignof(struct token));
         tokarr->capacity *= 2;
     }
     tokarr->tokens[tokarr->len] = tok;
     tokarr->len++;
 }
 
-static bool is_identifier_nondigit(int c) {
-    return isalpha(c) || c == '_';
+static bool is_identifier(char c) {
+    return char_flag_table[(unsigned char)c] & CHAR_IDENTIFIER;
 }
 
-static bool is_identifier(int c) {
-    return isalnum(c) || c == '_';
+static bool is_digit(char c) {
+    return char_flag_table[(unsigned char)c] & CHAR_DIGIT;
 }
 
-static bool is_nonzero_digit(int c) {
-    return isdigit(c) && c != '0';
+static bool is_hexadecimal_digit(char c) {
+    return char_flag_table[(unsigned char)c] & CHAR_HEX_DIGIT;
 }
 
-static bool is_octal_digit(int c) {
-    return c == '0' || c == '1' || c == '2' || c == '3' || c == '4' || c == '5'
-           || c == '6' || c == '7';
+static bool is_octal_digit(char c) {
+    return char_flag_table[(unsigned char)c] & CHAR_OCTAL_DIGIT;
 }
 
-static bool is_simple_escape_sequence_character(int c) {
+static bool is_simple_escape_sequence_character(char c) {
     return c == '\'' || c == '\"' || c == '?' || c == '\\' || c == 'a'
            || c == 'b' || c == 'f' || c == 'n' || c == 'r' || c == 't'
            || c == 'v';
 }
 
-static bool is_floating_suffix(int c) {
+static bool is_floating_suffix(char c) {
     return c == 'f' || c == 'l' || c == 'F' || c == 'L';
 }
 
-static int read_keyword_or_identifier(char **c, struct token *tok) {
-    char *const co = *c;
-    struct string str;
-
-    string_init(&str);
-
-    /* Must start with a nondigit identifier character. */
-    if (!is_identifier_nondigit(**c))
-        goto error;
-
-    /* Read whole token. */
-    while (is_identifier(**c)) APPADV(str, c);
-
-    /* If there is a quote, it's an error. */
-    if (**c == '\'' || **c == '\"') goto error;
-
-    /* Is this identifier? */
-    for (enum token_type i = 0; i < NUM_KEYWORDS; i++)
-        if (!strcmp(str.arr, keyword_table[i])) {
-            tok->type = i;
-            break;
-        }
-    if (tok->type == TOKEN_INDETERMINATE)
-        tok->type = TOKEN_IDENTIFER;
-
-    /* Copy string. */
-    string_copy(&tok->str, &str);
-
-    string_destroy(&str);
-    return 0;
-
-error:
-    string_destroy(&str);
-    *c = co;
-    return -1;
+/* Slot of keyword_hash_table for the identifier str of len characters, at
+   least 2, from its first two and last characters and its length. */
+static unsigned keyword_hash(const char *str, size_t len) {
+    return ((unsigned char)str[0] * 6 + (unsigned char)str[1] * 17
+            + (unsigned char)str[len-1] + len) % 128;
 }
 
-static int read_integer_constant(char **c, struct token *tok) {
-    char *const co = *c;
-    struct string str;
-
-    string_init(&str);
-    tok->type = TOKEN_INT_CONST;
-
-    /* Must start with a digit. */
-    if (!isdigit(**c)) goto error;
+static enum token_type keyword_lookup(const char *str, size_t len) {
+    unsigned hash;
+    const char *keyword;
 
-    /* Starting with a nonzero-digit: decimal-constant. */
-    if (is_nonzero_digit(**c))
-        while (isdigit(**c)) APPADV(str, c);
+    /* Keywords are 2 to 14 characters long. */
+    if (len < 2 || len > 14)
+        return TOKEN_IDENTIFER;
 
-    /* Starting with a zero: octal-constant or hexadecimal-constant. */
-    else if (**c == '0') {
-        APPADV(str, c);
+    hash = keyword_hash_table[keyword_hash(str, len)];
+    if (hash == 0)
+        return TOKEN_IDENTIFER;
 
-        /* Starting with 0x or 0X: hexadecimal-constant. */
-        if (**c == 'x' || **c == 'X') {
-            APPADV(str, c);
-            while (isxdigit(**c)) APPADV(str, c);
+    keyword = keyword_table[hash-1];
+    if (strncmp(keyword, str, len) || keyword[len] != '\0')
+        return TOKEN_IDENTIFER;
+    return hash-1;
+}
 
-            /* If there is no following hexadecimal-digit, it's an error. */
-            if (*(*c-1) == 'x' || *(*c-1) == 'X')
-                goto error;
-        }
+static int read_token(const char **c, const char *end, struct token *tok) {
+    switch (char_class_table[(unsigned char)**c]) {
+    case CLASS_IDENTIFIER:
+        return read_keyword_or_identifier(c, end, tok);
+    case CLASS_DIGIT:
+        return read_number(c, end, tok);
+    case CLASS_PERIOD:
+        /* A period followed by a digit starts a floating-constant. */
+        if (is_digit(*(*c+1)))
+            return read_number(c, end, tok);
+        return read_punctuator(c, tok);
+    case CLASS_QUOTE:
+        return read_character_constant(c, tok);
+    case CLASS_DOUBLE_QUOTE:
+        return read_string_literal(c, end, tok);
+    case CLASS_PUNCTUATOR:
+        return read_punctuator(c, tok);
+    default:
+        return -1;
+    }
+}
 
-        /* Otherwise: octal-constant. */
-        else
-            while (is_octal_digit(**c)) APPADV(str, c);
+/* Read a preprocessing token that is not a token: an identifier followed by
+   a stray quote, a pp-number that is not a valid constant, or any other
+   single character. */
+static void read_pp_token(const char **c, const char *end, struct token *tok) {
+    tok->atom = ATOM_NONE;
+    tok->int_value = 0;
+
+    if (is_identifier(**c) && !is_digit(**c)) {
+        const char *const start = *c;
+        *c += scan_identifier(*c, end);
+        tok->type = keyword_lookup(start, *c - start);
+        return;
     }
 
-    /* Read integer-suffix */
-    if (**c == 'u' || **c == 'U') {
-        APPADV(str, c);
-        if (**c == 'l' || **c == 'L') {
-            APPADV(str, c);
-            if (**c == *(*c-1)) APPADV(str, c);
+    tok->type = TOKEN_INDETERMINATE;
+    if (is_digit(**c) || (**c == '.' && is_digit(*(*c+1)))) {
+        /* pp-number: identifier characters and periods, and signs after an
+           exponent letter. */
+        ADV(c);
+        while (1) {
+            const char prev = *(*c-1);
+            if ((**c == '+' || **c == '-')
+                && (prev == 'e' || prev == 'E' || prev == 'p' || prev == 'P'))
+                ADV(c);
+            else if (is_identifier(**c) || **c == '.')
+                ADV(c);
+            else
+                break;
         }
-    } else if (**c == 'l' || **c == 'L') {
-        APPADV(str, c);
-        if (**c == *(*c-1)) APPADV(str, c);
-        if (**c == 'u' || **c == 'U') APPADV(str, c);
+        return;
     }
+    ADV(c);
+}
 
-    /* If there is trailing identifier character, it's an error. */
-    if (is_identifier(**c))
-        goto error;
-
-    /* If there is a period, it's an error; it's floating-constant. */
-    if (**c == '.')
-        goto error;
+static int read_keyword_or_identifier(const char **c, const char *end, struct token *tok) {
+    const char *const start = *c;
+    size_t len;
 
-    /* Copy string. */
-    string_copy(&tok->str, &str);
+    /* Read whole token. */
+    *c += scan_identifier(*c, end);
+    len = *c - start;
+
+    /* A quote may only follow an encoding prefix: L, u, U, or u8 (string
+       literals only). */
+    if (**c == '\'') {
+        if (len == 1 && (*start == 'L' || *start == 'u' || *start == 'U'))
+            return read_character_constant(c, tok);
+        return -1;
+    }
+    if (**c == '\"') {
+        if ((len == 1 && (*start == 'L' || *start == 'u' || *start == 'U'))
+            || (len == 2 && start[0] == 'u' && start[1] == '8'))
+            return read_string_literal(c, end, tok);
+        return -1;
+    }
 
-    string_destroy(&str);
+    tok->type = keyword_lookup(start, len);
     return 0;
-
-error:
-    string_destroy(&str);
-    *c = co;
-    return -1;
 }
 
-static int read_floating_constant(char **c, struct token *tok) {
-    char *const co = *c;
-    struct string str;
-    int cnt;
-    bool digit_seq_only;
+static int read_number(const char **c, const char *end, struct token *tok) {
+    const char *const start = *c;
+    const char *digits;
+    struct number num;
+    bool floating = false;
 
-    string_init(&str);
-    tok->type = TOKEN_FLOAT_CONST;
+    num.frac_digits = num.exp_digits = "";
+    num.frac_len = num.exp_len = 0;
+    num.exp_negative = false;
 
-    /* Starting with 0x or 0X: hexadecimal-floating-constant. */
+    /* Starting with 0x or 0X: hexadecimal-constant or
+       hexadecimal-floating-constant. */
     if (**c == '0' && (*(*c+1) == 'x' || *(*c+1) == 'X')) {
-        APPADV(str, c);
-        APPADV(str, c);
+        ADV(c);
+        ADV(c);
+        num.base = 16;
 
         /* hexadecimal-digit-sequence
            | hexadecimal-digit-sequence .
            | . hexadecimal-digit-sequence
            | hexadecimal-digit-sequence . hexadecimal-digit-sequence */
-        cnt = 0;
-        while (isxdigit(**c)) APPADV(str, c), cnt++;
+        digits = *c;
+        while (is_hexadecimal_digit(**c)) ADV(c);
+        num.int_digits = digits;
+        num.int_len = *c - digits;
         if (**c == '.') {
-            APPADV(str, c), cnt++;
-            while (isxdigit(**c)) APPADV(str, c), cnt++;
-            if (cnt == 1) goto error;
-        } else if (cnt == 0) goto error;
-
-        /* binary-exponent-part. */
-        if (**c != 'p' && **c != 'P') goto error;
-        APPADV(str, c);
-        if (**c == '+' || **c == '-') APPADV(str, c);
-        if (!isdigit(**c)) goto error;
-        while (isdigit(**c)) APPADV(str, c);
-    }
-    /* Otherwise: decimal floating-constant. */
+            ADV(c);
+            num.frac_digits = *c;
+            while (is_hexadecimal_digit(**c)) ADV(c);
+            num.frac_len = *c - num.frac_digits;
+            floating = true;
+            if (*c - digits == 1) return -1;
+        } else if (*c == digits) return -1;
+
+        /* binary-exponent-part, which is mandatory for a floating-constant. */
+        if (**c == 'p' || **c == 'P') {
+            ADV(c);
+            if (**c == '+' || **c == '-') num.exp_negative = *(*c)++ == '-';
+            if (!is_digit(**c)) return -1;
+            num.exp_digits = *c;
+            num.exp_len = scan_digits(*c, end);
+            *c += num.exp_len;
+            floating = true;
+        } else if (floating) return -1;
+    }
+
+    /* Otherwise: decimal-constant, octal-constant, or decimal
+       floating-constant. */
     else {
         /* digit-sequence
            | digit-sequence .
            | . digit-sequence
            | digit-sequence . digit-sequence */
-        cnt = 0;
-        digit_seq_only = false;
-        while (isdigit(**c)) APPADV(str, c), cnt++;
+        num.base = 10;
+        num.int_digits = start;
+        num.int_len = scan_digits(*c, end);
+        *c += num.int_len;
         if (**c == '.') {
-            APPADV(str, c), cnt++;
-            while (isdigit(**c)) APPADV(str, c), cnt++;
-            if (cnt == 1) goto error;
-        } else {
-            if (cnt == 0) goto error;
-            digit_seq_only = true;
+            ADV(c);
+            num.frac_digits = *c;
+            num.frac_len = scan_digits(*c, end);
+            *c += num.frac_len;
+            floating = true;
         }
 
         /* exponent-part. */
-        if (digit_seq_only && **c != 'e' && **c != 'E') goto error;
         if (**c == 'e' || **c == 'E') {
-            APPADV(str, c);
-            if (**c == '+' || **c == '-') APPADV(str, c);
-            if (!isdigit(**c)) goto error;
-            while (isdigit(**c)) APPADV(str, c);
+            ADV(c);
+            if (**c == '+' || **c == '-') num.exp_negative = *(*c)++ == '-';
+            if (!is_digit(**c)) return -1;
+            num.exp_digits = *c;
+            num.exp_len = scan_digits(*c, end);
+            *c += num.exp_len;
+            floating = true;
         }
-    }
 
-    /* Read floating-suffix. */
-    if (is_floating_suffix(**c)) APPADV(str, c);
+        /* Starting with a zero: octal-constant. */
+        if (!floating && *start == '0') {
+            for (digits = start; digits != *c; digits++)
+                if (!is_octal_digit(*digits)) return -1;
+            num.base = 8;
+        }
+    }
 
-    /* If there is trailing identifier character, it's an error. */
-    if (is_identifier(**c))
-        goto error;
+    /* Read floating-suffix or integer-suffix. */
+    num.is_unsigned = false;
+    num.num_longs = 0;
+    num.float_suffix = 0;
+    if (floating) {
+        tok->type = TOKEN_FLOAT_CONST;
+        if (is_floating_suffix(**c)) {
+            num.float_suffix = **c == 'f' || **c == 'F' ? 'f' : 'l';
+            ADV(c);
+        }
+    } else {
+        tok->type = TOKEN_INT_CONST;
+        if (**c == 'u' || **c == 'U') {
+            ADV(c);
+            num.is_unsigned = true;
+            if (**c == 'l' || **c == 'L') {
+                ADV(c);
+                num.num_longs = 1;
+                if (**c == *(*c-1)) {
+                    ADV(c);
+                    num.num_longs = 2;
+                }
+            }
+        } else if (**c == 'l' || **c == 'L') {
+            ADV(c);
+            num.num_longs = 1;
+            if (**c == *(*c-1)) {
+                ADV(c);
+                num.num_longs = 2;
+            }
+            if (**c == 'u' || **c == 'U') {
+                ADV(c);
+                num.is_unsigned = true;
+            }
+        }
+    }
 
-    /* If there is a period, it's an error. */
-    if (**c == '.')
-        goto error;
+    /* If there is trailing identifier character or a period, it's an
+       error. */
+    if (is_identifier(**c) || **c == '.')
+        return -1;
 
-    /* Copy string. */
-    string_copy(&tok->str, &str);
+    /* Decode the value now, while the digits are still in cache. */
+    if (floating)
+        tok->const_type = number_decode_floating(&num, &tok->float_value,
+                                                 &tok->const_flags);
+    else
+        tok->const_type = number_decode_integer(&num, &tok->int_value,
+                                                &tok->const_flags);
+    if (tok->const_flags) STATS_ADD_ATOMIC(constant_diagnostics, 0, 1);
 
-    string_destroy(&str);
     return 0;
-
-error:
-    string_destroy(&str);
-    *c = co;
-    return -1;
 }
 
-static int read_character_constant(char **c, struct token *tok) {
-    char *const co = *c;
-    struct string str;
-
-    string_init(&str);
+static int read_character_constant(const char **c, struct token *tok) {
     tok->type = TOKEN_CHAR_CONST;
 
-    /* Must start with ', L', u', or U'. */
-    if (**c == '\'') APPADV(str, c);
-    else if ((**c == 'L' || **c == 'u' || **c == 'U') && *(*c+1) == '\'') {
-        APPADV(str, c);
-        APPADV(str, c);
-    }
-    else goto error;
+    /* The encoding prefix, if any, is already read. */
+    ADV(c);
 
     /* Read c-char-sequence. */
-    if (read_c_char_sequence(c, &str)) goto error;
+    if (read_c_char_sequence(c)) return -1;
 
     /* Must end with a single quote. */
-    if (**c != '\'') goto error;
-    APPADV(str, c);
-
-    /* Copy string. */
-    string_copy(&tok->str, &str);
-
-    string_destroy(&str);
+    ADV(c);
     return 0;
-
-error:
-    string_destroy(&str);
-    *c = co;
-    return -1;
 }
 
-static int read_string_literal(char **c, struct token *tok) {
-    char *const co = *c;
-    struct string str;
-
-    string_init(&str);
+static int read_string_literal(const char **c, const char *end, struct token *tok) {
     tok->type = TOKEN_STRING_LITERAL;
 
-    /* Must start with ", u8", u", U", or L". */
-    if (**c == '\"') APPADV(str, c);
-    else if ((**c == 'u' || **c == 'U' || **c == 'L') && *(*c+1) == '\"') {
-        APPADV(str, c);
-        APPADV(str, c);
-    }
-    else if (**c == 'u' && *(*c+1) == '8' && *(*c+2) == '\"') {
-        APPADV(str, c);
-        APPADV(str, c);
-        APPADV(str, c);
-    }
-    else goto error;
+    /* The encoding prefix, if any, is already read. */
+    ADV(c);
 
     /* Read s-char-sequence. */
-    if (read_s_char_sequence(c, &str)) goto error;
+    if (read_s_char_sequence(c, end)) return -1;
 
     /* Must end with a double quote. */
-    if (**c != '\"') goto error;
-    APPADV(str, c);
-
-    /* Copy string. */
-    string_copy(&tok->str, &str);
-
-    string_destroy(&str);
+    ADV(c);
     return 0;
-
-error:
-    string_destroy(&str);
-    *c = co;
-    return -1;
 }
 
-static int read_punctuator(char **c, struct token *tok) {
-    char *const co = *c;
-
-    if (**c == '[') {
+static int read_punctuator(const char **c, struct token *tok) {
+    switch (**c) {
+    case '[':
         ADV(c);
         tok->type = TOKEN_BRACKET_OPEN;
-    } else if (**c == ']') {
+        break;
+    case ']':
         ADV(c);
         tok->type = TOKEN_BRACKET_CLOSE;
-    } else if (**c == '(') {
+        break;
+    case '(':
         ADV(c);
         tok->type = TOKEN_PAREN_OPEN;
-    } else if (**c == ')') {
+        break;
+    case ')':
         ADV(c);
         tok->type = TOKEN_PAREN_CLOSE;
-    } else if (**c == '{') {
+        break;
+    case '{':
         ADV(c);
         tok->type = TOKEN_BRACE_OPEN;
-    } else if (**c == '}') {
+        break;
+    case '}':
         ADV(c);
         tok->type = TOKEN_BRACE_CLOSE;
-    } else if (**c == '.') {
+        break;
+    case '.':
         ADV(c);
         if (**c == '.' && *(*c+1) == '.') {
             ADV(c); ADV(c);
             tok->type = TOKEN_THREE_PERIOD;
         } else
             tok->type = TOKEN_PERIOD;
-    } else if (**c == '-') {
+        break;
+    case '-':
         ADV(c);
         if (**c == '>') {
             ADV(c);
@@ -526,7 +1200,8 @@ static int read_punctuator(char **c, struct token *tok) {
             tok->type = TOKEN_SUB_ASSIGN;
         } else
             tok->type = TOKEN_MINUS;
-    } else if (**c == '+') {
+        break;
+    case '+':
         ADV(c);
         if (**c == '+') {
             ADV(c);
@@ -536,7 +1211,8 @@ static int read_punctuator(char **c, struct token *tok) {
             tok->type = TOKEN_ADD_ASSIGN;
         } else
             tok->type = TOKEN_PLUS;
-    } else if (**c == '&') {
+        break;
+    case '&':
         ADV(c);
         if (**c == '&') {
             ADV(c);
@@ -546,31 +1222,36 @@ static int read_punctuator(char **c, struct token *tok) {
             tok->type = TOKEN_AND_ASSIGN;
         } else
             tok->type = TOKEN_AMPERSAND;
-    } else if (**c == '*') {
+        break;
+    case '*':
         ADV(c);
         if (**c == '=') {
             ADV(c);
             tok->type = TOKEN_MUL_ASSIGN;
         } else
             tok->type = TOKEN_ASTERISK;
-    } else if (**c == '~') {
+        break;
+    case '~':
         ADV(c);
         tok->type = TOKEN_TILDE;
-    } else if (**c == '!') {
+        break;
+    case '!':
         ADV(c);
         if (**c == '=') {
             ADV(c);
             tok->type = TOKEN_NOT_EQUAL;
         } else
             tok->type = TOKEN_EXCLAMATION;
-    } else if (**c == '/') {
+        break;
+    case '/':
         ADV(c);
         if (**c == '=') {
             ADV(c);
             tok->type = TOKEN_DIV_ASSIGN;
         } else
             tok->type = TOKEN_SLASH;
-    } else if (**c == '%') {
+        break;
+    case '%':
         ADV(c);
         if (**c == '=') {
             ADV(c);
@@ -578,25 +1259,28 @@ static int read_punctuator(char **c, struct token *tok) {
         } else if (**c == '>') {
             ADV(c);
             tok->type = TOKEN_BRACE_CLOSE;
-        } else if (**c == ':' && *(*c+1) != '%') {
+        } else if (**c == ':') {
             ADV(c);
-            tok->type = TOKEN_SHARP;
-        } else if (**c == ':' && *(*c+1) == '%' && *(*c+2) == ':') {
-            ADV(c); ADV(c); ADV(c);
-            tok->type = TOKEN_TWO_SHARP;
+            if (**c == '%' && *(*c+1) == ':') {
+                ADV(c); ADV(c);
+                tok->type = TOKEN_TWO_SHARP;
+            } else
+                tok->type = TOKEN_SHARP;
         } else
             tok->type = TOKEN_PERCENT;
-    } else if (**c == '<') {
+        break;
+    case '<':
         ADV(c);
-        if (**c == '<' && *(*c+1) != '=') {
+        if (**c == '<') {
             ADV(c);
-            tok->type = TOKEN_LSHIFT;
+            if (**c == '=') {
+                ADV(c);
+                tok->type = TOKEN_LSHIFT_ASSIGN;
+            } else
+                tok->type = TOKEN_LSHIFT;
         } else if (**c == '=') {
             ADV(c);
             tok->type = TOKEN_LEQ;
-        } else if (**c == '<' && *(*c+1) == '=') {
-            ADV(c); ADV(c);
-            tok->type = TOKEN_LSHIFT_ASSIGN;
         } else if (**c == ':') {
             ADV(c);
             tok->type = TOKEN_BRACKET_OPEN;
@@ -605,34 +1289,39 @@ static int read_punctuator(char **c, struct token *tok) {
             tok->type = TOKEN_BRACE_OPEN;
         } else
             tok->type = TOKEN_LESS_THAN;
-    } else if (**c == '>') {
+        break;
+    case '>':
         ADV(c);
-        if (**c == '>' && *(*c+1) != '=') {
+        if (**c == '>') {
             ADV(c);
-            tok->type = TOKEN_RSHIFT;
+            if (**c == '=') {
+                ADV(c);
+                tok->type = TOKEN_RSHIFT_ASSIGN;
+            } else
+                tok->type = TOKEN_RSHIFT;
         } else if (**c == '=') {
             ADV(c);
             tok->type = TOKEN_GEQ;
-        } else if (**c == '>' && *(*c+1) == '=') {
-            ADV(c); ADV(c);
-            tok->type = TOKEN_RSHIFT_ASSIGN;
         } else
             tok->type = TOKEN_GREATER_THAN;
-    } else if (**c == '=') {
+        break;
+    case '=':
         ADV(c);
         if (**c == '=') {
             ADV(c);
             tok->type = TOKEN_EQUAL;
         } else
             tok->type = TOKEN_ASSIGN;
-    } else if (**c == '^') {
+        break;
+    case '^':
         ADV(c);
         if (**c == '=') {
             ADV(c);
             tok->type = TOKEN_XOR_ASSIGN;
         } else
             tok->type = TOKEN_CARROT;
-    } else if (**c == '|') {
+        break;
+    case '|':
         ADV(c);
         if (**c == '|') {
             ADV(c);
@@ -642,134 +1331,128 @@ static int read_punctuator(char **c, struct token *tok) {
             tok->type = TOKEN_OR_ASSIGN;
         } else
             tok->type = TOKEN_VERT_BAR;
-    } else if (**c == '?') {
+        break;
+    case '?':
         ADV(c);
         tok->type = TOKEN_QUESTION;
-    } else if (**c == ':') {
+        break;
+    case ':':
         ADV(c);
         if (**c == '>') {
             ADV(c);
             tok->type = TOKEN_BRACKET_CLOSE;
         } else
             tok->type = TOKEN_COLON;
-    } else if (**c == ';') {
+        break;
+    case ';':
         ADV(c);
         tok->type = TOKEN_SEMICOLON;
-    } else if (**c == ',') {
+        break;
+    case ',':
         ADV(c);
         tok->type = TOKEN_COMMA;
-    } else if (**c == '#') {
+        break;
+    case '#':
         ADV(c);
         if (**c == '#') {
             ADV(c);
             tok->type = TOKEN_TWO_SHARP;
         } else
             tok->type = TOKEN_SHARP;
-    } else goto error;
+        break;
+    default:
+        return -1;
+    }
 
     return 0;
-
-error:
-    *c = co;
-    return -1;
 }
 
-static int read_universal_character_name(char **c, struct string *str) {
-    printf("not yet implemented\n");
-    return -1;
+static int read_escape_sequence(const char **c) {
+    /* Skip the backslash. */
+    ADV(c);
+
+    /* simple-escape-sequence. */
+    if (is_simple_escape_sequence_character(**c))
+        ADV(c);
+    /* octal-escape-squence. */
+    else if (is_octal_digit(**c)) {
+        ADV(c);
+        if (is_octal_digit(**c)) {
+            ADV(c);
+            if (is_octal_digit(**c)) ADV(c);
+        }
+    }
+    /* hexadecimal-escape-sequence. */
+    else if (**c == 'x') {
+        ADV(c);
+        while (is_hexadecimal_digit(**c)) ADV(c);
+    }
+    /* universal-character-name. */
+    else if (read_universal_character_name(c))
+        return -1;
+
+    return 0;
 }
 
-static int read_c_char_sequence(char **c, struct string *str) {
-    const int leno = str->len;
+static int read_universal_character_name(const char **c) {
+    int cnt;
+
+    /* \u hex-quad or \U hex-quad hex-quad. */
+    if (**c == 'u') cnt = 4;
+    else if (**c == 'U') cnt = 8;
+    else return -1;
+    ADV(c);
+
+    while (cnt--) {
+        if (!is_hexadecimal_digit(**c)) return -1;
+        ADV(c);
+    }
+    return 0;
+}
 
+static int read_c_char_sequence(const char **c) {
     while (**c != '\'') {
         /* c-char-sequence cannot contain a new-line character. */
-        if (**c == '\n') goto error;
+        if (**c == '\n' || **c == '\0') return -1;
 
         /* escape-sequence. */
         if (**c == '\\') {
-            APPADV(*str, c);
-
-            /* simple-escape-sequence. */
-            if (is_simple_escape_sequence_character(**c))
-                APPADV(*str, c);
-            /* octal-escape-squence. */
-            else if (is_octal_digit(**c)) {
-                APPADV(*str, c);
-                if (is_octal_digit(**c)) {
-                    APPADV(*str, c);
-                    if (is_octal_digit(**c)) APPADV(*str, c);
-                }
-            }
-            /* hexadecimal-escape-sequencel. */
-            else if (**c == 'x') {
-                APPADV(*str, c);
-                while (isxdigit(**c)) APPADV(*str, c);
-            }
-            /* universal-character-name. */
-            else if (!read_universal_character_name(c, str)) {}
-            /* Error. */
-            else goto error;
+            if (read_escape_sequence(c)) return -1;
         }
 
         /* Any other character is OK. */
-        else APPADV(*str, c);
+        else ADV(c);
     }
 
     return 0;
-
-error:
-    str->len = leno;
-    str->arr[leno] = '\0';
-    return -1;
 }
 
-static int read_s_char_sequence(char **c, struct string *str) {
-    const int leno = str->len;
+static int read_s_char_sequence(const char **c, const char *end) {
+    while (1) {
+        /* Any character other than a double quote, a backslash, or a new-line
+           is OK. */
+        *c += scan_s_chars(*c, end);
 
-    while (**c != '\"') {
-        /* c-char-sequence cannot contain a new-line character. */
-        if (**c == '\n') goto error;
+        if (**c == '\"')
+            return 0;
 
         /* escape-sequence. */
         if (**c == '\\') {
-            APPADV(*str, c);
-
-            /* simple-escape-sequence. */
-            if (is_simple_escape_sequence_character(**c))
-                APPADV(*str, c);
-            /* octal-escape-squence. */
-            else if (is_octal_digit(**c)) {
-                APPADV(*str, c);
-                if (is_octal_digit(**c)) {
-                    APPADV(*str, c);
-                    if (is_octal_digit(**c)) APPADV(*str, c);
-                }
-            }
-            /* hexadecimal-escape-sequencel. */
-            else if (**c == 'x') {
-                APPADV(*str, c);
-                while (isxdigit(**c)) APPADV(*str, c);
-            }
-            /* universal-character-name. */
-            else if (!read_universal_character_name(c, str)) {}
-            /* Error. */
-            else goto error;
+            if (read_escape_sequence(c)) return -1;
         }
 
-        /* Any other character is OK. */
-        else APPADV(*str, c);
+        /* s-char-sequence cannot contain a new-line character. */
+        else return -1;
     }
+}
 
-    return 0;
-
-error:
-    str->len = leno;
-    str->arr[leno] = '\0';
-    return -1;
+#ifndef NO_STATS
+static const char *token_type_label(size_t i) {
+    return token_type_name(i);
 }
+#endif
 
-static void debug_print_token(struct token t) {
+static void debug_print_token(const char *buf, struct token t) {
     if (t.type < NUM_KEYWORDS) {
         fprintf(stderr, "keyword:%s ", keyword_table[t.type]);
         return;
@@ -780,19 +1463,19 @@ static void debug_print_token(struct token t) {
     }
     switch (t.type) {
     case TOKEN_IDENTIFER:
-        fprintf(stderr, "identifier:%s ", t.str.arr);
+        fprintf(stderr, "identifier:%s ", atom_spelling(t.atom));
         break;
     case TOKEN_INT_CONST:
-        fprintf(stderr, "integer-constant:%s ", t.str.arr);
+        fprintf(stderr, "integer-constant:%.*s ", (int)t.len, buf + t.offset);
         break;
     case TOKEN_FLOAT_CONST:
-        fprintf(stderr, "floating-constant:%s ", t.str.arr);
+        fprintf(stderr, "floating-constant:%.*s ", (int)t.len, buf + t.offset);
         break;
     case TOKEN_CHAR_CONST:
-        fprintf(stderr, "character-constant:%s ", t.str.arr);
+        fprintf(stderr, "character-constant:%.*s ", (int)t.len, buf + t.offset);
         break;
     case TOKEN_STRING_LITERAL:
-        fprintf(stderr, "string-literal:%s ", t.str.arr);
+        fprintf(stderr, "string-literal:%.*s ", (int)t.len, buf + t.offset);
         break;
     default:;
     }
@@ -1,8 +1,13 @@
 #ifndef LEXER_H
 #define LEXER_H
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 
+#include "number.h"
+#include "source.h"
 #include "utils.h"
 
 enum token_type {
@@ -113,13 +118,45 @@ enum token_type {
     TOKEN_SHARP,                /* # or %: */
     TOKEN_TWO_SHARP,            /* ## or %:%: */
 
+    /* End of input. */
+    TOKEN_EOF,
+
     /* Indeterminate. */
     TOKEN_INDETERMINATE,
 };
 
+/* Token flags. */
+/* First token of a line, e.g. the # of a preprocessing directive. */
+#define TOKEN_FLAG_BOL      0x01
+/* Preceded by white space or a comment. */
+#define TOKEN_FLAG_SPACE    0x02
+
+/* A token refers to its spelling by a span of the source buffer, which must
+   outlive the token. Identifiers also carry the atom of their spelling, and
+   integer and floating constants their decoded value. The offset is all a
+   token has of its position: its line and column are looked up in a
+   struct line_table of the source when needed, e.g. for a diagnostic. It is
+   32 bits, which limits a source to 4 GiB. */
 struct token {
     enum token_type type;
-    struct string str;
+    union {
+        uint32_t atom;
+        /* enum const_type and CONST_* flags of a constant. */
+        struct {
+            uint8_t const_type;
+            uint8_t const_flags;
+        };
+    };
+    uint32_t offset;
+    uint32_t len;
+    /* TOKEN_FLAG_* flags. */
+    uint16_t flags;
+    /* Id of the source the spelling is in (struct source). */
+    uint16_t file;
+    union {
+        uint64_t int_value;
+        double float_value;
+    };
 };
 
 struct token_array {
@@ -128,6 +165,118 @@ struct token_array {
     struct token *tokens;
 };
 
-struct token_array lexer(FILE *file);
+/* The tokens are allocated from arena, and grown in it. */
+void token_array_init(struct token_array *tokarr, struct arena *arena,
+                      size_t capacity);
+void token_array_append(struct token_array *tokarr, struct arena *arena,
+                        struct token tok);
+
+/* Bumped whenever the tokens lexed from a given source change, e.g. with a
+   new token type or flag, which invalidates cached token streams. */
+#define LEXER_VERSION 1
+
+/* Streaming lexer. Tokens are produced on demand from a window of the input
+   that holds only the unread lines, so lexing a file takes memory bounded by
+   LEXER_WINDOW_SIZE (or the longest line, if longer). The window of an
+   in-memory source is the source itself. */
+#define LEXER_WINDOW_SIZE 65536
+
+enum lexer_comment {
+    LEXER_NO_COMMENT,
+    LEXER_BLOCK_COMMENT,
+    /* A // comment continued by a line splice. */
+    LEXER_LINE_COMMENT,
+};
+
+struct lexer_state {
+    /* Input file, or NULL when lexing an in-memory source. */
+    FILE *file;
+    /* Window of the input: bytes [base, base + len), followed by a NUL. */
+    char *buf;
+    size_t len;
+    size_t capacity;
+    size_t base;
+    /* Current character, and the end of the complete lines in the window. */
+    const char *pos;
+    const char *limit;
+    bool eof;
+    /* The input goes on past the limit, which is not the end of the file:
+       a comment may be left open there. */
+    bool partial;
+    /* Source id given to the tokens. */
+    uint16_t file_id;
+    /* Whether the next token begins a line, or follows white space, and
+       whether the scan stopped inside a comment. */
+    bool bol;
+    bool space;
+    enum lexer_comment comment;
+    /* Lex preprocessing tokens: a character or pp-number that begins no
+       token is returned as TOKEN_INDETERMINATE instead of an error. */
+    bool pp_tokens;
+    /* Leave identifiers uninterned, with the hash of their spelling as the
+       atom, for the caller to intern with intern_hashed(). */
+    bool defer_intern;
+    /* Token read ahead by lexer_peek(). */
+    struct token peeked;
+    int peeked_status;
+    bool has_peeked;
+};
+
+/* Name of a token type, e.g. "int" or "identifier". */
+const char *token_type_name(enum token_type type);
+
+void lexer_init(struct lexer_state *state, const struct source *src);
+void lexer_init_file(struct lexer_state *state, FILE *file);
+void lexer_destroy(struct lexer_state *state);
+
+/* Read the next token, or TOKEN_EOF at the end of the input. Returns 0 on
+   success and -1 on a lexical or read error, or past 4 GiB of input. */
+int lexer_next(struct lexer_state *state, struct token *tok);
+int lexer_peek(struct lexer_state *state, struct token *tok);
+
+/* Spelling of a token just returned by lexer_next() or lexer_peek(). Valid
+   until the next call to either of them. */
+const char *lexer_spelling(const struct lexer_state *state,
+                           const struct token *tok);
+
+/* Lex a whole source. The token array is allocated from arena, and is
+   released with it. On an error, it holds the tokens before it, and the
+   error is reported on stderr with its line and column. */
+struct token_array lexer(const struct source *src, struct arena *arena);
+
+/* Same as lexer(), but splits the source into chunks that are lexed on jobs
+   threads. The result is identical to that of lexer(). */
+struct token_array lexer_parallel(const struct source *src,
+                                  struct arena *arena, size_t jobs);
+
+/* Lex a whole source into preprocessing tokens for the preprocessor, on jobs
+   threads. Returns 0 on success and -1 on an unterminated comment, or a
+   source too large; tokarr then holds the tokens before the error. */
+int lexer_pp(const struct source *src, struct arena *arena, size_t jobs,
+             struct token_array *tokarr);
+
+/* Offset in src of an error lexing it, given tokarr, the tokens lexed
+   before it: the start of the next token, or of the comment left open. */
+size_t lexer_error_offset(const struct source *src,
+                          const struct token_array *tokarr);
+
+/* An edit of a source: the bytes [offset, offset + old_len) were replaced
+   by new_len bytes. */
+struct lexer_edit {
+    size_t offset;
+    size_t old_len;
+    size_t new_len;
+};
+
+/* Update tokarr, the tokens lexed from a source before edit (in
+   preprocessing-token mode if pp_tokens), to the tokens of src, the source
+   after it. Lexing resumes at the last token boundary before the edit and
+   stops as soon as a token matches one of the old stream past the edit;
+   the old tokens from there on are kept, with their offsets shifted. The
+   result is that of lexing src from scratch. Returns 0 on success and -1
+   on a lexical error, which leaves tokarr unchanged. */
+int lexer_relex(const struct source *src, bool pp_tokens,
+                const struct lexer_edit *edit, struct arena *arena,
+                struct token_array *tokarr);
 
 #endif
\ No newline at end of file
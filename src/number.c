@@ -0,0 +1,415 @@
+#include "number.h"
+#include "pow5.h"
+#include "stats.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Largest number of decimal digits that always fit in 64 bits. */
+#define MAX_DECIMAL_DIGITS 19
+/* Exponents are saturated here; anything larger is out of range anyway. */
+#define MAX_EXPONENT 100000000
+
+/* Binary floating-point format, with the parameters of the Eisel-Lemire
+   algorithm for it. */
+struct float_format {
+    /* Explicitly stored mantissa bits. */
+    int mantissa_bits;
+    /* Exponent of the smallest and largest normal numbers. */
+    int min_exponent;
+    int max_exponent;
+    /* Decimal exponents beyond which every value is zero or infinity. */
+    int smallest_power_of_ten;
+    int largest_power_of_ten;
+    /* Decimal exponents for which a product can be exactly halfway. */
+    int min_round_to_even;
+    int max_round_to_even;
+    /* Largest significand and exponent for Clinger's fast path. */
+    uint64_t max_fast_mantissa;
+    int max_fast_exponent;
+};
+
+static const struct float_format binary64 = {
+    52, -1022, 1023, -342, 308, -4, 23, (uint64_t)1 << 53, 22,
+};
+
+static const struct float_format binary32 = {
+    23, -126, 127, -64, 38, -17, 10, (uint64_t)1 << 24, 10,
+};
+
+/* Significand of a decimal or hexadecimal floating constant: its first
+   significant digits, and how many digits are left out. */
+struct significand {
+    uint64_t digits;
+    size_t kept;
+    size_t dropped;
+    bool truncated;
+};
+
+STATS_COUNTER(float_fallbacks, "number.float_fallbacks");
+
+static uint64_t decimal_digits(const char *p, size_t n);
+static uint32_t eight_digits(const char *p);
+static int digit_value(char c);
+static int64_t exponent_value(const struct number *num);
+static void append_digits(struct significand *sig, const char *p, size_t n,
+                          int base, size_t max_kept);
+static bool eisel_lemire(const struct float_format *fmt, int64_t q,
+                         uint64_t w, uint64_t *bits);
+static double decimal_fallback(const struct number *num, bool single);
+static double hexadecimal_float(const struct float_format *fmt,
+                                const struct significand *sig, int64_t e,
+                                uint8_t *flags);
+
+static const uint64_t pow10_table[MAX_DECIMAL_DIGITS + 1] = {
+    1u, 10u, 100u, 1000u, 10000u, 100000u, 1000000u, 10000000u, 100000000u,
+    1000000000u, 10000000000u, 100000000000u, 1000000000000u,
+    10000000000000u, 100000000000000u, 1000000000000000u,
+    10000000000000000u, 100000000000000000u, 1000000000000000000u,
+    10000000000000000000u,
+};
+
+static const double exact_pow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+enum const_type number_decode_integer(const struct number *num,
+                                      uint64_t *value, uint8_t *flags) {
+    const char *p = num->int_digits;
+    size_t n = num->int_len;
+    const bool decimal = num->base == 10;
+    uint64_t v = 0;
+
+    *flags = 0;
+
+    if (decimal) {
+        /* The first 19 digits cannot overflow; check the others one by
+           one, wrapping around on overflow. */
+        const size_t head = n < MAX_DECIMAL_DIGITS ? n : MAX_DECIMAL_DIGITS;
+        v = decimal_digits(p, head);
+        for (p += head, n -= head; n; p++, n--) {
+            if (__builtin_mul_overflow(v, 10, &v)) *flags |= CONST_OVERFLOW;
+            if (__builtin_add_overflow(v, *p - '0', &v)) *flags |= CONST_OVERFLOW;
+        }
+    } else {
+        const int shift = num->base == 16 ? 4 : 3;
+        for (; n; p++, n--) {
+            if (v >> (64 - shift)) *flags |= CONST_OVERFLOW;
+            v = v << shift | digit_value(*p);
+        }
+    }
+    *value = v;
+
+    /* The first type in the list of C11 6.4.4.1 that can represent the
+       value. Octal and hexadecimal constants may also take the unsigned
+       types. */
+    if (*flags & CONST_OVERFLOW) {
+        *flags |= CONST_NO_TYPE;
+        return CONST_UNSIGNED_LONG_LONG;
+    }
+    if (num->num_longs == 0) {
+        if (!num->is_unsigned && v <= INT32_MAX) return CONST_INT;
+        if ((num->is_unsigned || !decimal) && v <= UINT32_MAX)
+            return CONST_UNSIGNED_INT;
+    }
+    if (num->num_longs <= 1) {
+        if (!num->is_unsigned && v <= INT64_MAX) return CONST_LONG;
+        if (num->is_unsigned || !decimal) return CONST_UNSIGNED_LONG;
+    }
+    if (!num->is_unsigned && v <= INT64_MAX) return CONST_LONG_LONG;
+    if (!num->is_unsigned && decimal) *flags |= CONST_NO_TYPE;
+    return CONST_UNSIGNED_LONG_LONG;
+}
+
+enum const_type number_decode_floating(const struct number *num,
+                                       double *value, uint8_t *flags) {
+    const bool single = num->float_suffix == 'f';
+    const struct float_format *const fmt = single ? &binary32 : &binary64;
+    const enum const_type type = single ? CONST_FLOAT
+                                 : num->float_suffix == 'l' ? CONST_LONG_DOUBLE
+                                 : CONST_DOUBLE;
+    struct significand sig = {0, 0, 0, false};
+    const size_t max_kept = num->base == 16 ? 16 : MAX_DECIMAL_DIGITS;
+    const int64_t exponent = exponent_value(num);
+    int64_t scale, q;
+    uint64_t bits, bits_up;
+
+    *flags = 0;
+
+    append_digits(&sig, num->int_digits, num->int_len, num->base, max_kept);
+    append_digits(&sig, num->frac_digits, num->frac_len, num->base, max_kept);
+
+    /* The value is digits * base^scale * 10^exponent, or 2^exponent for a
+       hexadecimal constant. */
+    scale = (int64_t)sig.dropped - (int64_t)num->frac_len;
+
+    if (num->base == 16) {
+        *value = hexadecimal_float(fmt, &sig, exponent + 4 * scale, flags);
+        return type;
+    }
+    q = exponent + scale;
+
+    if (sig.digits == 0) {
+        *value = 0;
+        return type;
+    }
+
+    /* Clinger's fast path: both the significand and the power of ten are
+       exact, so one correctly rounded operation gives the result. */
+    if (!sig.truncated && sig.digits <= fmt->max_fast_mantissa
+        && q >= -fmt->max_fast_exponent && q <= fmt->max_fast_exponent) {
+        if (single)
+            *value = q < 0 ? (float)sig.digits / (float)exact_pow10[-q]
+                           : (float)sig.digits * (float)exact_pow10[q];
+        else
+            *value = q < 0 ? (double)sig.digits / exact_pow10[-q]
+                           : (double)sig.digits * exact_pow10[q];
+        return type;
+    }
+
+    /* Eisel-Lemire. A truncated significand lies between digits and
+       digits + 1; if both round the same, so does the exact value. */
+    if (eisel_lemire(fmt, q, sig.digits, &bits)
+        && (!sig.truncated || (eisel_lemire(fmt, q, sig.digits + 1, &bits_up)
+                               && bits == bits_up))) {
+        if (single) {
+            const uint32_t bits32 = bits;
+            float f;
+            memcpy(&f, &bits32, sizeof(f));
+            *value = f;
+        } else
+            memcpy(value, &bits, sizeof(*value));
+    } else {
+        STATS_ADD_ATOMIC(float_fallbacks, 0, 1);
+        *value = decimal_fallback(num, single);
+    }
+
+    if (isinf(*value)) *flags |= CONST_OVERFLOW;
+    else if (*value == 0) *flags |= CONST_UNDERFLOW;
+    return type;
+}
+
+/* Value of n <= 19 decimal digits, eight at a time. */
+static uint64_t decimal_digits(const char *p, size_t n) {
+    uint64_t v = 0;
+
+    for (; n >= 8; p += 8, n -= 8)
+        v = v * 100000000 + eight_digits(p);
+    for (; n; p++, n--)
+        v = v * 10 + (*p - '0');
+    return v;
+}
+
+/* Value of eight decimal digits, combined in a 64-bit word: pairs of digits,
+   then pairs of pairs, then the two halves. */
+static uint32_t eight_digits(const char *p) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    uint64_t v;
+
+    memcpy(&v, p, sizeof(v));
+    v -= 0x3030303030303030;
+    v = v * 10 + (v >> 8);
+    v = ((v & 0x000000ff000000ff) * 0x000f424000000064
+         + ((v >> 16) & 0x000000ff000000ff) * 0x0000271000000001) >> 32;
+    return v;
+#else
+    uint32_t v = 0;
+    for (int i = 0; i < 8; i++) v = v * 10 + (p[i] - '0');
+    return v;
+#endif
+}
+
+static int digit_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return c - 'A' + 10;
+}
+
+static int64_t exponent_value(const struct number *num) {
+    int64_t e = 0;
+
+    for (size_t i = 0; i < num->exp_len && e < MAX_EXPONENT; i++)
+        e = e * 10 + (num->exp_digits[i] - '0');
+    return num->exp_negative ? -e : e;
+}
+
+/* Append digits to a significand, skipping leading zeros and keeping at most
+   max_kept significant digits. */
+static void append_digits(struct significand *sig, const char *p, size_t n,
+                          int base, size_t max_kept) {
+    size_t take;
+
+    if (sig->kept == 0)
+        for (; n && *p == '0'; p++, n--);
+
+    take = n < max_kept - sig->kept ? n : max_kept - sig->kept;
+    if (base == 10)
+        sig->digits = sig->digits * pow10_table[take] + decimal_digits(p, take);
+    else
+        for (size_t i = 0; i < take; i++)
+            sig->digits = sig->digits << 4 | digit_value(p[i]);
+    sig->kept += take;
+
+    for (p += take, n -= take; n; p++, n--) {
+        sig->dropped++;
+        if (*p != '0') sig->truncated = true;
+    }
+}
+
+/* Round w * 10^q to the format, as in the fast_float library. Returns false
+   when the 128-bit product is not precise enough to decide the rounding. */
+static bool eisel_lemire(const struct float_format *fmt, int64_t q,
+                         uint64_t w, uint64_t *bits) {
+    const int infinite_power = fmt->max_exponent - fmt->min_exponent + 2;
+    const uint64_t *pow5;
+    unsigned __int128 product;
+    uint64_t high, low, mantissa, precision_mask;
+    int lz, upper_bit, shift;
+    int64_t power2;
+
+    if (w == 0 || q < fmt->smallest_power_of_ten) {
+        *bits = 0;
+        return true;
+    }
+    if (q > fmt->largest_power_of_ten) {
+        *bits = (uint64_t)infinite_power << fmt->mantissa_bits;
+        return true;
+    }
+
+    /* Normalize w and multiply by the truncated 5^q; refine with the lower
+       half of 5^q when the bits that decide the rounding are all ones. */
+    lz = __builtin_clzll(w);
+    w <<= lz;
+    pow5 = pow5_table[q - POW5_MIN_EXPONENT];
+    product = (unsigned __int128)w * pow5[0];
+    high = product >> 64;
+    low = product;
+    precision_mask = UINT64_MAX >> (fmt->mantissa_bits + 3);
+    if ((high & precision_mask) == precision_mask) {
+        const uint64_t second = ((unsigned __int128)w * pow5[1]) >> 64;
+        low += second;
+        if (second > low) high++;
+    }
+    if (low == UINT64_MAX && (q < -27 || q > 55)) return false;
+
+    upper_bit = high >> 63;
+    shift = upper_bit + 64 - fmt->mantissa_bits - 3;
+    mantissa = high >> shift;
+    /* floor(log2(10^q)) + 63, plus the exponent bias. */
+    power2 = (((152170 + 65536) * q) >> 16) + 63 + upper_bit - lz
+             - (fmt->min_exponent - 1);
+
+    if (power2 <= 0) {
+        /* Subnormal, or zero. */
+        if (-power2 + 1 >= 64) {
+            *bits = 0;
+            return true;
+        }
+        mantissa >>= -power2 + 1;
+        mantissa += mantissa & 1;
+        mantissa >>= 1;
+        power2 = mantissa < (uint64_t)1 << fmt->mantissa_bits ? 0 : 1;
+        *bits = (mantissa & (((uint64_t)1 << fmt->mantissa_bits) - 1))
+                | (uint64_t)power2 << fmt->mantissa_bits;
+        return true;
+    }
+
+    /* Exactly halfway between two numbers: round to even. */
+    if (low <= 1 && q >= fmt->min_round_to_even && q <= fmt->max_round_to_even
+        && (mantissa & 3) == 1 && (mantissa << shift) == high)
+        mantissa &= ~(uint64_t)1;
+
+    mantissa += mantissa & 1;
+    mantissa >>= 1;
+    if (mantissa >= (uint64_t)2 << fmt->mantissa_bits) {
+        mantissa = (uint64_t)1 << fmt->mantissa_bits;
+        power2++;
+    }
+    mantissa &= ~((uint64_t)1 << fmt->mantissa_bits);
+    if (power2 >= infinite_power) {
+        power2 = infinite_power;
+        mantissa = 0;
+    }
+
+    *bits = mantissa | (uint64_t)power2 << fmt->mantissa_bits;
+    return true;
+}
+
+/* Correctly rounded conversion of the full spelling by the C library, for
+   the rare constants Eisel-Lemire cannot decide. */
+static double decimal_fallback(const struct number *num, bool single) {
+    char *const str = malloc(num->int_len + num->frac_len + num->exp_len + 4);
+    char *p = str;
+    double value;
+
+    memcpy(p, num->int_digits, num->int_len);
+    p += num->int_len;
+    *p++ = '.';
+    memcpy(p, num->frac_digits, num->frac_len);
+    p += num->frac_len;
+    *p++ = 'e';
+    if (num->exp_negative) *p++ = '-';
+    memcpy(p, num->exp_digits, num->exp_len);
+    p += num->exp_len;
+    *p = '\0';
+
+    value = single ? strtof(str, NULL) : strtod(str, NULL);
+    free(str);
+    return value;
+}
+
+/* Round sig.digits * 2^e, plus a sticky bit for the dropped digits, to the
+   format. Every step but the final rounding is exact. */
+static double hexadecimal_float(const struct float_format *fmt,
+                                const struct significand *sig, int64_t e,
+                                uint8_t *flags) {
+    uint64_t m = sig->digits;
+    int64_t top, bits;
+    uint64_t keep;
+    double value;
+
+    if (m == 0) return 0;
+
+    /* Normalize to m in [2^63, 2^64); top is the exponent of its leading
+       bit. */
+    e -= __builtin_clzll(m);
+    m <<= __builtin_clzll(m);
+    top = e + 63;
+
+    if (top > fmt->max_exponent) {
+        *flags |= CONST_OVERFLOW;
+        return INFINITY;
+    }
+
+    /* Number of significant bits the result can hold at this exponent. */
+    bits = fmt->mantissa_bits + 1;
+    if (top < fmt->min_exponent) bits -= fmt->min_exponent - top;
+
+    if (bits <= 0) {
+        /* Below the smallest subnormal: it rounds up to it only from above
+           half of it. */
+        const uint64_t half = (uint64_t)1 << 63;
+        keep = bits == 0 && (m > half || (m == half && sig->truncated));
+        top = fmt->min_exponent - fmt->mantissa_bits;
+        bits = 1;
+    } else {
+        const int shift = 64 - bits;
+        const uint64_t rem = m & (((uint64_t)1 << shift) - 1);
+        const uint64_t half = (uint64_t)1 << (shift - 1);
+        keep = m >> shift;
+        if (rem > half || (rem == half && (sig->truncated || (keep & 1))))
+            keep++;
+    }
+
+    if (fmt == &binary32)
+        value = ldexpf((float)keep, top - bits + 1);
+    else
+        value = ldexp((double)keep, top - bits + 1);
+
+    if (isinf(value)) *flags |= CONST_OVERFLOW;
+    else if (value == 0) *flags |= CONST_UNDERFLOW;
+    return value;
+}
@@ -0,0 +1,61 @@
+#ifndef NUMBER_H
+#define NUMBER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Type of an integer or floating constant, for an LP64 target: int is 32
+   bits, long and long long are 64 bits. */
+enum const_type {
+    CONST_INT,
+    CONST_UNSIGNED_INT,
+    CONST_LONG,
+    CONST_UNSIGNED_LONG,
+    CONST_LONG_LONG,
+    CONST_UNSIGNED_LONG_LONG,
+    CONST_FLOAT,
+    CONST_DOUBLE,
+    CONST_LONG_DOUBLE,
+};
+
+/* Diagnostics of a decoded constant. */
+/* The value does not fit in 64 bits and was truncated (which also sets
+   CONST_NO_TYPE), or a floating constant is too large and became infinity. */
+#define CONST_OVERFLOW      0x01
+/* An integer constant fits none of the types allowed for it; it was given
+   type unsigned long long. */
+#define CONST_NO_TYPE       0x02
+/* A nonzero floating constant is too small and became zero. */
+#define CONST_UNDERFLOW     0x04
+
+/* A numeric constant split into its parts by the lexer, which has validated
+   the digits already. The exponent is decimal for base 10 and binary for
+   base 16. */
+struct number {
+    /* 8, 10, or 16. */
+    int base;
+    const char *int_digits;
+    size_t int_len;
+    const char *frac_digits;
+    size_t frac_len;
+    const char *exp_digits;
+    size_t exp_len;
+    bool exp_negative;
+    /* Integer suffix. */
+    bool is_unsigned;
+    int num_longs;
+    /* Floating suffix: 0, 'f', or 'l', in lower case. */
+    char float_suffix;
+};
+
+/* Decode an integer constant into *value, returning its type and storing
+   CONST_* flags into *flags. */
+enum const_type number_decode_integer(const struct number *num,
+                                      uint64_t *value, uint8_t *flags);
+/* Same for a floating constant. A long double constant is rounded to double
+   precision, the precision cisc evaluates it in. */
+enum const_type number_decode_floating(const struct number *num,
+                                       double *value, uint8_t *flags);
+
+#endif
@@ -0,0 +1,1126 @@
+#include "parser.h"
+#include "intern.h"
+#include "preprocessor.h"
+#include "stats.h"
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Change to the binding of an identifier, undone at the end of its
+   scope. */
+struct binding {
+    uint32_t atom;
+    bool was_typedef;
+};
+
+struct parser {
+    struct preprocessor *pp;
+    struct arena *arena;
+    struct ast *ast;
+    const struct token *toks;
+    size_t len;
+    size_t pos;
+    /* An error was reported; the position is then kept at the end, so that
+       every loop runs out. */
+    bool failed;
+
+    /* Whether each identifier, by atom, is a typedef name in the innermost
+       scope that declares it, and the changes to undo at scope ends. */
+    bool *typedefs;
+    size_t num_atoms;
+    struct binding *bindings;
+    size_t num_bindings;
+    size_t bindings_capacity;
+
+    /* Nodes of the lists being parsed, the innermost on top. */
+    uint32_t *stack;
+    size_t stack_len;
+    size_t stack_capacity;
+};
+
+/* Binary operators: node kind and binding power by token type. Assignment
+   and the conditional operator associate to the right. */
+enum {
+    BP_NONE,
+    BP_COMMA,
+    BP_ASSIGN,
+    BP_COND,
+    BP_LOG_OR,
+    BP_LOG_AND,
+    BP_BIT_OR,
+    BP_BIT_XOR,
+    BP_BIT_AND,
+    BP_EQUALITY,
+    BP_RELATIONAL,
+    BP_SHIFT,
+    BP_ADDITIVE,
+    BP_MULTIPLICATIVE,
+};
+
+static const uint8_t binary_bp[TOKEN_INDETERMINATE + 1] = {
+    [TOKEN_COMMA] = BP_COMMA,
+    [TOKEN_ASSIGN] = BP_ASSIGN,
+    [TOKEN_MUL_ASSIGN] = BP_ASSIGN,
+    [TOKEN_DIV_ASSIGN] = BP_ASSIGN,
+    [TOKEN_MOD_ASSIGN] = BP_ASSIGN,
+    [TOKEN_ADD_ASSIGN] = BP_ASSIGN,
+    [TOKEN_SUB_ASSIGN] = BP_ASSIGN,
+    [TOKEN_LSHIFT_ASSIGN] = BP_ASSIGN,
+    [TOKEN_RSHIFT_ASSIGN] = BP_ASSIGN,
+    [TOKEN_AND_ASSIGN] = BP_ASSIGN,
+    [TOKEN_XOR_ASSIGN] = BP_ASSIGN,
+    [TOKEN_OR_ASSIGN] = BP_ASSIGN,
+    [TOKEN_QUESTION] = BP_COND,
+    [TOKEN_TWO_VERT_BAR] = BP_LOG_OR,
+    [TOKEN_TWO_AMPERSAND] = BP_LOG_AND,
+    [TOKEN_VERT_BAR] = BP_BIT_OR,
+    [TOKEN_CARROT] = BP_BIT_XOR,
+    [TOKEN_AMPERSAND] = BP_BIT_AND,
+    [TOKEN_EQUAL] = BP_EQUALITY,
+    [TOKEN_NOT_EQUAL] = BP_EQUALITY,
+    [TOKEN_LESS_THAN] = BP_RELATIONAL,
+    [TOKEN_GREATER_THAN] = BP_RELATIONAL,
+    [TOKEN_LEQ] = BP_RELATIONAL,
+    [TOKEN_GEQ] = BP_RELATIONAL,
+    [TOKEN_LSHIFT] = BP_SHIFT,
+    [TOKEN_RSHIFT] = BP_SHIFT,
+    [TOKEN_PLUS] = BP_ADDITIVE,
+    [TOKEN_MINUS] = BP_ADDITIVE,
+    [TOKEN_ASTERISK] = BP_MULTIPLICATIVE,
+    [TOKEN_SLASH] = BP_MULTIPLICATIVE,
+    [TOKEN_PERCENT] = BP_MULTIPLICATIVE,
+};
+
+static const uint8_t binary_kind[TOKEN_INDETERMINATE + 1] = {
+    [TOKEN_COMMA] = AST_COMMA,
+    [TOKEN_ASSIGN] = AST_ASSIGN,
+    [TOKEN_MUL_ASSIGN] = AST_MUL_ASSIGN,
+    [TOKEN_DIV_ASSIGN] = AST_DIV_ASSIGN,
+    [TOKEN_MOD_ASSIGN] = AST_MOD_ASSIGN,
+    [TOKEN_ADD_ASSIGN] = AST_ADD_ASSIGN,
+    [TOKEN_SUB_ASSIGN] = AST_SUB_ASSIGN,
+    [TOKEN_LSHIFT_ASSIGN] = AST_SHL_ASSIGN,
+    [TOKEN_RSHIFT_ASSIGN] = AST_SHR_ASSIGN,
+    [TOKEN_AND_ASSIGN] = AST_AND_ASSIGN,
+    [TOKEN_XOR_ASSIGN] = AST_XOR_ASSIGN,
+    [TOKEN_OR_ASSIGN] = AST_OR_ASSIGN,
+    [TOKEN_QUESTION] = AST_COND,
+    [TOKEN_TWO_VERT_BAR] = AST_LOG_OR,
+    [TOKEN_TWO_AMPERSAND] = AST_LOG_AND,
+    [TOKEN_VERT_BAR] = AST_BIT_OR,
+    [TOKEN_CARROT] = AST_BIT_XOR,
+    [TOKEN_AMPERSAND] = AST_BIT_AND,
+    [TOKEN_EQUAL] = AST_EQ,
+    [TOKEN_NOT_EQUAL] = AST_NE,
+    [TOKEN_LESS_THAN] = AST_LT,
+    [TOKEN_GREATER_THAN] = AST_GT,
+    [TOKEN_LEQ] = AST_LE,
+    [TOKEN_GEQ] = AST_GE,
+    [TOKEN_LSHIFT] = AST_SHL,
+    [TOKEN_RSHIFT] = AST_SHR,
+    [TOKEN_PLUS] = AST_ADD,
+    [TOKEN_MINUS] = AST_SUB,
+    [TOKEN_ASTERISK] = AST_MUL,
+    [TOKEN_SLASH] = AST_DIV,
+    [TOKEN_PERCENT] = AST_MOD,
+};
+
+/* Declaration specifier of each keyword that is one. */
+static const uint32_t keyword_spec[TOKEN_IDENTIFER] = {
+    [TOKEN_VOID] = AST_SPEC_VOID,
+    [TOKEN_CHAR] = AST_SPEC_CHAR,
+    [TOKEN_SHORT] = AST_SPEC_SHORT,
+    [TOKEN_INT] = AST_SPEC_INT,
+    [TOKEN_LONG] = AST_SPEC_LONG,
+    [TOKEN_FLOAT] = AST_SPEC_FLOAT,
+    [TOKEN_DOUBLE] = AST_SPEC_DOUBLE,
+    [TOKEN_SIGNED] = AST_SPEC_SIGNED,
+    [TOKEN_UNSIGNED] = AST_SPEC_UNSIGNED,
+    [TOKEN_BOOL] = AST_SPEC_BOOL,
+    [TOKEN_COMPLEX] = AST_SPEC_COMPLEX,
+    [TOKEN_TYPEDEF] = AST_SPEC_TYPEDEF,
+    [TOKEN_EXTERN] = AST_SPEC_EXTERN,
+    [TOKEN_STATIC] = AST_SPEC_STATIC,
+    [TOKEN_AUTO] = AST_SPEC_AUTO,
+    [TOKEN_REGISTER] = AST_SPEC_REGISTER,
+    [TOKEN_THREAD_LOCAL] = AST_SPEC_THREAD_LOCAL,
+    [TOKEN_INLINE] = AST_SPEC_INLINE,
+    [TOKEN_NORETURN] = AST_SPEC_NORETURN,
+    [TOKEN_CONST] = AST_SPEC_CONST,
+    [TOKEN_VOLATILE] = AST_SPEC_VOLATILE,
+    [TOKEN_RESTRICT] = AST_SPEC_RESTRICT,
+    [TOKEN_ATOMIC] = AST_SPEC_ATOMIC,
+};
+
+STATS_COUNTER(nodes, "parser.nodes");
+STATS_PHASE(parse_phase, "parser");
+
+static enum token_type peek(const struct parser *p);
+static enum token_type peek_at(const struct parser *p, size_t k);
+static uint32_t next(struct parser *p);
+static bool accept(struct parser *p, enum token_type type);
+static uint32_t expect(struct parser *p, enum token_type type);
+static void error(struct parser *p, const char *fmt, ...);
+static void error_expected(struct parser *p, const char *what);
+
+static uint32_t node(struct parser *p, enum ast_kind kind, uint32_t token,
+                     uint32_t lhs, uint32_t rhs);
+static uint32_t pair(struct parser *p, uint32_t a, uint32_t b);
+static size_t list_begin(const struct parser *p);
+static void list_push(struct parser *p, uint32_t i);
+static uint32_t list_end(struct parser *p, size_t mark);
+
+static size_t scope_begin(const struct parser *p);
+static void scope_end(struct parser *p, size_t mark);
+static void declare(struct parser *p, uint32_t name, bool is_typedef);
+static bool is_typedef_name(const struct parser *p, size_t k);
+static bool is_type_start(const struct parser *p, size_t k);
+static bool is_decl_start(const struct parser *p);
+
+static void parse_declaration(struct parser *p, bool external);
+static uint32_t parse_static_assert(struct parser *p);
+static uint32_t parse_decl_specs(struct parser *p, bool storage,
+                                 uint32_t *flags);
+static uint32_t parse_struct(struct parser *p);
+static uint32_t parse_enum(struct parser *p);
+static uint32_t parse_qualifiers(struct parser *p);
+static uint32_t parse_declarator(struct parser *p, uint32_t type,
+                                 uint32_t *name, bool abstract);
+static bool is_nested_declarator(const struct parser *p);
+static uint32_t parse_suffixes(struct parser *p, uint32_t type);
+static uint32_t parse_params(struct parser *p, enum ast_kind *kind);
+static uint32_t parse_type_name(struct parser *p);
+static uint32_t parse_initializer(struct parser *p);
+static uint32_t parse_init_list(struct parser *p);
+
+static uint32_t parse_statement(struct parser *p);
+static uint32_t parse_compound(struct parser *p);
+
+static uint32_t parse_expr(struct parser *p);
+static uint32_t parse_assignment(struct parser *p);
+static uint32_t parse_conditional(struct parser *p);
+static uint32_t parse_binary(struct parser *p, int min_bp);
+static uint32_t parse_cast(struct parser *p);
+static uint32_t parse_unary(struct parser *p);
+static uint32_t parse_postfix(struct parser *p, uint32_t e);
+static uint32_t parse_primary(struct parser *p);
+
+int parse(struct preprocessor *pp, const struct token_array *tokarr,
+          struct arena *arena, struct ast *ast) {
+    struct parser p;
+    size_t mark;
+
+    STATS_BEGIN(parse_phase);
+
+    p.pp = pp;
+    p.arena = arena;
+    p.ast = ast;
+    p.toks = tokarr->tokens;
+    p.len = tokarr->len;
+    p.pos = 0;
+    p.failed = false;
+    p.num_atoms = atom_count() + 1;
+    p.typedefs = calloc(p.num_atoms, sizeof(bool));
+    p.bindings = NULL;
+    p.num_bindings = 0;
+    p.bindings_capacity = 0;
+    p.stack = NULL;
+    p.stack_len = 0;
+    p.stack_capacity = 0;
+
+    /* About one node per token. */
+    ast_init(ast, arena, tokarr, tokarr->len + 16);
+
+    mark = list_begin(&p);
+    while (peek(&p) != TOKEN_EOF) {
+        /* A stray ; between external declarations, as GCC allows. */
+        if (accept(&p, TOKEN_SEMICOLON)) continue;
+        parse_declaration(&p, true);
+    }
+    ast->root = node(&p, AST_TRANSLATION_UNIT, AST_NO_TOKEN,
+                     list_end(&p, mark), 0);
+
+    free(p.typedefs);
+    free(p.bindings);
+    free(p.stack);
+
+    STATS_ADD_ATOMIC(nodes, 0, ast->len);
+    STATS_END(parse_phase);
+    return p.failed ? -1 : 0;
+}
+
+static enum token_type peek(const struct parser *p) {
+    return p->pos < p->len ? p->toks[p->pos].type : TOKEN_EOF;
+}
+
+static enum token_type peek_at(const struct parser *p, size_t k) {
+    return p->pos + k < p->len ? p->toks[p->pos + k].type : TOKEN_EOF;
+}
+
+/* Consume a token, returning its index. */
+static uint32_t next(struct parser *p) {
+    if (p->pos == p->len) return AST_NO_TOKEN;
+    return p->pos++;
+}
+
+static bool accept(struct parser *p, enum token_type type) {
+    if (peek(p) != type) return false;
+    p->pos++;
+    return true;
+}
+
+static uint32_t expect(struct parser *p, enum token_type type) {
+    char what[32];
+
+    if (peek(p) == type) return p->pos++;
+    if (type == TOKEN_IDENTIFER)
+        snprintf(what, sizeof(what), "identifier");
+    else
+        snprintf(what, sizeof(what), "'%s'", token_type_name(type));
+    error_expected(p, what);
+    return AST_NO_TOKEN;
+}
+
+/* Report an error at the current token, once. */
+static void error(struct parser *p, const char *fmt, ...) {
+    FILE *const out = p->pp ? p->pp->diagnostics : stderr;
+    const struct token *tok = NULL;
+    va_list ap;
+
+    if (p->failed) return;
+    p->failed = true;
+
+    if (p->pos < p->len) tok = &p->toks[p->pos];
+    else if (p->len) tok = &p->toks[p->len - 1];
+    if (p->pp && tok)
+        fprintf(out, "%s:%zu:%zu: error: ",
+                preprocessor_file_path(p->pp, tok),
+                preprocessor_line(p->pp, tok),
+                preprocessor_column(p->pp, tok));
+    else
+        fprintf(out, "cisc: error: ");
+    va_start(ap, fmt);
+    vfprintf(out, fmt, ap);
+    va_end(ap);
+    fputc('\n', out);
+
+    p->pos = p->len;
+}
+
+static void error_expected(struct parser *p, const char *what) {
+    const struct token *tok;
+
+    if (p->pos == p->len) {
+        error(p, "expected %s at end of input", what);
+        return;
+    }
+    tok = &p->toks[p->pos];
+    switch (tok->type) {
+    case TOKEN_IDENTIFER:
+        error(p, "expected %s before '%s'", what, atom_spelling(tok->atom));
+        break;
+    case TOKEN_INT_CONST:
+    case TOKEN_FLOAT_CONST:
+        error(p, "expected %s before numeric constant", what);
+        break;
+    case TOKEN_CHAR_CONST:
+        error(p, "expected %s before character constant", what);
+        break;
+    case TOKEN_STRING_LITERAL:
+        error(p, "expected %s before string constant", what);
+        break;
+    default:
+        error(p, "expected %s before '%s'", what, token_type_name(tok->type));
+    }
+}
+
+static uint32_t node(struct parser *p, enum ast_kind kind, uint32_t token,
+                     uint32_t lhs, uint32_t rhs) {
+    return ast_add(p->ast, p->arena, kind, token, lhs, rhs);
+}
+
+static uint32_t pair(struct parser *p, uint32_t a, uint32_t b) {
+    const uint32_t nodes[2] = {a, b};
+    return ast_add_list(p->ast, p->arena, nodes, 2, false);
+}
+
+/* Lists are collected on the stack, and moved to the tree when complete.
+   Lists nested in an item are complete before it is pushed. */
+static size_t list_begin(const struct parser *p) {
+    return p->stack_len;
+}
+
+static void list_push(struct parser *p, uint32_t i) {
+    if (p->stack_len == p->stack_capacity) {
+        p->stack_capacity = p->stack_capacity ? 2 * p->stack_capacity : 64;
+        p->stack = realloc(p->stack, sizeof(uint32_t) * p->stack_capacity);
+    }
+    p->stack[p->stack_len++] = i;
+}
+
+static uint32_t list_end(struct parser *p, size_t mark) {
+    const uint32_t list = ast_add_list(p->ast, p->arena, p->stack + mark,
+                                       p->stack_len - mark, true);
+    p->stack_len = mark;
+    return list;
+}
+
+static size_t scope_begin(const struct parser *p) {
+    return p->num_bindings;
+}
+
+static void scope_end(struct parser *p, size_t mark) {
+    while (p->num_bindings > mark) {
+        const struct binding *const b = &p->bindings[--p->num_bindings];
+        p->typedefs[b->atom] = b->was_typedef;
+    }
+}
+
+/* Declare the identifier at token name in the current scope. */
+static void declare(struct parser *p, uint32_t name, bool is_typedef) {
+    uint32_t atom;
+
+    if (name == AST_NO_TOKEN) return;
+    atom = p->toks[name].atom;
+    if (p->num_bindings == p->bindings_capacity) {
+        p->bindings_capacity = p->bindings_capacity
+                               ? 2 * p->bindings_capacity : 64;
+        p->bindings = realloc(p->bindings, sizeof(struct binding)
+                                           * p->bindings_capacity);
+    }
+    p->bindings[p->num_bindings].atom = atom;
+    p->bindings[p->num_bindings].was_typedef = p->typedefs[atom];
+    p->num_bindings++;
+    p->typedefs[atom] = is_typedef;
+}
+
+static bool is_typedef_name(const struct parser *p, size_t k) {
+    return peek_at(p, k) == TOKEN_IDENTIFER
+           && p->typedefs[p->toks[p->pos + k].atom];
+}
+
+/* Whether the k-th token from here begins a type name. */
+static bool is_type_start(const struct parser *p, size_t k) {
+    const enum token_type type = peek_at(p, k);
+
+    if (type < TOKEN_IDENTIFER && keyword_spec[type])
+        return !(keyword_spec[type] & (AST_SPEC_STORAGE | AST_SPEC_INLINE
+                                       | AST_SPEC_NORETURN));
+    return type == TOKEN_STRUCT || type == TOKEN_UNION || type == TOKEN_ENUM
+           || type == TOKEN_ALIGNAS || is_typedef_name(p, k);
+}
+
+/* Whether a declaration begins here, rather than a statement. */
+static bool is_decl_start(const struct parser *p) {
+    const enum token_type type = peek(p);
+
+    if (type == TOKEN_IDENTIFER)
+        return is_typedef_name(p, 0) && peek_at(p, 1) != TOKEN_COLON;
+    return (type < TOKEN_IDENTIFER && keyword_spec[type])
+           || type == TOKEN_STRUCT || type == TOKEN_UNION
+           || type == TOKEN_ENUM || type == TOKEN_ALIGNAS
+           || type == TOKEN_STATIC_ASSERT;
+}
+
+/* Parse a declaration, or a function definition if external, and push its
+   nodes on the current list, one per declarator. */
+static void parse_declaration(struct parser *p, bool external) {
+    uint32_t flags;
+    uint32_t spec;
+    bool first = true;
+
+    if (peek(p) == TOKEN_STATIC_ASSERT) {
+        list_push(p, parse_static_assert(p));
+        return;
+    }
+
+    spec = parse_decl_specs(p, true, &flags);
+    if (peek(p) == TOKEN_SEMICOLON) {
+        list_push(p, node(p, AST_TAG_DECL, p->ast->tokens[spec], spec, 0));
+        next(p);
+        return;
+    }
+
+    do {
+        uint32_t name;
+        const uint32_t type = parse_declarator(p, spec, &name, false);
+        const uint8_t kind = p->ast->kinds[type];
+
+        if (flags & AST_SPEC_TYPEDEF) {
+            declare(p, name, true);
+            list_push(p, node(p, AST_TYPEDEF, name, type, 0));
+            continue;
+        }
+        declare(p, name, false);
+
+        /* A function definition: its parameters are in the scope of the
+           body. */
+        if (external && first && peek(p) == TOKEN_BRACE_OPEN
+            && (kind == AST_FUNCTION || kind == AST_FUNCTION_VARIADIC
+                || kind == AST_FUNCTION_NO_PROTOTYPE)) {
+            const size_t scope = scope_begin(p);
+            const uint32_t params = p->ast->data[type].rhs;
+            uint32_t body;
+
+            for (size_t i = 0; i < ast_list_len(p->ast, params); i++)
+                declare(p, p->ast->tokens[ast_list(p->ast, params)[i]],
+                        false);
+            body = parse_compound(p);
+            scope_end(p, scope);
+            list_push(p, node(p, AST_FUNC_DEF, name, type, body));
+            return;
+        }
+
+        list_push(p, node(p, AST_DECL, name, type,
+                          accept(p, TOKEN_ASSIGN) ? parse_initializer(p)
+                                                  : 0));
+        first = false;
+    } while (accept(p, TOKEN_COMMA));
+    expect(p, TOKEN_SEMICOLON);
+}
+
+static uint32_t parse_static_assert(struct parser *p) {
+    const uint32_t tok = next(p);
+    uint32_t expr;
+    uint32_t message;
+
+    expect(p, TOKEN_PAREN_OPEN);
+    expr = parse_conditional(p);
+    expect(p, TOKEN_COMMA);
+    message = expect(p, TOKEN_STRING_LITERAL);
+    while (accept(p, TOKEN_STRING_LITERAL)) {}
+    expect(p, TOKEN_PAREN_CLOSE);
+    expect(p, TOKEN_SEMICOLON);
+    return node(p, AST_STATIC_ASSERT, tok, expr, message);
+}
+
+/* Declaration specifiers, or the specifiers and qualifiers of a type name
+   or a member if not storage. */
+static uint32_t parse_decl_specs(struct parser *p, bool storage,
+                                 uint32_t *flags) {
+    const uint32_t first = p->pos;
+    uint32_t ref = 0;
+
+    *flags = 0;
+    while (1) {
+        const enum token_type type = peek(p);
+        uint32_t spec;
+
+        if (type == TOKEN_STRUCT || type == TOKEN_UNION) {
+            if (ref) break;
+            ref = parse_struct(p);
+            continue;
+        }
+        if (type == TOKEN_ENUM) {
+            if (ref) break;
+            ref = parse_enum(p);
+            continue;
+        }
+        if (type == TOKEN_IDENTIFER) {
+            /* A typedef name, unless the type is given already and this
+               is the name declared. */
+            if (ref || (*flags & AST_SPEC_TYPES) || !is_typedef_name(p, 0))
+                break;
+            ref = node(p, AST_TYPEDEF_NAME, next(p), 0, 0);
+            continue;
+        }
+        if (type == TOKEN_ALIGNAS) {
+            /* Parsed, but objects are given their natural alignment. */
+            next(p);
+            expect(p, TOKEN_PAREN_OPEN);
+            if (is_type_start(p, 0)) parse_type_name(p);
+            else parse_conditional(p);
+            expect(p, TOKEN_PAREN_CLOSE);
+            continue;
+        }
+        if (type >= TOKEN_IDENTIFER || !keyword_spec[type]) break;
+
+        spec = keyword_spec[type];
+        if (!storage && (spec & (AST_SPEC_STORAGE | AST_SPEC_INLINE
+                                 | AST_SPEC_NORETURN))) {
+            error(p, "storage class or function specifier '%s' not "
+                     "allowed here", token_type_name(type));
+            break;
+        }
+        if (spec == AST_SPEC_LONG && (*flags & AST_SPEC_LONG)) {
+            if (*flags & AST_SPEC_LONG_LONG) {
+                error(p, "'long long long' is too long");
+                break;
+            }
+            spec = AST_SPEC_LONG_LONG;
+        } else if ((*flags & spec) && !(spec & AST_SPEC_QUALIFIERS)) {
+            error(p, "duplicate '%s'", token_type_name(type));
+            break;
+        }
+        *flags |= spec;
+        next(p);
+    }
+
+    if (p->pos == first) error_expected(p, "declaration specifiers");
+    return node(p, AST_DECL_SPEC, first, *flags, ref);
+}
+
+static uint32_t parse_struct(struct parser *p) {
+    const uint32_t tok = next(p);
+    const enum ast_kind kind = p->toks[tok].type == TOKEN_STRUCT
+                               ? AST_STRUCT : AST_UNION;
+    uint32_t tag = AST_NO_TOKEN;
+    size_t mark;
+
+    if (peek(p) == TOKEN_IDENTIFER) tag = next(p);
+    if (peek(p) != TOKEN_BRACE_OPEN) {
+        if (tag == AST_NO_TOKEN) expect(p, TOKEN_BRACE_OPEN);
+        return node(p, kind, tok, tag, 0);
+    }
+    next(p);
+
+    mark = list_begin(p);
+    while (!accept(p, TOKEN_BRACE_CLOSE) && !p->failed) {
+        uint32_t flags;
+        uint32_t spec;
+
+        if (peek(p) == TOKEN_STATIC_ASSERT) {
+            list_push(p, parse_static_assert(p));
+            continue;
+        }
+        spec = parse_decl_specs(p, false, &flags);
+        /* An anonymous structure or union. */
+        if (accept(p, TOKEN_SEMICOLON)) {
+            list_push(p, node(p, AST_FIELD, AST_NO_TOKEN, spec, 0));
+            continue;
+        }
+        do {
+            uint32_t name = AST_NO_TOKEN;
+            uint32_t type = spec;
+            uint32_t width = 0;
+
+            if (peek(p) != TOKEN_COLON)
+                type = parse_declarator(p, spec, &name, false);
+            if (accept(p, TOKEN_COLON)) width = parse_conditional(p);
+            list_push(p, node(p, AST_FIELD, name, type, width));
+        } while (accept(p, TOKEN_COMMA));
+        expect(p, TOKEN_SEMICOLON);
+    }
+    return node(p, kind, tok, tag, list_end(p, mark));
+}
+
+static uint32_t parse_enum(struct parser *p) {
+    const uint32_t tok = next(p);
+    uint32_t tag = AST_NO_TOKEN;
+    size_t mark;
+
+    if (peek(p) == TOKEN_IDENTIFER) tag = next(p);
+    if (peek(p) != TOKEN_BRACE_OPEN) {
+        if (tag == AST_NO_TOKEN) expect(p, TOKEN_BRACE_OPEN);
+        return node(p, AST_ENUM, tok, tag, 0);
+    }
+    next(p);
+
+    mark = list_begin(p);
+    while (peek(p) != TOKEN_BRACE_CLOSE && !p->failed) {
+        const uint32_t name = expect(p, TOKEN_IDENTIFER);
+        const uint32_t value = accept(p, TOKEN_ASSIGN) ? parse_conditional(p)
+                                                       : 0;
+        declare(p, name, false);
+        list_push(p, node(p, AST_ENUMERATOR, name, value, 0));
+        if (!accept(p, TOKEN_COMMA)) break;
+    }
+    expect(p, TOKEN_BRACE_CLOSE);
+    return node(p, AST_ENUM, tok, tag, list_end(p, mark));
+}
+
+static uint32_t parse_qualifiers(struct parser *p) {
+    uint32_t flags = 0;
+
+    while (peek(p) < TOKEN_IDENTIFER
+           && (keyword_spec[peek(p)] & AST_SPEC_QUALIFIERS))
+        flags |= keyword_spec[p->toks[next(p)].type];
+    return flags;
+}
+
+/* Parse a declarator of the given type, storing the token of its name into
+   *name, or AST_NO_TOKEN if abstract and there is none. Returns the type
+   declared. */
+static uint32_t parse_declarator(struct parser *p, uint32_t type,
+                                 uint32_t *name, bool abstract) {
+    while (peek(p) == TOKEN_ASTERISK) {
+        const uint32_t tok = next(p);
+        type = node(p, AST_POINTER, tok, type, parse_qualifiers(p));
+    }
+
+    /* In (D) suffixes, D applies to the type with the suffixes, which are
+       parsed after it: D is built on a placeholder that is then filled in
+       with that type. */
+    if (peek(p) == TOKEN_PAREN_OPEN && is_nested_declarator(p)) {
+        struct ast *const ast = p->ast;
+        uint32_t hole;
+        uint32_t inner;
+        uint32_t outer;
+
+        next(p);
+        hole = node(p, AST_NONE, AST_NO_TOKEN, 0, 0);
+        inner = parse_declarator(p, hole, name, abstract);
+        expect(p, TOKEN_PAREN_CLOSE);
+        outer = parse_suffixes(p, type);
+        ast->kinds[hole] = ast->kinds[outer];
+        ast->tokens[hole] = ast->tokens[outer];
+        ast->data[hole] = ast->data[outer];
+        return inner;
+    }
+
+    *name = AST_NO_TOKEN;
+    if (peek(p) == TOKEN_IDENTIFER) *name = next(p);
+    else if (!abstract) error_expected(p, "identifier or '('");
+    return parse_suffixes(p, type);
+}
+
+/* Whether the ( here opens a nested declarator rather than a parameter
+   list. */
+static bool is_nested_declarator(const struct parser *p) {
+    const enum token_type type = peek_at(p, 1);
+
+    if (type == TOKEN_IDENTIFER) return !is_typedef_name(p, 1);
+    return type == TOKEN_ASTERISK || type == TOKEN_PAREN_OPEN
+           || type == TOKEN_BRACKET_OPEN;
+}
+
+/* Array and function suffixes, of which the leftmost is the outermost. */
+static uint32_t parse_suffixes(struct parser *p, uint32_t type) {
+    if (peek(p) == TOKEN_BRACKET_OPEN) {
+        const uint32_t tok = next(p);
+        uint32_t len = 0;
+
+        accept(p, TOKEN_STATIC);
+        parse_qualifiers(p);
+        accept(p, TOKEN_STATIC);
+        if (peek(p) == TOKEN_ASTERISK && peek_at(p, 1) == TOKEN_BRACKET_CLOSE)
+            next(p);
+        else if (peek(p) != TOKEN_BRACKET_CLOSE)
+            len = parse_assignment(p);
+        expect(p, TOKEN_BRACKET_CLOSE);
+        return node(p, AST_ARRAY, tok, parse_suffixes(p, type), len);
+    }
+    if (peek(p) == TOKEN_PAREN_OPEN) {
+        const uint32_t tok = next(p);
+        enum ast_kind kind;
+        const uint32_t params = parse_params(p, &kind);
+        return node(p, kind, tok, parse_suffixes(p, type), params);
+    }
+    return type;
+}
+
+/* Parameter list, after the (. */
+static uint32_t parse_params(struct parser *p, enum ast_kind *kind) {
+    size_t mark;
+    size_t scope;
+
+    *kind = AST_FUNCTION_NO_PROTOTYPE;
+    if (accept(p, TOKEN_PAREN_CLOSE)) return 0;
+
+    *kind = AST_FUNCTION;
+    mark = list_begin(p);
+    scope = scope_begin(p);
+    do {
+        uint32_t flags;
+        uint32_t spec;
+        uint32_t type;
+        uint32_t name;
+
+        if (accept(p, TOKEN_THREE_PERIOD)) {
+            *kind = AST_FUNCTION_VARIADIC;
+            break;
+        }
+        spec = parse_decl_specs(p, true, &flags);
+        type = parse_declarator(p, spec, &name, true);
+        declare(p, name, false);
+        list_push(p, node(p, AST_PARAM, name, type, 0));
+    } while (accept(p, TOKEN_COMMA));
+    expect(p, TOKEN_PAREN_CLOSE);
+    scope_end(p, scope);
+
+    /* (void) declares no parameters. */
+    if (p->stack_len - mark == 1 && *kind == AST_FUNCTION) {
+        const struct ast *const ast = p->ast;
+        const uint32_t param = p->stack[mark];
+        const uint32_t type = ast->data[param].lhs;
+        if (ast->tokens[param] == AST_NO_TOKEN
+            && ast->kinds[type] == AST_DECL_SPEC
+            && ast->data[type].lhs == AST_SPEC_VOID && !ast->data[type].rhs)
+            p->stack_len = mark;
+    }
+    return list_end(p, mark);
+}
+
+static uint32_t parse_type_name(struct parser *p) {
+    uint32_t flags;
+    uint32_t name;
+    const uint32_t spec = parse_decl_specs(p, false, &flags);
+    const uint32_t type = parse_declarator(p, spec, &name, true);
+
+    if (name != AST_NO_TOKEN) {
+        p->pos = name;
+        error(p, "unexpected identifier in type name");
+    }
+    return type;
+}
+
+static uint32_t parse_initializer(struct parser *p) {
+    if (peek(p) == TOKEN_BRACE_OPEN) return parse_init_list(p);
+    return parse_assignment(p);
+}
+
+static uint32_t parse_init_list(struct parser *p) {
+    const uint32_t tok = expect(p, TOKEN_BRACE_OPEN);
+    const size_t mark = list_begin(p);
+
+    while (peek(p) != TOKEN_BRACE_CLOSE && !p->failed) {
+        if (peek(p) == TOKEN_BRACKET_OPEN || peek(p) == TOKEN_PERIOD) {
+            const uint32_t first = p->pos;
+            const size_t designators = list_begin(p);
+            uint32_t list;
+
+            while (1) {
+                if (peek(p) == TOKEN_BRACKET_OPEN) {
+                    const uint32_t bracket = next(p);
+                    const uint32_t index = parse_conditional(p);
+                    expect(p, TOKEN_BRACKET_CLOSE);
+                    list_push(p, node(p, AST_DESIG_INDEX, bracket, index, 0));
+                } else if (accept(p, TOKEN_PERIOD)) {
+                    list_push(p, node(p, AST_DESIG_FIELD,
+                                      expect(p, TOKEN_IDENTIFER), 0, 0));
+                } else {
+                    break;
+                }
+            }
+            expect(p, TOKEN_ASSIGN);
+            list = list_end(p, designators);
+            list_push(p, node(p, AST_DESIGNATION, first, list,
+                              parse_initializer(p)));
+        } else {
+            list_push(p, parse_initializer(p));
+        }
+        if (!accept(p, TOKEN_COMMA)) break;
+    }
+    expect(p, TOKEN_BRACE_CLOSE);
+    return node(p, AST_INIT_LIST, tok, list_end(p, mark), 0);
+}
+
+static uint32_t parse_statement(struct parser *p) {
+    const uint32_t tok = p->pos;
+    uint32_t a;
+    uint32_t b;
+
+    switch (peek(p)) {
+    case TOKEN_BRACE_OPEN:
+        return parse_compound(p);
+
+    case TOKEN_IF:
+        next(p);
+        expect(p, TOKEN_PAREN_OPEN);
+        a = parse_expr(p);
+        expect(p, TOKEN_PAREN_CLOSE);
+        b = parse_statement(p);
+        return node(p, AST_IF, tok, a,
+                    pair(p, b, accept(p, TOKEN_ELSE) ? parse_statement(p)
+                                                     : 0));
+
+    case TOKEN_SWITCH:
+    case TOKEN_WHILE:
+        next(p);
+        expect(p, TOKEN_PAREN_OPEN);
+        a = parse_expr(p);
+        expect(p, TOKEN_PAREN_CLOSE);
+        b = parse_statement(p);
+        return node(p, p->toks[tok].type == TOKEN_SWITCH ? AST_SWITCH
+                                                         : AST_WHILE,
+                    tok, a, b);
+
+    case TOKEN_DO:
+        next(p);
+        a = parse_statement(p);
+        expect(p, TOKEN_WHILE);
+        expect(p, TOKEN_PAREN_OPEN);
+        b = parse_expr(p);
+        expect(p, TOKEN_PAREN_CLOSE);
+        expect(p, TOKEN_SEMICOLON);
+        return node(p, AST_DO, tok, a, b);
+
+    case TOKEN_FOR: {
+        /* The first clause may declare variables, scoped to the loop. */
+        const size_t scope = scope_begin(p);
+        uint32_t clauses[3] = {0, 0, 0};
+        uint32_t body;
+
+        next(p);
+        expect(p, TOKEN_PAREN_OPEN);
+        if (is_decl_start(p)) {
+            const size_t mark = list_begin(p);
+            const uint32_t first = p->pos;
+            parse_declaration(p, false);
+            clauses[0] = node(p, AST_DECL_LIST, first, list_end(p, mark), 0);
+        } else {
+            if (peek(p) != TOKEN_SEMICOLON) clauses[0] = parse_expr(p);
+            expect(p, TOKEN_SEMICOLON);
+        }
+        if (peek(p) != TOKEN_SEMICOLON) clauses[1] = parse_expr(p);
+        expect(p, TOKEN_SEMICOLON);
+        if (peek(p) != TOKEN_PAREN_CLOSE) clauses[2] = parse_expr(p);
+        expect(p, TOKEN_PAREN_CLOSE);
+        body = parse_statement(p);
+        scope_end(p, scope);
+        return node(p, AST_FOR, tok,
+                    ast_add_list(p->ast, p->arena, clauses, 3, false), body);
+    }
+
+    case TOKEN_GOTO:
+        next(p);
+        a = expect(p, TOKEN_IDENTIFER);
+        expect(p, TOKEN_SEMICOLON);
+        return node(p, AST_GOTO, a, 0, 0);
+
+    case TOKEN_CONTINUE:
+    case TOKEN_BREAK:
+        next(p);
+        expect(p, TOKEN_SEMICOLON);
+        return node(p, p->toks[tok].type == TOKEN_BREAK ? AST_BREAK
+                                                        : AST_CONTINUE,
+                    tok, 0, 0);
+
+    case TOKEN_RETURN:
+        next(p);
+        a = peek(p) == TOKEN_SEMICOLON ? 0 : parse_expr(p);
+        expect(p, TOKEN_SEMICOLON);
+        return node(p, AST_RETURN, tok, a, 0);
+
+    case TOKEN_CASE:
+        next(p);
+        a = parse_conditional(p);
+        expect(p, TOKEN_COLON);
+        return node(p, AST_CASE, tok, a, parse_statement(p));
+
+    case TOKEN_DEFAULT:
+        next(p);
+        expect(p, TOKEN_COLON);
+        return node(p, AST_DEFAULT, tok, parse_statement(p), 0);
+
+    case TOKEN_IDENTIFER:
+        if (peek_at(p, 1) == TOKEN_COLON) {
+            p->pos += 2;
+            return node(p, AST_LABEL, tok, parse_statement(p), 0);
+        }
+        break;
+
+    case TOKEN_SEMICOLON:
+        next(p);
+        return node(p, AST_EXPR_STMT, tok, 0, 0);
+
+    default:
+        break;
+    }
+
+    a = parse_expr(p);
+    expect(p, TOKEN_SEMICOLON);
+    return node(p, AST_EXPR_STMT, tok, a, 0);
+}
+
+static uint32_t parse_compound(struct parser *p) {
+    const uint32_t tok = expect(p, TOKEN_BRACE_OPEN);
+    const size_t scope = scope_begin(p);
+    const size_t mark = list_begin(p);
+    uint32_t list;
+
+    while (peek(p) != TOKEN_BRACE_CLOSE && peek(p) != TOKEN_EOF) {
+        if (is_decl_start(p)) parse_declaration(p, false);
+        else list_push(p, parse_statement(p));
+    }
+    expect(p, TOKEN_BRACE_CLOSE);
+    list = list_end(p, mark);
+    scope_end(p, scope);
+    return node(p, AST_COMPOUND, tok, list, 0);
+}
+
+static uint32_t parse_expr(struct parser *p) {
+    return parse_binary(p, BP_COMMA);
+}
+
+static uint32_t parse_assignment(struct parser *p) {
+    return parse_binary(p, BP_ASSIGN);
+}
+
+static uint32_t parse_conditional(struct parser *p) {
+    return parse_binary(p, BP_COND);
+}
+
+/* Operators binding at least as tightly as min_bp, by precedence
+   climbing. */
+static uint32_t parse_binary(struct parser *p, int min_bp) {
+    uint32_t lhs = parse_cast(p);
+
+    while (1) {
+        const enum token_type type = peek(p);
+        const int bp = binary_bp[type];
+        uint32_t tok;
+        uint32_t rhs;
+
+        if (bp == BP_NONE || bp < min_bp) break;
+        tok = next(p);
+        if (type == TOKEN_QUESTION) {
+            const uint32_t then = parse_expr(p);
+            expect(p, TOKEN_COLON);
+            rhs = pair(p, then, parse_binary(p, BP_COND));
+        } else if (bp == BP_ASSIGN) {
+            rhs = parse_binary(p, BP_ASSIGN);
+        } else {
+            rhs = parse_binary(p, bp + 1);
+        }
+        lhs = node(p, binary_kind[type], tok, lhs, rhs);
+    }
+    return lhs;
+}
+
+static uint32_t parse_cast(struct parser *p) {
+    uint32_t tok;
+    uint32_t type;
+
+    if (peek(p) != TOKEN_PAREN_OPEN || !is_type_start(p, 1))
+        return parse_unary(p);
+
+    tok = next(p);
+    type = parse_type_name(p);
+    expect(p, TOKEN_PAREN_CLOSE);
+    if (peek(p) == TOKEN_BRACE_OPEN)
+        return parse_postfix(p, node(p, AST_COMPOUND_LITERAL, tok, type,
+                                     parse_init_list(p)));
+    return node(p, AST_CAST, tok, type, parse_cast(p));
+}
+
+static uint32_t parse_unary(struct parser *p) {
+    const uint32_t tok = p->pos;
+    enum ast_kind kind;
+    uint32_t type;
+
+    switch (peek(p)) {
+    case TOKEN_TWO_PLUS: kind = AST_PRE_INC; break;
+    case TOKEN_TWO_MINUS: kind = AST_PRE_DEC; break;
+    case TOKEN_AMPERSAND: kind = AST_ADDR; break;
+    case TOKEN_ASTERISK: kind = AST_DEREF; break;
+    case TOKEN_PLUS: kind = AST_PLUS; break;
+    case TOKEN_MINUS: kind = AST_NEG; break;
+    case TOKEN_TILDE: kind = AST_BIT_NOT; break;
+    case TOKEN_EXCLAMATION: kind = AST_NOT; break;
+
+    case TOKEN_SIZEOF:
+        next(p);
+        if (peek(p) != TOKEN_PAREN_OPEN || !is_type_start(p, 1))
+            return node(p, AST_SIZEOF_EXPR, tok, parse_unary(p), 0);
+        next(p);
+        type = parse_type_name(p);
+        expect(p, TOKEN_PAREN_CLOSE);
+        /* sizeof (T){...} is the size of a compound literal. */
+        if (peek(p) == TOKEN_BRACE_OPEN)
+            return node(p, AST_SIZEOF_EXPR, tok,
+                        parse_postfix(p, node(p, AST_COMPOUND_LITERAL,
+                                              tok + 1, type,
+                                              parse_init_list(p))),
+                        0);
+        return node(p, AST_SIZEOF_TYPE, tok, type, 0);
+
+    case TOKEN_ALIGNOF:
+        next(p);
+        expect(p, TOKEN_PAREN_OPEN);
+        type = parse_type_name(p);
+        expect(p, TOKEN_PAREN_CLOSE);
+        return node(p, AST_ALIGNOF, tok, type, 0);
+
+    default:
+        return parse_postfix(p, parse_primary(p));
+    }
+
+    next(p);
+    /* ++ and -- apply to a unary expression, the others to a cast. */
+    if (kind == AST_PRE_INC || kind == AST_PRE_DEC)
+        return node(p, kind, tok, parse_unary(p), 0);
+    return node(p, kind, tok, parse_cast(p), 0);
+}
+
+static uint32_t parse_postfix(struct parser *p, uint32_t e) {
+    while (1) {
+        const uint32_t tok = p->pos;
+        uint32_t rhs;
+        size_t mark;
+
+        switch (peek(p)) {
+        case TOKEN_BRACKET_OPEN:
+            next(p);
+            rhs = parse_expr(p);
+            expect(p, TOKEN_BRACKET_CLOSE);
+            e = node(p, AST_INDEX, tok, e, rhs);
+            break;
+
+        case TOKEN_PAREN_OPEN:
+            next(p);
+            mark = list_begin(p);
+            if (peek(p) != TOKEN_PAREN_CLOSE) {
+                do list_push(p, parse_assignment(p));
+                while (accept(p, TOKEN_COMMA));
+            }
+            expect(p, TOKEN_PAREN_CLOSE);
+            e = node(p, AST_CALL, tok, e, list_end(p, mark));
+            break;
+
+        case TOKEN_PERIOD:
+        case TOKEN_ARROW:
+            next(p);
+            rhs = expect(p, TOKEN_IDENTIFER);
+            e = node(p, p->toks[tok].type == TOKEN_PERIOD ? AST_MEMBER
+                                                          : AST_PTR_MEMBER,
+                     tok, e, rhs);
+            break;
+
+        case TOKEN_TWO_PLUS:
+            next(p);
+            e = node(p, AST_POST_INC, tok, e, 0);
+            break;
+
+        case TOKEN_TWO_MINUS:
+            next(p);
+            e = node(p, AST_POST_DEC, tok, e, 0);
+            break;
+
+        default:
+            return e;
+        }
+    }
+}
+
+static uint32_t parse_primary(struct parser *p) {
+    const uint32_t tok = p->pos;
+    uint32_t e;
+
+    switch (peek(p)) {
+    case TOKEN_IDENTIFER:
+        return node(p, AST_IDENT, next(p), 0, 0);
+    case TOKEN_INT_CONST:
+        return node(p, AST_INT_CONST, next(p), 0, 0);
+    case TOKEN_FLOAT_CONST:
+        return node(p, AST_FLOAT_CONST, next(p), 0, 0);
+    case TOKEN_CHAR_CONST:
+        return node(p, AST_CHAR_CONST, next(p), 0, 0);
+    case TOKEN_STRING_LITERAL:
+        while (accept(p, TOKEN_STRING_LITERAL)) {}
+        return node(p, AST_STRING, tok, p->pos - tok, 0);
+    case TOKEN_PAREN_OPEN:
+        next(p);
+        e = parse_expr(p);
+        expect(p, TOKEN_PAREN_CLOSE);
+        return e;
+    case TOKEN_GENERIC:
+        error(p, "_Generic is not supported");
+        return 0;
+    default:
+        error_expected(p, "expression");
+        return 0;
+    }
+}
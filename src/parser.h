@@ -0,0 +1,27 @@
+#ifndef PARSER_H
+#define PARSER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ast.h"
+#include "lexer.h"
+#include "utils.h"
+
+struct preprocessor;
+
+/* Parse the tokens of a translation unit, as returned by preprocess(), into
+   ast, whose arrays are allocated from arena. A recursive-descent parser for
+   declarations and statements, and a Pratt parser for expressions.
+
+   Typedef names are told from other identifiers as C requires, by tracking
+   which of them are declared as typedefs in each scope, so that e.g. T * x;
+   is a declaration if T is a typedef name and a multiplication otherwise.
+
+   Errors are reported on pp->diagnostics at their location in the files of
+   pp, or on stderr without one if pp is NULL, and parsing stops at the
+   first. Returns 0 on success and -1 on an error. */
+int parse(struct preprocessor *pp, const struct token_array *tokarr,
+          struct arena *arena, struct ast *ast);
+
+#endif
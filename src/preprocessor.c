@@ -0,0 +1,1891 @@
+#include "preprocessor.h"
+#include "intern.h"
+#include "stats.h"
+
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Deepest nesting of #include. */
+#define MAX_INCLUDE_DEPTH 200
+/* Size of a scratch buffer for the spellings made by ## and #. */
+#define SCRATCH_SIZE 65536
+
+struct pp_file {
+    /* Path the file was opened by, which __FILE__ expands to, and its
+       directory with a trailing slash, for quoted includes. */
+    const char *path;
+    const char *dir;
+    struct source src;
+    struct token_array tokens;
+    /* Macro whose #ifndef wraps the whole file, or ATOM_NONE. */
+    uint32_t guard;
+    /* Marked with #pragma once. */
+    bool once;
+    /* Scratch buffer, with no tokens of its own. */
+    bool scratch;
+    /* Where the lines of the source start, for diagnostics and __LINE__. */
+    struct line_table lines;
+};
+
+/* Names a token must not be expanded as, since it came out of their
+   expansion. The sets are small and shared between tokens. */
+struct hideset {
+    uint32_t name;
+    struct hideset *next;
+};
+
+struct pp_token {
+    struct token tok;
+    struct hideset *hs;
+};
+
+struct pp_tokens {
+    size_t len;
+    size_t capacity;
+    struct pp_token *data;
+};
+
+enum macro_kind {
+    MACRO_OBJECT,
+    MACRO_FUNCTION,
+    /* __FILE__ and __LINE__. */
+    MACRO_FILE,
+    MACRO_LINE,
+};
+
+struct macro {
+    enum macro_kind kind;
+    /* Parameters, the last of which is __VA_ARGS__ if variadic. */
+    size_t num_params;
+    uint32_t *params;
+    bool variadic;
+    size_t body_len;
+    struct token *body;
+    /* Parameter each body token names, or -1. */
+    int *param_index;
+    /* Memoized full expansion of an object-like macro, made in epoch; NULL
+       if the expansion depends on the tokens after the macro. */
+    uint64_t expansion_epoch;
+    size_t expansion_len;
+    struct pp_token *expansion;
+};
+
+struct pp_context {
+    /* File being read, or NULL for the tokens of a macro expansion. */
+    struct pp_file *file;
+    const struct pp_token *tokens;
+    /* Tokens freed when the context is popped. */
+    struct pp_token *owned;
+    size_t pos;
+    size_t len;
+    /* Depth of the #if stack when the file was entered, and the index in
+       the search path of the directory it was found in, or -1. */
+    size_t cond_base;
+    size_t dir_index;
+    /* Reading stops at the end of a barrier context instead of going on to
+       the one below: the tokens are expanded in isolation. hit is set when
+       an expansion needed tokens past the end, which is an error unless
+       quiet. */
+    bool barrier;
+    bool quiet;
+    bool hit;
+};
+
+struct pp_cond {
+    /* A group of the conditional has been taken. */
+    bool taken;
+    bool seen_else;
+};
+
+enum directive {
+    DIRECTIVE_NONE,
+    DIRECTIVE_IF,
+    DIRECTIVE_IFDEF,
+    DIRECTIVE_IFNDEF,
+    DIRECTIVE_ELIF,
+    DIRECTIVE_ELSE,
+    DIRECTIVE_ENDIF,
+    DIRECTIVE_INCLUDE,
+    DIRECTIVE_INCLUDE_NEXT,
+    DIRECTIVE_DEFINE,
+    DIRECTIVE_UNDEF,
+    DIRECTIVE_LINE,
+    DIRECTIVE_ERROR,
+    DIRECTIVE_WARNING,
+    DIRECTIVE_PRAGMA,
+    NUM_DIRECTIVES,
+};
+
+/* Value of an #if expression: intmax_t or uintmax_t. */
+struct pp_value {
+    uint64_t v;
+    bool is_unsigned;
+};
+
+struct pp_expr {
+    struct preprocessor *pp;
+    const struct pp_token *tokens;
+    size_t len;
+    size_t pos;
+    /* Inside an operand that is not evaluated, e.g. the right of a false
+       &&, where division by zero is no error. */
+    int unevaluated;
+    bool error;
+};
+
+static const char *directive_names[NUM_DIRECTIVES] = {
+    [DIRECTIVE_IFDEF] = "ifdef",
+    [DIRECTIVE_IFNDEF] = "ifndef",
+    [DIRECTIVE_ELIF] = "elif",
+    [DIRECTIVE_ENDIF] = "endif",
+    [DIRECTIVE_INCLUDE] = "include",
+    [DIRECTIVE_INCLUDE_NEXT] = "include_next",
+    [DIRECTIVE_DEFINE] = "define",
+    [DIRECTIVE_UNDEF] = "undef",
+    [DIRECTIVE_LINE] = "line",
+    [DIRECTIVE_ERROR] = "error",
+    [DIRECTIVE_WARNING] = "warning",
+    [DIRECTIVE_PRAGMA] = "pragma",
+};
+
+/* Atoms of the directive names, of the keywords, which are identifiers to
+   the preprocessor, and of a few other names. */
+static uint32_t directive_atoms[NUM_DIRECTIVES];
+static uint32_t keyword_atoms[TOKEN_IDENTIFER];
+static uint32_t atom_defined;
+static uint32_t atom_va_args;
+static uint32_t atom_once;
+
+STATS_PHASE(pp_phase, "pp");
+STATS_COUNTER(files_lexed, "pp.files_lexed");
+STATS_COUNTER(includes, "pp.includes");
+STATS_COUNTER(include_skips, "pp.include_skips");
+STATS_COUNTER(directives, "pp.directives");
+STATS_COUNTER(expansions, "pp.expansions");
+STATS_COUNTER(memo_hits, "pp.memo_hits");
+STATS_COUNTER(skipped_tokens, "pp.skipped_tokens");
+
+static void pp_tokens_append(struct pp_tokens *v, const struct pp_token *t);
+
+static void error_at(struct preprocessor *pp, const struct token *tok,
+                     const char *kind, const char *fmt, ...);
+static size_t line_of(struct pp_file *file, size_t offset);
+static size_t column_of(struct pp_file *file, size_t offset);
+static struct pp_file *location_file(struct preprocessor *pp,
+                                     const struct token *tok, size_t *offset);
+
+static uint32_t name_of(const struct token *tok);
+static enum directive directive_kind(const struct token *tok);
+static bool is_directive(const struct token *toks, size_t len, size_t i);
+static bool is_defined(const struct preprocessor *pp, uint32_t name);
+
+static struct pp_file *load_file(struct preprocessor *pp, const char *path);
+static struct pp_file *new_file(struct preprocessor *pp, const char *path);
+static int lex_file(struct preprocessor *pp, struct pp_file *file);
+static uint32_t detect_guard(const struct pp_file *file);
+static char *find_include(struct preprocessor *pp, const struct pp_file *from,
+                          const char *name, bool quoted, size_t first,
+                          size_t *found);
+
+static void push_context(struct preprocessor *pp, struct pp_file *file,
+                         const struct pp_token *tokens, size_t len,
+                         struct pp_token *owned, bool barrier, bool quiet);
+static void pop_context(struct preprocessor *pp);
+static struct pp_file *current_file(struct preprocessor *pp);
+
+static void read_raw(struct preprocessor *pp, struct pp_token *t);
+static void next_token(struct preprocessor *pp, struct pp_token *t);
+static bool expand_macro(struct preprocessor *pp, const struct pp_token *t);
+static bool next_is_lparen(struct preprocessor *pp);
+static int collect_args(struct preprocessor *pp, const struct macro *m,
+                        const struct token *name, struct pp_tokens **args,
+                        struct pp_token *rparen);
+static void subst(struct preprocessor *pp, const struct macro *m,
+                  struct pp_tokens *args, struct hideset *hs,
+                  struct pp_tokens *out);
+static bool expand_isolated(struct preprocessor *pp,
+                            const struct pp_token *tokens, size_t len,
+                            bool quiet, struct pp_tokens *out);
+static bool memoize(struct preprocessor *pp, struct macro *m, uint32_t name);
+
+static struct hideset *hideset_add(struct preprocessor *pp,
+                                   struct hideset *hs, uint32_t name);
+static bool hideset_contains(const struct hideset *hs, uint32_t name);
+static struct hideset *hideset_union(struct preprocessor *pp,
+                                     struct hideset *a, struct hideset *b);
+static struct hideset *hideset_intersect(struct preprocessor *pp,
+                                         struct hideset *a,
+                                         struct hideset *b);
+
+static const char *spelling(const struct preprocessor *pp,
+                            const struct token *tok);
+static bool scratch_token(struct preprocessor *pp, const char *text,
+                          size_t len, struct token *tok);
+static void paste(struct preprocessor *pp, struct pp_token *lhs,
+                  const struct pp_token *rhs);
+static void stringize(struct preprocessor *pp, const struct pp_tokens *arg,
+                      struct pp_token *out);
+
+static void directive(struct preprocessor *pp);
+static void skip_group(struct preprocessor *pp);
+static void do_include(struct preprocessor *pp, const struct token *line,
+                       size_t len, const struct token *dtok, bool next);
+static void do_define(struct preprocessor *pp, const struct token *line,
+                      size_t len, const struct token *dtok);
+static bool eval_condition(struct preprocessor *pp, const struct token *line,
+                           size_t len, const struct token *dtok);
+
+static struct pp_value eval_conditional(struct pp_expr *e);
+static struct pp_value eval_binary(struct pp_expr *e, int min_prec);
+static struct pp_value eval_unary(struct pp_expr *e);
+static uint64_t char_value(const char *s, size_t len);
+
+void preprocessor_init(struct preprocessor *pp, size_t jobs) {
+    memset(pp, 0, sizeof(*pp));
+    pp->jobs = jobs;
+    pp->diagnostics = stderr;
+    arena_init(&pp->arena);
+    string_init(&pp->predefined);
+    pp->epoch = 1;
+
+    for (enum directive d = 0; d < NUM_DIRECTIVES; d++)
+        if (directive_names[d])
+            directive_atoms[d] = intern(directive_names[d],
+                                        strlen(directive_names[d]));
+    for (enum token_type t = 0; t < TOKEN_IDENTIFER; t++)
+        keyword_atoms[t] = intern(token_type_name(t),
+                                  strlen(token_type_name(t)));
+    atom_defined = intern("defined", 7);
+    atom_va_args = intern("__VA_ARGS__", 11);
+    atom_once = intern("once", 4);
+
+    /* __FILE__ and __LINE__ are built in; the rest are plain definitions. */
+    const enum macro_kind builtins[] = { MACRO_FILE, MACRO_LINE };
+    const char *builtin_names[] = { "__FILE__", "__LINE__" };
+    for (size_t i = 0; i < 2; i++) {
+        const uint32_t name = intern(builtin_names[i],
+                                     strlen(builtin_names[i]));
+        struct macro *const m = arena_alloc(&pp->arena, sizeof(struct macro),
+                                            _Alignof(struct macro));
+
+        memset(m, 0, sizeof(*m));
+        m->kind = builtins[i];
+        if (name >= pp->macros_len) {
+            pp->macros = realloc(pp->macros,
+                                 sizeof(struct macro *) * (name + 1));
+            memset(pp->macros + pp->macros_len, 0,
+                   sizeof(struct macro *) * (name + 1 - pp->macros_len));
+            pp->macros_len = name + 1;
+        }
+        pp->macros[name] = m;
+    }
+
+    static const char predefined[] =
+        "#define __STDC__ 1\n"
+        "#define __STDC_VERSION__ 201112L\n"
+        "#define __STDC_HOSTED__ 1\n"
+        "#define __LP64__ 1\n"
+        "#define __cisc__ 1\n";
+    string_append_n(&pp->predefined, predefined, sizeof(predefined) - 1);
+}
+
+void preprocessor_destroy(struct preprocessor *pp) {
+    while (pp->num_contexts) pop_context(pp);
+    for (size_t i = 0; i < pp->num_files; i++)
+        line_table_destroy(&pp->files[i]->lines);
+    for (size_t i = 0; i < pp->num_files; i++)
+        if (!pp->files[i]->scratch && pp->files[i]->src.buf
+            && pp->files[i]->src.buf != pp->predefined.arr)
+            source_close(&pp->files[i]->src);
+    for (size_t i = 0; i < pp->num_include_dirs; i++)
+        free((char *)pp->include_dirs[i]);
+    free(pp->include_dirs);
+    free(pp->files);
+    free(pp->file_ids);
+    free(pp->macros);
+    free(pp->contexts);
+    free(pp->conds);
+    string_destroy(&pp->predefined);
+    arena_destroy(&pp->arena);
+}
+
+void preprocessor_add_include_dir(struct preprocessor *pp, const char *dir) {
+    pp->include_dirs = realloc(pp->include_dirs,
+                               sizeof(char *) * (pp->num_include_dirs + 1));
+    pp->include_dirs[pp->num_include_dirs++] = strdup(dir);
+}
+
+void preprocessor_define(struct preprocessor *pp, const char *definition) {
+    const char *const eq = strchr(definition, '=');
+
+    string_append_n(&pp->predefined, "#define ", 8);
+    if (eq) {
+        string_append_n(&pp->predefined, definition, eq - definition);
+        string_append(&pp->predefined, ' ');
+        string_append_n(&pp->predefined, eq + 1, strlen(eq + 1));
+    }
+    else {
+        string_append_n(&pp->predefined, definition, strlen(definition));
+        string_append_n(&pp->predefined, " 1", 2);
+    }
+    string_append(&pp->predefined, '\n');
+}
+
+int preprocess(struct preprocessor *pp, const char *path, struct arena *arena,
+               struct token_array *tokarr) {
+    struct pp_file *main_file;
+    struct pp_file *predefined;
+    struct pp_token t;
+
+    STATS_BEGIN(pp_phase);
+
+    main_file = load_file(pp, path);
+    if (main_file == NULL) {
+        fprintf(pp->diagnostics, "%s: cannot open file\n", path);
+        STATS_END(pp_phase);
+        return -1;
+    }
+
+    /* The predefined macros are read first, as if included at the top. */
+    predefined = new_file(pp, "<built-in>");
+    predefined->src.buf = pp->predefined.arr;
+    predefined->src.len = pp->predefined.len;
+    lex_file(pp, predefined);
+
+    push_context(pp, main_file, NULL, main_file->tokens.len, NULL, false,
+                 false);
+    push_context(pp, predefined, NULL, predefined->tokens.len, NULL, false,
+                 false);
+
+    token_array_init(tokarr, arena, main_file->tokens.len + 16);
+    while (1) {
+        next_token(pp, &t);
+        if (t.tok.type == TOKEN_EOF) break;
+        if (t.tok.type == TOKEN_INDETERMINATE) {
+            error_at(pp, &t.tok, "error", "stray '%.*s' in program",
+                     (int)t.tok.len, spelling(pp, &t.tok));
+            continue;
+        }
+        token_array_append(tokarr, arena, t.tok);
+    }
+
+    STATS_END(pp_phase);
+    return pp->errors ? -1 : 0;
+}
+
+const char *preprocessor_spelling(const struct preprocessor *pp,
+                                  const struct token *tok) {
+    return spelling(pp, tok);
+}
+
+const char *preprocessor_file_path(const struct preprocessor *pp,
+                                   const struct token *tok) {
+    return pp->files[tok->file]->path;
+}
+
+size_t preprocessor_line(struct preprocessor *pp, const struct token *tok) {
+    return line_of(pp->files[tok->file], tok->offset);
+}
+
+size_t preprocessor_column(struct preprocessor *pp,
+                           const struct token *tok) {
+    return column_of(pp->files[tok->file], tok->offset);
+}
+
+static void pp_tokens_append(struct pp_tokens *v, const struct pp_token *t) {
+    if (v->len == v->capacity) {
+        v->capacity = v->capacity ? 2 * v->capacity : 16;
+        v->data = realloc(v->data, sizeof(struct pp_token) * v->capacity);
+    }
+    v->data[v->len++] = *t;
+}
+
+/* Report a diagnostic at tok, e.g. "test.c:3:5: error: ...". */
+static void error_at(struct preprocessor *pp, const struct token *tok,
+                     const char *kind, const char *fmt, ...) {
+    size_t offset;
+    struct pp_file *const file = location_file(pp, tok, &offset);
+    va_list ap;
+
+    if (file)
+        fprintf(pp->diagnostics, "%s:%zu:%zu: %s: ", file->path,
+                line_of(file, offset), column_of(file, offset), kind);
+    else
+        fprintf(pp->diagnostics, "cisc: %s: ", kind);
+    va_start(ap, fmt);
+    vfprintf(pp->diagnostics, fmt, ap);
+    va_end(ap);
+    fputc('\n', pp->diagnostics);
+
+    if (!strcmp(kind, "error")) pp->errors++;
+}
+
+static size_t line_of(struct pp_file *file, size_t offset) {
+    size_t line;
+    size_t column;
+
+    line_table_find(&file->lines, &file->src, offset, &line, &column);
+    return line;
+}
+
+static size_t column_of(struct pp_file *file, size_t offset) {
+    size_t line;
+    size_t column;
+
+    line_table_find(&file->lines, &file->src, offset, &line, &column);
+    return column;
+}
+
+/* File and offset to report a token at. A token of the innermost file
+   being read is reported where it is, and any other, e.g. one of a macro
+   definition, where that file is being read. */
+static struct pp_file *location_file(struct preprocessor *pp,
+                                     const struct token *tok, size_t *offset) {
+    for (size_t i = pp->num_contexts; i-- > 0;) {
+        const struct pp_context *const ctx = &pp->contexts[i];
+        if (ctx->file == NULL) continue;
+        if (tok && tok->file == ctx->file->src.id) *offset = tok->offset;
+        else *offset = ctx->pos
+                       ? ctx->file->tokens.tokens[ctx->pos - 1].offset : 0;
+        return ctx->file;
+    }
+    return NULL;
+}
+
+/* Atom of an identifier or keyword, or ATOM_NONE. */
+static uint32_t name_of(const struct token *tok) {
+    if (tok->type == TOKEN_IDENTIFER) return tok->atom;
+    if (tok->type < TOKEN_IDENTIFER) return keyword_atoms[tok->type];
+    return ATOM_NONE;
+}
+
+static enum directive directive_kind(const struct token *tok) {
+    uint32_t name;
+
+    /* if and else are keywords. */
+    if (tok->type == TOKEN_IF) return DIRECTIVE_IF;
+    if (tok->type == TOKEN_ELSE) return DIRECTIVE_ELSE;
+    if (tok->type != TOKEN_IDENTIFER) return DIRECTIVE_NONE;
+    name = tok->atom;
+    for (enum directive d = 0; d < NUM_DIRECTIVES; d++)
+        if (directive_atoms[d] == name && name != ATOM_NONE) return d;
+    return DIRECTIVE_NONE;
+}
+
+/* Whether toks[i] is the # of a directive with a name. */
+static bool is_directive(const struct token *toks, size_t len, size_t i) {
+    return toks[i].type == TOKEN_SHARP && (toks[i].flags & TOKEN_FLAG_BOL)
+           && i + 1 < len && !(toks[i + 1].flags & TOKEN_FLAG_BOL);
+}
+
+static bool is_defined(const struct preprocessor *pp, uint32_t name) {
+    return name < pp->macros_len && pp->macros[name] != NULL;
+}
+
+/* The file at path, which is read and lexed on first use. Returns NULL if
+   it cannot be opened. */
+static struct pp_file *load_file(struct preprocessor *pp, const char *path) {
+    char *const real = realpath(path, NULL);
+    uint32_t key;
+    struct pp_file *file;
+
+    if (real == NULL) return NULL;
+    key = intern(real, strlen(real));
+    free(real);
+    if (key < pp->file_ids_len && pp->file_ids[key])
+        return pp->files[pp->file_ids[key] - 1];
+
+    file = new_file(pp, path);
+    if (source_open(&file->src, path)) {
+        file->src.buf = NULL;
+        return NULL;
+    }
+    file->src.id = pp->num_files - 1;
+    lex_file(pp, file);
+    file->guard = detect_guard(file);
+
+    if (key >= pp->file_ids_len) {
+        const size_t len = 2 * key + 16;
+        pp->file_ids = realloc(pp->file_ids, sizeof(uint32_t) * len);
+        memset(pp->file_ids + pp->file_ids_len, 0,
+               sizeof(uint32_t) * (len - pp->file_ids_len));
+        pp->file_ids_len = len;
+    }
+    pp->file_ids[key] = pp->num_files;
+    return file;
+}
+
+/* Register a file with no contents yet. */
+static struct pp_file *new_file(struct preprocessor *pp, const char *path) {
+    struct pp_file *const file = arena_alloc(&pp->arena,
+                                             sizeof(struct pp_file),
+                                             _Alignof(struct pp_file));
+    const char *const slash = strrchr(path, '/');
+    const size_t path_len = strlen(path);
+    const size_t dir_len = slash ? (size_t)(slash - path) + 1 : 0;
+    char *const copy = arena_alloc(&pp->arena, path_len + dir_len + 2, 1);
+
+    memset(file, 0, sizeof(*file));
+    memcpy(copy, path, path_len + 1);
+    memcpy(copy + path_len + 1, path, dir_len);
+    copy[path_len + 1 + dir_len] = '\0';
+    file->path = copy;
+    file->dir = copy + path_len + 1;
+
+    if (pp->num_files > UINT16_MAX) {
+        fprintf(stderr, "%s: too many files\n", path);
+        exit(1);
+    }
+    if (pp->num_files == pp->files_capacity) {
+        pp->files_capacity = pp->files_capacity ? 2 * pp->files_capacity : 16;
+        pp->files = realloc(pp->files,
+                            sizeof(struct pp_file *) * pp->files_capacity);
+    }
+    file->src.id = pp->num_files;
+    pp->files[pp->num_files++] = file;
+    return file;
+}
+
+static int lex_file(struct preprocessor *pp, struct pp_file *file) {
+    size_t offset;
+
+    STATS_ADD_ATOMIC(files_lexed, 0, 1);
+    if (lexer_pp(&file->src, &pp->arena, pp->jobs, &file->tokens) == 0)
+        return 0;
+    if (file->src.len > UINT32_MAX) {
+        fprintf(pp->diagnostics, "%s: error: file too large\n", file->path);
+    } else {
+        offset = lexer_error_offset(&file->src, &file->tokens);
+        fprintf(pp->diagnostics, "%s:%zu:%zu: error: unterminated comment\n",
+                file->path, line_of(file, offset), column_of(file, offset));
+    }
+    pp->errors++;
+    return -1;
+}
+
+/* The macro of an include guard, i.e. X if the whole file is one group of
+   #ifndef X, or #if !defined X, with no #else or #elif. */
+static uint32_t detect_guard(const struct pp_file *file) {
+    const struct token *const toks = file->tokens.tokens;
+    const size_t len = file->tokens.len;
+    uint32_t guard = ATOM_NONE;
+    size_t i;
+    size_t depth = 0;
+
+    if (len < 4 || !is_directive(toks, len, 0)) return ATOM_NONE;
+    if (directive_kind(&toks[1]) == DIRECTIVE_IFNDEF
+        && toks[2].type == TOKEN_IDENTIFER
+        && (toks[3].flags & TOKEN_FLAG_BOL)) {
+        guard = toks[2].atom;
+        i = 3;
+    }
+    else if (len > 6 && toks[1].type == TOKEN_IF
+             && toks[2].type == TOKEN_EXCLAMATION
+             && name_of(&toks[3]) == atom_defined) {
+        if (toks[4].type == TOKEN_IDENTIFER
+            && (toks[5].flags & TOKEN_FLAG_BOL)) {
+            guard = toks[4].atom;
+            i = 5;
+        }
+        else if (len > 8 && toks[4].type == TOKEN_PAREN_OPEN
+                 && toks[5].type == TOKEN_IDENTIFER
+                 && toks[6].type == TOKEN_PAREN_CLOSE
+                 && (toks[7].flags & TOKEN_FLAG_BOL)) {
+            guard = toks[5].atom;
+            i = 7;
+        }
+        else return ATOM_NONE;
+    }
+    else return ATOM_NONE;
+
+    for (; i < len; i++) {
+        if (!is_directive(toks, len, i)) continue;
+        switch (directive_kind(&toks[i + 1])) {
+        case DIRECTIVE_IF:
+        case DIRECTIVE_IFDEF:
+        case DIRECTIVE_IFNDEF:
+            depth++;
+            break;
+        case DIRECTIVE_ELIF:
+        case DIRECTIVE_ELSE:
+            if (depth == 0) return ATOM_NONE;
+            break;
+        case DIRECTIVE_ENDIF:
+            if (depth == 0) {
+                /* Nothing may follow the line of the #endif. */
+                i += 2;
+                while (i < len && !(toks[i].flags & TOKEN_FLAG_BOL)) i++;
+                return i == len ? guard : ATOM_NONE;
+            }
+            depth--;
+            break;
+        default:
+            break;
+        }
+    }
+    return ATOM_NONE;
+}
+
+/* Path of the file an #include names, or NULL if there is none. The
+   directory of the including file is searched first for a quoted name, then
+   the search path from its first directory on. *found is set to the index
+   in the search path of the directory the file is in, or -1. */
+static char *find_include(struct preprocessor *pp, const struct pp_file *from,
+                          const char *name, bool quoted, size_t first,
+                          size_t *found) {
+    const size_t name_len = strlen(name);
+    const char *dirs[pp->num_include_dirs + 1];
+    size_t num_dirs = 0;
+
+    *found = -1;
+    if (name[0] == '/')
+        return access(name, R_OK) == 0 ? strdup(name) : NULL;
+
+    for (size_t i = 0; i < pp->num_include_dirs; i++)
+        dirs[num_dirs++] = pp->include_dirs[i];
+#ifdef CISC_INCLUDE_DIR
+    dirs[num_dirs++] = CISC_INCLUDE_DIR;
+#endif
+
+    for (size_t i = quoted ? (size_t)-1 : first; i == (size_t)-1 || i < num_dirs;
+         i++) {
+        const char *const dir = i == (size_t)-1 ? (from ? from->dir : "")
+                                                : dirs[i];
+        const size_t dir_len = strlen(dir);
+        const bool slash = dir_len && dir[dir_len - 1] != '/';
+        char *const path = malloc(dir_len + slash + name_len + 1);
+
+        memcpy(path, dir, dir_len);
+        if (slash) path[dir_len] = '/';
+        memcpy(path + dir_len + slash, name, name_len + 1);
+        if (access(path, R_OK) == 0) {
+            *found = i;
+            return path;
+        }
+        free(path);
+    }
+    return NULL;
+}
+
+static void push_context(struct preprocessor *pp, struct pp_file *file,
+                         const struct pp_token *tokens, size_t len,
+                         struct pp_token *owned, bool barrier, bool quiet) {
+    struct pp_context *ctx;
+
+    if (pp->num_contexts == pp->contexts_capacity) {
+        pp->contexts_capacity = pp->contexts_capacity
+                                ? 2 * pp->contexts_capacity : 64;
+        pp->contexts = realloc(pp->contexts, sizeof(struct pp_context)
+                                             * pp->contexts_capacity);
+    }
+    ctx = &pp->contexts[pp->num_contexts++];
+    ctx->file = file;
+    ctx->tokens = tokens;
+    ctx->owned = owned;
+    ctx->pos = 0;
+    ctx->len = len;
+    ctx->cond_base = pp->num_conds;
+    ctx->dir_index = -1;
+    ctx->barrier = barrier;
+    ctx->quiet = quiet;
+    ctx->hit = false;
+}
+
+static void pop_context(struct preprocessor *pp) {
+    struct pp_context *const ctx = &pp->contexts[pp->num_contexts - 1];
+
+    if (ctx->file && pp->num_conds > ctx->cond_base) {
+        fprintf(pp->diagnostics,
+                "%s: error: unterminated conditional directive\n",
+                ctx->file->path);
+        pp->errors++;
+        pp->num_conds = ctx->cond_base;
+    }
+    free(ctx->owned);
+    pp->num_contexts--;
+}
+
+/* Innermost file being read. */
+static struct pp_file *current_file(struct preprocessor *pp) {
+    for (size_t i = pp->num_contexts; i-- > 0;)
+        if (pp->contexts[i].file) return pp->contexts[i].file;
+    return NULL;
+}
+
+/* Read the next token without expanding it, running the directives on the
+   way. TOKEN_EOF at the end of the input or of a barrier context. */
+static void read_raw(struct preprocessor *pp, struct pp_token *t) {
+    while (pp->num_contexts) {
+        struct pp_context *const ctx = &pp->contexts[pp->num_contexts - 1];
+
+        if (ctx->pos == ctx->len) {
+            if (ctx->barrier) break;
+            pop_context(pp);
+            continue;
+        }
+        if (ctx->file == NULL) {
+            *t = ctx->tokens[ctx->pos++];
+            return;
+        }
+
+        t->tok = ctx->file->tokens.tokens[ctx->pos++];
+        t->hs = NULL;
+        if (t->tok.type == TOKEN_SHARP && (t->tok.flags & TOKEN_FLAG_BOL)) {
+            directive(pp);
+            continue;
+        }
+        return;
+    }
+
+    memset(t, 0, sizeof(*t));
+    t->tok.type = TOKEN_EOF;
+}
+
+/* Read the next token with macros expanded. */
+static void next_token(struct preprocessor *pp, struct pp_token *t) {
+    do read_raw(pp, t);
+    while (t->tok.type != TOKEN_EOF && expand_macro(pp, t));
+}
+
+/* If t names a macro that may be expanded, push its expansion and return
+   true. */
+static bool expand_macro(struct preprocessor *pp, const struct pp_token *t) {
+    const uint32_t name = name_of(&t->tok);
+    struct macro *m;
+    struct pp_tokens out = { 0 };
+    struct hideset *hs;
+
+    if (!is_defined(pp, name) || hideset_contains(t->hs, name)) return false;
+    m = pp->macros[name];
+
+    switch (m->kind) {
+    case MACRO_FILE:
+    case MACRO_LINE: {
+        struct pp_file *const file = current_file(pp);
+        struct string text;
+        struct pp_token result;
+        char line[24];
+
+        string_init(&text);
+        if (m->kind == MACRO_LINE) {
+            size_t offset;
+            struct pp_file *const at = location_file(pp, NULL, &offset);
+            snprintf(line, sizeof(line), "%zu", at ? line_of(at, offset) : 0);
+            string_append_n(&text, line, strlen(line));
+        }
+        else {
+            string_append(&text, '"');
+            for (const char *p = file ? file->path : ""; *p; p++) {
+                if (*p == '"' || *p == '\\') string_append(&text, '\\');
+                string_append(&text, *p);
+            }
+            string_append(&text, '"');
+        }
+        scratch_token(pp, text.arr, text.len, &result.tok);
+        string_destroy(&text);
+        result.tok.flags = t->tok.flags;
+        result.hs = hideset_add(pp, t->hs, name);
+        pp_tokens_append(&out, &result);
+
+        /* The value depends on where the macro is used, so no expansion that
+           contains it may be memoized. */
+        for (size_t i = 0; i < pp->num_contexts; i++)
+            if (pp->contexts[i].quiet) pp->contexts[i].hit = true;
+        break;
+    }
+    case MACRO_OBJECT:
+        if (m->expansion_epoch == pp->epoch) STATS_ADD_ATOMIC(memo_hits, 0, 1);
+        if (t->hs == NULL && memoize(pp, m, name)) {
+            if (m->expansion_len == 0) return true;
+            out.len = out.capacity = m->expansion_len;
+            out.data = malloc(sizeof(struct pp_token) * out.len);
+            memcpy(out.data, m->expansion, sizeof(struct pp_token) * out.len);
+            break;
+        }
+        subst(pp, m, NULL, hideset_add(pp, t->hs, name), &out);
+        break;
+    case MACRO_FUNCTION: {
+        struct pp_tokens *args;
+        struct pp_token rparen;
+
+        if (!next_is_lparen(pp)) return false;
+        read_raw(pp, &rparen);
+        if (collect_args(pp, m, &t->tok, &args, &rparen)) return true;
+        hs = hideset_add(pp, hideset_intersect(pp, t->hs, rparen.hs), name);
+        subst(pp, m, args, hs, &out);
+        for (size_t i = 0; i < m->num_params; i++) free(args[i].data);
+        free(args);
+        break;
+    }
+    }
+
+    STATS_ADD_ATOMIC(expansions, 0, 1);
+    if (out.len == 0) {
+        free(out.data);
+        return true;
+    }
+    /* The expansion takes the place of the name, with its spacing. */
+    out.data[0].tok.flags = (out.data[0].tok.flags
+                             & ~(TOKEN_FLAG_BOL | TOKEN_FLAG_SPACE))
+                            | (t->tok.flags
+                               & (TOKEN_FLAG_BOL | TOKEN_FLAG_SPACE));
+    push_context(pp, NULL, out.data, out.len, out.data, false, false);
+    return true;
+}
+
+/* Whether the next token is a (, which makes a function-like macro name an
+   invocation. Looks through the ends of expansions, but not of files. */
+static bool next_is_lparen(struct preprocessor *pp) {
+    for (size_t i = pp->num_contexts; i-- > 0;) {
+        struct pp_context *const ctx = &pp->contexts[i];
+
+        if (ctx->pos < ctx->len) {
+            if (ctx->file)
+                return ctx->file->tokens.tokens[ctx->pos].type
+                       == TOKEN_PAREN_OPEN;
+            return ctx->tokens[ctx->pos].tok.type == TOKEN_PAREN_OPEN;
+        }
+        if (ctx->barrier) {
+            ctx->hit = true;
+            return false;
+        }
+        if (ctx->file) return false;
+    }
+    return false;
+}
+
+/* Read the arguments of an invocation of m, after its (, up to and
+   including the ) that is stored into *rparen. */
+static int collect_args(struct preprocessor *pp, const struct macro *m,
+                        const struct token *name, struct pp_tokens **args,
+                        struct pp_token *rparen) {
+    size_t capacity = m->num_params ? m->num_params : 1;
+    size_t n = 1;
+    int depth = 0;
+    struct pp_token t;
+
+    *args = calloc(capacity, sizeof(struct pp_tokens));
+    while (1) {
+        read_raw(pp, &t);
+        if (t.tok.type == TOKEN_EOF) {
+            struct pp_context *const top = pp->num_contexts
+                                           ? &pp->contexts[pp->num_contexts-1]
+                                           : NULL;
+            if (top) top->hit = true;
+            if (top == NULL || !top->quiet)
+                error_at(pp, name, "error",
+                         "unterminated argument list invoking macro '%s'",
+                         atom_spelling(name_of(name)));
+            for (size_t i = 0; i < n; i++) free((*args)[i].data);
+            free(*args);
+            return -1;
+        }
+        if (t.tok.type == TOKEN_PAREN_OPEN) depth++;
+        else if (t.tok.type == TOKEN_PAREN_CLOSE) {
+            if (depth == 0) break;
+            depth--;
+        }
+        else if (t.tok.type == TOKEN_COMMA && depth == 0
+                 && !(m->variadic && n == m->num_params)) {
+            if (n == capacity) {
+                *args = realloc(*args,
+                                sizeof(struct pp_tokens) * 2 * capacity);
+                memset(*args + capacity, 0,
+                       sizeof(struct pp_tokens) * capacity);
+                capacity *= 2;
+            }
+            n++;
+            continue;
+        }
+        pp_tokens_append(&(*args)[n - 1], &t);
+    }
+    *rparen = t;
+
+    /* f() passes no argument to a macro without parameters, and the variable
+       arguments may be left out altogether. */
+    if (m->num_params == 0 && n == 1 && (*args)[0].len == 0) n = 0;
+    if (m->variadic && n + 1 == m->num_params) n++;
+    if (n != m->num_params) {
+        error_at(pp, name, "error",
+                 "macro '%s' passed %zu arguments, but takes %zu",
+                 atom_spelling(name_of(name)), n, m->num_params);
+        for (size_t i = 0; i < capacity; i++) free((*args)[i].data);
+        free(*args);
+        return -1;
+    }
+    return 0;
+}
+
+/* Substitute the arguments into the body of a macro, doing the # and ##
+   operators, and add hs to the hidesets of the result. args is NULL for an
+   object-like macro. */
+static void subst(struct preprocessor *pp, const struct macro *m,
+                  struct pp_tokens *args, struct hideset *hs,
+                  struct pp_tokens *out) {
+    /* Fully expanded arguments, made on first use. */
+    struct pp_tokens expanded[m->num_params ? m->num_params : 1];
+    bool is_expanded[m->num_params ? m->num_params : 1];
+    /* The left operand of a following ## is an empty argument. */
+    bool placemarker = false;
+
+    memset(expanded, 0, sizeof(expanded));
+    memset(is_expanded, 0, sizeof(is_expanded));
+
+    for (size_t i = 0; i < m->body_len; i++) {
+        const struct token *const tok = &m->body[i];
+        const int param = m->param_index[i];
+        const bool pasted = i + 1 < m->body_len
+                            && m->body[i + 1].type == TOKEN_TWO_SHARP;
+        struct pp_token t;
+
+        if (tok->type == TOKEN_SHARP && m->kind == MACRO_FUNCTION) {
+            stringize(pp, &args[m->param_index[++i]], &t);
+            t.tok.flags = tok->flags;
+            pp_tokens_append(out, &t);
+            placemarker = false;
+            continue;
+        }
+
+        if (tok->type == TOKEN_TWO_SHARP) {
+            const int rhs_param = m->param_index[++i];
+            const struct pp_token *rhs = &t;
+            size_t rhs_len = 1;
+
+            if (rhs_param >= 0) {
+                rhs = args[rhs_param].data;
+                rhs_len = args[rhs_param].len;
+            }
+            else if (m->body[i].type == TOKEN_SHARP
+                     && m->kind == MACRO_FUNCTION) {
+                stringize(pp, &args[m->param_index[++i]], &t);
+            }
+            else {
+                t.tok = m->body[i];
+                t.hs = NULL;
+            }
+
+            /* GNU extension: , ## __VA_ARGS__ drops the comma if there are
+               no variable arguments, and pastes nothing otherwise. */
+            if (m->variadic && (size_t)rhs_param == m->num_params - 1
+                && !placemarker && out->len
+                && out->data[out->len - 1].tok.type == TOKEN_COMMA) {
+                if (rhs_len == 0) out->len--;
+                for (size_t j = 0; j < rhs_len; j++)
+                    pp_tokens_append(out, &rhs[j]);
+                continue;
+            }
+
+            /* An empty operand is a placemarker, which pastes to the other
+               operand. */
+            if (rhs_len == 0) continue;
+            if (placemarker || out->len == 0) {
+                for (size_t j = 0; j < rhs_len; j++)
+                    pp_tokens_append(out, &rhs[j]);
+            }
+            else {
+                paste(pp, &out->data[out->len - 1], &rhs[0]);
+                for (size_t j = 1; j < rhs_len; j++)
+                    pp_tokens_append(out, &rhs[j]);
+            }
+            placemarker = false;
+            continue;
+        }
+
+        if (param >= 0) {
+            const struct pp_tokens *arg = &args[param];
+            const size_t start = out->len;
+
+            /* An operand of ## is not expanded. */
+            if (!pasted) {
+                if (!is_expanded[param]) {
+                    expand_isolated(pp, args[param].data, args[param].len,
+                                    false, &expanded[param]);
+                    is_expanded[param] = true;
+                }
+                arg = &expanded[param];
+            }
+            placemarker = arg->len == 0;
+            for (size_t j = 0; j < arg->len; j++)
+                pp_tokens_append(out, &arg->data[j]);
+            if (out->len > start)
+                out->data[start].tok.flags =
+                    (out->data[start].tok.flags & ~TOKEN_FLAG_SPACE)
+                    | (tok->flags & TOKEN_FLAG_SPACE);
+            continue;
+        }
+
+        t.tok = *tok;
+        t.hs = NULL;
+        pp_tokens_append(out, &t);
+        placemarker = false;
+    }
+
+    for (size_t i = 0; i < out->len; i++)
+        out->data[i].hs = hideset_union(pp, out->data[i].hs, hs);
+    for (size_t i = 0; i < m->num_params; i++) free(expanded[i].data);
+}
+
+/* Fully expand tokens on their own, appending the result to out. Returns
+   whether an expansion needed tokens past the end. */
+static bool expand_isolated(struct preprocessor *pp,
+                            const struct pp_token *tokens, size_t len,
+                            bool quiet, struct pp_tokens *out) {
+    const size_t base = pp->num_contexts;
+    struct pp_token t;
+    bool hit;
+
+    push_context(pp, NULL, tokens, len, NULL, true, quiet);
+    while (1) {
+        next_token(pp, &t);
+        if (t.tok.type == TOKEN_EOF) break;
+        pp_tokens_append(out, &t);
+    }
+    hit = pp->contexts[base].hit;
+    while (pp->num_contexts > base) pop_context(pp);
+    return hit;
+}
+
+/* Make sure the memoized expansion of object-like macro m is current, and
+   return whether there is one. */
+static bool memoize(struct preprocessor *pp, struct macro *m, uint32_t name) {
+    struct pp_tokens body = { 0 };
+    struct pp_tokens result = { 0 };
+
+    if (m->expansion_epoch == pp->epoch) return m->expansion != NULL;
+
+    subst(pp, m, NULL, hideset_add(pp, NULL, name), &body);
+
+    m->expansion_epoch = pp->epoch;
+    m->expansion = NULL;
+    m->expansion_len = 0;
+    if (!expand_isolated(pp, body.data, body.len, true, &result)) {
+        /* Never NULL, even if empty. */
+        m->expansion = arena_alloc(&pp->arena,
+                                   sizeof(struct pp_token) * result.len + 1,
+                                   _Alignof(struct pp_token));
+        if (result.len)
+            memcpy(m->expansion, result.data,
+                   sizeof(struct pp_token) * result.len);
+        m->expansion_len = result.len;
+    }
+    free(body.data);
+    free(result.data);
+    return m->expansion != NULL;
+}
+
+static struct hideset *hideset_add(struct preprocessor *pp,
+                                   struct hideset *hs, uint32_t name) {
+    struct hideset *node;
+
+    if (hideset_contains(hs, name)) return hs;
+    node = arena_alloc(&pp->arena, sizeof(struct hideset),
+                       _Alignof(struct hideset));
+    node->name = name;
+    node->next = hs;
+    return node;
+}
+
+static bool hideset_contains(const struct hideset *hs, uint32_t name) {
+    for (; hs; hs = hs->next)
+        if (hs->name == name) return true;
+    return false;
+}
+
+static struct hideset *hideset_union(struct preprocessor *pp,
+                                     struct hideset *a, struct hideset *b) {
+    for (; a; a = a->next) b = hideset_add(pp, b, a->name);
+    return b;
+}
+
+static struct hideset *hideset_intersect(struct preprocessor *pp,
+                                         struct hideset *a,
+                                         struct hideset *b) {
+    struct hideset *result = NULL;
+
+    for (; a; a = a->next)
+        if (hideset_contains(b, a->name))
+            result = hideset_add(pp, result, a->name);
+    return result;
+}
+
+static const char *spelling(const struct preprocessor *pp,
+                            const struct token *tok) {
+    return pp->files[tok->file]->src.buf + tok->offset;
+}
+
+/* Lex text as a single token, whose spelling is kept in a scratch buffer.
+   Returns false if it is not exactly one token. */
+static bool scratch_token(struct preprocessor *pp, const char *text,
+                          size_t len, struct token *tok) {
+    struct pp_file *file = pp->scratch;
+    struct lexer_state state;
+    char *buf;
+    size_t start;
+
+    if (file == NULL || file->src.len + len + 1 > file->tokens.capacity) {
+        const size_t size = len + 1 > SCRATCH_SIZE ? len + 1 : SCRATCH_SIZE;
+
+        file = new_file(pp, "<scratch>");
+        file->scratch = true;
+        file->src.buf = arena_alloc(&pp->arena, size, 1);
+        /* The capacity of the buffer; a scratch file has no tokens. */
+        file->tokens.capacity = size;
+        pp->scratch = file;
+    }
+    buf = (char *)file->src.buf;
+    start = file->src.len;
+    memcpy(buf + start, text, len);
+    buf[start + len] = '\0';
+    file->src.len += len + 1;
+
+    lexer_init(&state, &file->src);
+    state.pos = buf + start;
+    state.limit = buf + start + len;
+    state.pp_tokens = true;
+    if (lexer_next(&state, tok) || tok->type == TOKEN_EOF) {
+        tok->type = TOKEN_INDETERMINATE;
+        tok->offset = start;
+        tok->len = len;
+        return false;
+    }
+    return tok->offset == start && tok->len == len;
+}
+
+static void paste(struct preprocessor *pp, struct pp_token *lhs,
+                  const struct pp_token *rhs) {
+    const size_t len = lhs->tok.len + rhs->tok.len;
+    char text[len + 1];
+    struct token tok;
+
+    memcpy(text, spelling(pp, &lhs->tok), lhs->tok.len);
+    memcpy(text + lhs->tok.len, spelling(pp, &rhs->tok), rhs->tok.len);
+    text[len] = '\0';
+
+    if (!scratch_token(pp, text, len, &tok)) {
+        error_at(pp, &lhs->tok, "error",
+                 "pasting \"%.*s\" and \"%.*s\" does not give a valid "
+                 "preprocessing token",
+                 (int)lhs->tok.len, spelling(pp, &lhs->tok),
+                 (int)rhs->tok.len, spelling(pp, &rhs->tok));
+        return;
+    }
+    tok.flags = lhs->tok.flags;
+    lhs->tok = tok;
+}
+
+static void stringize(struct preprocessor *pp, const struct pp_tokens *arg,
+                      struct pp_token *out) {
+    struct string text;
+
+    string_init(&text);
+    string_append(&text, '"');
+    for (size_t i = 0; i < arg->len; i++) {
+        const struct token *const tok = &arg->data[i].tok;
+        const char *const s = spelling(pp, tok);
+        const bool quoted = tok->type == TOKEN_STRING_LITERAL
+                            || tok->type == TOKEN_CHAR_CONST;
+
+        if (i > 0 && (tok->flags & (TOKEN_FLAG_SPACE | TOKEN_FLAG_BOL)))
+            string_append(&text, ' ');
+        for (size_t j = 0; j < tok->len; j++) {
+            if (quoted && (s[j] == '"' || s[j] == '\\'))
+                string_append(&text, '\\');
+            string_append(&text, s[j]);
+        }
+    }
+    string_append(&text, '"');
+
+    if (!scratch_token(pp, text.arr, text.len, &out->tok))
+        error_at(pp, NULL, "error", "invalid string literal %s", text.arr);
+    out->hs = NULL;
+    string_destroy(&text);
+}
+
+/* Run the directive whose # was just read from the innermost file. */
+static void directive(struct preprocessor *pp) {
+    struct pp_context *ctx = &pp->contexts[pp->num_contexts - 1];
+    struct pp_file *const file = ctx->file;
+    const struct token *const toks = file->tokens.tokens;
+    const size_t begin = ctx->pos;
+    size_t end = begin;
+    const struct token *dtok;
+    const struct token *line;
+    size_t len;
+
+    while (end < ctx->len && !(toks[end].flags & TOKEN_FLAG_BOL)) end++;
+    ctx->pos = end;
+    /* The null directive. */
+    if (begin == end) return;
+
+    STATS_ADD_ATOMIC(directives, 0, 1);
+    dtok = &toks[begin];
+    line = dtok + 1;
+    len = end - begin - 1;
+
+    switch (directive_kind(dtok)) {
+    case DIRECTIVE_IF:
+    case DIRECTIVE_IFDEF:
+    case DIRECTIVE_IFNDEF: {
+        bool value;
+
+        if (directive_kind(dtok) == DIRECTIVE_IF)
+            value = eval_condition(pp, line, len, dtok);
+        else if (len == 0 || name_of(&line[0]) == ATOM_NONE) {
+            error_at(pp, dtok, "error", "macro names must be identifiers");
+            value = false;
+        }
+        else
+            value = is_defined(pp, name_of(&line[0]))
+                    == (directive_kind(dtok) == DIRECTIVE_IFDEF);
+
+        if (pp->num_conds == pp->conds_capacity) {
+            pp->conds_capacity = pp->conds_capacity
+                                 ? 2 * pp->conds_capacity : 16;
+            pp->conds = realloc(pp->conds,
+                                sizeof(struct pp_cond) * pp->conds_capacity);
+        }
+        pp->conds[pp->num_conds].taken = value;
+        pp->conds[pp->num_conds].seen_else = false;
+        pp->num_conds++;
+        if (!value) skip_group(pp);
+        break;
+    }
+    case DIRECTIVE_ELIF:
+    case DIRECTIVE_ELSE: {
+        const bool is_else = directive_kind(dtok) == DIRECTIVE_ELSE;
+        struct pp_cond *cond;
+
+        if (pp->num_conds == ctx->cond_base) {
+            error_at(pp, dtok, "error", "#%s without #if",
+                     is_else ? "else" : "elif");
+            break;
+        }
+        cond = &pp->conds[pp->num_conds - 1];
+        if (cond->seen_else) {
+            error_at(pp, dtok, "error", "#%s after #else",
+                     is_else ? "else" : "elif");
+            break;
+        }
+        if (cond->taken) {
+            cond->seen_else = is_else;
+            skip_group(pp);
+        }
+        else if (is_else || eval_condition(pp, line, len, dtok)) {
+            /* eval_condition() may have moved the conditional stack. */
+            cond = &pp->conds[pp->num_conds - 1];
+            cond->taken = true;
+            cond->seen_else = is_else;
+        }
+        else
+            skip_group(pp);
+        break;
+    }
+    case DIRECTIVE_ENDIF:
+        if (pp->num_conds == ctx->cond_base)
+            error_at(pp, dtok, "error", "#endif without #if");
+        else
+            pp->num_conds--;
+        break;
+    case DIRECTIVE_INCLUDE:
+    case DIRECTIVE_INCLUDE_NEXT:
+        do_include(pp, line, len, dtok,
+                   directive_kind(dtok) == DIRECTIVE_INCLUDE_NEXT);
+        break;
+    case DIRECTIVE_DEFINE:
+        do_define(pp, line, len, dtok);
+        break;
+    case DIRECTIVE_UNDEF:
+        if (len == 0 || name_of(&line[0]) == ATOM_NONE) {
+            error_at(pp, dtok, "error", "macro names must be identifiers");
+            break;
+        }
+        if (is_defined(pp, name_of(&line[0]))) {
+            pp->macros[name_of(&line[0])] = NULL;
+            pp->epoch++;
+        }
+        break;
+    case DIRECTIVE_ERROR:
+    case DIRECTIVE_WARNING: {
+        const bool is_error = directive_kind(dtok) == DIRECTIVE_ERROR;
+        const char *const text = len ? spelling(pp, &line[0]) : "";
+        const size_t text_len = len ? line[len - 1].offset + line[len - 1].len
+                                      - line[0].offset : 0;
+
+        error_at(pp, dtok, is_error ? "error" : "warning", "#%s %.*s",
+                 is_error ? "error" : "warning", (int)text_len, text);
+        break;
+    }
+    case DIRECTIVE_PRAGMA:
+        /* Other pragmas are ignored. */
+        if (len == 1 && name_of(&line[0]) == atom_once) file->once = true;
+        break;
+    case DIRECTIVE_LINE:
+        /* Line control is accepted, and ignored. */
+        break;
+    default:
+        /* So are the line markers of other preprocessors, # 1 "file". */
+        if (dtok->type != TOKEN_INT_CONST)
+            error_at(pp, dtok, "error", "invalid preprocessing directive "
+                     "#%.*s", (int)dtok->len, spelling(pp, dtok));
+        break;
+    }
+}
+
+/* Skip the tokens of a group that is not taken, up to the #elif, #else, or
+   #endif that ends it, which is left to be read. */
+static void skip_group(struct preprocessor *pp) {
+    struct pp_context *const ctx = &pp->contexts[pp->num_contexts - 1];
+    const struct token *const toks = ctx->file->tokens.tokens;
+    size_t depth = 0;
+    size_t i;
+
+    for (i = ctx->pos; i < ctx->len; i++) {
+        if (!is_directive(toks, ctx->len, i)) continue;
+        switch (directive_kind(&toks[i + 1])) {
+        case DIRECTIVE_IF:
+        case DIRECTIVE_IFDEF:
+        case DIRECTIVE_IFNDEF:
+            depth++;
+            continue;
+        case DIRECTIVE_ELIF:
+        case DIRECTIVE_ELSE:
+            if (depth) continue;
+            break;
+        case DIRECTIVE_ENDIF:
+            if (depth) {
+                depth--;
+                continue;
+            }
+            break;
+        default:
+            continue;
+        }
+        break;
+    }
+    STATS_ADD_ATOMIC(skipped_tokens, 0, i - ctx->pos);
+    ctx->pos = i;
+}
+
+/* #include, or #include_next, which goes on searching the search path
+   after the directory the current file was found in. */
+static void do_include(struct preprocessor *pp, const struct token *line,
+                       size_t len, const struct token *dtok, bool next) {
+    struct pp_file *const from = current_file(pp);
+    struct pp_tokens expanded = { 0 };
+    struct string name;
+    bool quoted = false;
+    size_t first = 0;
+    size_t found;
+    char *path;
+    struct pp_file *file;
+
+    string_init(&name);
+    if (len && line[0].type == TOKEN_STRING_LITERAL
+        && spelling(pp, &line[0])[0] == '"') {
+        string_append_n(&name, spelling(pp, &line[0]) + 1, line[0].len - 2);
+        quoted = true;
+    }
+    else if (len && line[0].type == TOKEN_LESS_THAN) {
+        /* The name is the text between < and >, as written. */
+        size_t i = 1;
+        while (i < len && line[i].type != TOKEN_GREATER_THAN) i++;
+        if (i == len) {
+            error_at(pp, dtok, "error", "missing terminating > character");
+            return;
+        }
+        string_append_n(&name, spelling(pp, &line[0]) + 1,
+                        line[i].offset - line[0].offset - 1);
+    }
+    else {
+        /* A macro that expands to either form. */
+        struct pp_tokens raw = { 0 };
+
+        for (size_t i = 0; i < len; i++) {
+            const struct pp_token t = { line[i], NULL };
+            pp_tokens_append(&raw, &t);
+        }
+        expand_isolated(pp, raw.data, raw.len, false, &expanded);
+        free(raw.data);
+
+        if (expanded.len
+            && expanded.data[0].tok.type == TOKEN_STRING_LITERAL) {
+            const struct token *const tok = &expanded.data[0].tok;
+            string_append_n(&name, spelling(pp, tok) + 1, tok->len - 2);
+            quoted = true;
+        }
+        else if (expanded.len
+                 && expanded.data[0].tok.type == TOKEN_LESS_THAN) {
+            size_t i;
+            for (i = 1; i < expanded.len
+                        && expanded.data[i].tok.type != TOKEN_GREATER_THAN;
+                 i++) {
+                const struct token *const tok = &expanded.data[i].tok;
+                if (i > 1 && (tok->flags & TOKEN_FLAG_SPACE))
+                    string_append(&name, ' ');
+                string_append_n(&name, spelling(pp, tok), tok->len);
+            }
+            if (i == expanded.len) string_clear(&name);
+        }
+        free(expanded.data);
+    }
+    if (name.len == 0) {
+        error_at(pp, dtok, "error",
+                 "#include expects \"FILENAME\" or <FILENAME>");
+        string_destroy(&name);
+        return;
+    }
+
+    if (next) {
+        for (size_t i = pp->num_contexts; i-- > 0;)
+            if (pp->contexts[i].file) {
+                first = pp->contexts[i].dir_index + 1;
+                break;
+            }
+        quoted = false;
+    }
+    path = find_include(pp, from, name.arr, quoted, first, &found);
+    if (path == NULL) {
+        error_at(pp, dtok, "error", "%s: file not found", name.arr);
+        string_destroy(&name);
+        return;
+    }
+    string_destroy(&name);
+
+    file = load_file(pp, path);
+    if (file == NULL) {
+        error_at(pp, dtok, "error", "%s: cannot open file", path);
+        free(path);
+        return;
+    }
+    free(path);
+    STATS_ADD_ATOMIC(includes, 0, 1);
+
+    /* A guarded file would expand to nothing. */
+    if (file->once || (file->guard && is_defined(pp, file->guard))) {
+        STATS_ADD_ATOMIC(include_skips, 0, 1);
+        return;
+    }
+
+    size_t depth = 0;
+    for (size_t i = 0; i < pp->num_contexts; i++)
+        if (pp->contexts[i].file) depth++;
+    if (depth > MAX_INCLUDE_DEPTH) {
+        error_at(pp, dtok, "error", "#include nested too deeply");
+        return;
+    }
+    push_context(pp, file, NULL, file->tokens.len, NULL, false, false);
+    pp->contexts[pp->num_contexts - 1].dir_index = found;
+}
+
+static void do_define(struct preprocessor *pp, const struct token *line,
+                      size_t len, const struct token *dtok) {
+    const uint32_t name = len ? name_of(&line[0]) : ATOM_NONE;
+    struct macro *m;
+    uint32_t params[len + 1];
+    size_t i = 1;
+
+    if (name == ATOM_NONE) {
+        error_at(pp, dtok, "error", "macro names must be identifiers");
+        return;
+    }
+    if (name == atom_defined) {
+        error_at(pp, dtok, "error",
+                 "\"defined\" cannot be used as a macro name");
+        return;
+    }
+
+    m = arena_alloc(&pp->arena, sizeof(struct macro), _Alignof(struct macro));
+    memset(m, 0, sizeof(*m));
+    m->kind = MACRO_OBJECT;
+
+    /* A ( right after the name begins a parameter list. */
+    if (len > 1 && line[1].type == TOKEN_PAREN_OPEN
+        && !(line[1].flags & TOKEN_FLAG_SPACE)) {
+        m->kind = MACRO_FUNCTION;
+        i = 2;
+        if (i < len && line[i].type == TOKEN_PAREN_CLOSE) i++;
+        else while (1) {
+            if (i < len && line[i].type == TOKEN_THREE_PERIOD) {
+                m->variadic = true;
+                params[m->num_params++] = atom_va_args;
+                i++;
+            }
+            else if (i < len && name_of(&line[i]) != ATOM_NONE)
+                params[m->num_params++] = name_of(&line[i++]);
+            else {
+                error_at(pp, dtok, "error",
+                         "expected parameter name in macro '%s'",
+                         atom_spelling(name));
+                return;
+            }
+
+            if (i < len && line[i].type == TOKEN_PAREN_CLOSE) {
+                i++;
+                break;
+            }
+            if (m->variadic || i == len || line[i].type != TOKEN_COMMA) {
+                error_at(pp, dtok, "error",
+                         "expected ',' or ')' in parameter list of "
+                         "macro '%s'", atom_spelling(name));
+                return;
+            }
+            i++;
+        }
+        m->params = arena_alloc(&pp->arena,
+                                sizeof(uint32_t) * m->num_params + 1,
+                                _Alignof(uint32_t));
+        memcpy(m->params, params, sizeof(uint32_t) * m->num_params);
+    }
+
+    m->body_len = len - i;
+    m->body = arena_alloc(&pp->arena, sizeof(struct token) * m->body_len + 1,
+                          _Alignof(struct token));
+    m->param_index = arena_alloc(&pp->arena, sizeof(int) * m->body_len + 1,
+                                 _Alignof(int));
+    for (size_t j = 0; j < m->body_len; j++) {
+        const uint32_t tok_name = name_of(&line[i + j]);
+
+        m->body[j] = line[i + j];
+        m->param_index[j] = -1;
+        for (size_t k = 0; k < m->num_params; k++)
+            if (tok_name != ATOM_NONE && tok_name == m->params[k])
+                m->param_index[j] = k;
+    }
+
+    if (m->body_len && (m->body[0].type == TOKEN_TWO_SHARP
+                        || m->body[m->body_len - 1].type == TOKEN_TWO_SHARP)) {
+        error_at(pp, dtok, "error", "'##' cannot appear at either end of a "
+                 "macro expansion");
+        return;
+    }
+    if (m->kind == MACRO_FUNCTION)
+        for (size_t j = 0; j < m->body_len; j++)
+            if (m->body[j].type == TOKEN_SHARP
+                && (j + 1 == m->body_len || m->param_index[j + 1] < 0)) {
+                error_at(pp, dtok, "error",
+                         "'#' is not followed by a macro parameter");
+                return;
+            }
+
+    if (name >= pp->macros_len) {
+        const size_t macros_len = 2 * name + 16;
+        pp->macros = realloc(pp->macros, sizeof(struct macro *) * macros_len);
+        memset(pp->macros + pp->macros_len, 0,
+               sizeof(struct macro *) * (macros_len - pp->macros_len));
+        pp->macros_len = macros_len;
+    }
+    pp->macros[name] = m;
+    pp->epoch++;
+}
+
+/* Evaluate the controlling expression of an #if or #elif. */
+static bool eval_condition(struct preprocessor *pp, const struct token *line,
+                           size_t len, const struct token *dtok) {
+    struct pp_tokens pre = { 0 };
+    struct pp_tokens expanded = { 0 };
+    struct pp_expr e;
+    struct pp_value value;
+
+    /* defined is replaced before macro expansion. */
+    for (size_t i = 0; i < len; i++) {
+        struct pp_token t = { line[i], NULL };
+
+        if (name_of(&line[i]) == atom_defined) {
+            const bool paren = i + 1 < len
+                               && line[i + 1].type == TOKEN_PAREN_OPEN;
+            const size_t at = i + 1 + paren;
+            uint32_t name;
+
+            if (at >= len || (name = name_of(&line[at])) == ATOM_NONE
+                || (paren && (at + 1 >= len
+                              || line[at + 1].type != TOKEN_PAREN_CLOSE))) {
+                error_at(pp, dtok, "error", "operator \"defined\" requires "
+                         "an identifier");
+                free(pre.data);
+                return false;
+            }
+            scratch_token(pp, is_defined(pp, name) ? "1" : "0", 1, &t.tok);
+            i = at + paren;
+        }
+        pp_tokens_append(&pre, &t);
+    }
+
+    expand_isolated(pp, pre.data, pre.len, false, &expanded);
+    free(pre.data);
+
+    e.pp = pp;
+    e.tokens = expanded.data;
+    e.len = expanded.len;
+    e.pos = 0;
+    e.unevaluated = 0;
+    e.error = false;
+    if (e.len == 0) {
+        error_at(pp, dtok, "error", "#%s with no expression",
+                 directive_kind(dtok) == DIRECTIVE_IF ? "if" : "elif");
+        return false;
+    }
+    value = eval_conditional(&e);
+    if (!e.error && e.pos != e.len) {
+        error_at(pp, &e.tokens[e.pos].tok, "error",
+                 "token \"%.*s\" is not valid in preprocessor expressions",
+                 (int)e.tokens[e.pos].tok.len,
+                 spelling(pp, &e.tokens[e.pos].tok));
+        e.error = true;
+    }
+    free(expanded.data);
+    return !e.error && value.v != 0;
+}
+
+static enum token_type peek_type(const struct pp_expr *e) {
+    return e->pos < e->len ? e->tokens[e->pos].tok.type : TOKEN_EOF;
+}
+
+static void expr_error(struct pp_expr *e, const char *msg) {
+    if (e->error) return;
+    error_at(e->pp, e->pos < e->len ? &e->tokens[e->pos].tok : NULL,
+             "error", "%s in preprocessor expression", msg);
+    e->error = true;
+}
+
+static struct pp_value eval_conditional(struct pp_expr *e) {
+    struct pp_value cond = eval_binary(e, 1);
+    struct pp_value a;
+    struct pp_value b;
+
+    if (peek_type(e) != TOKEN_QUESTION) return cond;
+    e->pos++;
+
+    if (!cond.v) e->unevaluated++;
+    a = eval_conditional(e);
+    if (!cond.v) e->unevaluated--;
+    if (peek_type(e) != TOKEN_COLON) {
+        expr_error(e, "expected ':'");
+        return cond;
+    }
+    e->pos++;
+    if (cond.v) e->unevaluated++;
+    b = eval_conditional(e);
+    if (cond.v) e->unevaluated--;
+
+    a = cond.v ? a : b;
+    a.is_unsigned = a.is_unsigned || b.is_unsigned;
+    return a;
+}
+
+/* Precedence of a binary operator, or 0. */
+static int precedence(enum token_type type) {
+    switch (type) {
+    case TOKEN_TWO_VERT_BAR: return 1;
+    case TOKEN_TWO_AMPERSAND: return 2;
+    case TOKEN_VERT_BAR: return 3;
+    case TOKEN_CARROT: return 4;
+    case TOKEN_AMPERSAND: return 5;
+    case TOKEN_EQUAL: case TOKEN_NOT_EQUAL: return 6;
+    case TOKEN_LESS_THAN: case TOKEN_GREATER_THAN:
+    case TOKEN_LEQ: case TOKEN_GEQ: return 7;
+    case TOKEN_LSHIFT: case TOKEN_RSHIFT: return 8;
+    case TOKEN_PLUS: case TOKEN_MINUS: return 9;
+    case TOKEN_ASTERISK: case TOKEN_SLASH: case TOKEN_PERCENT: return 10;
+    default: return 0;
+    }
+}
+
+static struct pp_value eval_binary(struct pp_expr *e, int min_prec) {
+    struct pp_value lhs = eval_unary(e);
+
+    while (1) {
+        const enum token_type op = peek_type(e);
+        const int prec = precedence(op);
+        struct pp_value rhs;
+        bool skip = false;
+        bool u;
+
+        if (prec == 0 || prec < min_prec) return lhs;
+        e->pos++;
+
+        /* The right operand of a decided && or || is not evaluated. */
+        if ((op == TOKEN_TWO_AMPERSAND && !lhs.v)
+            || (op == TOKEN_TWO_VERT_BAR && lhs.v))
+            skip = true;
+        if (skip) e->unevaluated++;
+        rhs = eval_binary(e, prec + 1);
+        if (skip) e->unevaluated--;
+
+        u = lhs.is_unsigned || rhs.is_unsigned;
+        switch (op) {
+        case TOKEN_TWO_VERT_BAR:
+            lhs.v = lhs.v || rhs.v;
+            u = false;
+            break;
+        case TOKEN_TWO_AMPERSAND:
+            lhs.v = lhs.v && rhs.v;
+            u = false;
+            break;
+        case TOKEN_VERT_BAR: lhs.v |= rhs.v; break;
+        case TOKEN_CARROT: lhs.v ^= rhs.v; break;
+        case TOKEN_AMPERSAND: lhs.v &= rhs.v; break;
+        case TOKEN_EQUAL:
+            lhs.v = lhs.v == rhs.v;
+            u = false;
+            break;
+        case TOKEN_NOT_EQUAL:
+            lhs.v = lhs.v != rhs.v;
+            u = false;
+            break;
+        case TOKEN_LESS_THAN:
+            lhs.v = u ? lhs.v < rhs.v : (int64_t)lhs.v < (int64_t)rhs.v;
+            u = false;
+            break;
+        case TOKEN_GREATER_THAN:
+            lhs.v = u ? lhs.v > rhs.v : (int64_t)lhs.v > (int64_t)rhs.v;
+            u = false;
+            break;
+        case TOKEN_LEQ:
+            lhs.v = u ? lhs.v <= rhs.v : (int64_t)lhs.v <= (int64_t)rhs.v;
+            u = false;
+            break;
+        case TOKEN_GEQ:
+            lhs.v = u ? lhs.v >= rhs.v : (int64_t)lhs.v >= (int64_t)rhs.v;
+            u = false;
+            break;
+        case TOKEN_LSHIFT:
+            /* The type is that of the left operand. */
+            u = lhs.is_unsigned;
+            lhs.v = rhs.v >= 64 ? 0 : lhs.v << rhs.v;
+            break;
+        case TOKEN_RSHIFT:
+            u = lhs.is_unsigned;
+            if (u) lhs.v = rhs.v >= 64 ? 0 : lhs.v >> rhs.v;
+            else lhs.v = (int64_t)lhs.v >> (rhs.v >= 64 ? 63 : rhs.v);
+            break;
+        case TOKEN_PLUS: lhs.v += rhs.v; break;
+        case TOKEN_MINUS: lhs.v -= rhs.v; break;
+        case TOKEN_ASTERISK: lhs.v *= rhs.v; break;
+        case TOKEN_SLASH:
+        case TOKEN_PERCENT:
+            if (rhs.v == 0) {
+                if (!e->unevaluated) expr_error(e, "division by zero");
+                lhs.v = 0;
+            }
+            else if (u)
+                lhs.v = op == TOKEN_SLASH ? lhs.v / rhs.v : lhs.v % rhs.v;
+            else if ((int64_t)lhs.v == INT64_MIN && (int64_t)rhs.v == -1)
+                lhs.v = op == TOKEN_SLASH ? lhs.v : 0;
+            else
+                lhs.v = op == TOKEN_SLASH ? (uint64_t)((int64_t)lhs.v
+                                                       / (int64_t)rhs.v)
+                                          : (uint64_t)((int64_t)lhs.v
+                                                       % (int64_t)rhs.v);
+            break;
+        default:
+            break;
+        }
+        lhs.is_unsigned = u;
+    }
+}
+
+static struct pp_value eval_unary(struct pp_expr *e) {
+    struct pp_value value = { 0, false };
+    const struct token *tok;
+
+    if (e->pos == e->len) {
+        expr_error(e, "missing operand");
+        return value;
+    }
+    tok = &e->tokens[e->pos++].tok;
+
+    switch (tok->type) {
+    case TOKEN_PLUS:
+        return eval_unary(e);
+    case TOKEN_MINUS:
+        value = eval_unary(e);
+        value.v = -value.v;
+        return value;
+    case TOKEN_TILDE:
+        value = eval_unary(e);
+        value.v = ~value.v;
+        return value;
+    case TOKEN_EXCLAMATION:
+        value = eval_unary(e);
+        value.v = !value.v;
+        value.is_unsigned = false;
+        return value;
+    case TOKEN_PAREN_OPEN:
+        value = eval_conditional(e);
+        if (peek_type(e) != TOKEN_PAREN_CLOSE) expr_error(e, "expected ')'");
+        else e->pos++;
+        return value;
+    case TOKEN_INT_CONST:
+        /* Every integer type acts as intmax_t or uintmax_t. */
+        value.v = tok->int_value;
+        value.is_unsigned = tok->const_type == CONST_UNSIGNED_INT
+                            || tok->const_type == CONST_UNSIGNED_LONG
+                            || tok->const_type == CONST_UNSIGNED_LONG_LONG;
+        return value;
+    case TOKEN_CHAR_CONST:
+        value.v = char_value(spelling(e->pp, tok), tok->len);
+        return value;
+    case TOKEN_FLOAT_CONST:
+        e->pos--;
+        expr_error(e, "floating constant");
+        return value;
+    default:
+        /* Identifiers left after expansion, keywords included, are 0. */
+        if (name_of(tok) != ATOM_NONE) return value;
+        e->pos--;
+        expr_error(e, "expected value");
+        return value;
+    }
+}
+
+/* Value of a character constant, as GCC gives it: a plain one is a char,
+   which is signed, and the characters of a multi-character one are packed
+   into an int. */
+static uint64_t char_value(const char *s, size_t len) {
+    const char *const end = s + len - 1;
+    const bool wide = *s != '\'';
+    int64_t value = 0;
+    size_t n = 0;
+
+    while (*s != '\'') s++;
+    s++;
+    while (s < end) {
+        uint32_t c = (unsigned char)*s++;
+
+        if (c == '\\') {
+            c = (unsigned char)*s++;
+            switch (c) {
+            case 'a': c = '\a'; break;
+            case 'b': c = '\b'; break;
+            case 'f': c = '\f'; break;
+            case 'n': c = '\n'; break;
+            case 'r': c = '\r'; break;
+            case 't': c = '\t'; break;
+            case 'v': c = '\v'; break;
+            case 'x':
+            case 'u':
+            case 'U':
+                for (c = 0; s < end && isxdigit((unsigned char)*s); s++)
+                    c = c * 16 + (isdigit((unsigned char)*s)
+                                  ? *s - '0' : (*s | 0x20) - 'a' + 10);
+                break;
+            default:
+                if (c >= '0' && c <= '7') {
+                    c -= '0';
+                    for (int i = 1; i < 3 && *s >= '0' && *s <= '7'; i++)
+                        c = c * 8 + (*s++ - '0');
+                }
+                break;
+            }
+        }
+
+        if (wide) value = c;
+        else if (n++ == 0) value = (signed char)c;
+        else value = (int32_t)((uint32_t)value << 8 | (c & 0xff));
+    }
+    return value;
+}
@@ -0,0 +1,96 @@
+#ifndef PREPROCESSOR_H
+#define PREPROCESSOR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "lexer.h"
+#include "utils.h"
+
+struct pp_file;
+struct pp_context;
+struct pp_cond;
+struct macro;
+
+/* Translation phase 4: directives, conditional inclusion, and macro
+   expansion, over the preprocessing tokens of lexer_pp().
+
+   Every file is read and lexed once per preprocessor, however often it is
+   included, and a file wrapped in an include guard or marked with #pragma
+   once is not even scanned again. The full expansion of an object-like
+   macro is memoized until the next #define or #undef. */
+struct preprocessor {
+    /* Number of lexer threads per file. */
+    size_t jobs;
+    /* Stream the diagnostics of the files preprocessed, parsed and compiled
+       with this preprocessor are reported on, stderr unless set. */
+    FILE *diagnostics;
+    /* Files, macros, and memoized expansions. */
+    struct arena arena;
+
+    /* -I directories, searched before the built-in include directory. */
+    const char **include_dirs;
+    size_t num_include_dirs;
+
+    /* Predefined macros and -D options, as the text of a pseudo-file. */
+    struct string predefined;
+
+    /* Files by id, which is also the source id of their tokens, and the id
+       + 1 of each file by the atom of its real path. */
+    struct pp_file **files;
+    size_t num_files;
+    size_t files_capacity;
+    uint32_t *file_ids;
+    size_t file_ids_len;
+
+    /* Macro definitions by the atom of their name. The epoch changes with
+       every definition, and invalidates memoized expansions. */
+    struct macro **macros;
+    size_t macros_len;
+    uint64_t epoch;
+
+    /* Stack of files being read and macro expansions being rescanned. */
+    struct pp_context *contexts;
+    size_t num_contexts;
+    size_t contexts_capacity;
+
+    /* Stack of open #if groups. */
+    struct pp_cond *conds;
+    size_t num_conds;
+    size_t conds_capacity;
+
+    /* Spellings made by ## and #, which are lexed in place. */
+    struct pp_file *scratch;
+
+    int errors;
+};
+
+void preprocessor_init(struct preprocessor *pp, size_t jobs);
+void preprocessor_destroy(struct preprocessor *pp);
+
+void preprocessor_add_include_dir(struct preprocessor *pp, const char *dir);
+/* Define a macro as the -D option does: "NAME" defines it as 1, and
+   "NAME=value" as value. */
+void preprocessor_define(struct preprocessor *pp, const char *definition);
+
+/* Preprocess the file at path into tokens, allocated from arena. Errors are
+   reported on pp->diagnostics. Returns 0 on success and -1 if there were
+   errors. */
+int preprocess(struct preprocessor *pp, const char *path, struct arena *arena,
+               struct token_array *tokarr);
+
+/* Spelling of a token returned by preprocess(), which is not NUL-terminated,
+   and the path of the file it was spelled in. Valid until
+   preprocessor_destroy(). */
+const char *preprocessor_spelling(const struct preprocessor *pp,
+                                  const struct token *tok);
+const char *preprocessor_file_path(const struct preprocessor *pp,
+                                   const struct token *tok);
+/* Line and column of a token returned by preprocess() in the file it was
+   spelled in, both counted from 1, looked up from its offset. */
+size_t preprocessor_line(struct preprocessor *pp, const struct token *tok);
+size_t preprocessor_column(struct preprocessor *pp, const struct token *tok);
+
+#endif
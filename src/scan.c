@@ -0,0 +1,242 @@
+#include "scan.h"
+
+#include <stdbool.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SCAN_X86 1
+#include <immintrin.h>
+#else
+#define SCAN_X86 0
+#endif
+
+struct scan_kernels {
+    enum scan_isa isa;
+    size_t (*space)(const char *p, const char *end);
+    size_t (*identifier)(const char *p, const char *end);
+    size_t (*digits)(const char *p, const char *end);
+    size_t (*s_chars)(const char *p, const char *end);
+    size_t (*lines)(const char *p, const char *end, uint32_t base,
+                    uint32_t *starts);
+};
+
+static bool is_space_char(unsigned char c) {
+    return c == ' ' || (unsigned char)(c - '\t') <= '\r' - '\t';
+}
+
+static bool is_identifier_char(unsigned char c) {
+    return (unsigned char)((c | 0x20) - 'a') <= 'z' - 'a'
+           || (unsigned char)(c - '0') <= 9 || c == '_';
+}
+
+static bool is_digit_char(unsigned char c) {
+    return (unsigned char)(c - '0') <= 9;
+}
+
+static bool is_s_char(unsigned char c) {
+    return c != '\"' && c != '\\' && c != '\n' && c != '\0';
+}
+
+/* Scalar kernels, also used for the tails of the vector kernels. */
+#define SCALAR_KERNEL(name, pred)                                           \
+    static size_t name##_scalar(const char *p, const char *end) {           \
+        const char *const start = p;                                        \
+        while (p != end && pred((unsigned char)*p)) p++;                    \
+        return p - start;                                                   \
+    }
+
+SCALAR_KERNEL(space, is_space_char)
+SCALAR_KERNEL(identifier, is_identifier_char)
+SCALAR_KERNEL(digits, is_digit_char)
+SCALAR_KERNEL(s_chars, is_s_char)
+
+static size_t lines_scalar(const char *p, const char *end, uint32_t base,
+                           uint32_t *starts) {
+    size_t n = 0;
+    for (const char *q = p; q != end; q++)
+        if (*q == '\n') starts[n++] = base + (uint32_t)(q - p) + 1;
+    return n;
+}
+
+static const struct scan_kernels scalar_kernels = {
+    SCAN_SCALAR, space_scalar, identifier_scalar, digits_scalar, s_chars_scalar,
+    lines_scalar,
+};
+
+#if SCAN_X86
+
+/* Vector kernels. A mask function sets every byte of its result to 0xff where
+   the corresponding character belongs to the run; the kernel then finds the
+   first zero byte. Ranges are tested with a single unsigned comparison:
+   lo <= x <= hi iff min(x - lo, hi - lo) == x - lo. */
+#define VECTOR_KERNEL(name, isa, vec, width, load, movemask, full)          \
+    static size_t name##_##isa(const char *p, const char *end) {            \
+        const char *const start = p;                                        \
+        unsigned mask;                                                      \
+        while (end - p >= width) {                                          \
+            mask = movemask(name##_mask_##isa(load((const vec *)p)));       \
+            if (mask != full)                                               \
+                return p - start + __builtin_ctz(~mask);                    \
+            p += width;                                                     \
+        }                                                                   \
+        return p - start + name##_scalar(p, end);                           \
+    }
+
+/* The lines kernel stores an offset for each set bit of the mask of the
+   new-lines in a vector, lowest first. */
+#define LINES_KERNEL(isa, vec, width, load, movemask, set1, cmpeq)          \
+    static size_t lines_##isa(const char *p, const char *end,               \
+                              uint32_t base, uint32_t *starts) {            \
+        const vec nl = set1('\n');                                          \
+        const char *q = p;                                                  \
+        size_t n = 0;                                                       \
+        unsigned mask;                                                      \
+        while (end - q >= width) {                                          \
+            mask = movemask(cmpeq(load((const vec *)q), nl));               \
+            while (mask) {                                                  \
+                starts[n++] = base + (uint32_t)(q - p)                      \
+                              + __builtin_ctz(mask) + 1;                    \
+                mask &= mask - 1;                                           \
+            }                                                               \
+            q += width;                                                     \
+        }                                                                   \
+        return n + lines_scalar(q, end, base + (uint32_t)(q - p),           \
+                                starts + n);                                \
+    }
+
+static inline __m128i in_range_sse2(__m128i x, char lo, char hi) {
+    const __m128i d = _mm_sub_epi8(x, _mm_set1_epi8(lo));
+    return _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(hi - lo)), d);
+}
+
+static inline __m128i space_mask_sse2(__m128i x) {
+    return _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8(' ')),
+                        in_range_sse2(x, '\t', '\r'));
+}
+
+static inline __m128i identifier_mask_sse2(__m128i x) {
+    const __m128i lower = _mm_or_si128(x, _mm_set1_epi8(0x20));
+    return _mm_or_si128(_mm_or_si128(in_range_sse2(lower, 'a', 'z'),
+                                     in_range_sse2(x, '0', '9')),
+                        _mm_cmpeq_epi8(x, _mm_set1_epi8('_')));
+}
+
+static inline __m128i digits_mask_sse2(__m128i x) {
+    return in_range_sse2(x, '0', '9');
+}
+
+static inline __m128i s_chars_mask_sse2(__m128i x) {
+    const __m128i stop = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('\"')),
+                     _mm_cmpeq_epi8(x, _mm_set1_epi8('\\'))),
+        _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('\n')),
+                     _mm_cmpeq_epi8(x, _mm_setzero_si128())));
+    return _mm_andnot_si128(stop, _mm_set1_epi8(-1));
+}
+
+VECTOR_KERNEL(space, sse2, __m128i, 16, _mm_loadu_si128, _mm_movemask_epi8, 0xffffu)
+VECTOR_KERNEL(identifier, sse2, __m128i, 16, _mm_loadu_si128, _mm_movemask_epi8, 0xffffu)
+VECTOR_KERNEL(digits, sse2, __m128i, 16, _mm_loadu_si128, _mm_movemask_epi8, 0xffffu)
+VECTOR_KERNEL(s_chars, sse2, __m128i, 16, _mm_loadu_si128, _mm_movemask_epi8, 0xffffu)
+LINES_KERNEL(sse2, __m128i, 16, _mm_loadu_si128, _mm_movemask_epi8, _mm_set1_epi8, _mm_cmpeq_epi8)
+
+static const struct scan_kernels sse2_kernels = {
+    SCAN_SSE2, space_sse2, identifier_sse2, digits_sse2, s_chars_sse2,
+    lines_sse2,
+};
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static inline __m256i in_range_avx2(__m256i x, char lo, char hi) {
+    const __m256i d = _mm256_sub_epi8(x, _mm256_set1_epi8(lo));
+    return _mm256_cmpeq_epi8(_mm256_min_epu8(d, _mm256_set1_epi8(hi - lo)), d);
+}
+
+AVX2 static inline __m256i space_mask_avx2(__m256i x) {
+    return _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8(' ')),
+                           in_range_avx2(x, '\t', '\r'));
+}
+
+AVX2 static inline __m256i identifier_mask_avx2(__m256i x) {
+    const __m256i lower = _mm256_or_si256(x, _mm256_set1_epi8(0x20));
+    return _mm256_or_si256(_mm256_or_si256(in_range_avx2(lower, 'a', 'z'),
+                                           in_range_avx2(x, '0', '9')),
+                           _mm256_cmpeq_epi8(x, _mm256_set1_epi8('_')));
+}
+
+AVX2 static inline __m256i digits_mask_avx2(__m256i x) {
+    return in_range_avx2(x, '0', '9');
+}
+
+AVX2 static inline __m256i s_chars_mask_avx2(__m256i x) {
+    const __m256i stop = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('\"')),
+                        _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\\'))),
+        _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('\n')),
+                        _mm256_cmpeq_epi8(x, _mm256_setzero_si256())));
+    return _mm256_andnot_si256(stop, _mm256_set1_epi8(-1));
+}
+
+AVX2 VECTOR_KERNEL(space, avx2, __m256i, 32, _mm256_loadu_si256, _mm256_movemask_epi8, 0xffffffffu)
+AVX2 VECTOR_KERNEL(identifier, avx2, __m256i, 32, _mm256_loadu_si256, _mm256_movemask_epi8, 0xffffffffu)
+AVX2 VECTOR_KERNEL(digits, avx2, __m256i, 32, _mm256_loadu_si256, _mm256_movemask_epi8, 0xffffffffu)
+AVX2 VECTOR_KERNEL(s_chars, avx2, __m256i, 32, _mm256_loadu_si256, _mm256_movemask_epi8, 0xffffffffu)
+AVX2 LINES_KERNEL(avx2, __m256i, 32, _mm256_loadu_si256, _mm256_movemask_epi8, _mm256_set1_epi8, _mm256_cmpeq_epi8)
+
+static const struct scan_kernels avx2_kernels = {
+    SCAN_AVX2, space_avx2, identifier_avx2, digits_avx2, s_chars_avx2,
+    lines_avx2,
+};
+
+#endif
+
+static const struct scan_kernels *kernels;
+
+void scan_init(void) {
+    if (kernels == NULL) scan_select(SCAN_AVX2);
+}
+
+enum scan_isa scan_select(enum scan_isa max) {
+    kernels = &scalar_kernels;
+#if SCAN_X86
+    __builtin_cpu_init();
+    if (max >= SCAN_AVX2 && __builtin_cpu_supports("avx2"))
+        kernels = &avx2_kernels;
+    else if (max >= SCAN_SSE2 && __builtin_cpu_supports("sse2"))
+        kernels = &sse2_kernels;
+#endif
+    return kernels->isa;
+}
+
+const char *scan_isa_name(enum scan_isa isa) {
+    switch (isa) {
+    case SCAN_SSE2: return "sse2";
+    case SCAN_AVX2: return "avx2";
+    default: return "scalar";
+    }
+}
+
+size_t scan_space(const char *p, const char *end) {
+    scan_init();
+    return kernels->space(p, end);
+}
+
+size_t scan_identifier(const char *p, const char *end) {
+    scan_init();
+    return kernels->identifier(p, end);
+}
+
+size_t scan_digits(const char *p, const char *end) {
+    scan_init();
+    return kernels->digits(p, end);
+}
+
+size_t scan_s_chars(const char *p, const char *end) {
+    scan_init();
+    return kernels->s_chars(p, end);
+}
+
+size_t scan_lines(const char *p, const char *end, uint32_t base,
+                  uint32_t *starts) {
+    scan_init();
+    return kernels->lines(p, end, base, starts);
+}
@@ -0,0 +1,41 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Bulk character scanning kernels for the lexer. Each returns the length of
+   the run of characters at p, never reading at or past end:
+
+   scan_space:      white-space characters.
+   scan_identifier: identifier characters, i.e. letters, digits, and '_'.
+   scan_digits:     decimal digits.
+   scan_s_chars:    characters other than '"', '\\', new-line, and NUL.
+
+   scan_lines finds the starts of lines instead: for each new-line in
+   [p, end), it stores base plus the offset from p just past it in starts,
+   which must have room for end - p of them, and returns how many it stored.
+
+   The kernel set is selected at runtime from the best instruction set the
+   CPU supports. All kernel sets return exactly the same results. */
+
+enum scan_isa {
+    SCAN_SCALAR,
+    SCAN_SSE2,
+    SCAN_AVX2,
+};
+
+/* scan_init() selects the best kernel set unless one is already selected.
+   It must be called before scanning from several threads. */
+void scan_init(void);
+enum scan_isa scan_select(enum scan_isa max);
+const char *scan_isa_name(enum scan_isa isa);
+
+size_t scan_space(const char *p, const char *end);
+size_t scan_identifier(const char *p, const char *end);
+size_t scan_digits(const char *p, const char *end);
+size_t scan_s_chars(const char *p, const char *end);
+size_t scan_lines(const char *p, const char *end, uint32_t base,
+                  uint32_t *starts);
+
+#endif
@@ -0,0 +1,465 @@
+#include "snapshot.h"
+#include "host.h"
+#include "intern.h"
+#include "preprocessor.h"
+#include "stats.h"
+#include "type.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Every section starts at a multiple of this, which suits any element. */
+#define SECTION_ALIGN 64
+
+/* Arrays of a program that are saved, with their lengths and the types of
+   their elements. */
+#define ARRAYS(X)                                                           \
+    X(CODE, code, code_len, struct insn)                                    \
+    X(CODE_TOKENS, code_tokens, code_len, uint32_t)                         \
+    X(FUNCTIONS, functions, num_functions, struct function)                 \
+    X(GLOBALS, globals, num_globals, struct global)                         \
+    X(DATA, data, data_size, uint8_t)                                       \
+    X(RELOCS, relocs, num_relocs, struct reloc)                             \
+    X(CONSTANTS, constants, num_constants, uint64_t)                        \
+    X(CALL_SITES, call_sites, num_call_sites, struct call_site)             \
+    X(ARG_CLASSES, arg_classes, num_arg_classes, uint8_t)                   \
+    X(HOST_SIGNATURES, host_signatures, num_host_signatures,                \
+      struct host_signature)                                                \
+    X(SWITCHES, switches, num_switches, struct switch_table)                \
+    X(SWITCH_CASES, switch_cases, num_switch_cases, struct switch_case)     \
+    X(FRAME_SLOTS, frame_slots, num_frame_slots, struct frame_slot)         \
+    X(OVERFLOW_SITES, overflow_sites, num_overflow_sites,                   \
+      struct overflow_site)                                                 \
+    X(LOCATIONS, locations, num_locations, struct program_location)
+
+enum section {
+#define SECTION_ENUM(id, name, count, type) SECTION_##id,
+    ARRAYS(SECTION_ENUM)
+#undef SECTION_ENUM
+    /* Offsets in SPELLINGS of the saved names, numbered from 1: name i is
+       spelled from offset i - 1, up to a NUL before offset i. */
+    SECTION_NAMES,
+    SECTION_SPELLINGS,
+    NUM_SECTIONS,
+};
+
+static const uint32_t element_sizes[NUM_SECTIONS] = {
+#define SECTION_SIZE(id, name, count, type) sizeof(type),
+    ARRAYS(SECTION_SIZE)
+#undef SECTION_SIZE
+    sizeof(uint32_t),
+    1,
+};
+
+struct snapshot_section {
+    uint64_t offset;
+    uint64_t len;
+    uint32_t element_size;
+};
+
+/* All fields are in host byte order. */
+struct snapshot_header {
+    char magic[8];
+    uint32_t format;
+    /* What the code was compiled and linked for. */
+    uint32_t overflow;
+    uint8_t memory_checks;
+    uint8_t specialize;
+    int64_t main;
+    /* hash_contents() of the header, with this holding hash_contents() of
+       everything after the header. */
+    uint64_t checksum;
+    struct snapshot_section sections[NUM_SECTIONS];
+};
+
+/* Names saved so far: the atoms in order, and the index of each atom,
+   numbered from 1, or 0 if not saved. */
+struct names {
+    uint32_t *atoms;
+    size_t len;
+    size_t capacity;
+    uint32_t *index;
+    size_t index_len;
+};
+
+static const char magic[8] = "CISCSNP";
+
+STATS_PHASE(load_phase, "snapshot.load");
+
+static uint32_t save_name(struct names *names, uint32_t atom);
+static uint32_t *make_locations(const struct program *prog,
+                                struct names *names,
+                                struct program_location **locations,
+                                size_t *num_locations);
+static void write_section(struct string *payload,
+                          struct snapshot_header *header, enum section s,
+                          const void *arr, size_t len);
+static int check_image(const char *map, size_t size);
+
+bool snapshot_check(const char *path) {
+    char buf[sizeof(magic)];
+    FILE *const fp = fopen(path, "rb");
+    bool found;
+
+    if (fp == NULL) return false;
+    found = fread(buf, 1, sizeof(buf), fp) == sizeof(buf)
+            && !memcmp(buf, magic, sizeof(magic));
+    fclose(fp);
+    return found;
+}
+
+int snapshot_save(const struct program *prog, const char *path) {
+    struct snapshot_header header;
+    struct names names;
+    /* The program as saved: its arrays, but for those made relocatable. */
+    struct program image = *prog;
+    struct function *functions;
+    struct global *globals;
+    struct frame_slot *slots;
+    struct host_signature *signatures;
+    uint32_t *offsets;
+    struct string spellings;
+    /* Everything after the header. */
+    struct string payload;
+    FILE *fp;
+    int status = 0;
+
+    memset(&names, 0, sizeof(names));
+    functions = malloc(sizeof(struct function) * (prog->num_functions + 1));
+    for (size_t i = 0; i < prog->num_functions; i++) {
+        functions[i] = prog->functions[i];
+        functions[i].name = save_name(&names, functions[i].name);
+        functions[i].host = NULL;
+    }
+    globals = malloc(sizeof(struct global) * (prog->num_globals + 1));
+    for (size_t i = 0; i < prog->num_globals; i++) {
+        globals[i] = prog->globals[i];
+        globals[i].name = save_name(&names, globals[i].name);
+        globals[i].host = NULL;
+    }
+    slots = malloc(sizeof(struct frame_slot) * (prog->num_frame_slots + 1));
+    for (size_t i = 0; i < prog->num_frame_slots; i++) {
+        slots[i] = prog->frame_slots[i];
+        slots[i].name = save_name(&names, slots[i].name);
+    }
+    signatures = malloc(sizeof(struct host_signature)
+                        * (prog->num_host_signatures + 1));
+    for (size_t i = 0; i < prog->num_host_signatures; i++) {
+        signatures[i] = prog->host_signatures[i];
+        signatures[i].stub = NULL;
+    }
+    image.functions = functions;
+    image.globals = globals;
+    image.frame_slots = slots;
+    image.host_signatures = signatures;
+    image.code_tokens = make_locations(prog, &names, &image.locations,
+                                       &image.num_locations);
+
+    offsets = malloc(sizeof(uint32_t) * (names.len + 1));
+    string_init(&spellings);
+    offsets[0] = 0;
+    for (size_t i = 0; i < names.len; i++) {
+        /* With the NUL. */
+        string_append_n(&spellings, atom_spelling(names.atoms[i]),
+                        atom_len(names.atoms[i]) + 1);
+        offsets[i + 1] = spellings.len;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, magic, sizeof(magic));
+    header.format = SNAPSHOT_FORMAT;
+    header.overflow = prog->overflow;
+    header.memory_checks = prog->memory_checks;
+    header.specialize = prog->specialize;
+    header.main = prog->main;
+
+    string_init(&payload);
+#define SECTION_WRITE(id, name, count, type)                                  \
+    write_section(&payload, &header, SECTION_##id, image.name, image.count);
+    ARRAYS(SECTION_WRITE)
+#undef SECTION_WRITE
+    write_section(&payload, &header, SECTION_NAMES, offsets, names.len + 1);
+    write_section(&payload, &header, SECTION_SPELLINGS, spellings.arr,
+                  spellings.len);
+    header.checksum = hash_contents(payload.arr, payload.len);
+    header.checksum = hash_contents(&header, sizeof(header));
+
+    fp = fopen(path, "wb");
+    if (fp == NULL || fwrite(&header, sizeof(header), 1, fp) != 1
+        || fwrite(payload.arr, 1, payload.len, fp) != payload.len)
+        status = -1;
+    if (fp && fclose(fp)) status = -1;
+    if (status) {
+        perror(path);
+        remove(path);
+    }
+
+    free(functions);
+    free(globals);
+    free(slots);
+    free(signatures);
+    free(image.code_tokens);
+    free(image.locations);
+    free(offsets);
+    string_destroy(&spellings);
+    string_destroy(&payload);
+    free(names.atoms);
+    free(names.index);
+    return status;
+}
+
+int snapshot_load(struct program *prog, const char *path) {
+    const struct snapshot_header *header;
+    const uint32_t *offsets;
+    const char *spellings;
+    size_t num_names;
+    uint32_t *atoms;
+    struct stat st;
+    char *map;
+    int fd;
+    int status = 0;
+
+    STATS_BEGIN(load_phase);
+    program_init(prog);
+    fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st)) {
+        if (fd >= 0) close(fd);
+        perror(path);
+        STATS_END(load_phase);
+        return -1;
+    }
+    map = MAP_FAILED;
+    if ((size_t)st.st_size >= sizeof(*header))
+        map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd,
+                   0);
+    close(fd);
+    if (map == MAP_FAILED || check_image(map, st.st_size)) {
+        fprintf(stderr, "%s: not a snapshot of this version of cisc\n",
+                path);
+        if (map != MAP_FAILED) munmap(map, st.st_size);
+        STATS_END(load_phase);
+        return -1;
+    }
+    header = (const struct snapshot_header *)map;
+
+#define SECTION_LOAD(id, name, count, type)                                   \
+    prog->name = (type *)(map + header->sections[SECTION_##id].offset);     \
+    prog->count = header->sections[SECTION_##id].len;
+    ARRAYS(SECTION_LOAD)
+#undef SECTION_LOAD
+    prog->image = map;
+    prog->image_size = st.st_size;
+    prog->main = header->main;
+    prog->overflow = header->overflow;
+    prog->memory_checks = header->memory_checks;
+    prog->specialize = header->specialize;
+
+    /* Relocate the names to the atoms of this process. */
+    offsets = (const uint32_t *)(map
+                                 + header->sections[SECTION_NAMES].offset);
+    spellings = map + header->sections[SECTION_SPELLINGS].offset;
+    num_names = header->sections[SECTION_NAMES].len - 1;
+    atoms = malloc(sizeof(uint32_t) * (num_names + 1));
+    atoms[0] = ATOM_NONE;
+    for (size_t i = 1; i <= num_names; i++)
+        atoms[i] = intern(spellings + offsets[i - 1],
+                          offsets[i] - offsets[i - 1] - 1);
+    /* The host addresses are looked up again, whatever was saved. */
+    for (size_t i = 0; i < prog->num_functions; i++) {
+        prog->functions[i].host = NULL;
+        if (prog->functions[i].name > num_names) status = -1;
+        else prog->functions[i].name = atoms[prog->functions[i].name];
+    }
+    for (size_t i = 0; i < prog->num_globals; i++) {
+        prog->globals[i].host = NULL;
+        if (prog->globals[i].name > num_names) status = -1;
+        else prog->globals[i].name = atoms[prog->globals[i].name];
+    }
+    for (size_t i = 0; i < prog->num_frame_slots; i++) {
+        if (prog->frame_slots[i].name > num_names) status = -1;
+        else prog->frame_slots[i].name = atoms[prog->frame_slots[i].name];
+    }
+    for (size_t i = 0; i < prog->num_locations; i++) {
+        if (prog->locations[i].path > num_names) status = -1;
+        else prog->locations[i].path = atoms[prog->locations[i].path];
+    }
+    free(atoms);
+
+    if (status == 0) status = program_check(prog);
+    if (status) {
+        fprintf(stderr, "%s: not a snapshot of this version of cisc\n",
+                path);
+    } else {
+        status = program_relink(prog);
+    }
+    if (status) {
+        program_destroy(prog);
+        program_init(prog);
+    }
+    STATS_END(load_phase);
+    return status;
+}
+
+static uint32_t save_name(struct names *names, uint32_t atom) {
+    if (atom == ATOM_NONE) return 0;
+    if (atom >= names->index_len) {
+        const size_t len = names->index_len;
+
+        names->index_len = atom_count() + 1;
+        names->index = realloc(names->index,
+                               sizeof(uint32_t) * names->index_len);
+        memset(names->index + len, 0,
+               sizeof(uint32_t) * (names->index_len - len));
+    }
+    if (names->index[atom] == 0) {
+        if (names->len == names->capacity) {
+            names->capacity = names->capacity ? 2 * names->capacity : 256;
+            names->atoms = realloc(names->atoms,
+                                   sizeof(uint32_t) * names->capacity);
+        }
+        names->atoms[names->len++] = atom;
+        names->index[atom] = names->len;
+    }
+    return names->index[atom];
+}
+
+/* Distinct locations of the code of prog, whose paths are saved in names,
+   and the index of the location of each instruction, or UINT32_MAX. */
+static uint32_t *make_locations(const struct program *prog,
+                                struct names *names,
+                                struct program_location **locations,
+                                size_t *num_locations) {
+    uint32_t *const code_locations = malloc(sizeof(uint32_t)
+                                            * (prog->code_len + 1));
+    /* Index + 1 of each location by hash of its path and line, or 0. */
+    size_t table_len = 64;
+    uint32_t *table;
+    size_t unit = 0;
+    uint32_t last_token = UINT32_MAX;
+    uint32_t last = UINT32_MAX;
+
+    while (table_len < 2 * prog->code_len) table_len *= 2;
+    table = calloc(table_len, sizeof(uint32_t));
+    *locations = malloc(sizeof(struct program_location)
+                        * (prog->code_len + 1));
+    *num_locations = 0;
+
+    for (size_t i = 0; i < prog->code_len; i++) {
+        const uint32_t token = prog->code_tokens[i];
+        const struct program_unit *u;
+        const struct token *tok;
+        const char *file;
+        struct program_location loc;
+        size_t h;
+
+        while (unit + 1 < prog->num_units
+               && prog->units[unit + 1].code <= i) {
+            unit++;
+            last_token = UINT32_MAX;
+        }
+        u = unit < prog->num_units ? &prog->units[unit] : NULL;
+        if (token == UINT32_MAX || u == NULL || u->pp == NULL) {
+            code_locations[i] = UINT32_MAX;
+            continue;
+        }
+        if (token == last_token) {
+            code_locations[i] = last;
+            continue;
+        }
+
+        tok = &u->tokens[token];
+        file = preprocessor_file_path(u->pp, tok);
+        loc.path = save_name(names, intern(file, strlen(file)));
+        loc.line = preprocessor_line(u->pp, tok);
+        h = (loc.path * 0x9e3779b1u ^ loc.line) & (table_len - 1);
+        while (table[h]
+               && ((*locations)[table[h] - 1].path != loc.path
+                   || (*locations)[table[h] - 1].line != loc.line))
+            h = (h + 1) & (table_len - 1);
+        if (table[h] == 0) {
+            (*locations)[*num_locations] = loc;
+            table[h] = ++*num_locations;
+        }
+        last_token = token;
+        last = code_locations[i] = table[h] - 1;
+    }
+    free(table);
+    return code_locations;
+}
+
+/* Append the section s, of len elements at arr, to payload, at the next
+   aligned offset of the file, and record where in header. */
+static void write_section(struct string *payload,
+                          struct snapshot_header *header, enum section s,
+                          const void *arr, size_t len) {
+    static const char zeros[SECTION_ALIGN];
+    const size_t offset = sizeof(*header) + payload->len;
+    const size_t pad = (SECTION_ALIGN - offset % SECTION_ALIGN)
+                       % SECTION_ALIGN;
+
+    string_append_n(payload, zeros, pad);
+    if (len) string_append_n(payload, arr, element_sizes[s] * len);
+    header->sections[s].offset = offset + pad;
+    header->sections[s].len = len;
+    header->sections[s].element_size = element_sizes[s];
+}
+
+/* Whether the size bytes at map, at least a header, are a snapshot of this
+   format and build, intact, with every section inside. */
+static int check_image(const char *map, size_t size) {
+    const struct snapshot_header *const header
+        = (const struct snapshot_header *)map;
+    struct snapshot_header copy = *header;
+    const struct overflow_site *sites;
+    const struct snapshot_section *names;
+    const uint32_t *offsets;
+
+    if (memcmp(header->magic, magic, sizeof(magic))
+        || header->format != SNAPSHOT_FORMAT)
+        return -1;
+    copy.checksum = hash_contents(map + sizeof(*header),
+                                  size - sizeof(*header));
+    if (hash_contents(&copy, sizeof(copy)) != header->checksum)
+        return -1;
+    if (header->overflow > OVERFLOW_SATURATE || header->memory_checks > 1
+        || header->specialize > 1)
+        return -1;
+    for (size_t s = 0; s < NUM_SECTIONS; s++) {
+        const struct snapshot_section *const sec = &header->sections[s];
+
+        if (sec->element_size != element_sizes[s]
+            || sec->offset % SECTION_ALIGN || sec->offset > size
+            || sec->len > (size - sec->offset) / element_sizes[s])
+            return -1;
+    }
+    if (header->main < -1
+        || header->main >= (int64_t)header->sections[SECTION_FUNCTIONS].len)
+        return -1;
+
+    /* Overflow sites are checked instructions, by increasing code, of
+       integer types. */
+    sites = (const struct overflow_site *)
+            (map + header->sections[SECTION_OVERFLOW_SITES].offset);
+    for (size_t i = 0; i < header->sections[SECTION_OVERFLOW_SITES].len; i++)
+        if (sites[i].code >= header->sections[SECTION_CODE].len
+            || (i && sites[i].code <= sites[i - 1].code)
+            || sites[i].type < TYPE_BOOL || sites[i].type > TYPE_ULLONG)
+            return -1;
+
+    /* The spellings of the names are in order and each ends in a NUL. */
+    names = &header->sections[SECTION_NAMES];
+    offsets = (const uint32_t *)(map + names->offset);
+    if (names->len == 0 || offsets[0] != 0) return -1;
+    for (size_t i = 1; i < names->len; i++)
+        if (offsets[i] <= offsets[i - 1]
+            || offsets[i] > header->sections[SECTION_SPELLINGS].len
+            || map[header->sections[SECTION_SPELLINGS].offset
+                   + offsets[i] - 1])
+            return -1;
+    return 0;
+}
@@ -0,0 +1,43 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdbool.h>
+
+#include "bytecode.h"
+
+/* Snapshots of linked programs, which are run in place of their sources,
+   with no preprocessing, parsing or compiling.
+
+   A snapshot is the arrays of the program as they are in memory, each at
+   an aligned offset of the file after a header. It is loaded by mapping
+   the file, privately so that it may be written to, and pointing the
+   arrays of the program into the mapping. Everything in a program refers
+   to everything else by index; only what belongs to the process is
+   relocated on loading. The names of functions and globals and the paths
+   of locations, which are atoms, are saved as indexes into a table of
+   their spellings, which are interned again. The functions and globals of
+   the host, and the stubs of the host signatures, are looked up again by
+   program_relink().
+
+   The tokens are not saved, but the line each instruction was compiled
+   from is, for diagnostics. The header carries a format version, the size
+   of each kind of element, the options the code was compiled for, and a
+   checksum of itself and the rest, and a snapshot of another version or
+   build, or a damaged one, is rejected. So is one whose code
+   program_check() finds the VM could not run safely, as the code is run
+   as if just compiled. */
+#define SNAPSHOT_FORMAT 5
+
+/* Whether the file at path is a snapshot, by the magic it starts with. */
+bool snapshot_check(const char *path);
+
+/* Save prog, which must be linked, to the file at path. Returns 0 on
+   success, and -1 with an error reported on stderr. */
+int snapshot_save(const struct program *prog, const char *path);
+
+/* Load the snapshot at path into prog, which is initialized, and relink it.
+   Errors are reported on stderr; returns 0 on success and -1 on an error,
+   when prog is left empty, to be destroyed. */
+int snapshot_load(struct program *prog, const char *path);
+
+#endif
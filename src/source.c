@@ -0,0 +1,170 @@
+#include "source.h"
+#include "scan.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Bytes scanned for new-lines at a time, after making room for as many
+   line starts. */
+#define LINE_BLOCK 65536
+
+static void line_table_extend(struct line_table *lines,
+                              const struct source *src);
+
+int source_open(struct source *src, const char *path) {
+    struct stat st;
+    int fd;
+    long page_size;
+    void *buf;
+    FILE *file;
+    int ret;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    if (fstat(fd, &st)) goto error;
+
+    /* A regular file whose size is not a multiple of the page size can be
+       mapped directly: the rest of the last page is zero-filled, which
+       provides the terminating NUL for free. Otherwise, read it once. */
+    page_size = sysconf(_SC_PAGESIZE);
+    if (S_ISREG(st.st_mode) && st.st_size > 0 && st.st_size % page_size) {
+        buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (buf != MAP_FAILED) {
+            close(fd);
+            src->buf = buf;
+            src->len = st.st_size;
+            src->mapped = true;
+            src->id = 0;
+            return 0;
+        }
+    }
+
+    file = fdopen(fd, "r");
+    if (file == NULL) goto error;
+    ret = source_read(src, file);
+    fclose(file);
+    return ret;
+
+error:
+    close(fd);
+    return -1;
+}
+
+int source_read(struct source *src, FILE *file) {
+    size_t len = 0;
+    size_t capacity = 4096;
+    char *buf = malloc(capacity);
+
+    while (1) {
+        if (len + 1 == capacity) {
+            buf = realloc(buf, 2 * capacity);
+            capacity *= 2;
+        }
+        len += fread(buf + len, 1, capacity - len - 1, file);
+        if (feof(file)) break;
+        if (ferror(file)) {
+            free(buf);
+            return -1;
+        }
+    }
+    buf[len] = '\0';
+
+    src->buf = buf;
+    src->len = len;
+    src->mapped = false;
+    src->id = 0;
+    return 0;
+}
+
+void source_edit(struct source *src, size_t offset, size_t old_len,
+                 const char *text, size_t len) {
+    const size_t new_len = src->len - old_len + len;
+    char *buf;
+
+    if (src->mapped) {
+        buf = malloc(src->len + 1);
+        memcpy(buf, src->buf, src->len + 1);
+        munmap((void *)src->buf, src->len);
+        src->mapped = false;
+    } else {
+        buf = (char *)src->buf;
+    }
+
+    /* Move the tail, with its NUL, before shrinking or after growing. */
+    if (new_len < src->len)
+        memmove(buf + offset + len, buf + offset + old_len,
+                src->len - offset - old_len + 1);
+    buf = realloc(buf, new_len + 1);
+    if (new_len >= src->len)
+        memmove(buf + offset + len, buf + offset + old_len,
+                src->len - offset - old_len + 1);
+    memcpy(buf + offset, text, len);
+
+    src->buf = buf;
+    src->len = new_len;
+}
+
+void source_close(struct source *src) {
+    if (src->mapped)
+        munmap((void *)src->buf, src->len);
+    else
+        free((void *)src->buf);
+    src->buf = NULL;
+    src->len = 0;
+}
+
+void line_table_init(struct line_table *lines) {
+    memset(lines, 0, sizeof(*lines));
+}
+
+void line_table_destroy(struct line_table *lines) {
+    free(lines->starts);
+    line_table_init(lines);
+}
+
+void line_table_find(struct line_table *lines, const struct source *src,
+                     size_t offset, size_t *line, size_t *column) {
+    size_t lo = 0;
+    size_t hi;
+
+    if (lines->len == 0 || lines->scanned < src->len)
+        line_table_extend(lines, src);
+    if (offset > src->len) offset = src->len;
+
+    /* The last line that starts at or before offset. */
+    hi = lines->len;
+    while (hi - lo > 1) {
+        const size_t mid = lo + (hi - lo) / 2;
+        if (lines->starts[mid] <= offset) lo = mid;
+        else hi = mid;
+    }
+    *line = lo + 1;
+    *column = offset - lines->starts[lo] + 1;
+}
+
+static void line_table_extend(struct line_table *lines,
+                              const struct source *src) {
+    if (lines->len == 0) {
+        lines->capacity = LINE_BLOCK;
+        lines->starts = malloc(sizeof(uint32_t) * lines->capacity);
+        lines->starts[lines->len++] = 0;
+    }
+    while (lines->scanned < src->len) {
+        const size_t n = src->len - lines->scanned < LINE_BLOCK
+                         ? src->len - lines->scanned : LINE_BLOCK;
+
+        if (lines->len + n > lines->capacity) {
+            while (lines->len + n > lines->capacity) lines->capacity *= 2;
+            lines->starts = realloc(lines->starts,
+                                    sizeof(uint32_t) * lines->capacity);
+        }
+        lines->len += scan_lines(src->buf + lines->scanned,
+                                 src->buf + lines->scanned + n,
+                                 lines->scanned, lines->starts + lines->len);
+        lines->scanned += n;
+    }
+}
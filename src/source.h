@@ -0,0 +1,50 @@
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Whole contents of a source file in a single buffer. The buffer is always
+   followed by a NUL byte, i.e. buf[len] == '\0', so the lexer may look one
+   character past any position without a bounds check. */
+struct source {
+    const char *buf;
+    size_t len;
+    bool mapped;
+    /* Id given to the tokens lexed from the source; 0 unless set by the
+       owner of several sources, such as the preprocessor. */
+    uint16_t id;
+};
+
+int source_open(struct source *src, const char *path);
+int source_read(struct source *src, FILE *file);
+/* Replace the bytes [offset, offset + old_len) with the len bytes of text.
+   A mapped source is copied into memory first. */
+void source_edit(struct source *src, size_t offset, size_t old_len,
+                 const char *text, size_t len);
+void source_close(struct source *src);
+
+/* Offsets at which the lines of a source start, which map any offset in it
+   to a line and column by binary search, so that a token need carry no more
+   than its offset. The table is built the first time it is asked, with a
+   vector scan for new-lines, and extended when the source has grown since,
+   as a scratch buffer does; it must not be used after the source has been
+   edited otherwise. A zeroed table is empty. */
+struct line_table {
+    uint32_t *starts;
+    size_t len;
+    size_t capacity;
+    /* Bytes of the source scanned for new-lines. */
+    size_t scanned;
+};
+
+void line_table_init(struct line_table *lines);
+void line_table_destroy(struct line_table *lines);
+/* Line and column, both counted from 1, of the byte at offset in src. The
+   column counts bytes. */
+void line_table_find(struct line_table *lines, const struct source *src,
+                     size_t offset, size_t *line, size_t *column);
+
+#endif
@@ -0,0 +1,159 @@
+#include "stats.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+struct trace_event {
+    const char *name;
+    uint64_t start;
+    uint64_t ns;
+    long tid;
+};
+
+static struct stats_counter *counters;
+static struct stats_phase *phases;
+
+static bool tracing;
+static uint64_t trace_start;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct trace_event *events;
+static size_t num_events;
+static size_t events_capacity;
+
+static void write_json_string(FILE *fp, const char *s);
+
+void stats_register_counter(struct stats_counter *counter) {
+    struct stats_counter **p = &counters;
+
+    /* Keep the list sorted by name, so that reports do not depend on the
+       order of constructors. */
+    while (*p && strcmp((*p)->name, counter->name) < 0) p = &(*p)->next;
+    counter->next = *p;
+    *p = counter;
+}
+
+void stats_register_phase(struct stats_phase *phase) {
+    struct stats_phase **p = &phases;
+
+    while (*p && strcmp((*p)->name, phase->name) < 0) p = &(*p)->next;
+    phase->next = *p;
+    *p = phase;
+}
+
+uint64_t stats_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void stats_phase_end(struct stats_phase *phase, uint64_t start) {
+    const uint64_t ns = stats_now() - start;
+
+    /* Phases may run on worker threads. */
+    __atomic_fetch_add(&phase->calls, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&phase->ns, ns, __ATOMIC_RELAXED);
+
+    if (!tracing) return;
+
+    pthread_mutex_lock(&trace_lock);
+    if (num_events == events_capacity) {
+        events_capacity = events_capacity ? 2 * events_capacity : 256;
+        events = realloc(events, sizeof(struct trace_event) * events_capacity);
+    }
+    events[num_events].name = phase->name;
+    events[num_events].start = start;
+    events[num_events].ns = ns;
+    events[num_events].tid = syscall(SYS_gettid);
+    num_events++;
+    pthread_mutex_unlock(&trace_lock);
+}
+
+void stats_enable_trace(void) {
+    trace_start = stats_now();
+    tracing = true;
+}
+
+void stats_print(FILE *fp) {
+#ifdef NO_STATS
+    fprintf(fp, "statistics were compiled out\n");
+#else
+    fprintf(fp, "%-32s %10s %12s\n", "phase", "calls", "ms");
+    for (struct stats_phase *p = phases; p; p = p->next)
+        fprintf(fp, "%-32s %10lu %12.3f\n", p->name, (unsigned long)p->calls,
+                p->ns / 1e6);
+
+    fprintf(fp, "\n%-32s %23s\n", "counter", "value");
+    for (struct stats_counter *c = counters; c; c = c->next) {
+        if (c->label == NULL) {
+            fprintf(fp, "%-32s %23lu\n", c->name, (unsigned long)c->values[0]);
+            continue;
+        }
+        /* Only the non-zero values of a counter array. */
+        for (size_t i = 0; i < c->len; i++)
+            if (c->values[i])
+                fprintf(fp, "%s.%-*s %23lu\n", c->name,
+                        (int)(31 - strlen(c->name)), c->label(i),
+                        (unsigned long)c->values[i]);
+    }
+#endif
+}
+
+int stats_write_trace(const char *path) {
+    FILE *const fp = fopen(path, "w");
+    const long pid = getpid();
+    const uint64_t end = stats_now();
+
+    if (fp == NULL) return -1;
+
+    /* Timestamps are in microseconds from stats_enable_trace(). */
+    fprintf(fp, "{\"traceEvents\":[\n");
+    for (size_t i = 0; i < num_events; i++) {
+        fprintf(fp, "{\"name\":");
+        write_json_string(fp, events[i].name);
+        fprintf(fp, ",\"cat\":\"cisc\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                    "\"pid\":%ld,\"tid\":%ld},\n",
+                (events[i].start - trace_start) / 1e3, events[i].ns / 1e3,
+                pid, events[i].tid);
+    }
+
+    /* Final counter values, as one counter event each. */
+    for (struct stats_counter *c = counters; c; c = c->next) {
+        bool first = true;
+        fprintf(fp, "{\"name\":");
+        write_json_string(fp, c->name);
+        fprintf(fp, ",\"ph\":\"C\",\"ts\":%.3f,\"pid\":%ld,\"args\":{",
+                (end - trace_start) / 1e3, pid);
+        for (size_t i = 0; i < c->len; i++) {
+            if (c->label && c->values[i] == 0) continue;
+            if (!first) fputc(',', fp);
+            write_json_string(fp, c->label ? c->label(i) : "value");
+            fprintf(fp, ":%lu", (unsigned long)c->values[i]);
+            first = false;
+        }
+        fprintf(fp, "}},\n");
+    }
+
+    fprintf(fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%ld,"
+                "\"args\":{\"name\":\"cisc\"}}\n]}\n", pid);
+
+    free(events);
+    events = NULL;
+    num_events = events_capacity = 0;
+    tracing = false;
+
+    return fclose(fp) ? -1 : 0;
+}
+
+static void write_json_string(FILE *fp, const char *s) {
+    fputc('"', fp);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') fputc('\\', fp);
+        fputc(*s, fp);
+    }
+    fputc('"', fp);
+}
@@ -0,0 +1,94 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Instrumentation. Each module declares its own counters and phases at file
+   scope; they register themselves before main() runs, and are reported by
+   stats_print() and stats_write_trace().
+
+       STATS_COUNTER(reallocs, "string.reallocs");
+       STATS_INC(reallocs);
+
+   A counter array holds one value per index, e.g. per token type; label(i)
+   names value i. STATS_INC and STATS_ADD are plain increments for counters
+   bumped from one thread at a time; counters bumped from worker threads use
+   STATS_ADD_ATOMIC.
+
+   A phase accumulates wall time over the code between STATS_BEGIN and
+   STATS_END. While tracing, every such interval is also recorded as a trace
+   event.
+
+   Building with -DNO_STATS compiles all of it out. */
+
+struct stats_counter {
+    const char *name;
+    size_t len;
+    uint64_t *values;
+    const char *(*label)(size_t i);
+    struct stats_counter *next;
+};
+
+struct stats_phase {
+    const char *name;
+    uint64_t calls;
+    uint64_t ns;
+    struct stats_phase *next;
+};
+
+void stats_register_counter(struct stats_counter *counter);
+void stats_register_phase(struct stats_phase *phase);
+
+uint64_t stats_now(void);
+void stats_phase_end(struct stats_phase *phase, uint64_t start);
+
+/* Record trace events from now on. */
+void stats_enable_trace(void);
+
+void stats_print(FILE *fp);
+/* Write the trace in the Chrome trace-event format. */
+int stats_write_trace(const char *path);
+
+#ifndef NO_STATS
+
+#define STATS_COUNTER_ARRAY(var, name, n, label)                            \
+    static uint64_t var##_values[n];                                        \
+    static struct stats_counter var = {name, n, var##_values, label, NULL}; \
+    __attribute__((constructor)) static void var##_register(void) {         \
+        stats_register_counter(&var);                                       \
+    }
+#define STATS_COUNTER(var, name) STATS_COUNTER_ARRAY(var, name, 1, NULL)
+
+#define STATS_PHASE(var, name)                                              \
+    static struct stats_phase var = {name, 0, 0, NULL};                     \
+    __attribute__((constructor)) static void var##_register(void) {         \
+        stats_register_phase(&var);                                         \
+    }
+
+#define STATS_INC(var) (var##_values[0]++)
+#define STATS_ADD(var, i, n) (var##_values[i] += (n))
+#define STATS_ADD_ATOMIC(var, i, n) \
+    __atomic_fetch_add(&var##_values[i], (n), __ATOMIC_RELAXED)
+
+#define STATS_BEGIN(var) const uint64_t var##_start = stats_now()
+#define STATS_END(var) stats_phase_end(&var, var##_start)
+
+#else
+
+#define STATS_COUNTER_ARRAY(var, name, n, label) \
+    _Static_assert(1, "statistics compiled out")
+#define STATS_COUNTER(var, name) STATS_COUNTER_ARRAY(var, name, 1, NULL)
+#define STATS_PHASE(var, name) STATS_COUNTER_ARRAY(var, name, 1, NULL)
+
+#define STATS_INC(var) ((void)0)
+#define STATS_ADD(var, i, n) ((void)0)
+#define STATS_ADD_ATOMIC(var, i, n) ((void)0)
+
+#define STATS_BEGIN(var) ((void)0)
+#define STATS_END(var) ((void)0)
+
+#endif
+
+#endif
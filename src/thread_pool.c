@@ -0,0 +1,105 @@
+#include "thread_pool.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+static void *worker(void *arg);
+
+void thread_pool_init(struct thread_pool *pool, size_t num_threads) {
+    if (num_threads == 0) num_threads = thread_pool_num_cpus();
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->task_ready, NULL);
+    pthread_cond_init(&pool->all_done, NULL);
+
+    pool->capacity = 16;
+    pool->tasks = malloc(sizeof(struct thread_pool_task) * pool->capacity);
+    pool->head = pool->tail = 0;
+    pool->pending = 0;
+    pool->stop = false;
+
+    pool->num_threads = num_threads;
+    pool->threads = malloc(sizeof(pthread_t) * num_threads);
+    for (size_t i = 0; i < num_threads; i++)
+        pthread_create(&pool->threads[i], NULL, worker, pool);
+}
+
+void thread_pool_destroy(struct thread_pool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = true;
+    pthread_cond_broadcast(&pool->task_ready);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (size_t i = 0; i < pool->num_threads; i++)
+        pthread_join(pool->threads[i], NULL);
+
+    free(pool->threads);
+    free(pool->tasks);
+    pthread_cond_destroy(&pool->all_done);
+    pthread_cond_destroy(&pool->task_ready);
+    pthread_mutex_destroy(&pool->lock);
+}
+
+void thread_pool_submit(struct thread_pool *pool, void (*fn)(void *arg),
+                        void *arg) {
+    pthread_mutex_lock(&pool->lock);
+
+    /* The queue is a ring buffer; it is full when tail would meet head. */
+    if ((pool->tail + 1) % pool->capacity == pool->head) {
+        struct thread_pool_task *const tasks =
+            malloc(sizeof(struct thread_pool_task) * 2 * pool->capacity);
+        size_t len = 0;
+        for (size_t i = pool->head; i != pool->tail; i = (i + 1) % pool->capacity)
+            tasks[len++] = pool->tasks[i];
+        free(pool->tasks);
+        pool->tasks = tasks;
+        pool->head = 0;
+        pool->tail = len;
+        pool->capacity *= 2;
+    }
+
+    pool->tasks[pool->tail].fn = fn;
+    pool->tasks[pool->tail].arg = arg;
+    pool->tail = (pool->tail + 1) % pool->capacity;
+    pool->pending++;
+
+    pthread_cond_signal(&pool->task_ready);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void thread_pool_wait(struct thread_pool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    while (pool->pending)
+        pthread_cond_wait(&pool->all_done, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+size_t thread_pool_num_cpus(void) {
+    const long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? n : 1;
+}
+
+static void *worker(void *arg) {
+    struct thread_pool *const pool = arg;
+    struct thread_pool_task task;
+
+    pthread_mutex_lock(&pool->lock);
+    while (1) {
+        while (pool->head == pool->tail && !pool->stop)
+            pthread_cond_wait(&pool->task_ready, &pool->lock);
+        if (pool->head == pool->tail) break;
+
+        task = pool->tasks[pool->head];
+        pool->head = (pool->head + 1) % pool->capacity;
+
+        pthread_mutex_unlock(&pool->lock);
+        task.fn(task.arg);
+        pthread_mutex_lock(&pool->lock);
+
+        if (--pool->pending == 0)
+            pthread_cond_broadcast(&pool->all_done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
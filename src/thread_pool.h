@@ -0,0 +1,42 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+struct thread_pool_task {
+    void (*fn)(void *arg);
+    void *arg;
+};
+
+/* Fixed set of worker threads running tasks from a FIFO queue. */
+struct thread_pool {
+    pthread_t *threads;
+    size_t num_threads;
+
+    pthread_mutex_t lock;
+    pthread_cond_t task_ready;
+    pthread_cond_t all_done;
+
+    struct thread_pool_task *tasks;
+    size_t head;
+    size_t tail;
+    size_t capacity;
+    /* Tasks queued or running. */
+    size_t pending;
+    bool stop;
+};
+
+/* Start num_threads workers; 0 means one per online CPU. */
+void thread_pool_init(struct thread_pool *pool, size_t num_threads);
+void thread_pool_destroy(struct thread_pool *pool);
+
+void thread_pool_submit(struct thread_pool *pool, void (*fn)(void *arg),
+                        void *arg);
+/* Wait until every submitted task has finished. */
+void thread_pool_wait(struct thread_pool *pool);
+
+size_t thread_pool_num_cpus(void);
+
+#endif
@@ -0,0 +1,1104 @@
+#include "tier.h"
+#include "stats.h"
+#include "vm.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Largest function compiled, in instructions times registers: the bits of
+   its liveness sets. */
+#define TIER_MAX_SIZE (1 << 24)
+
+#define NO_REG UINT32_MAX
+#define NO_TARGET UINT32_MAX
+
+STATS_COUNTER(functions_compiled, "tier.functions");
+STATS_COUNTER(nodes_made, "tier.nodes");
+STATS_COUNTER(instructions_folded, "tier.folded");
+STATS_COUNTER(runs, "tier.runs");
+
+/* Operations of the nodes, computing r from the operands x and y as the
+   interpreter does. */
+#define INT_OPS(X, name, op)                                                \
+    X(name##_I32, r.i = (int32_t)(uint32_t)(x.u op y.u))                    \
+    X(name##_U32, r.u = (uint32_t)(x.u op y.u))                             \
+    X(name##_I64, r.u = x.u op y.u)                                         \
+    X(name##_U64, r.u = x.u op y.u)
+#define FLOAT_OPS(X, name, op)                                              \
+    X(name##_F32, r = f32(x.f op y.f))                                      \
+    X(name##_F64, r = f64(x.d op y.d))
+#define BINARY_OPS(X)                                                       \
+    INT_OPS(X, ADD, +) FLOAT_OPS(X, ADD, +)                                 \
+    INT_OPS(X, SUB, -) FLOAT_OPS(X, SUB, -)                                 \
+    INT_OPS(X, MUL, *) FLOAT_OPS(X, MUL, *)                                 \
+    FLOAT_OPS(X, DIV, /)                                                    \
+    X(SHL_I32, r.i = (int32_t)((uint32_t)x.u << (y.u & 31)))                \
+    X(SHL_U32, r.u = (uint32_t)((uint32_t)x.u << (y.u & 31)))               \
+    X(SHL_I64, r.u = x.u << (y.u & 63))                                     \
+    X(SHL_U64, r.u = x.u << (y.u & 63))                                     \
+    X(SHR_I32, r.i = (int32_t)x.i >> (y.u & 31))                            \
+    X(SHR_U32, r.u = (uint32_t)x.u >> (y.u & 31))                           \
+    X(SHR_I64, r.i = x.i >> (y.u & 63))                                     \
+    X(SHR_U64, r.u = x.u >> (y.u & 63))                                     \
+    X(AND, r.u = x.u & y.u)                                                 \
+    X(OR, r.u = x.u | y.u)                                                  \
+    X(XOR, r.u = x.u ^ y.u)                                                 \
+    X(SUB_P, r.u = (x.u & VM_ADDRESS_MASK) - (y.u & VM_ADDRESS_MASK))
+#define COMPARE_OPS(X)                                                      \
+    X(EQ_I, x.u == y.u) X(EQ_U, x.u == y.u)                                 \
+    X(EQ_F32, x.f == y.f) X(EQ_F64, x.d == y.d)                             \
+    X(NE_I, x.u != y.u) X(NE_U, x.u != y.u)                                 \
+    X(NE_F32, x.f != y.f) X(NE_F64, x.d != y.d)                             \
+    X(LT_I, x.i < y.i) X(LT_U, x.u < y.u)                                   \
+    X(LT_F32, x.f < y.f) X(LT_F64, x.d < y.d)                               \
+    X(LE_I, x.i <= y.i) X(LE_U, x.u <= y.u)                                 \
+    X(LE_F32, x.f <= y.f) X(LE_F64, x.d <= y.d)                             \
+    X(EQ_P, (x.u & VM_ADDRESS_MASK) == (y.u & VM_ADDRESS_MASK))             \
+    X(NE_P, (x.u & VM_ADDRESS_MASK) != (y.u & VM_ADDRESS_MASK))             \
+    X(LT_P, (x.u & VM_ADDRESS_MASK) < (y.u & VM_ADDRESS_MASK))              \
+    X(LE_P, (x.u & VM_ADDRESS_MASK) <= (y.u & VM_ADDRESS_MASK))
+#define UNARY_OPS(X)                                                        \
+    X(MOV, r = x)                                                           \
+    X(NEG_I32, r.i = (int32_t)(0u - (uint32_t)x.u))                         \
+    X(NEG_U32, r.u = (uint32_t)(0u - (uint32_t)x.u))                        \
+    X(NEG_I64, r.u = 0 - x.u)                                               \
+    X(NEG_U64, r.u = 0 - x.u)                                               \
+    X(NEG_F32, r = f32(-x.f))                                               \
+    X(NEG_F64, r = f64(-x.d))                                               \
+    X(BNOT_I32, r.i = (int32_t)~(uint32_t)x.u)                              \
+    X(BNOT_U32, r.u = (uint32_t)~x.u)                                       \
+    X(BNOT_I64, r.u = ~x.u)                                                 \
+    X(BNOT_U64, r.u = ~x.u)                                                 \
+    X(NOT, r.u = !x.u)                                                      \
+    X(BOOL, r.u = x.u != 0)                                                 \
+    X(BOOL_F32, r.u = x.f != 0)                                             \
+    X(BOOL_F64, r.u = x.d != 0)                                             \
+    X(SEXT8, r.i = (int8_t)x.u)                                             \
+    X(SEXT16, r.i = (int16_t)x.u)                                           \
+    X(SEXT32, r.i = (int32_t)x.u)                                           \
+    X(ZEXT8, r.u = (uint8_t)x.u)                                            \
+    X(ZEXT16, r.u = (uint16_t)x.u)                                          \
+    X(ZEXT32, r.u = (uint32_t)x.u)                                          \
+    X(I64_TO_F32, r = f32((float)x.i))                                      \
+    X(U64_TO_F32, r = f32((float)x.u))                                      \
+    X(I64_TO_F64, r = f64((double)x.i))                                     \
+    X(U64_TO_F64, r = f64((double)x.u))                                     \
+    X(F32_TO_I64, r.i = (int64_t)x.f)                                       \
+    X(F32_TO_U64, r.u = (uint64_t)x.f)                                      \
+    X(F64_TO_I64, r.i = (int64_t)x.d)                                       \
+    X(F64_TO_U64, r.u = (uint64_t)x.d)                                      \
+    X(F32_TO_F64, r = f64(x.f))                                             \
+    X(F64_TO_F32, r = f32((float)x.d))
+#define LOAD_OPS(X)                                                         \
+    X(I8, int8_t, i) X(U8, uint8_t, u) X(I16, int16_t, i)                   \
+    X(U16, uint16_t, u) X(I32, int32_t, i) X(U32, uint32_t, u)              \
+    X(64, uint64_t, u)
+#define STORE_OPS(X)                                                        \
+    X(8, uint8_t) X(16, uint16_t) X(32, uint32_t) X(64, uint64_t)
+/* y is the right operand as the overflow builtin takes it. The immediate
+   of ADDIC is added as a signed number, whatever the type. */
+#define CHECKED_OPS(X)                                                      \
+    X(ADDC_I32, int32_t, __builtin_add_overflow, (int32_t)y.i)              \
+    X(ADDC_U32, uint32_t, __builtin_add_overflow, (uint32_t)y.u)            \
+    X(ADDC_I64, int64_t, __builtin_add_overflow, y.i)                       \
+    X(ADDC_U64, uint64_t, __builtin_add_overflow, y.u)                      \
+    X(SUBC_I32, int32_t, __builtin_sub_overflow, (int32_t)y.i)              \
+    X(SUBC_U32, uint32_t, __builtin_sub_overflow, (uint32_t)y.u)            \
+    X(SUBC_I64, int64_t, __builtin_sub_overflow, y.i)                       \
+    X(SUBC_U64, uint64_t, __builtin_sub_overflow, y.u)                      \
+    X(MULC_I32, int32_t, __builtin_mul_overflow, (int32_t)y.i)              \
+    X(MULC_U32, uint32_t, __builtin_mul_overflow, (uint32_t)y.u)            \
+    X(MULC_I64, int64_t, __builtin_mul_overflow, y.i)                       \
+    X(MULC_U64, uint64_t, __builtin_mul_overflow, y.u)
+#define IMMEDIATE_CHECKED_OPS(X)                                            \
+    X(ADDIC_I32, int32_t) X(ADDIC_U32, uint32_t)                            \
+    X(ADDIC_I64, int64_t) X(ADDIC_U64, uint64_t)
+/* The other instructions that may fault, with the test for it. */
+#define FAULTING_OPS(X)                                                     \
+    X(DIV_I32, !y.u, r.i = y.i == -1 ? (int32_t)(0u - (uint32_t)x.u)        \
+                                     : (int32_t)x.i / (int32_t)y.i)         \
+    X(DIV_U32, !y.u, r.u = (uint32_t)x.u / (uint32_t)y.u)                   \
+    X(DIV_I64, !y.u, r.i = y.i == -1 ? (int64_t)(0 - x.u) : x.i / y.i)      \
+    X(DIV_U64, !y.u, r.u = x.u / y.u)                                       \
+    X(MOD_I32, !y.u, r.i = y.i == -1 ? 0 : (int32_t)x.i % (int32_t)y.i)     \
+    X(MOD_U32, !y.u, r.u = (uint32_t)x.u % (uint32_t)y.u)                   \
+    X(MOD_I64, !y.u, r.i = y.i == -1 ? 0 : x.i % y.i)                       \
+    X(MOD_U64, !y.u, r.u = x.u % y.u)                                       \
+    X(DIVC_I32, !y.u || (y.i == -1 && x.i == INT32_MIN),                    \
+      r.i = (int32_t)x.i / (int32_t)y.i)                                    \
+    X(DIVC_I64, !y.u || (y.i == -1 && x.i == INT64_MIN), r.i = x.i / y.i)   \
+    X(SHLC_I32, y.u >= 32 ? x.i != 0                                        \
+                : (int32_t)((uint32_t)x.u << y.u) >> y.u != x.i,            \
+      r.i = (int32_t)((uint32_t)x.u << y.u))                                \
+    X(SHLC_I64, y.u >= 64 ? x.i != 0                                        \
+                : (int64_t)(x.u << y.u) >> y.u != x.i,                      \
+      r.i = (int64_t)(x.u << y.u))
+#define UNARY_FAULTING_OPS(X)                                               \
+    X(NEGC_I32, x.i == INT32_MIN, r.i = -x.i)                               \
+    X(NEGC_I64, x.i == INT64_MIN, r.i = -x.i)
+
+/* Operations of the nodes. An operation with a register operand c has a
+   form _K, following it, with the constant v in its place, and a compare
+   has the forms branching on its result, JZ_ and JNZ_, following those. A
+   load or store through b has a form _X through b plus c, and a store of
+   a has a form _K storing v. */
+enum tier_op {
+    T_EXIT,
+    T_NOP,
+    T_JMP,
+    T_JZ,
+    T_JNZ,
+    T_CONST,
+    T_FRAME,
+    T_LOCAL,
+    /* The step and test of a for loop over an int: a += k, and a branch
+       if b < c. */
+    T_ADDI_I32_JNZ_LT_I,
+    T_ADDI_I32_JNZ_LT_I_K,
+    T_ADDIC_I32_JNZ_LT_I,
+    T_ADDIC_I32_JNZ_LT_I_K,
+#define ONE_FORM(name, ...) T_##name,
+#define TWO_FORMS(name, ...) T_##name, T_##name##_K,
+#define COMPARE_FORMS(name, ...)                                            \
+    T_##name, T_##name##_K, T_JZ_##name, T_JZ_##name##_K, T_JNZ_##name,     \
+    T_JNZ_##name##_K,
+#define LOAD_FORMS(name, ...)                                               \
+    T_LOAD_##name, T_LOAD_##name##_X, T_LOADC_##name, T_LOADC_##name##_X,
+#define STORE_FORMS(name, ...)                                              \
+    T_STORE_##name, T_STORE_##name##_K, T_STORE_##name##_X,                 \
+    T_STOREC_##name, T_STOREC_##name##_K, T_STOREC_##name##_X,
+    BINARY_OPS(TWO_FORMS)
+    COMPARE_OPS(COMPARE_FORMS)
+    UNARY_OPS(ONE_FORM)
+    LOAD_OPS(LOAD_FORMS)
+    STORE_OPS(STORE_FORMS)
+    CHECKED_OPS(TWO_FORMS)
+    IMMEDIATE_CHECKED_OPS(ONE_FORM)
+    FAULTING_OPS(TWO_FORMS)
+    UNARY_FAULTING_OPS(ONE_FORM)
+#undef ONE_FORM
+#undef TWO_FORMS
+#undef COMPARE_FORMS
+#undef LOAD_FORMS
+#undef STORE_FORMS
+    NUM_TIER_OPS
+};
+
+/* Node of the instructions from insn on, count in all, bound to their
+   registers a, b and c, offset or immediate k, and constant v, which goes
+   to the node after it, or to next or target if it branches. */
+struct tier_node {
+    uint16_t op;
+    uint16_t count;
+    uint32_t insn;
+    uint32_t a;
+    uint32_t b;
+    uint32_t c;
+    int32_t k;
+    union reg v;
+    const struct tier_node *next;
+    const struct tier_node *target;
+};
+
+struct tier {
+    struct arena arena;
+};
+
+/* What an instruction compiles to: the operation of its node, or T_EXIT
+   if it is left to the interpreter, and the forms the operation has. */
+enum {
+    HAS_K = 1,
+    COMPARE = 2,
+    LOADS = 4,
+    STORES = 8,
+    /* Of format ABI, whose immediate is its constant. */
+    IMMEDIATE = 16,
+    CONSTANT = 32,
+};
+
+struct op {
+    uint16_t node;
+    uint8_t flags;
+};
+
+/* An instruction of the function being compiled, without
+   superinstructions, and the registers it reads and writes: a call reads
+   all of those from uses_from on. A data word of the instruction before
+   is not an instruction. */
+struct decoded {
+    enum opcode op;
+    const struct op *info;
+    bool data;
+    bool leader;
+    bool header;
+    uint32_t def;
+    uint32_t uses[2];
+    uint32_t uses_from;
+};
+
+struct compilation {
+    const struct vm *vm;
+    const struct function *fn;
+    const struct insn *code;
+    uint32_t len;
+    struct decoded *insns;
+    /* Registers live after each instruction, words per set. */
+    uint64_t *live;
+    size_t words;
+};
+
+static const struct op ops[NUM_OPCODES] = {
+#define ENTRY(name, ...) [OP_##name] = {T_##name, 0},
+#define K_ENTRY(name, ...) [OP_##name] = {T_##name, HAS_K},
+#define COMPARE_ENTRY(name, ...) [OP_##name] = {T_##name, COMPARE},
+#define LOAD_ENTRY(name, ...)                                               \
+    [OP_LOAD_##name] = {T_LOAD_##name, LOADS},                              \
+    [OP_LOADC_##name] = {T_LOADC_##name, LOADS},
+#define STORE_ENTRY(name, ...)                                              \
+    [OP_STORE_##name] = {T_STORE_##name, STORES},                           \
+    [OP_STOREC_##name] = {T_STOREC_##name, STORES},
+#define IMMEDIATE_ENTRY(name, ...) [OP_##name] = {T_##name, IMMEDIATE},
+    BINARY_OPS(K_ENTRY)
+    COMPARE_OPS(COMPARE_ENTRY)
+    UNARY_OPS(ENTRY)
+    LOAD_OPS(LOAD_ENTRY)
+    STORE_OPS(STORE_ENTRY)
+    CHECKED_OPS(K_ENTRY)
+    IMMEDIATE_CHECKED_OPS(IMMEDIATE_ENTRY)
+    FAULTING_OPS(K_ENTRY)
+    UNARY_FAULTING_OPS(ENTRY)
+#undef ENTRY
+#undef K_ENTRY
+#undef COMPARE_ENTRY
+#undef LOAD_ENTRY
+#undef STORE_ENTRY
+#undef IMMEDIATE_ENTRY
+    [OP_ADDI_I32] = {T_ADD_I32_K, IMMEDIATE},
+    [OP_ADDI_U32] = {T_ADD_U32_K, IMMEDIATE},
+    [OP_ADDI_I64] = {T_ADD_I64_K, IMMEDIATE},
+    [OP_ADDI_U64] = {T_ADD_U64_K, IMMEDIATE},
+    [OP_MULI_I64] = {T_MUL_I64_K, IMMEDIATE},
+    [OP_LOADI] = {T_CONST, CONSTANT},
+    [OP_LOADK] = {T_CONST, CONSTANT},
+    [OP_ADDR_GLOBAL] = {T_CONST, CONSTANT},
+    [OP_ADDR_FUNC] = {T_CONST, CONSTANT},
+    [OP_ADDR_LOCAL] = {T_FRAME, 0},
+    [OP_ADDRC_LOCAL] = {T_LOCAL, 0},
+    [OP_NOP] = {T_NOP, 0},
+    [OP_JMP] = {T_JMP, 0},
+    [OP_JZ] = {T_JZ, 0},
+    [OP_JNZ] = {T_JNZ, 0},
+};
+
+static void decode(struct compilation *c, uint32_t i);
+static bool find_leaders(struct compilation *c);
+static void compute_liveness(struct compilation *c);
+static bool merge_live_in(struct compilation *c, uint32_t s, uint64_t *out);
+static bool live_after(const struct compilation *c, uint32_t i,
+                       uint32_t reg);
+static bool commutes(enum opcode op);
+static uint32_t make_node(const struct compilation *c, uint32_t i,
+                          struct tier_node *n, uint32_t *target);
+static uint32_t fuse_constant(const struct compilation *c, uint32_t i,
+                              struct tier_node *n, uint32_t *target);
+static uint32_t fuse_branch(const struct compilation *c, uint32_t i,
+                            struct tier_node *n, uint32_t *target);
+static uint32_t fuse_step(const struct compilation *c, uint32_t i,
+                          struct tier_node *n, uint32_t *target);
+static uint32_t fuse_address(const struct compilation *c, uint32_t i,
+                             struct tier_node *n);
+static void compile_function(struct compilation *c, struct tier_node *nodes,
+                             const struct tier_node **entries);
+
+void tier_compile(struct vm *vm, uint32_t insn) {
+    const struct program *const prog = vm->prog;
+    const struct function *fn = NULL;
+    struct compilation c;
+    struct tier *tier;
+    struct tier_node *nodes;
+    size_t index;
+
+    for (index = 0; index < prog->num_functions; index++) {
+        fn = &prog->functions[index];
+        if (fn->defined && insn - fn->code < fn->code_len) break;
+    }
+    if (index == prog->num_functions || vm->tiers[index]) return;
+
+    /* A function too large to compile keeps an empty tier, so that it is
+       not tried again. */
+    tier = malloc(sizeof(struct tier));
+    arena_init(&tier->arena);
+    vm->tiers[index] = tier;
+    if ((uint64_t)fn->code_len * fn->num_regs > TIER_MAX_SIZE) return;
+
+    memset(&c, 0, sizeof(c));
+    c.vm = vm;
+    c.fn = fn;
+    c.code = prog->code + fn->code;
+    c.len = fn->code_len;
+    c.words = (fn->num_regs + 63) / 64;
+    c.insns = calloc(c.len + 1, sizeof(struct decoded));
+    c.live = calloc(c.len * c.words + 1, sizeof(uint64_t));
+
+    for (uint32_t i = 0; i < c.len; i++) {
+        decode(&c, i);
+        if (opcode_format(c.insns[i].op) == FORMAT_ABX && i + 1 < c.len)
+            c.insns[++i].data = true;
+    }
+    /* Only loops gain from compiling. */
+    if (!find_leaders(&c)) {
+        free(c.insns);
+        free(c.live);
+        return;
+    }
+    compute_liveness(&c);
+
+    /* At most a node per instruction, and one past the end, which is never
+       reached. */
+    nodes = arena_alloc(&tier->arena,
+                        sizeof(struct tier_node) * (c.len + 1),
+                        _Alignof(struct tier_node));
+    compile_function(&c, nodes, vm->entries + fn->code);
+    STATS_INC(functions_compiled);
+
+    free(c.insns);
+    free(c.live);
+}
+
+static void decode(struct compilation *c, uint32_t i) {
+    const struct insn *const insn = &c->code[i];
+    struct decoded *const d = &c->insns[i];
+
+    d->op = opcode_first(insn->op);
+    d->info = &ops[d->op];
+    d->def = NO_REG;
+    d->uses[0] = d->uses[1] = NO_REG;
+    d->uses_from = NO_REG;
+
+    switch (d->op) {
+    case OP_NOP:
+    case OP_JMP:
+    case OP_RET_VOID:
+        return;
+    case OP_JZ:
+    case OP_JNZ:
+    case OP_ZERO:
+    case OP_SWITCH:
+    case OP_RET:
+    case OP_HALT:
+        d->uses[0] = insn->a;
+        return;
+    /* Its b is a frame slot. */
+    case OP_ADDRC_LOCAL:
+        d->def = insn->a;
+        return;
+    case OP_COPY:
+        d->uses[0] = insn->a;
+        d->uses[1] = insn->b;
+        return;
+    /* A callee's registers start at the argument registers. */
+    case OP_CALL:
+    case OP_CALL_HOST:
+        d->def = insn->a;
+        d->uses_from = insn->a;
+        return;
+    case OP_CALL_PTR:
+        d->def = insn->a;
+        d->uses[0] = insn->b;
+        d->uses_from = insn->a;
+        return;
+    default:
+        break;
+    }
+    if (d->info->flags & STORES) {
+        d->uses[0] = insn->a;
+        d->uses[1] = insn->b;
+        return;
+    }
+    d->def = insn->a;
+    switch (opcode_format(d->op)) {
+    case FORMAT_ABC:
+        d->uses[0] = insn->b;
+        d->uses[1] = insn->c;
+        break;
+    case FORMAT_AB:
+    case FORMAT_ABI:
+        d->uses[0] = insn->b;
+        break;
+    default:
+        break;
+    }
+}
+
+/* Blocks start at the function entry, at the targets of branches, and
+   after branches and the instructions left to the interpreter. The targets
+   of backward branches are loop headers, where the interpreter enters the
+   compiled code. Returns whether there are any. */
+static bool find_leaders(struct compilation *c) {
+    const struct program *const prog = c->vm->prog;
+    bool loops = false;
+
+    c->insns[0].leader = true;
+    for (uint32_t i = 0; i < c->len; i++) {
+        const struct decoded *const d = &c->insns[i];
+        const struct insn *const insn = &c->code[i];
+        uint32_t after = i + 1;
+
+        if (d->data) continue;
+        switch (d->op) {
+        case OP_JMP:
+        case OP_JZ:
+        case OP_JNZ:
+            if (i + insn->imm >= c->len) break;
+            c->insns[i + insn->imm].leader = true;
+            if (insn->imm <= 0) {
+                c->insns[i + insn->imm].header = true;
+                loops = true;
+            }
+            break;
+        case OP_SWITCH: {
+            const struct switch_table *const t = &prog->switches[insn->imm];
+
+            if (i + t->default_target < c->len)
+                c->insns[i + t->default_target].leader = true;
+            for (uint32_t k = 0; k < t->num_cases; k++) {
+                const uint32_t s = i + prog->switch_cases[t->cases + k].target;
+
+                if (s < c->len) c->insns[s].leader = true;
+            }
+            break;
+        }
+        default:
+            if (d->info->node != T_EXIT) continue;
+            if (opcode_format(d->op) == FORMAT_ABX) after++;
+            break;
+        }
+        if (after < c->len) c->insns[after].leader = true;
+    }
+    return loops;
+}
+
+/* Registers live after each instruction, by iterating to a fixed
+   point. */
+static void compute_liveness(struct compilation *c) {
+    const struct program *const prog = c->vm->prog;
+    bool changed;
+
+    do {
+        changed = false;
+        for (uint32_t i = c->len; i-- > 0;) {
+            const struct decoded *const d = &c->insns[i];
+            const struct insn *const insn = &c->code[i];
+            uint64_t *const out = c->live + (size_t)i * c->words;
+
+            if (d->data) continue;
+            switch (d->op) {
+            case OP_JMP:
+                changed |= merge_live_in(c, i + insn->imm, out);
+                break;
+            case OP_JZ:
+            case OP_JNZ:
+                changed |= merge_live_in(c, i + insn->imm, out);
+                changed |= merge_live_in(c, i + 1, out);
+                break;
+            case OP_SWITCH: {
+                const struct switch_table *const t =
+                    &prog->switches[insn->imm];
+
+                changed |= merge_live_in(c, i + t->default_target, out);
+                for (uint32_t k = 0; k < t->num_cases; k++)
+                    changed |= merge_live_in(
+                        c, i + prog->switch_cases[t->cases + k].target, out);
+                break;
+            }
+            case OP_RET:
+            case OP_RET_VOID:
+            case OP_HALT:
+                break;
+            default:
+                changed |= merge_live_in(
+                    c, i + (opcode_format(d->op) == FORMAT_ABX ? 2 : 1), out);
+                break;
+            }
+        }
+    } while (changed);
+}
+
+/* Add the registers live before instruction s to out, returning whether
+   it changed. */
+static bool merge_live_in(struct compilation *c, uint32_t s, uint64_t *out) {
+    const struct decoded *d;
+    const uint64_t *live;
+    bool changed = false;
+
+    if (s >= c->len) return false;
+    d = &c->insns[s];
+    live = c->live + (size_t)s * c->words;
+    for (size_t w = 0; w < c->words; w++) {
+        uint64_t in = live[w];
+
+        if (d->def != NO_REG && d->def / 64 == w)
+            in &= ~(UINT64_C(1) << d->def % 64);
+        for (int k = 0; k < 2; k++)
+            if (d->uses[k] != NO_REG && d->uses[k] / 64 == w)
+                in |= UINT64_C(1) << d->uses[k] % 64;
+        if (d->uses_from != NO_REG && (w + 1) * 64 > d->uses_from)
+            in |= d->uses_from <= w * 64 ? ~UINT64_C(0)
+                  : ~UINT64_C(0) << d->uses_from % 64;
+        if (in & ~out[w]) {
+            out[w] |= in;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+static bool live_after(const struct compilation *c, uint32_t i,
+                       uint32_t reg) {
+    return c->live[(size_t)i * c->words + reg / 64] >> reg % 64 & 1;
+}
+
+/* Whether the operands of op may be swapped. */
+static bool commutes(enum opcode op) {
+    switch (op) {
+    case OP_ADD_I32:
+    case OP_ADD_U32:
+    case OP_ADD_I64:
+    case OP_ADD_U64:
+    case OP_ADD_F32:
+    case OP_ADD_F64:
+    case OP_MUL_I32:
+    case OP_MUL_U32:
+    case OP_MUL_I64:
+    case OP_MUL_U64:
+    case OP_MUL_F32:
+    case OP_MUL_F64:
+    case OP_AND:
+    case OP_OR:
+    case OP_XOR:
+    case OP_ADDC_I32:
+    case OP_ADDC_U32:
+    case OP_ADDC_I64:
+    case OP_ADDC_U64:
+    case OP_MULC_I32:
+    case OP_MULC_U32:
+    case OP_MULC_I64:
+    case OP_MULC_U64:
+    case OP_EQ_I:
+    case OP_EQ_U:
+    case OP_NE_I:
+    case OP_NE_U:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/* Whether instruction i can be fused into the one before it: it is in the
+   same block, and the value t the one before computes is not read after
+   it, unless it computes t again. */
+static bool fusible(const struct compilation *c, uint32_t i, uint32_t t) {
+    return i < c->len && !c->insns[i].leader && !c->insns[i].data
+           && (!live_after(c, i, t) || c->insns[i].def == t);
+}
+
+/* Make the node of instruction i, fused with those after it that it can
+   be, returning the instruction after them, and setting *target to the
+   instruction it branches to, if any. */
+static uint32_t make_node(const struct compilation *c, uint32_t i,
+                          struct tier_node *n, uint32_t *target) {
+    const struct insn *const insn = &c->code[i];
+    const struct decoded *const d = &c->insns[i];
+    const struct vm *const vm = c->vm;
+    uint32_t end;
+
+    memset(n, 0, sizeof(struct tier_node));
+    n->op = d->info->node;
+    n->count = 1;
+    n->insn = c->fn->code + i;
+    n->a = insn->a;
+    n->b = insn->b;
+    n->c = insn->c;
+    *target = NO_TARGET;
+
+    if (d->info->flags & CONSTANT) {
+        if (d->op == OP_LOADI) n->v.i = insn->imm;
+        else if (d->op == OP_LOADK) n->v.u = vm->prog->constants[insn->imm];
+        else if (d->op == OP_ADDR_GLOBAL) n->v.p = vm->globals[insn->imm];
+        else n->v.p = (void *)&vm->prog->functions[insn->imm];
+        if ((end = fuse_constant(c, i, n, target))) return end;
+        return i + 1;
+    }
+    if ((d->info->flags & COMPARE) && (end = fuse_branch(c, i, n, target)))
+        return end;
+    if ((d->op == OP_ADDI_I32 || d->op == OP_ADDIC_I32)
+        && (end = fuse_step(c, i, n, target)))
+        return end;
+    if ((d->op == OP_ADD_U64) && (end = fuse_address(c, i, n))) return end;
+
+    switch (d->op) {
+    case OP_ADDR_LOCAL:
+        n->k = insn->imm;
+        break;
+    case OP_JMP:
+    case OP_JZ:
+    case OP_JNZ:
+        *target = i + insn->imm;
+        break;
+    default:
+        if (n->op == T_EXIT) {
+            n->count = 0;
+            return i + (opcode_format(d->op) == FORMAT_ABX ? 2 : 1);
+        }
+        if (opcode_format(d->op) != FORMAT_ABI) break;
+        n->k = (int16_t)insn->c;
+        n->v.i = n->k;
+        break;
+    }
+    return i + 1;
+}
+
+/* Fuse constant instruction i, whose value is n->v, into the operation
+   reading it next, which is then made of the form _K, and that into a
+   branch on its result. n is left as it is if they cannot be fused. */
+static uint32_t fuse_constant(const struct compilation *c, uint32_t i,
+                              struct tier_node *n, uint32_t *target) {
+    const uint32_t t = c->code[i].a;
+    const uint32_t j = i + 1;
+    const struct insn *insn;
+    const struct op *info;
+    struct tier_node fused;
+
+    if (!fusible(c, j, t)) return 0;
+    insn = &c->code[j];
+    info = c->insns[j].info;
+    fused = *n;
+    fused.a = insn->a;
+    fused.b = insn->b;
+    fused.c = t;
+    fused.k = (int16_t)insn->c;
+    if (info->flags & STORES) {
+        if (insn->a != t || insn->b == t) return 0;
+    } else if (info->flags & (HAS_K | COMPARE)) {
+        if (insn->b == t && insn->c != t && commutes(c->insns[j].op))
+            fused.b = insn->c;
+        else if (insn->c != t || insn->b == t)
+            return 0;
+    } else {
+        return 0;
+    }
+    fused.op = info->node + 1;
+    fused.count = 2;
+    *n = fused;
+    if (info->flags & COMPARE) {
+        const uint32_t k = j + 1;
+
+        if (fusible(c, k, insn->a)
+            && (c->insns[k].op == OP_JZ || c->insns[k].op == OP_JNZ)
+            && c->code[k].a == insn->a) {
+            n->op += c->insns[k].op == OP_JZ ? 2 : 4;
+            n->count = 3;
+            *target = k + c->code[k].imm;
+            return k + 1;
+        }
+    }
+    return j + 1;
+}
+
+/* Fuse compare i into the branch on its result after it. */
+static uint32_t fuse_branch(const struct compilation *c, uint32_t i,
+                            struct tier_node *n, uint32_t *target) {
+    const uint32_t t = c->code[i].a;
+    const uint32_t j = i + 1;
+
+    if (!fusible(c, j, t)
+        || (c->insns[j].op != OP_JZ && c->insns[j].op != OP_JNZ)
+        || c->code[j].a != t)
+        return 0;
+    n->op += c->insns[j].op == OP_JZ ? 2 : 4;
+    n->count = 2;
+    *target = j + c->code[j].imm;
+    return j + 1;
+}
+
+/* Fuse the step i of a for loop, a = a + k, into the test after it, which
+   may be the loop header, as the superinstructions of the interpreter
+   do. */
+static uint32_t fuse_step(const struct compilation *c, uint32_t i,
+                          struct tier_node *n, uint32_t *target) {
+    const struct insn *const insn = &c->code[i];
+    struct tier_node test;
+    uint32_t end;
+
+    if (insn->a != insn->b || i + 1 >= c->len || c->insns[i + 1].data)
+        return 0;
+    end = make_node(c, i + 1, &test, target);
+    if (test.op != T_JNZ_LT_I && test.op != T_JNZ_LT_I_K) {
+        *target = NO_TARGET;
+        return 0;
+    }
+    n->op = (c->insns[i].op == OP_ADDI_I32 ? T_ADDI_I32_JNZ_LT_I
+                                          : T_ADDIC_I32_JNZ_LT_I)
+            + (test.op == T_JNZ_LT_I_K);
+    n->count = 1 + test.count;
+    n->k = (int16_t)insn->c;
+    n->b = test.b;
+    n->c = test.c;
+    n->v = test.v;
+    return end;
+}
+
+/* Fuse the address b + c computed by i into the load or store through it
+   after it. */
+static uint32_t fuse_address(const struct compilation *c, uint32_t i,
+                             struct tier_node *n) {
+    const struct insn *const insn = &c->code[i];
+    const uint32_t j = i + 1;
+    const struct insn *next;
+
+    if (!fusible(c, j, insn->a)) return 0;
+    next = &c->code[j];
+    if (!(c->insns[j].info->flags & (LOADS | STORES)) || next->b != insn->a
+        || ((c->insns[j].info->flags & STORES) && next->a == insn->a))
+        return 0;
+    n->op = c->insns[j].info->node
+            + (c->insns[j].info->flags & STORES ? 2 : 1);
+    n->count = 2;
+    n->a = next->a;
+    n->k = (int16_t)next->c;
+    return j + 1;
+}
+
+/* Make the nodes of the function in order, each instruction in one, and
+   link them to their successors, and set the entries of its loop headers.
+   A node fused across a block start, at a loop header, is followed by the
+   nodes from there on, for the jumps to it. */
+static void compile_function(struct compilation *c, struct tier_node *nodes,
+                             const struct tier_node **entries) {
+    uint32_t *const node_of = malloc(sizeof(uint32_t) * (c->len + 1));
+    uint32_t *const ends = malloc(sizeof(uint32_t) * (c->len + 1));
+    uint32_t *const targets = malloc(sizeof(uint32_t) * (c->len + 1));
+    uint32_t num_nodes = 0;
+
+    for (uint32_t i = 0; i <= c->len; i++) node_of[i] = UINT32_MAX;
+    for (uint32_t i = 0; i < c->len;) {
+        struct tier_node *const n = &nodes[num_nodes];
+        const uint32_t end = make_node(c, i, n, &targets[num_nodes]);
+        uint32_t j = i + 1;
+
+        node_of[i] = num_nodes;
+        ends[num_nodes] = end;
+        STATS_ADD(instructions_folded, 0, n->count ? n->count - 1 : 0);
+        num_nodes++;
+        while (j < end && !c->insns[j].leader) j++;
+        i = j;
+    }
+    node_of[c->len] = num_nodes;
+    memset(&nodes[num_nodes], 0, sizeof(struct tier_node));
+    nodes[num_nodes].op = T_EXIT;
+    nodes[num_nodes].insn = c->fn->code + c->len - 1;
+    STATS_ADD(nodes_made, 0, num_nodes);
+
+    for (uint32_t k = 0; k < num_nodes; k++) {
+        struct tier_node *const n = &nodes[k];
+
+        n->next = &nodes[node_of[ends[k]] == UINT32_MAX ? num_nodes
+                                                         : node_of[ends[k]]];
+        if (targets[k] != NO_TARGET)
+            n->target = &nodes[targets[k] < c->len ? node_of[targets[k]]
+                                                   : num_nodes];
+    }
+    for (uint32_t i = 0; i < c->len; i++)
+        if (c->insns[i].header && node_of[i] != UINT32_MAX
+            && nodes[node_of[i]].op != T_EXIT)
+            entries[i] = &nodes[node_of[i]];
+    free(node_of);
+    free(ends);
+    free(targets);
+}
+
+/* Quick check of a scalar access of n bytes at p, as the interpreter
+   makes it. */
+static inline bool quick_check(const struct vm_object *objects, uint64_t p,
+                               uint64_t n) {
+    const struct vm_object *const o = &objects[p >> VM_TAG_SHIFT];
+    const uint64_t off = (p & VM_ADDRESS_MASK) - (uintptr_t)o->base;
+
+    return off < o->size && o->size - off >= n && !(p & (n - 1))
+           && (n == 1 || !o->elem_size || o->elem_size == n);
+}
+
+const struct insn *tier_run(const struct vm *vm,
+                            const struct tier_node *entry, union reg *regs,
+                            uint8_t *fp, const uint64_t *locals,
+                            uint64_t *steps) {
+#ifdef VM_COMPUTED_GOTO
+    static const void *const labels[NUM_TIER_OPS] = {
+#define ONE_FORM(name, ...) [T_##name] = &&L_##name,
+#define TWO_FORMS(name, ...) ONE_FORM(name) ONE_FORM(name##_K)
+#define COMPARE_FORMS(name, ...)                                            \
+    TWO_FORMS(name) TWO_FORMS(JZ_##name) TWO_FORMS(JNZ_##name)
+#define LOAD_FORMS(name, ...)                                               \
+    ONE_FORM(LOAD_##name) ONE_FORM(LOAD_##name##_X)                         \
+    ONE_FORM(LOADC_##name) ONE_FORM(LOADC_##name##_X)
+#define STORE_FORMS(name, ...)                                              \
+    TWO_FORMS(STORE_##name) ONE_FORM(STORE_##name##_X)                      \
+    TWO_FORMS(STOREC_##name) ONE_FORM(STOREC_##name##_X)
+        ONE_FORM(EXIT) ONE_FORM(NOP) ONE_FORM(JMP) ONE_FORM(JZ)
+        ONE_FORM(JNZ) ONE_FORM(CONST) ONE_FORM(FRAME) ONE_FORM(LOCAL)
+        TWO_FORMS(ADDI_I32_JNZ_LT_I) TWO_FORMS(ADDIC_I32_JNZ_LT_I)
+        BINARY_OPS(TWO_FORMS)
+        COMPARE_OPS(COMPARE_FORMS)
+        UNARY_OPS(ONE_FORM)
+        LOAD_OPS(LOAD_FORMS)
+        STORE_OPS(STORE_FORMS)
+        CHECKED_OPS(TWO_FORMS)
+        IMMEDIATE_CHECKED_OPS(ONE_FORM)
+        FAULTING_OPS(TWO_FORMS)
+        UNARY_FAULTING_OPS(ONE_FORM)
+#undef ONE_FORM
+#undef TWO_FORMS
+#undef COMPARE_FORMS
+#undef LOAD_FORMS
+#undef STORE_FORMS
+    };
+#define CASE(name) L_##name:
+#define DISPATCH() do { count += n->count; goto *labels[n->op]; } while (0)
+#else
+#define CASE(name) case T_##name:
+#define DISPATCH() do { count += n->count; goto dispatch; } while (0)
+#endif
+#define NEXT() do { n++; DISPATCH(); } while (0)
+/* Each way dispatches on its own, for the branch to be predicted. */
+#define BRANCH(test)                                                        \
+    do {                                                                    \
+        if (test) {                                                         \
+            n = n->target;                                                  \
+            DISPATCH();                                                     \
+        }                                                                   \
+        n = n->next;                                                        \
+        DISPATCH();                                                         \
+    } while (0)
+#define A regs[n->a]
+#define B regs[n->b]
+#define C regs[n->c]
+#define K ((int64_t)n->k)
+
+    const struct vm_object *const objects = vm->objects;
+    const struct tier_node *n = entry;
+    uint64_t count = 0;
+
+    DISPATCH();
+
+#ifndef VM_COMPUTED_GOTO
+dispatch:
+    switch ((enum tier_op)n->op) {
+#endif
+
+    CASE(EXIT) goto done;
+    CASE(NOP) NEXT();
+    CASE(JMP) n = n->target; DISPATCH();
+    CASE(JZ) BRANCH(!A.u);
+    CASE(JNZ) BRANCH(A.u);
+    CASE(CONST) A = n->v; NEXT();
+    CASE(FRAME) A.p = fp + n->k; NEXT();
+    CASE(LOCAL) A.u = locals[n->b] + K; NEXT();
+
+    CASE(ADDI_I32_JNZ_LT_I)
+        A.i = (int32_t)(uint32_t)(A.u + K);
+        BRANCH(B.i < C.i);
+    CASE(ADDI_I32_JNZ_LT_I_K)
+        A.i = (int32_t)(uint32_t)(A.u + K);
+        BRANCH(B.i < n->v.i);
+    CASE(ADDIC_I32_JNZ_LT_I) {
+        int32_t r;
+
+        if (__builtin_expect(__builtin_add_overflow((int32_t)A.u, K, &r), 0))
+            goto fault;
+        A.i = r;
+        BRANCH(B.i < C.i);
+    }
+    CASE(ADDIC_I32_JNZ_LT_I_K) {
+        int32_t r;
+
+        if (__builtin_expect(__builtin_add_overflow((int32_t)A.u, K, &r), 0))
+            goto fault;
+        A.i = r;
+        BRANCH(B.i < n->v.i);
+    }
+
+#define BINARY(name, expr)                                                  \
+    CASE(name) {                                                            \
+        const union reg x = B, y = C;                                       \
+        union reg r;                                                        \
+                                                                            \
+        expr;                                                               \
+        A = r;                                                              \
+        NEXT();                                                             \
+    }                                                                       \
+    CASE(name##_K) {                                                        \
+        const union reg x = B, y = n->v;                                    \
+        union reg r;                                                        \
+                                                                            \
+        expr;                                                               \
+        A = r;                                                              \
+        NEXT();                                                             \
+    }
+    BINARY_OPS(BINARY)
+#undef BINARY
+
+#define COMPARE_FORM(name, y_, ...)                                         \
+    CASE(name) {                                                            \
+        const union reg x = B, y = y_;                                      \
+                                                                            \
+        __VA_ARGS__;                                                        \
+    }
+#define COMPARE(name, test)                                                 \
+    COMPARE_FORM(name, C, A.u = (test); NEXT())                             \
+    COMPARE_FORM(name##_K, n->v, A.u = (test); NEXT())                      \
+    COMPARE_FORM(JZ_##name, C, BRANCH(!(test)))                             \
+    COMPARE_FORM(JZ_##name##_K, n->v, BRANCH(!(test)))                      \
+    COMPARE_FORM(JNZ_##name, C, BRANCH(test))                               \
+    COMPARE_FORM(JNZ_##name##_K, n->v, BRANCH(test))
+    COMPARE_OPS(COMPARE)
+#undef COMPARE
+#undef COMPARE_FORM
+
+#define UNARY(name, expr)                                                   \
+    CASE(name) {                                                            \
+        const union reg x = B;                                              \
+        union reg r;                                                        \
+                                                                            \
+        expr;                                                               \
+        A = r;                                                              \
+        NEXT();                                                             \
+    }
+    UNARY_OPS(UNARY)
+#undef UNARY
+
+    /* Accesses through b + k, or b + c + k; the checked ones fault if the
+       quick check fails, for the interpreter to report or allow them. */
+#define LOAD_FORM(name, type, field, address, checked)                      \
+    CASE(name) {                                                            \
+        const uint64_t p = (address);                                       \
+        type v;                                                             \
+                                                                            \
+        if ((checked) && __builtin_expect(!quick_check(objects, p,          \
+                                                       sizeof(type)), 0))   \
+            goto fault;                                                     \
+        memcpy(&v, (void *)(uintptr_t)(p & VM_ADDRESS_MASK), sizeof(v));    \
+        A.field = v;                                                        \
+        NEXT();                                                             \
+    }
+#define LOAD(name, type, field)                                             \
+    LOAD_FORM(LOAD_##name, type, field, B.u + K, false)                     \
+    LOAD_FORM(LOAD_##name##_X, type, field, B.u + C.u + K, false)           \
+    LOAD_FORM(LOADC_##name, type, field, B.u + K, true)                     \
+    LOAD_FORM(LOADC_##name##_X, type, field, B.u + C.u + K, true)
+    LOAD_OPS(LOAD)
+#undef LOAD
+#undef LOAD_FORM
+
+#define STORE_FORM(name, type, value, address, checked)                     \
+    CASE(name) {                                                            \
+        const uint64_t p = (address);                                       \
+        const type v = (type)(value);                                       \
+                                                                            \
+        if ((checked) && __builtin_expect(!quick_check(objects, p,          \
+                                                       sizeof(type)), 0))   \
+            goto fault;                                                     \
+        memcpy((void *)(uintptr_t)(p & VM_ADDRESS_MASK), &v, sizeof(v));    \
+        NEXT();                                                             \
+    }
+#define STORE(name, type)                                                   \
+    STORE_FORM(STORE_##name, type, A.u, B.u + K, false)                     \
+    STORE_FORM(STORE_##name##_K, type, n->v.u, B.u + K, false)              \
+    STORE_FORM(STORE_##name##_X, type, A.u, B.u + C.u + K, false)           \
+    STORE_FORM(STOREC_##name, type, A.u, B.u + K, true)                     \
+    STORE_FORM(STOREC_##name##_K, type, n->v.u, B.u + K, true)              \
+    STORE_FORM(STOREC_##name##_X, type, A.u, B.u + C.u + K, true)
+    STORE_OPS(STORE)
+#undef STORE
+#undef STORE_FORM
+
+    /* Checked instructions fault when the check fails, to be run again by
+       the interpreter. */
+#define CHECKED_FORM(name, type, builtin, y_, y_reg)                        \
+    CASE(name) {                                                            \
+        const union reg x = B, y = y_reg;                                   \
+        type r;                                                             \
+                                                                            \
+        if (__builtin_expect(builtin((type)x.u, y_, &r), 0)) goto fault;    \
+        A.i = r;                                                            \
+        NEXT();                                                             \
+    }
+#define CHECKED(name, type, builtin, y_)                                    \
+    CHECKED_FORM(name, type, builtin, y_, C)                                \
+    CHECKED_FORM(name##_K, type, builtin, y_, n->v)
+#define IMMEDIATE_CHECKED(name, type)                                       \
+    CHECKED_FORM(name, type, __builtin_add_overflow, y.i, n->v)
+    CHECKED_OPS(CHECKED)
+    IMMEDIATE_CHECKED_OPS(IMMEDIATE_CHECKED)
+#undef CHECKED
+#undef IMMEDIATE_CHECKED
+#undef CHECKED_FORM
+
+#define FAULTING_FORM(name, test, expr, y_)                                 \
+    CASE(name) {                                                            \
+        const union reg x = B, y = y_;                                      \
+        union reg r;                                                        \
+                                                                            \
+        if (__builtin_expect(test, 0)) goto fault;                          \
+        expr;                                                               \
+        A = r;                                                              \
+        NEXT();                                                             \
+    }
+#define FAULTING(name, test, expr)                                          \
+    FAULTING_FORM(name, test, expr, C)                                      \
+    FAULTING_FORM(name##_K, test, expr, n->v)
+#define UNARY_FAULTING(name, test, expr)                                    \
+    CASE(name) {                                                            \
+        const union reg x = B;                                              \
+        union reg r;                                                        \
+                                                                            \
+        if (__builtin_expect(test, 0)) goto fault;                          \
+        expr;                                                               \
+        A = r;                                                              \
+        NEXT();                                                             \
+    }
+    FAULTING_OPS(FAULTING)
+    UNARY_FAULTING_OPS(UNARY_FAULTING)
+#undef FAULTING
+#undef UNARY_FAULTING
+#undef FAULTING_FORM
+
+#ifndef VM_COMPUTED_GOTO
+    case NUM_TIER_OPS:
+        break;
+    }
+#endif
+
+/* A node faults before changing anything, and the interpreter runs its
+   instructions instead. */
+fault:
+    count -= n->count;
+done:
+    STATS_INC(runs);
+    *steps += count;
+    return vm->prog->code + n->insn;
+
+#undef CASE
+#undef DISPATCH
+#undef NEXT
+#undef BRANCH
+#undef A
+#undef B
+#undef C
+#undef K
+}
+
+void tier_destroy(struct tier *tier) {
+    if (!tier) return;
+    arena_destroy(&tier->arena);
+    free(tier);
+}
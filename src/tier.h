@@ -0,0 +1,50 @@
+#ifndef TIER_H
+#define TIER_H
+
+#include <stdint.h>
+
+#include "bytecode.h"
+
+struct vm;
+
+/* Second tier of the VM. The interpreter counts the calls of each function
+   and the backward jumps to each instruction, and once either reaches
+   TIER_THRESHOLD, compiles the function, if it has loops, into nodes: each
+   a run of instructions fused into one operation, with the registers it is
+   bound to, constants, addresses of globals and frame offsets baked in,
+   and the nodes to go to next.
+
+   Liveness of the registers decides what can be fused: a constant into the
+   instruction that reads it, a compare into the branch on its result, an
+   address sum into the load or store through it, and the step of a loop
+   counter into the test after it. The operand kinds are known when the
+   function is compiled, as the bytecode is typed, so each operation is
+   specialized on them. tier_run() threads through the nodes as the
+   interpreter does through instructions, one dispatch per node, with a
+   branch going straight to the node of its target.
+
+   Code that the second tier does not compile, such as calls, returns and
+   switches, is left to the interpreter, which the nodes of it exit to. So
+   are the checked instructions whose check fails: the node exits before
+   changing anything, and the interpreter runs its instructions again, to
+   report or handle the failure. It enters compiled code again at a loop
+   header. */
+#define TIER_THRESHOLD 1000
+
+struct tier;
+struct tier_node;
+
+/* Compile the function containing instruction insn, if not tried before,
+   setting the entries of vm to the nodes of each instruction the
+   interpreter may enter the compiled code at. */
+void tier_compile(struct vm *vm, uint32_t insn);
+/* Run compiled code from entry, on the registers, frame and frame slots
+   of the function, until it exits. Returns the instruction to interpret
+   next, and adds those run to *steps. */
+const struct insn *tier_run(const struct vm *vm,
+                            const struct tier_node *entry, union reg *regs,
+                            uint8_t *fp, const uint64_t *locals,
+                            uint64_t *steps);
+void tier_destroy(struct tier *tier);
+
+#endif
@@ -0,0 +1,445 @@
+#include "token_cache.h"
+#include "intern.h"
+#include "stats.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <utime.h>
+
+/* Changes with the layout of an entry. */
+#define TOKEN_CACHE_FORMAT 2
+/* Entries are lexed in preprocessing-token mode. */
+#define TOKEN_CACHE_PP_TOKENS 0x01
+/* An entry used within this many seconds is not touched again, to spare a
+   system call per hit. */
+#define TOUCH_INTERVAL 3600
+/* Temporary files older than this are left over by crashed runs. */
+#define STALE_TMP_AGE 86400
+
+/* An entry is a header, the tokens, whose atoms are indexes into the
+   table of names, and the names, as spans of the source. All fields are in
+   host byte order; token_size guards against a different struct token. */
+struct cache_header {
+    char magic[8];
+    uint32_t format;
+    uint32_t lexer_version;
+    uint32_t token_size;
+    uint32_t flags;
+    uint64_t source_hash;
+    uint64_t source_len;
+    uint64_t num_tokens;
+    uint64_t num_names;
+    /* hash_contents() of everything after the header. */
+    uint64_t checksum;
+};
+
+struct cache_name {
+    uint32_t offset;
+    uint32_t len;
+};
+
+struct cache_entry {
+    char *name;
+    off_t size;
+    struct timespec mtime;
+};
+
+static const char magic[8] = "CISCTOK";
+
+static struct {
+    char *dir;
+    size_t max_bytes;
+    /* Bytes in the directory, counted on the first store, or -1. */
+    size_t size;
+    /* Stores may be made from several threads at once, as translation
+       units are compiled: each writes its own temporary file, numbered by
+       tmp_count, and size is counted under lock. */
+    size_t tmp_count;
+    pthread_mutex_t lock;
+} cache = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+STATS_PHASE(load_phase, "token_cache.load");
+STATS_COUNTER(hits, "token_cache.hits");
+STATS_COUNTER(misses, "token_cache.misses");
+STATS_COUNTER(rejects, "token_cache.rejects");
+STATS_COUNTER(stores, "token_cache.stores");
+STATS_COUNTER(evictions, "token_cache.evictions");
+
+static char *format_path(const char *fmt, ...);
+static char *entry_path(uint64_t hash, bool pp_tokens);
+static int check_entry(const struct source *src, uint32_t flags,
+                       uint64_t hash, const char *map, size_t size);
+static size_t scan_dir(struct cache_entry **entries, size_t *num_entries);
+static void evict(const char *keep);
+static int compare_entries(const void *a, const void *b);
+
+int token_cache_open(const char *dir, size_t max_bytes) {
+    struct stat st;
+
+    if (mkdir(dir, 0777) && errno != EEXIST) return -1;
+    if (stat(dir, &st) || !S_ISDIR(st.st_mode)
+        || access(dir, R_OK | W_OK | X_OK))
+        return -1;
+
+    token_cache_close();
+    cache.dir = strdup(dir);
+    cache.max_bytes = max_bytes;
+    cache.size = -1;
+    return 0;
+}
+
+void token_cache_close(void) {
+    free(cache.dir);
+    cache.dir = NULL;
+}
+
+bool token_cache_enabled(void) {
+    return cache.dir != NULL;
+}
+
+int token_cache_load(const struct source *src, bool pp_tokens,
+                     struct arena *arena, uint64_t *hash,
+                     struct token_array *tokarr) {
+    const uint32_t flags = pp_tokens ? TOKEN_CACHE_PP_TOKENS : 0;
+    const struct cache_header *header;
+    const struct token *tokens;
+    const struct cache_name *names;
+    uint32_t *atoms;
+    char *path;
+    struct stat st;
+    char *map;
+    int fd;
+
+    if (cache.dir == NULL) return -1;
+
+    STATS_BEGIN(load_phase);
+    *hash = hash_contents(src->buf, src->len);
+    path = entry_path(*hash, pp_tokens);
+    fd = path ? open(path, O_RDONLY) : -1;
+    if (fd < 0 || fstat(fd, &st) || (size_t)st.st_size < sizeof(*header)) {
+        if (fd >= 0) close(fd);
+        free(path);
+        STATS_ADD_ATOMIC(misses, 0, 1);
+        STATS_END(load_phase);
+        return -1;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED
+        || check_entry(src, flags, *hash, map, st.st_size)) {
+        /* A damaged entry, or one of another build, is replaced. */
+        if (map != MAP_FAILED) munmap(map, st.st_size);
+        unlink(path);
+        free(path);
+        STATS_ADD_ATOMIC(rejects, 0, 1);
+        STATS_ADD_ATOMIC(misses, 0, 1);
+        STATS_END(load_phase);
+        return -1;
+    }
+
+    header = (const struct cache_header *)map;
+    tokens = (const struct token *)(header + 1);
+    names = (const struct cache_name *)(tokens + header->num_tokens);
+
+    /* Intern the names in order of first occurrence, which numbers new
+       atoms as lexing would. */
+    atoms = malloc(sizeof(uint32_t) * (header->num_names + 1));
+    if (atoms == NULL) {
+        munmap(map, st.st_size);
+        free(path);
+        STATS_ADD_ATOMIC(misses, 0, 1);
+        STATS_END(load_phase);
+        return -1;
+    }
+    for (size_t i = 0; i < header->num_names; i++)
+        atoms[i] = intern(src->buf + names[i].offset, names[i].len);
+
+    token_array_init(tokarr, arena, header->num_tokens + 1);
+    memcpy(tokarr->tokens, tokens, sizeof(struct token) * header->num_tokens);
+    tokarr->len = header->num_tokens;
+    for (size_t i = 0; i < tokarr->len; i++) {
+        struct token *const tok = &tokarr->tokens[i];
+        if (tok->type == TOKEN_IDENTIFER) tok->atom = atoms[tok->atom];
+        tok->file = src->id;
+    }
+    free(atoms);
+
+    /* The modification time orders entries for eviction. */
+    if (time(NULL) - st.st_mtime > TOUCH_INTERVAL) utime(path, NULL);
+    munmap(map, st.st_size);
+    free(path);
+
+    STATS_ADD_ATOMIC(hits, 0, 1);
+    STATS_END(load_phase);
+    return 0;
+}
+
+void token_cache_store(const struct source *src, bool pp_tokens,
+                       uint64_t hash, const struct token_array *tokarr) {
+    struct cache_header header;
+    struct token *tokens;
+    struct cache_name *names;
+    size_t num_names = 0;
+    size_t payload_size;
+    uint32_t *index;
+    char *payload;
+    char *path;
+    char *tmp;
+    FILE *fp;
+    struct stat st;
+    bool ok;
+
+    if (cache.dir == NULL) return;
+    /* Offsets and lengths of names are 32-bit. */
+    if (src->len > UINT32_MAX) return;
+
+    /* Local name index + 1 of each atom, 0 if not seen yet. */
+    index = calloc(atom_count() + 1, sizeof(uint32_t));
+    payload_size = sizeof(struct token) * tokarr->len
+                   + sizeof(struct cache_name) * tokarr->len;
+    payload = malloc(payload_size ? payload_size : 1);
+    if (index == NULL || payload == NULL) {
+        free(index);
+        free(payload);
+        return;
+    }
+    tokens = (struct token *)payload;
+    names = (struct cache_name *)(tokens + tokarr->len);
+
+    /* The tokens are copied field by field over zeroes, so that the padding
+       of struct token is zero and the same entry is written for the same
+       tokens. The file is that of the source loading them. */
+    memset(tokens, 0, sizeof(struct token) * tokarr->len);
+    for (size_t i = 0; i < tokarr->len; i++) {
+        struct token *const tok = &tokens[i];
+        const struct token *const from = &tokarr->tokens[i];
+
+        tok->type = from->type;
+        tok->atom = from->atom;
+        tok->offset = from->offset;
+        tok->len = from->len;
+        tok->flags = from->flags;
+        tok->int_value = from->int_value;
+        if (tok->type != TOKEN_IDENTIFER) continue;
+        if (index[tok->atom] == 0) {
+            names[num_names].offset = tok->offset;
+            names[num_names].len = tok->len;
+            index[tok->atom] = ++num_names;
+        }
+        tok->atom = index[tok->atom] - 1;
+    }
+    free(index);
+    /* Close up the table of names after the tokens. */
+    payload_size = sizeof(struct token) * tokarr->len
+                   + sizeof(struct cache_name) * num_names;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, magic, sizeof(magic));
+    header.format = TOKEN_CACHE_FORMAT;
+    header.lexer_version = LEXER_VERSION;
+    header.token_size = sizeof(struct token);
+    header.flags = pp_tokens ? TOKEN_CACHE_PP_TOKENS : 0;
+    header.source_hash = hash;
+    header.source_len = src->len;
+    header.num_tokens = tokarr->len;
+    header.num_names = num_names;
+    header.checksum = hash_contents(payload, payload_size);
+
+    path = entry_path(hash, pp_tokens);
+    tmp = path ? format_path("%s.%ld.%zu.tmp", path, (long)getpid(),
+                             __atomic_fetch_add(&cache.tmp_count, 1,
+                                                __ATOMIC_RELAXED))
+               : NULL;
+    if (tmp == NULL) {
+        free(path);
+        free(payload);
+        return;
+    }
+
+    fp = fopen(tmp, "wb");
+    ok = fp != NULL;
+    if (ok) {
+        ok = fwrite(&header, sizeof(header), 1, fp) == 1
+             && fwrite(payload, 1, payload_size, fp) == payload_size;
+        ok = !fclose(fp) && ok;
+    }
+    if (ok) {
+        /* An entry replaced, e.g. a damaged one, no longer counts. */
+        pthread_mutex_lock(&cache.lock);
+        if (cache.size != (size_t)-1 && stat(path, &st) == 0)
+            cache.size -= (size_t)st.st_size < cache.size
+                          ? (size_t)st.st_size : cache.size;
+        ok = rename(tmp, path) == 0;
+        if (ok) {
+            STATS_ADD_ATOMIC(stores, 0, 1);
+            if (cache.size == (size_t)-1) cache.size = scan_dir(NULL, NULL);
+            else cache.size += sizeof(header) + payload_size;
+            if (cache.size > cache.max_bytes) evict(path);
+        } else if (cache.size != (size_t)-1 && stat(path, &st) == 0) {
+            cache.size += st.st_size;
+        }
+        pthread_mutex_unlock(&cache.lock);
+    }
+    if (!ok) unlink(tmp);
+
+    free(tmp);
+    free(path);
+    free(payload);
+}
+
+/* Path formatted from fmt into a new buffer of its length, or NULL if it
+   cannot be allocated. */
+static char *format_path(const char *fmt, ...) {
+    va_list ap;
+    int len;
+    char *path;
+
+    va_start(ap, fmt);
+    len = vsnprintf(NULL, 0, fmt, ap);
+    va_end(ap);
+    if (len < 0 || (path = malloc((size_t)len + 1)) == NULL) return NULL;
+    va_start(ap, fmt);
+    vsnprintf(path, (size_t)len + 1, fmt, ap);
+    va_end(ap);
+    return path;
+}
+
+static char *entry_path(uint64_t hash, bool pp_tokens) {
+    return format_path("%s/%016lx-v%u%s.tok", cache.dir, (unsigned long)hash,
+                       LEXER_VERSION, pp_tokens ? "p" : "");
+}
+
+/* Whether the entry mapped at map is sound and made from src. */
+static int check_entry(const struct source *src, uint32_t flags,
+                       uint64_t hash, const char *map, size_t size) {
+    const struct cache_header *const header = (const struct cache_header *)map;
+    const struct token *const tokens = (const struct token *)(header + 1);
+    const struct cache_name *names;
+
+    if (memcmp(header->magic, magic, sizeof(magic))
+        || header->format != TOKEN_CACHE_FORMAT
+        || header->lexer_version != LEXER_VERSION
+        || header->token_size != sizeof(struct token)
+        || header->flags != flags
+        || header->source_hash != hash
+        || header->source_len != src->len)
+        return -1;
+
+    /* The counts must add up to the size, without overflowing. */
+    if (header->num_tokens > size / sizeof(struct token)
+        || header->num_names > size / sizeof(struct cache_name)
+        || sizeof(*header) + sizeof(struct token) * header->num_tokens
+           + sizeof(struct cache_name) * header->num_names != size)
+        return -1;
+    if (hash_contents(header + 1, size - sizeof(*header)) != header->checksum)
+        return -1;
+
+    names = (const struct cache_name *)(tokens + header->num_tokens);
+    for (size_t i = 0; i < header->num_names; i++)
+        if (names[i].offset > src->len
+            || names[i].len > src->len - names[i].offset)
+            return -1;
+    for (size_t i = 0; i < header->num_tokens; i++) {
+        const struct token *const tok = &tokens[i];
+        if ((unsigned)tok->type > TOKEN_INDETERMINATE
+            || tok->offset > src->len || tok->len > src->len - tok->offset
+            || (tok->type == TOKEN_IDENTIFER
+                && tok->atom >= header->num_names))
+            return -1;
+    }
+    return 0;
+}
+
+/* Total size of the entries in the directory, and the entries themselves
+   if entries is not NULL. Stale temporary files are removed. */
+static size_t scan_dir(struct cache_entry **entries, size_t *num_entries) {
+    DIR *const dir = opendir(cache.dir);
+    const time_t now = time(NULL);
+    size_t capacity = 0;
+    size_t total = 0;
+    struct dirent *ent;
+
+    if (entries) {
+        *entries = NULL;
+        *num_entries = 0;
+    }
+    if (dir == NULL) return 0;
+
+    while ((ent = readdir(dir))) {
+        const size_t len = strlen(ent->d_name);
+        const bool is_tmp = len > 4 && !strcmp(ent->d_name + len - 4, ".tmp");
+        char *path;
+        struct stat st;
+
+        if (!is_tmp && (len < 4 || strcmp(ent->d_name + len - 4, ".tok")))
+            continue;
+        path = format_path("%s/%s", cache.dir, ent->d_name);
+        if (path == NULL || stat(path, &st)) {
+            free(path);
+            continue;
+        }
+        if (is_tmp) {
+            if (now - st.st_mtime > STALE_TMP_AGE) unlink(path);
+            free(path);
+            continue;
+        }
+
+        total += st.st_size;
+        if (entries == NULL) {
+            free(path);
+            continue;
+        }
+        if (*num_entries == capacity) {
+            capacity = capacity ? 2 * capacity : 64;
+            *entries = realloc(*entries,
+                               sizeof(struct cache_entry) * capacity);
+        }
+        (*entries)[*num_entries].name = path;
+        (*entries)[*num_entries].size = st.st_size;
+        (*entries)[*num_entries].mtime = st.st_mtim;
+        (*num_entries)++;
+    }
+    closedir(dir);
+    return total;
+}
+
+/* Remove the least recently used entries other than keep, down to three
+   quarters of the limit so that eviction does not run on every store. */
+static void evict(const char *keep) {
+    struct cache_entry *entries;
+    size_t num_entries;
+    size_t total = scan_dir(&entries, &num_entries);
+
+    qsort(entries, num_entries, sizeof(struct cache_entry), compare_entries);
+    for (size_t i = 0; i < num_entries; i++) {
+        if (total > cache.max_bytes / 4 * 3 && strcmp(entries[i].name, keep)
+            && unlink(entries[i].name) == 0) {
+            total -= entries[i].size;
+            STATS_ADD_ATOMIC(evictions, 0, 1);
+        }
+        free(entries[i].name);
+    }
+    free(entries);
+    cache.size = total;
+}
+
+static int compare_entries(const void *a, const void *b) {
+    const struct cache_entry *const x = a;
+    const struct cache_entry *const y = b;
+
+    if (x->mtime.tv_sec != y->mtime.tv_sec)
+        return (x->mtime.tv_sec > y->mtime.tv_sec)
+               - (x->mtime.tv_sec < y->mtime.tv_sec);
+    return (x->mtime.tv_nsec > y->mtime.tv_nsec)
+           - (x->mtime.tv_nsec < y->mtime.tv_nsec);
+}
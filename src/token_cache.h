@@ -0,0 +1,43 @@
+#ifndef TOKEN_CACHE_H
+#define TOKEN_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lexer.h"
+#include "source.h"
+#include "utils.h"
+
+/* Persistent cache of token streams, shared by all runs that use the same
+   directory. A source's entry is keyed by a hash of its contents and by
+   LEXER_VERSION, and is a versioned binary file that is mapped to be loaded:
+   the tokens are copied out as they are, and identifiers are interned from
+   a table of their first occurrences, so that a hit does no scanning.
+
+   Each entry carries a checksum, and is checked against the source before
+   use; a bad one is treated as a miss and replaced. Entries are written to
+   a temporary file that is renamed into place, so concurrent runs never see
+   a partial one. When the directory grows past its size limit, the least
+   recently used entries are removed.
+
+   The cache is process-wide and off until token_cache_open(). */
+#define TOKEN_CACHE_DEFAULT_SIZE (256 * 1024 * 1024)
+
+/* Use dir, which is created if missing, keeping it under max_bytes. Returns
+   0 on success and -1 if dir cannot be used. */
+int token_cache_open(const char *dir, size_t max_bytes);
+void token_cache_close(void);
+bool token_cache_enabled(void);
+
+/* Load the tokens of src into tokarr, allocated from arena. Returns 0 on a
+   hit and -1 on a miss. *hash is set to the hash of the contents of src,
+   for token_cache_store(). */
+int token_cache_load(const struct source *src, bool pp_tokens,
+                     struct arena *arena, uint64_t *hash,
+                     struct token_array *tokarr);
+/* Store the tokens of src, lexed after a miss. Errors are ignored. */
+void token_cache_store(const struct source *src, bool pp_tokens,
+                       uint64_t hash, const struct token_array *tokarr);
+
+#endif
@@ -0,0 +1,95 @@
+#include "token_store.h"
+#include "intern.h"
+
+#include <string.h>
+
+_Static_assert(TOKEN_INDETERMINATE <= UINT8_MAX, "token type must fit in a byte");
+
+static void token_store_alloc(struct token_store *store, struct arena *arena,
+                              size_t capacity, bool with_payloads);
+
+void token_store_init(struct token_store *store, struct arena *arena,
+                      size_t capacity, bool with_payloads) {
+    store->len = 0;
+    token_store_alloc(store, arena, capacity, with_payloads);
+}
+
+void token_store_append(struct token_store *store, struct arena *arena,
+                        const struct token *tok) {
+    const size_t i = store->len;
+
+    if (store->len == store->capacity) {
+        struct token_store old = *store;
+
+        token_store_alloc(store, arena, 2 * old.capacity + 16,
+                          old.payloads != NULL);
+        memcpy(store->types, old.types, old.len * sizeof(uint8_t));
+        memcpy(store->offsets, old.offsets, old.len * sizeof(uint32_t));
+        memcpy(store->lens, old.lens, old.len * sizeof(uint32_t));
+        memcpy(store->flags, old.flags, old.len * sizeof(uint16_t));
+        memcpy(store->files, old.files, old.len * sizeof(uint16_t));
+        if (old.payloads) {
+            memcpy(store->payloads, old.payloads, old.len * sizeof(uint32_t));
+            memcpy(store->values, old.values, old.len * sizeof(uint64_t));
+        }
+    }
+
+    store->types[i] = tok->type;
+    store->offsets[i] = tok->offset;
+    store->lens[i] = tok->len;
+    store->flags[i] = tok->flags;
+    store->files[i] = tok->file;
+    if (store->payloads) {
+        store->payloads[i] = tok->atom;
+        store->values[i] = tok->int_value;
+    }
+    store->len++;
+}
+
+void token_store_from_array(struct token_store *store, struct arena *arena,
+                            const struct token_array *tokarr,
+                            bool with_payloads) {
+    token_store_init(store, arena, tokarr->len, with_payloads);
+    for (size_t i = 0; i < tokarr->len; i++)
+        token_store_append(store, arena, &tokarr->tokens[i]);
+}
+
+void token_store_get(const struct token_store *store, size_t i,
+                     struct token *tok) {
+    tok->type = store->types[i];
+    tok->atom = store->payloads ? store->payloads[i] : ATOM_NONE;
+    tok->int_value = store->payloads ? store->values[i] : 0;
+    tok->offset = store->offsets[i];
+    tok->len = store->lens[i];
+    tok->flags = store->flags[i];
+    tok->file = store->files[i];
+}
+
+size_t token_store_find(const struct token_store *store, size_t from,
+                        enum token_type type) {
+    const uint8_t *found;
+
+    if (from >= store->len) return store->len;
+    found = memchr(store->types + from, type, store->len - from);
+    return found ? (size_t)(found - store->types) : store->len;
+}
+
+static void token_store_alloc(struct token_store *store, struct arena *arena,
+                              size_t capacity, bool with_payloads) {
+    store->capacity = capacity;
+    store->types = arena_alloc(arena, capacity * sizeof(uint8_t), 1);
+    store->offsets = arena_alloc(arena, capacity * sizeof(uint32_t),
+                                 _Alignof(uint32_t));
+    store->lens = arena_alloc(arena, capacity * sizeof(uint32_t),
+                              _Alignof(uint32_t));
+    store->flags = arena_alloc(arena, capacity * sizeof(uint16_t),
+                               _Alignof(uint16_t));
+    store->files = arena_alloc(arena, capacity * sizeof(uint16_t),
+                               _Alignof(uint16_t));
+    store->payloads = with_payloads
+        ? arena_alloc(arena, capacity * sizeof(uint32_t), _Alignof(uint32_t))
+        : NULL;
+    store->values = with_payloads
+        ? arena_alloc(arena, capacity * sizeof(uint64_t), _Alignof(uint64_t))
+        : NULL;
+}
@@ -0,0 +1,50 @@
+#ifndef TOKEN_STORE_H
+#define TOKEN_STORE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lexer.h"
+#include "utils.h"
+
+/* Compact token storage as a struct of arrays: a one-byte type, a 32-bit
+   offset, a 32-bit length, and the 16-bit flags and source id per token,
+   i.e. 13 bytes per token against the 32 of struct token. A parser that
+   only looks at token types walks the types array alone, 64 tokens per
+   cache line.
+
+   Payloads are kept in optional side tables parallel to the others: the atom
+   of an identifier or the type and flags of a constant, and the value of a
+   constant. Both are 0 for every other token. */
+struct token_store {
+    size_t len;
+    size_t capacity;
+    uint8_t *types;
+    uint32_t *offsets;
+    uint32_t *lens;
+    uint16_t *flags;
+    uint16_t *files;
+    uint32_t *payloads;
+    uint64_t *values;
+};
+
+/* All arrays are allocated from arena. Growing the store reallocates them,
+   so prefer token_store_from_array() when the token count is known. */
+void token_store_init(struct token_store *store, struct arena *arena,
+                      size_t capacity, bool with_payloads);
+void token_store_append(struct token_store *store, struct arena *arena,
+                        const struct token *tok);
+
+void token_store_from_array(struct token_store *store, struct arena *arena,
+                            const struct token_array *tokarr,
+                            bool with_payloads);
+void token_store_get(const struct token_store *store, size_t i,
+                     struct token *tok);
+
+/* Index of the first token of the given type at or after from, or store->len
+   if there is none. Only the types array is read. */
+size_t token_store_find(const struct token_store *store, size_t from,
+                        enum token_type type);
+
+#endif
@@ -0,0 +1,320 @@
+#include "type.h"
+#include "intern.h"
+#include <stdio.h>
+#include <string.h>
+
+/* The basic types and pointers to them are shared by every compilation,
+   and so never point to types allocated from an arena. */
+#define BASIC_TYPE(kind, size, pointer)                                     \
+    {kind, size, size, false, NULL, 0, NULL, false, false, ATOM_NONE,       \
+     NULL, 0, pointer, true}
+#define BASIC_POINTER(base)                                                 \
+    {TYPE_POINTER, 8, 8, false, base, 0, NULL, false, false, ATOM_NONE,     \
+     NULL, 0, NULL, true}
+
+static struct type pointer_void = BASIC_POINTER(&type_void);
+static struct type pointer_bool = BASIC_POINTER(&type_bool);
+static struct type pointer_char = BASIC_POINTER(&type_char);
+static struct type pointer_schar = BASIC_POINTER(&type_schar);
+static struct type pointer_uchar = BASIC_POINTER(&type_uchar);
+static struct type pointer_short = BASIC_POINTER(&type_short);
+static struct type pointer_ushort = BASIC_POINTER(&type_ushort);
+static struct type pointer_int = BASIC_POINTER(&type_int);
+static struct type pointer_uint = BASIC_POINTER(&type_uint);
+static struct type pointer_long = BASIC_POINTER(&type_long);
+static struct type pointer_ulong = BASIC_POINTER(&type_ulong);
+static struct type pointer_llong = BASIC_POINTER(&type_llong);
+static struct type pointer_ullong = BASIC_POINTER(&type_ullong);
+static struct type pointer_float = BASIC_POINTER(&type_float);
+static struct type pointer_double = BASIC_POINTER(&type_double);
+static struct type pointer_ldouble = BASIC_POINTER(&type_ldouble);
+
+struct type type_void = BASIC_TYPE(TYPE_VOID, 1, &pointer_void);
+struct type type_bool = BASIC_TYPE(TYPE_BOOL, 1, &pointer_bool);
+struct type type_char = BASIC_TYPE(TYPE_CHAR, 1, &pointer_char);
+struct type type_schar = BASIC_TYPE(TYPE_SCHAR, 1, &pointer_schar);
+struct type type_uchar = BASIC_TYPE(TYPE_UCHAR, 1, &pointer_uchar);
+struct type type_short = BASIC_TYPE(TYPE_SHORT, 2, &pointer_short);
+struct type type_ushort = BASIC_TYPE(TYPE_USHORT, 2, &pointer_ushort);
+struct type type_int = BASIC_TYPE(TYPE_INT, 4, &pointer_int);
+struct type type_uint = BASIC_TYPE(TYPE_UINT, 4, &pointer_uint);
+struct type type_long = BASIC_TYPE(TYPE_LONG, 8, &pointer_long);
+struct type type_ulong = BASIC_TYPE(TYPE_ULONG, 8, &pointer_ulong);
+struct type type_llong = BASIC_TYPE(TYPE_LLONG, 8, &pointer_llong);
+struct type type_ullong = BASIC_TYPE(TYPE_ULLONG, 8, &pointer_ullong);
+struct type type_float = BASIC_TYPE(TYPE_FLOAT, 4, &pointer_float);
+struct type type_double = BASIC_TYPE(TYPE_DOUBLE, 8, &pointer_double);
+struct type type_ldouble = BASIC_TYPE(TYPE_LDOUBLE, 8, &pointer_ldouble);
+
+static struct type *new_type(struct arena *arena, enum type_kind kind,
+                             size_t size, size_t align);
+static void append(struct string *str, const char *s);
+static void spell_prefix(const struct type *type, struct string *str);
+static void spell_suffix(const struct type *type, struct string *str);
+
+static struct type *new_type(struct arena *arena, enum type_kind kind,
+                             size_t size, size_t align) {
+    struct type *const type = arena_alloc(arena, sizeof(struct type),
+                                          _Alignof(struct type));
+
+    memset(type, 0, sizeof(struct type));
+    type->kind = kind;
+    type->size = size;
+    type->align = align;
+    type->tag = ATOM_NONE;
+    return type;
+}
+
+struct type *type_pointer(struct arena *arena, struct type *base) {
+    struct type *type = base->pointer;
+
+    if (type) return type;
+    type = new_type(arena, TYPE_POINTER, 8, 8);
+    type->base = base;
+    if (!base->shared) base->pointer = type;
+    return type;
+}
+
+struct type *type_array(struct arena *arena, struct type *base, size_t len,
+                        bool incomplete) {
+    struct type *const type = new_type(arena, TYPE_ARRAY,
+                                       incomplete ? 0 : base->size * len,
+                                       base->align);
+
+    type->base = base;
+    type->len = incomplete ? 0 : len;
+    type->incomplete = incomplete;
+    return type;
+}
+
+struct type *type_function(struct arena *arena, struct type *ret,
+                           struct type *const *params, size_t num_params,
+                           bool variadic, bool prototyped) {
+    struct type *const type = new_type(arena, TYPE_FUNCTION, 1, 1);
+
+    type->base = ret;
+    type->len = num_params;
+    if (num_params) {
+        type->params = arena_alloc(arena, sizeof(struct type *) * num_params,
+                                   _Alignof(struct type *));
+        memcpy(type->params, params, sizeof(struct type *) * num_params);
+    }
+    type->variadic = variadic;
+    type->prototyped = prototyped;
+    return type;
+}
+
+struct type *type_record(struct arena *arena, enum type_kind kind,
+                         uint32_t tag) {
+    struct type *const type = new_type(arena, kind, 0, 1);
+
+    type->tag = tag;
+    type->incomplete = true;
+    return type;
+}
+
+void type_complete(struct type *type, struct arena *arena,
+                   const struct member *members, size_t num_members) {
+    size_t size = 0;
+    size_t align = 1;
+
+    type->members = arena_alloc(arena, sizeof(struct member) * num_members
+                                       + 1, _Alignof(struct member));
+    memcpy(type->members, members, sizeof(struct member) * num_members);
+    type->num_members = num_members;
+
+    for (size_t i = 0; i < num_members; i++) {
+        struct member *const m = &type->members[i];
+        const size_t a = m->type->align;
+
+        if (type->kind == TYPE_STRUCT) {
+            size = (size + a - 1) & ~(a - 1);
+            m->offset = size;
+            size += m->type->size;
+        } else {
+            m->offset = 0;
+            if (m->type->size > size) size = m->type->size;
+        }
+        if (a > align) align = a;
+    }
+    type->size = (size + align - 1) & ~(align - 1);
+    type->align = align;
+    type->incomplete = false;
+}
+
+const struct member *type_member(const struct type *type, uint32_t name,
+                                 size_t *offset) {
+    for (size_t i = 0; i < type->num_members; i++) {
+        const struct member *const m = &type->members[i];
+
+        if (m->name == name) {
+            *offset = m->offset;
+            return m;
+        }
+        if (m->name == ATOM_NONE && type_is_record(m->type)) {
+            const struct member *const inner = type_member(m->type, name,
+                                                           offset);
+            if (inner) {
+                *offset += m->offset;
+                return inner;
+            }
+        }
+    }
+    return NULL;
+}
+
+bool type_is_unsigned(const struct type *type) {
+    switch (type->kind) {
+    case TYPE_BOOL:
+    case TYPE_UCHAR:
+    case TYPE_USHORT:
+    case TYPE_UINT:
+    case TYPE_ULONG:
+    case TYPE_ULLONG:
+    case TYPE_POINTER:
+        return true;
+    default:
+        return false;
+    }
+}
+
+struct type *type_promote(struct type *type) {
+    if (type->kind >= TYPE_BOOL && type->kind <= TYPE_USHORT)
+        return &type_int;
+    return type;
+}
+
+struct type *type_common(struct type *a, struct type *b) {
+    if (a->kind == TYPE_LDOUBLE || b->kind == TYPE_LDOUBLE)
+        return &type_ldouble;
+    if (a->kind == TYPE_DOUBLE || b->kind == TYPE_DOUBLE) return &type_double;
+    if (a->kind == TYPE_FLOAT || b->kind == TYPE_FLOAT) return &type_float;
+
+    a = type_promote(a);
+    b = type_promote(b);
+    if (a->kind == b->kind) return a;
+    if (type_is_unsigned(a) == type_is_unsigned(b))
+        return a->kind > b->kind ? a : b;
+    /* One is signed and the other unsigned: make a the unsigned one. The
+       signed type wins if it is larger, and so can represent every value
+       of the other; if of the same size but higher rank, as long long is
+       to unsigned long, its unsigned counterpart wins. */
+    if (type_is_unsigned(b)) {
+        struct type *const t = a;
+        a = b;
+        b = t;
+    }
+    if (a->kind > b->kind || a->size >= b->size) {
+        if (a->size == b->size && b->kind > a->kind)
+            return b->kind == TYPE_LLONG ? &type_ullong : &type_ulong;
+        return a;
+    }
+    return b;
+}
+
+bool type_equal(const struct type *a, const struct type *b) {
+    if (a == b) return true;
+    if (a->kind != b->kind) return false;
+
+    switch (a->kind) {
+    case TYPE_POINTER:
+        return type_equal(a->base, b->base);
+    case TYPE_ARRAY:
+        return (a->incomplete || b->incomplete || a->len == b->len)
+               && type_equal(a->base, b->base);
+    case TYPE_FUNCTION:
+        if (!type_equal(a->base, b->base)) return false;
+        if (!a->prototyped || !b->prototyped) return true;
+        if (a->len != b->len || a->variadic != b->variadic) return false;
+        for (size_t i = 0; i < a->len; i++)
+            if (!type_equal(a->params[i], b->params[i])) return false;
+        return true;
+    case TYPE_STRUCT:
+    case TYPE_UNION:
+        return false;
+    default:
+        return true;
+    }
+}
+
+static void append(struct string *str, const char *s) {
+    string_append_n(str, s, strlen(s));
+}
+
+const char *type_kind_name(enum type_kind kind) {
+    static const char *const names[] = {
+        "void", "_Bool", "char", "signed char", "unsigned char", "short",
+        "unsigned short", "int", "unsigned int", "long", "unsigned long",
+        "long long", "unsigned long long", "float", "double", "long double",
+    };
+
+    return names[kind];
+}
+
+void type_spell(const struct type *type, struct string *str) {
+    spell_prefix(type, str);
+    spell_suffix(type, str);
+}
+
+/* The specifiers and pointer declarators, which are written outwards from
+   the name, and the suffixes, written inwards. */
+static void spell_prefix(const struct type *type, struct string *str) {
+    switch (type->kind) {
+    case TYPE_POINTER:
+        spell_prefix(type->base, str);
+        if (type->base->kind == TYPE_ARRAY
+            || type->base->kind == TYPE_FUNCTION)
+            append(str, " (*");
+        else if (str->len && str->arr[str->len - 1] == '*')
+            append(str, "*");
+        else
+            append(str, " *");
+        break;
+    case TYPE_ARRAY:
+    case TYPE_FUNCTION:
+        spell_prefix(type->base, str);
+        break;
+    case TYPE_STRUCT:
+    case TYPE_UNION:
+        append(str, type->kind == TYPE_STRUCT ? "struct " : "union ");
+        append(str, type->tag ? atom_spelling(type->tag) : "<anonymous>");
+        break;
+    default:
+        append(str, type_kind_name(type->kind));
+    }
+}
+
+static void spell_suffix(const struct type *type, struct string *str) {
+    char buf[32];
+
+    switch (type->kind) {
+    case TYPE_POINTER:
+        if (type->base->kind == TYPE_ARRAY
+            || type->base->kind == TYPE_FUNCTION)
+            append(str, ")");
+        spell_suffix(type->base, str);
+        break;
+    case TYPE_ARRAY:
+        if (type->incomplete) {
+            append(str, "[]");
+        } else {
+            snprintf(buf, sizeof(buf), "[%zu]", type->len);
+            append(str, buf);
+        }
+        spell_suffix(type->base, str);
+        break;
+    case TYPE_FUNCTION:
+        append(str, "(");
+        for (size_t i = 0; i < type->len; i++) {
+            if (i) append(str, ", ");
+            type_spell(type->params[i], str);
+        }
+        if (type->variadic) append(str, type->len ? ", ..." : "...");
+        else if (type->prototyped && !type->len) append(str, "void");
+        append(str, ")");
+        spell_suffix(type->base, str);
+        break;
+    default:
+        break;
+    }
+}
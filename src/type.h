@@ -0,0 +1,161 @@
+#ifndef TYPE_H
+#define TYPE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "utils.h"
+
+/* Kinds of C types, for an LP64 target: int is 32 bits, long, long long,
+   and pointers 64 bits, and plain char is signed. long double is given the
+   representation of double, the precision cisc evaluates it in. */
+enum type_kind {
+    TYPE_VOID,
+    /* Integer types, by rank; each signed type comes just before the
+       unsigned type of the same rank. */
+    TYPE_BOOL,
+    TYPE_CHAR,
+    TYPE_SCHAR,
+    TYPE_UCHAR,
+    TYPE_SHORT,
+    TYPE_USHORT,
+    TYPE_INT,
+    TYPE_UINT,
+    TYPE_LONG,
+    TYPE_ULONG,
+    TYPE_LLONG,
+    TYPE_ULLONG,
+    /* Floating types. */
+    TYPE_FLOAT,
+    TYPE_DOUBLE,
+    TYPE_LDOUBLE,
+    /* Derived types. */
+    TYPE_POINTER,
+    TYPE_ARRAY,
+    TYPE_FUNCTION,
+    TYPE_STRUCT,
+    TYPE_UNION,
+};
+
+struct type;
+
+/* Member of a structure or union. The members of an anonymous structure or
+   union member are found through it, which has no name. */
+struct member {
+    uint32_t name;
+    struct type *type;
+    size_t offset;
+};
+
+/* Types are never freed, and those other than the basic types below and
+   pointers to them are allocated from the arena given to their
+   constructor. Qualifiers are not
+   represented: they do not change how a value is stored. */
+struct type {
+    enum type_kind kind;
+    /* Size and alignment in bytes. The size of an incomplete type is 0. */
+    size_t size;
+    size_t align;
+    /* An array of unknown length, or a structure or union whose members are
+       not declared yet. */
+    bool incomplete;
+
+    /* Pointed-to type, element type, or return type. */
+    struct type *base;
+    /* Number of elements of an array, or of parameters of a function. */
+    size_t len;
+
+    /* Function: parameter types, and whether it takes more arguments after
+       them or has no prototype. */
+    struct type **params;
+    bool variadic;
+    bool prototyped;
+
+    /* Structure or union: tag atom, or ATOM_NONE, and members. */
+    uint32_t tag;
+    struct member *members;
+    size_t num_members;
+
+    /* Pointer to this type, made on first use. */
+    struct type *pointer;
+    /* Statically allocated, and shared by all compilations: the types
+       derived from it are not kept in it. */
+    bool shared;
+};
+
+extern struct type type_void;
+extern struct type type_bool;
+extern struct type type_char;
+extern struct type type_schar;
+extern struct type type_uchar;
+extern struct type type_short;
+extern struct type type_ushort;
+extern struct type type_int;
+extern struct type type_uint;
+extern struct type type_long;
+extern struct type type_ulong;
+extern struct type type_llong;
+extern struct type type_ullong;
+extern struct type type_float;
+extern struct type type_double;
+extern struct type type_ldouble;
+
+struct type *type_pointer(struct arena *arena, struct type *base);
+/* Array of len elements, or of unknown length if incomplete. */
+struct type *type_array(struct arena *arena, struct type *base, size_t len,
+                        bool incomplete);
+/* The parameter types are copied. */
+struct type *type_function(struct arena *arena, struct type *ret,
+                           struct type *const *params, size_t num_params,
+                           bool variadic, bool prototyped);
+/* Structure or union, incomplete until type_complete(). */
+struct type *type_record(struct arena *arena, enum type_kind kind,
+                         uint32_t tag);
+/* Lay out the members of a structure or union in order, which are
+   copied. */
+void type_complete(struct type *type, struct arena *arena,
+                   const struct member *members, size_t num_members);
+
+/* Find the member called name, looking into anonymous members, and store
+   its offset from the start of type into *offset. Returns NULL if there is
+   none. */
+const struct member *type_member(const struct type *type, uint32_t name,
+                                 size_t *offset);
+
+static inline bool type_is_integer(const struct type *type) {
+    return type->kind >= TYPE_BOOL && type->kind <= TYPE_ULLONG;
+}
+
+static inline bool type_is_floating(const struct type *type) {
+    return type->kind >= TYPE_FLOAT && type->kind <= TYPE_LDOUBLE;
+}
+
+static inline bool type_is_arithmetic(const struct type *type) {
+    return type->kind >= TYPE_BOOL && type->kind <= TYPE_LDOUBLE;
+}
+
+static inline bool type_is_scalar(const struct type *type) {
+    return type->kind >= TYPE_BOOL && type->kind <= TYPE_POINTER;
+}
+
+static inline bool type_is_record(const struct type *type) {
+    return type->kind == TYPE_STRUCT || type->kind == TYPE_UNION;
+}
+
+bool type_is_unsigned(const struct type *type);
+
+/* Integer promotion of an arithmetic type. */
+struct type *type_promote(struct type *type);
+/* Common type of the usual arithmetic conversions. */
+struct type *type_common(struct type *a, struct type *b);
+
+/* Whether two types are the same type, ignoring qualifiers. */
+bool type_equal(const struct type *a, const struct type *b);
+
+/* Spelling of a basic type, of kind TYPE_VOID to TYPE_LDOUBLE. */
+const char *type_kind_name(enum type_kind kind);
+/* Spell a type as in a declaration with no name, e.g. "char (*)[4]". */
+void type_spell(const struct type *type, struct string *str);
+
+#endif
@@ -1,48 +1,193 @@
 #include "utils.h"
+#include "stats.h"
 #include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include <string.h>
 
+STATS_COUNTER(string_reallocs, "string.reallocs");
+
 void string_init(struct string *str) {
     str->len = 0;
-    str->capacity = 0;
-    str->arr = NULL;
+    str->capacity = STRING_INLINE_SIZE;
+    str->arr = str->inline_arr;
+    str->inline_arr[0] = '\0';
 }
 
 void string_destroy(struct string *str) {
+    if (str->arr != str->inline_arr) free(str->arr);
     str->len = -1;
-    str->capacity = -1;
-    free(str->arr);
+    str->capacity = 0;
     str->arr = NULL;
 }
 
-void string_append(struct string *str, char c) {
-    assert(str->len != (size_t)-1);
-
-    if (str->capacity == 0) {
-        str->arr = malloc(16);
-        str->capacity = 16;
-    }
-    else if (str->len+1 == str->capacity) {
-        str->arr = realloc(str->arr, 2 * str->capacity);
-        str->capacity *= 2;
-    }
-    str->arr[str->len] = c;
-    str->len++;
+void string_append_n(struct string *str, const char *s, size_t n) {
+    if (str->len + n >= str->capacity) string_grow(str, str->len + n + 1);
+    memcpy(str->arr + str->len, s, n);
+    str->len += n;
     str->arr[str->len] = '\0';
 }
 
+void string_reserve(struct string *str, size_t n) {
+    if (str->len + n >= str->capacity) string_grow(str, str->len + n + 1);
+}
+
 void string_clear(struct string *str) {
     assert(str->len != (size_t)-1);
 
     str->len = 0;
-    if (str->arr != NULL) str->arr[0] = '\0';
+    str->arr[0] = '\0';
 }
 
 void string_copy(struct string *dest, struct string *src) {
-    assert(!dest->len && !dest->capacity && !dest->arr);
+    assert(dest->len == 0);
+
+    string_append_n(dest, src->arr, src->len);
+}
+
+void string_grow(struct string *str, size_t capacity) {
+    size_t new_capacity = str->capacity ? str->capacity : STRING_INLINE_SIZE;
+
+    assert(str->len != (size_t)-1);
+
+    if (capacity <= str->capacity) return;
+    while (new_capacity < capacity) new_capacity *= 2;
+    if (str->arr == str->inline_arr) {
+        str->arr = malloc(new_capacity);
+        memcpy(str->arr, str->inline_arr, str->len + 1);
+    } else {
+        STATS_ADD_ATOMIC(string_reallocs, 0, 1);
+        str->arr = realloc(str->arr, new_capacity);
+    }
+    str->capacity = new_capacity;
+}
+
+static uint64_t hash_mix(uint64_t h) {
+    h ^= h >> 31;
+    h *= 0xbf58476d1ce4e5b9;
+    h ^= h >> 29;
+    return h;
+}
+
+uint64_t hash_bytes(const void *data, size_t len) {
+    const unsigned char *p = data;
+    uint64_t h = 0x9e3779b97f4a7c15 ^ len;
+    uint64_t w;
+
+    /* Eight bytes at a time, then the zero-padded tail. */
+    for (; len >= 8; p += 8, len -= 8) {
+        memcpy(&w, p, 8);
+        h = hash_mix(h ^ w) * 0x94d049bb133111eb;
+    }
+    w = 0;
+    memcpy(&w, p, len);
+    return hash_mix(h ^ w);
+}
+
+/* Like hash_bytes(), but runs four independent lanes over 32-byte blocks,
+   which makes it several times faster on long inputs. */
+uint64_t hash_contents(const void *data, size_t len) {
+    const unsigned char *p = data;
+    uint64_t h[4] = {
+        0x9e3779b97f4a7c15 ^ len, 0xbf58476d1ce4e5b9,
+        0x94d049bb133111eb, 0xd6e8feb86659fd93,
+    };
+    uint64_t w;
+
+    for (; len >= 32; p += 32, len -= 32)
+        for (int i = 0; i < 4; i++) {
+            memcpy(&w, p + 8 * i, 8);
+            h[i] = (h[i] ^ w) * 0x94d049bb133111eb;
+            h[i] ^= h[i] >> 29;
+        }
+    return hash_bytes(h, sizeof(h)) ^ hash_bytes(p, len);
+}
+
+struct arena_chunk {
+    struct arena_chunk *next;
+    size_t size;
+    max_align_t data[];
+};
+
+static bool arena_fits(struct arena_chunk *chunk, size_t size, size_t align);
+
+void arena_init(struct arena *arena) {
+    arena->first = NULL;
+    arena->chunk = NULL;
+    arena->ptr = NULL;
+    arena->end = NULL;
+}
+
+void arena_reset(struct arena *arena) {
+    arena->chunk = arena->first;
+    if (arena->chunk) {
+        arena->ptr = (char *)arena->chunk->data;
+        arena->end = arena->ptr + arena->chunk->size;
+    }
+}
+
+void arena_destroy(struct arena *arena) {
+    struct arena_chunk *chunk = arena->first;
+    struct arena_chunk *next;
+
+    while (chunk) {
+        next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    arena_init(arena);
+}
+
+void *arena_alloc(struct arena *arena, size_t size, size_t align) {
+    struct arena_chunk *chunk;
+    char *ptr;
+
+    assert(align && !(align & (align - 1)));
+
+    ptr = (char *)(((uintptr_t)arena->ptr + align - 1) & ~(uintptr_t)(align - 1));
+    if (arena->ptr == NULL || ptr > arena->end
+        || size > (size_t)(arena->end - ptr)) {
+        /* Move on to the next chunk, reusing chunks kept by arena_reset(). */
+        if (arena->chunk && arena_fits(arena->chunk->next, size, align))
+            chunk = arena->chunk->next;
+        else {
+            const size_t min_size = size + align;
+            const size_t chunk_size = min_size > ARENA_CHUNK_SIZE ? min_size : ARENA_CHUNK_SIZE;
+            chunk = malloc(sizeof(struct arena_chunk) + chunk_size);
+            chunk->size = chunk_size;
+            if (arena->chunk) {
+                chunk->next = arena->chunk->next;
+                arena->chunk->next = chunk;
+            } else {
+                chunk->next = arena->first;
+                arena->first = chunk;
+            }
+        }
+        arena->chunk = chunk;
+        arena->end = (char *)chunk->data + chunk->size;
+        ptr = (char *)(((uintptr_t)chunk->data + align - 1) & ~(uintptr_t)(align - 1));
+    }
+
+    arena->ptr = ptr + size;
+    return ptr;
+}
+
+void *arena_grow(struct arena *arena, void *ptr, size_t old_size,
+                 size_t new_size, size_t align) {
+    void *new_ptr;
+
+    /* The most recent allocation is extended in place if the chunk has room. */
+    if ((char *)ptr + old_size == arena->ptr
+        && new_size - old_size <= (size_t)(arena->end - arena->ptr)) {
+        arena->ptr += new_size - old_size;
+        return ptr;
+    }
+
+    new_ptr = arena_alloc(arena, new_size, align);
+    if (old_size) memcpy(new_ptr, ptr, old_size);
+    return new_ptr;
+}
 
-    dest->len = src->len;
-    dest->capacity = src->len + 1;
-    dest->arr = malloc(src->len + 1);
-    strncpy(dest->arr, src->arr, src->len+1);
+static bool arena_fits(struct arena_chunk *chunk, size_t size, size_t align) {
+    return chunk && size + align <= chunk->size;
 }
@@ -1,19 +1,77 @@
 #ifndef UTILS_H
 #define UTILS_H
 
+#include <stdint.h>
 #include <stdlib.h>
 
+/* Growable string, always NUL-terminated at arr[len]. A string shorter than
+   STRING_INLINE_SIZE, as most identifiers and punctuators are, is kept in
+   the struct itself with no allocation, and arr points there: a string must
+   not be moved, only copied with string_copy(). The capacity doubles as it
+   grows, so that appending n bytes reallocates O(log n) times. */
+#define STRING_INLINE_SIZE 16
+
 struct string {
     size_t len;
+    /* Bytes at arr, with the NUL. */
     size_t capacity;
     char *arr;
+    char inline_arr[STRING_INLINE_SIZE];
 };
 
 void string_init(struct string *str);
 void string_destroy(struct string *str);
 
-void string_append(struct string *str, char c);
+static inline void string_append(struct string *str, char c);
+/* Append the n bytes at s, e.g. a span of a source already scanned. */
+void string_append_n(struct string *str, const char *s, size_t n);
+/* Make room for n more bytes, which are then appended with no growing. */
+void string_reserve(struct string *str, size_t n);
 void string_clear(struct string *str);
+/* Copy src into dest, which must be empty. */
 void string_copy(struct string *dest, struct string *src);
 
+/* Grow str to a capacity of at least capacity bytes, with the NUL. */
+void string_grow(struct string *str, size_t capacity);
+
+static inline void string_append(struct string *str, char c) {
+    const size_t len = str->len;
+    char *arr;
+
+    /* A destroyed string has a length of -1 and a capacity of 0, and is
+       caught by string_grow(). */
+    if (len + 1 == str->capacity) string_grow(str, len + 2);
+    arr = str->arr;
+    arr[len] = c;
+    arr[len + 1] = '\0';
+    str->len = len + 1;
+}
+
+uint64_t hash_bytes(const void *data, size_t len);
+/* Like hash_bytes(), but faster on long inputs, such as whole files. */
+uint64_t hash_contents(const void *data, size_t len);
+
+/* Bump-pointer arena. Memory is carved out of chunks of ARENA_CHUNK_SIZE
+   bytes (larger requests get a chunk of their own) and is only released as
+   a whole: arena_reset() rewinds to the first chunk, keeping the chunks for
+   reuse, and arena_destroy() frees them. */
+#define ARENA_CHUNK_SIZE 65536
+
+struct arena_chunk;
+
+struct arena {
+    struct arena_chunk *first;
+    struct arena_chunk *chunk;
+    char *ptr;
+    char *end;
+};
+
+void arena_init(struct arena *arena);
+void arena_reset(struct arena *arena);
+void arena_destroy(struct arena *arena);
+
+void *arena_alloc(struct arena *arena, size_t size, size_t align);
+void *arena_grow(struct arena *arena, void *ptr, size_t old_size,
+                 size_t new_size, size_t align);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,1912 @@
+#include "vm.h"
+#include "host.h"
+#include "intern.h"
+#include "lexer.h"
+#include "preprocessor.h"
+#include "stats.h"
+#include "tier.h"
+#include "type.h"
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Sizes of the stacks: 32 MiB of registers, 8 MiB of frames, as many
+   calls deep as C programs usually get with an 8 MiB stack, and a frame
+   slot for every 8 bytes of frames. */
+#define VM_REGS (4 << 20)
+#define VM_MEMORY (8 << 20)
+#define VM_FRAMES (1 << 18)
+#define VM_LOCALS (1 << 20)
+
+/* Functions of the program that the VM provides when memory is checked,
+   in vm->builtins. */
+enum builtin {
+    BUILTIN_NONE,
+    BUILTIN_MALLOC,
+    BUILTIN_CALLOC,
+    BUILTIN_REALLOC,
+    BUILTIN_FREE,
+    BUILTIN_STRDUP,
+};
+
+/* How many bytes a host function accesses through its buffers: as many
+   as argument size says, as many elements as it says of the size the next
+   says, as the string at argument size takes, with its NUL, as the string
+   at the first buffer does with that appended, or as the string the
+   function formats does. */
+enum buffer_length {
+    LENGTH_ARG,
+    LENGTH_ARRAY,
+    LENGTH_COPY,
+    LENGTH_APPEND,
+    LENGTH_FORMAT,
+};
+
+/* Host functions that access a buffer through pointer arguments: with
+   memory checked, a call to one is checked as the access. */
+static const struct {
+    const char *name;
+    /* The pointer arguments, the second if not -1, and the size. */
+    int8_t buffers[2];
+    int8_t size;
+    uint8_t length;
+} host_buffers[] = {
+    {"memcpy", {0, 1}, 2, LENGTH_ARG},
+    {"memmove", {0, 1}, 2, LENGTH_ARG},
+    {"memcmp", {0, 1}, 2, LENGTH_ARG},
+    {"memset", {0, -1}, 2, LENGTH_ARG},
+    {"memchr", {0, -1}, 2, LENGTH_ARG},
+    {"strncpy", {0, -1}, 2, LENGTH_ARG},
+    {"fgets", {0, -1}, 1, LENGTH_ARG},
+    {"snprintf", {0, -1}, 1, LENGTH_ARG},
+    {"qsort", {0, -1}, 1, LENGTH_ARRAY},
+    {"bsearch", {1, -1}, 2, LENGTH_ARRAY},
+    {"strcpy", {0, -1}, 1, LENGTH_COPY},
+    {"strcat", {0, -1}, 1, LENGTH_APPEND},
+    {"sprintf", {0, -1}, 1, LENGTH_FORMAT},
+};
+
+/* Host functions that read strings, those declared with parameters of
+   type const char * not bounded by a length: with memory checked, the
+   terminating null character of each must be within the object it points
+   into, and so must that of each argument of a %s conversion of the
+   format, if there is one. */
+static const struct {
+    const char *name;
+    /* Bit set of the string arguments, and the format, or -1. */
+    uint8_t strings;
+    int8_t format;
+} host_strings[] = {
+    {"printf", 1, 0},
+    {"fprintf", 2, 1},
+    {"sprintf", 2, 1},
+    {"snprintf", 4, 2},
+    {"puts", 1, -1},
+    {"fputs", 1, -1},
+    {"scanf", 1, -1},
+    {"sscanf", 3, -1},
+    {"fopen", 3, -1},
+    {"perror", 1, -1},
+    {"atoi", 1, -1},
+    {"atol", 1, -1},
+    {"atof", 1, -1},
+    {"strtol", 1, -1},
+    {"strtoul", 1, -1},
+    {"strtod", 1, -1},
+    {"getenv", 1, -1},
+    {"strlen", 1, -1},
+    {"strcmp", 3, -1},
+    {"strchr", 1, -1},
+    {"strrchr", 1, -1},
+    {"strstr", 3, -1},
+};
+
+/* Host functions taking a format, and the argument it is. cisc gives long
+   double the representation of double, so each conversion of a long
+   double in a format is passed as that of a double. */
+static const struct {
+    const char *name;
+    int8_t format;
+} host_formats[] = {
+    {"printf", 0},
+    {"fprintf", 1},
+    {"sprintf", 1},
+    {"snprintf", 2},
+    {"scanf", 0},
+    {"sscanf", 1},
+};
+
+/* Function of the program passed to a host function, which calls it
+   through run_callback(): the VM, the call to the host, and the stacks
+   its activations go on, above those of the caller; status is -1 once one
+   of them has failed, so that the others do nothing until the host
+   function returns. */
+struct vm_callback {
+    struct vm *vm;
+    const struct insn *ip;
+    const struct function *fn;
+    union reg *regs;
+    uint8_t *sp;
+    uint64_t *lp;
+    size_t depth;
+    int status;
+};
+
+extern char **environ;
+
+/* The callback of the host call in progress, if any. */
+static struct vm_callback *callback;
+
+STATS_COUNTER(instructions, "vm.instructions");
+STATS_COUNTER(calls, "vm.calls");
+STATS_PHASE(vm_phase, "vm");
+
+static void runtime_error(const struct vm *vm, const struct insn *ip,
+                          const char *fmt, ...);
+static void runtime_warning(const struct vm *vm, const struct insn *ip,
+                            const char *fmt, ...);
+static void runtime_diagnostic(const struct vm *vm, const struct insn *ip,
+                               const char *severity, const char *fmt,
+                               va_list ap);
+static int handle_overflow(struct vm *vm, const struct insn *ip,
+                           union reg *dst, uint64_t wrapped, int dir);
+static size_t spilled_position(const struct vm *vm, uint64_t base,
+                               uint64_t size);
+static struct vm_object *spill(struct vm *vm, uint64_t base,
+                               uint64_t size);
+static uint64_t new_object(struct vm *vm, enum vm_object_kind kind,
+                           void *base, uint64_t size, uint8_t elem_size,
+                           uint32_t name);
+static void kill_object(struct vm *vm, uint64_t p,
+                        enum vm_object_kind kind);
+static void new_locals(struct vm *vm, const struct function *fn,
+                       uint8_t *fp, uint64_t *locals);
+static void describe_object(const struct vm_object *o, char *buf,
+                            size_t size);
+static const struct vm_object *object_of(const struct vm *vm, uint64_t p,
+                                         uint64_t n);
+static void read_host_ranges(struct vm *vm);
+static bool host_mapped(struct vm *vm, uint64_t addr, uint64_t n);
+static int check_access(struct vm *vm, const struct insn *ip, uint64_t p,
+                        uint64_t n, bool scalar);
+static int call_builtin(struct vm *vm, const struct insn *ip,
+                        enum builtin builtin, union reg *args);
+static int execute(struct vm *vm, const struct function *fn,
+                   union reg *regs, uint8_t *sp, uint64_t *lp, size_t depth,
+                   union reg *result);
+static int host_call(struct vm *vm, const struct insn *ip,
+                     const struct function *host,
+                     const struct call_site *site, union reg *args,
+                     uint8_t *sp, uint64_t *lp, size_t depth);
+static int check_host_call(struct vm *vm, const struct insn *ip,
+                           const struct function *host,
+                           const struct host_signature *sig,
+                           union reg *args);
+static int check_strings(struct vm *vm, const struct insn *ip,
+                         const struct function *host,
+                         const struct host_signature *sig,
+                         const union reg *args);
+static uint64_t string_size(struct vm *vm, uint64_t p);
+static char *double_format(const char *fmt, char *buf, size_t size);
+static int format_length(char *buf, const char *fmt, ...);
+static uint64_t run_callback(uint64_t a0, uint64_t a1, uint64_t a2,
+                             uint64_t a3, uint64_t a4, uint64_t a5);
+static const struct switch_case *find_case(const struct switch_case *cases,
+                                           uint32_t n, int64_t value);
+
+void vm_init(struct vm *vm, const struct program *prog) {
+    memset(vm, 0, sizeof(struct vm));
+    vm->prog = prog;
+
+    vm->data = calloc(prog->data_size ? prog->data_size : 1, 1);
+    memcpy(vm->data, prog->data, prog->data_size);
+    if (prog->memory_checks) {
+        vm->objects = calloc(VM_MAX_OBJECTS, sizeof(struct vm_object));
+        vm->objects[0].name = ATOM_NONE;
+        vm->objects[VM_SPILLED].kind = OBJECT_SPILLED;
+        vm->objects[VM_SPILLED].name = ATOM_NONE;
+        vm->free_objects = malloc(sizeof(uint16_t) * VM_MAX_OBJECTS);
+        for (size_t i = 1; i < VM_SPILLED; i++)
+            vm->free_objects[vm->free_tail++] = i;
+
+        vm->builtins = calloc(prog->num_functions + 1, 1);
+        vm->buffers = calloc(prog->num_functions + 1, 1);
+        vm->strings = calloc(prog->num_functions + 1, 1);
+        for (size_t i = 0; i < prog->num_functions; i++) {
+            const char *const name = atom_spelling(prog->functions[i].name);
+
+            if (prog->functions[i].defined) continue;
+            if (!strcmp(name, "malloc"))
+                vm->builtins[i] = BUILTIN_MALLOC;
+            else if (!strcmp(name, "calloc"))
+                vm->builtins[i] = BUILTIN_CALLOC;
+            else if (!strcmp(name, "realloc"))
+                vm->builtins[i] = BUILTIN_REALLOC;
+            else if (!strcmp(name, "free"))
+                vm->builtins[i] = BUILTIN_FREE;
+            else if (!strcmp(name, "strdup"))
+                vm->builtins[i] = BUILTIN_STRDUP;
+            for (size_t k = 0;
+                 k < sizeof(host_buffers) / sizeof(host_buffers[0]); k++)
+                if (!strcmp(name, host_buffers[k].name))
+                    vm->buffers[i] = k + 1;
+            for (size_t k = 0;
+                 k < sizeof(host_strings) / sizeof(host_strings[0]); k++)
+                if (!strcmp(name, host_strings[k].name))
+                    vm->strings[i] = k + 1;
+        }
+    }
+
+    vm->formats = calloc(prog->num_functions + 1, 1);
+    for (size_t i = 0; i < prog->num_functions; i++) {
+        const char *const name = atom_spelling(prog->functions[i].name);
+
+        if (prog->functions[i].defined) continue;
+        for (size_t k = 0;
+             k < sizeof(host_formats) / sizeof(host_formats[0]); k++)
+            if (!strcmp(name, host_formats[k].name))
+                vm->formats[i] = k + 1;
+    }
+
+    vm->globals = malloc(sizeof(void *) * (prog->num_globals + 1));
+    for (size_t i = 0; i < prog->num_globals; i++) {
+        const struct global *const g = &prog->globals[i];
+        uint64_t tag;
+
+        if (!g->defined) {
+            vm->globals[i] = g->host;
+            continue;
+        }
+        tag = vm->objects ? new_object(vm, OBJECT_GLOBAL,
+                                       vm->data + g->offset, g->size,
+                                       g->elem_size, g->name)
+                          : 0;
+        vm->globals[i] = (void *)((uintptr_t)(vm->data + g->offset) | tag);
+    }
+    for (size_t i = 0; i < prog->num_relocs; i++) {
+        const struct reloc *const r = &prog->relocs[i];
+        const uint8_t *const target = r->kind == RELOC_GLOBAL
+                                      ? (uint8_t *)vm->globals[r->target]
+                                      : (uint8_t *)&prog->functions[
+                                          r->target];
+        const uint64_t address = (uint64_t)(uintptr_t)target + r->addend;
+
+        memcpy(vm->data + r->offset, &address, 8);
+    }
+
+    vm->num_regs = VM_REGS;
+    vm->regs = malloc(sizeof(union reg) * vm->num_regs);
+    vm->memory_size = VM_MEMORY;
+    vm->memory = malloc(vm->memory_size);
+    vm->max_frames = VM_FRAMES;
+    vm->frames = malloc(sizeof(struct vm_frame) * vm->max_frames);
+    if (vm->objects) {
+        vm->max_locals = VM_LOCALS;
+        vm->locals = malloc(sizeof(uint64_t) * vm->max_locals);
+    }
+    vm->warned = calloc((prog->code_len + 7) / 8, 1);
+    if (prog->specialize)
+        vm->callees = calloc(prog->num_call_sites + 1,
+                             sizeof(struct function *));
+    if (prog->tiering) {
+        vm->call_counts = calloc(prog->num_functions + 1, sizeof(uint32_t));
+        vm->jump_counts = calloc(prog->code_len + 1, sizeof(uint32_t));
+        vm->tiers = calloc(prog->num_functions + 1, sizeof(struct tier *));
+        vm->entries = calloc(prog->code_len + 1,
+                             sizeof(struct tier_node *));
+    }
+}
+
+void vm_destroy(struct vm *vm) {
+    /* Blocks the program did not free. */
+    if (vm->objects)
+        for (size_t i = 1; i < VM_MAX_OBJECTS; i++)
+            if (vm->objects[i].kind == OBJECT_HEAP)
+                free(vm->objects[i].base);
+    for (size_t i = 0; i < vm->num_spilled; i++)
+        if (vm->spilled[i].kind == OBJECT_HEAP)
+            free(vm->spilled[i].base);
+    free(vm->objects);
+    free(vm->free_objects);
+    free(vm->spilled);
+    free(vm->host_ranges);
+    free(vm->builtins);
+    free(vm->buffers);
+    free(vm->strings);
+    free(vm->formats);
+    free(vm->data);
+    free(vm->globals);
+    free(vm->regs);
+    free(vm->memory);
+    free(vm->frames);
+    free(vm->locals);
+    free(vm->warned);
+    free(vm->callees);
+    if (vm->tiers)
+        for (size_t i = 0; i < vm->prog->num_functions; i++)
+            tier_destroy(vm->tiers[i]);
+    free(vm->call_counts);
+    free(vm->jump_counts);
+    free(vm->tiers);
+    free(vm->entries);
+}
+
+int vm_run(struct vm *vm, int argc, char **argv, int *status) {
+    const struct program *const prog = vm->prog;
+    const struct function *fn;
+    union reg result;
+    int ret;
+
+    if (prog->main < 0) {
+        fprintf(stderr, "cisc: error: no definition of 'main'\n");
+        return -1;
+    }
+    fn = &prog->functions[prog->main];
+    result.u = 0;
+    vm->regs[0].i = argc;
+    vm->regs[1].p = argv;
+    vm->regs[2].p = environ;
+
+    STATS_BEGIN(vm_phase);
+    ret = execute(vm, fn, vm->regs, vm->memory, vm->locals, 0, &result);
+    STATS_ADD(instructions, 0, vm->steps);
+    STATS_END(vm_phase);
+    *status = (int)result.i;
+    return ret;
+}
+
+static void runtime_error(const struct vm *vm, const struct insn *ip,
+                          const char *fmt, ...) {
+    va_list ap;
+
+    va_start(ap, fmt);
+    runtime_diagnostic(vm, ip, "error", fmt, ap);
+    va_end(ap);
+}
+
+static void runtime_warning(const struct vm *vm, const struct insn *ip,
+                            const char *fmt, ...) {
+    va_list ap;
+
+    va_start(ap, fmt);
+    runtime_diagnostic(vm, ip, "warning", fmt, ap);
+    va_end(ap);
+}
+
+static void runtime_diagnostic(const struct vm *vm, const struct insn *ip,
+                               const char *severity, const char *fmt,
+                               va_list ap) {
+    const struct program *const prog = vm->prog;
+    const size_t i = ip - prog->code;
+    const uint32_t token = prog->code_tokens[i];
+    const struct program_unit *unit = NULL;
+
+    /* The last unit starting at or before ip. */
+    for (size_t lo = 0, hi = prog->num_units; lo < hi;) {
+        const size_t mid = lo + (hi - lo) / 2;
+
+        if (prog->units[mid].code <= i) {
+            unit = &prog->units[mid];
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    fflush(stdout);
+    if (unit && unit->pp && token != UINT32_MAX) {
+        const struct token *const tok = &unit->tokens[token];
+
+        fprintf(stderr, "%s:%zu: runtime %s: ",
+                preprocessor_file_path(unit->pp, tok),
+                preprocessor_line(unit->pp, tok), severity);
+    } else if (prog->locations && token != UINT32_MAX) {
+        const struct program_location *const loc = &prog->locations[token];
+
+        fprintf(stderr, "%s:%u: runtime %s: ", atom_spelling(loc->path),
+                loc->line, severity);
+    } else {
+        fprintf(stderr, "cisc: runtime %s: ", severity);
+    }
+    vfprintf(stderr, fmt, ap);
+    fputc('\n', stderr);
+}
+
+/* Handle the overflow of the checked instruction ip, whose wrapped result
+   overflowed in direction dir, by the policy of the program, storing the
+   result into *dst. Returns -1 if the program is to stop. */
+static int handle_overflow(struct vm *vm, const struct insn *ip,
+                           union reg *dst, uint64_t wrapped, int dir) {
+    static const char *const types[] = {
+        "int", "unsigned int", "long", "unsigned long",
+    };
+    static const char *const ops[] = {
+        "addition", "subtraction", "multiplication", "addition",
+        "negation", "division", "left shift",
+    };
+    const struct program *const prog = vm->prog;
+    const size_t index = ip - prog->code;
+    const enum opcode op = opcode_first(ip->op);
+    const char *type;
+    int group;
+    int cls;
+
+    if (op < OP_NEGC_I32) {
+        group = (op - OP_ADDC_I32) / 4;
+        cls = (op - OP_ADDC_I32) % 4;
+        /* Subtraction of a constant adds its negation. */
+        if (group == 3 && (int16_t)ip->c < 0) group = 1;
+    } else {
+        group = 4 + (op - OP_NEGC_I32) / 2;
+        cls = (op - OP_NEGC_I32) % 2 * 2;
+    }
+
+    /* The type the operands were declared with, e.g. long long, which has
+       the class of long. */
+    type = types[cls];
+    for (size_t lo = 0, hi = prog->num_overflow_sites; lo < hi;) {
+        const size_t mid = lo + (hi - lo) / 2;
+
+        if (prog->overflow_sites[mid].code == index) {
+            type = type_kind_name(prog->overflow_sites[mid].type);
+            break;
+        }
+        if (prog->overflow_sites[mid].code < index) lo = mid + 1;
+        else hi = mid;
+    }
+
+    switch (prog->overflow) {
+    case OVERFLOW_TRAP:
+        runtime_error(vm, ip, "integer overflow in %s %s", type, ops[group]);
+        return -1;
+    case OVERFLOW_SATURATE:
+        dst->u = overflow_limit(cls, dir);
+        return 0;
+    default:
+        if (!(vm->warned[index / 8] & 1 << index % 8)) {
+            vm->warned[index / 8] |= 1 << index % 8;
+            runtime_warning(vm, ip, "integer overflow in %s %s wraps "
+                                    "around", type, ops[group]);
+        }
+        dst->u = wrapped;
+        return 0;
+    }
+}
+
+/* Number of spilled objects before one at base of size: those at lower
+   addresses, and those as large or larger at the same one. */
+static size_t spilled_position(const struct vm *vm, uint64_t base,
+                               uint64_t size) {
+    size_t lo = 0;
+
+    for (size_t hi = vm->num_spilled; lo < hi;) {
+        const size_t mid = lo + (hi - lo) / 2;
+        const struct vm_object *const o = &vm->spilled[mid];
+
+        if ((uintptr_t)o->base < base
+            || ((uintptr_t)o->base == base && o->size >= size))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* Make room among the spilled objects for one at base of size, dropping
+   the dead ones at the addresses it covers, and return it. */
+static struct vm_object *spill(struct vm *vm, uint64_t base,
+                               uint64_t size) {
+    const uint64_t end = base + (size ? size : 1);
+    size_t i = spilled_position(vm, base, UINT64_MAX);
+    size_t k = i;
+    size_t j;
+
+    for (j = i; j < vm->num_spilled && (uintptr_t)vm->spilled[j].base < end;
+         j++)
+        if (vm->spilled[j].kind != OBJECT_RETURNED
+            && vm->spilled[j].kind != OBJECT_FREED)
+            vm->spilled[k++] = vm->spilled[j];
+    memmove(&vm->spilled[k], &vm->spilled[j],
+            sizeof(struct vm_object) * (vm->num_spilled - j));
+    vm->num_spilled -= j - k;
+
+    if (vm->num_spilled == vm->max_spilled) {
+        vm->max_spilled = vm->max_spilled ? vm->max_spilled * 2 : 256;
+        vm->spilled = realloc(vm->spilled, sizeof(struct vm_object)
+                                           * vm->max_spilled);
+    }
+    i = spilled_position(vm, base, size);
+    memmove(&vm->spilled[i + 1], &vm->spilled[i],
+            sizeof(struct vm_object) * (vm->num_spilled - i));
+    vm->num_spilled++;
+    return &vm->spilled[i];
+}
+
+/* Add an object to the table, or to the spilled objects if the table is
+   full, returning the tag of pointers to it. */
+static uint64_t new_object(struct vm *vm, enum vm_object_kind kind,
+                           void *base, uint64_t size, uint8_t elem_size,
+                           uint32_t name) {
+    struct vm_object *o;
+    uint16_t index;
+
+    if (vm->free_head == vm->free_tail) {
+        index = VM_SPILLED;
+        o = spill(vm, (uintptr_t)base, size);
+    } else {
+        index = vm->free_objects[vm->free_head++ % VM_MAX_OBJECTS];
+        o = &vm->objects[index];
+    }
+    o->base = base;
+    o->size = size;
+    o->kind = kind;
+    o->elem_size = elem_size;
+    o->name = name;
+    return (uint64_t)index << VM_TAG_SHIFT;
+}
+
+/* Mark the object of the tagged pointer p to its start dead, as kind,
+   keeping its base for diagnostics. */
+static void kill_object(struct vm *vm, uint64_t p,
+                        enum vm_object_kind kind) {
+    const uint16_t index = p >> VM_TAG_SHIFT;
+
+    if (index == VM_SPILLED) {
+        const uint64_t base = p & VM_ADDRESS_MASK;
+        const size_t i = spilled_position(vm, base, UINT64_MAX);
+        struct vm_object o;
+
+        if (i == vm->num_spilled || (uintptr_t)vm->spilled[i].base != base)
+            return;
+        /* It moves after the live objects at its base. */
+        o = vm->spilled[i];
+        vm->num_spilled--;
+        memmove(&vm->spilled[i], &vm->spilled[i + 1],
+                sizeof(struct vm_object) * (vm->num_spilled - i));
+        o.size = 0;
+        o.kind = kind;
+        *spill(vm, base, 0) = o;
+        return;
+    }
+    vm->objects[index].size = 0;
+    vm->objects[index].kind = kind;
+    vm->free_objects[vm->free_tail++ % VM_MAX_OBJECTS] = index;
+}
+
+/* Add the objects of the frame slots of fn, whose frame is at fp, storing
+   the tagged address of each into locals. */
+static void new_locals(struct vm *vm, const struct function *fn,
+                       uint8_t *fp, uint64_t *locals) {
+    const struct frame_slot *const slots = vm->prog->frame_slots + fn->slots;
+
+    for (uint32_t i = 0; i < fn->num_slots; i++) {
+        uint8_t *const base = fp + slots[i].offset;
+
+        locals[i] = (uintptr_t)base
+                    | new_object(vm, OBJECT_LOCAL, base, slots[i].size,
+                                 slots[i].elem_size, slots[i].name);
+    }
+}
+
+static void describe_object(const struct vm_object *o, char *buf,
+                            size_t size) {
+    switch (o->kind) {
+    case OBJECT_GLOBAL:
+        if (o->name != ATOM_NONE)
+            snprintf(buf, size, "'%s'", atom_spelling(o->name));
+        else
+            snprintf(buf, size, "an unnamed object");
+        break;
+    case OBJECT_FRAME:
+        snprintf(buf, size, "a stack frame");
+        break;
+    case OBJECT_LOCAL:
+        if (o->name != ATOM_NONE)
+            snprintf(buf, size, "'%s'", atom_spelling(o->name));
+        else
+            snprintf(buf, size, "a temporary object");
+        break;
+    case OBJECT_HEAP:
+        snprintf(buf, size, "a heap block");
+        break;
+    case OBJECT_SPILLED:
+        snprintf(buf, size, "no live object");
+        break;
+    default:
+        snprintf(buf, size, "host memory");
+        break;
+    }
+}
+
+/* Object an access of n bytes at p is to: the entry of its tag, or, if
+   that is VM_SPILLED, the spilled object holding the bytes, else the last
+   one starting at or before them, else the entry of VM_SPILLED. */
+static const struct vm_object *object_of(const struct vm *vm, uint64_t p,
+                                         uint64_t n) {
+    const uint64_t addr = p & VM_ADDRESS_MASK;
+    size_t i;
+
+    if (p >> VM_TAG_SHIFT != VM_SPILLED)
+        return &vm->objects[p >> VM_TAG_SHIFT];
+    i = spilled_position(vm, addr, 0);
+    if (!i) return &vm->objects[VM_SPILLED];
+
+    /* The slots of a frame come after it. */
+    for (size_t k = i; k-- > 0;) {
+        const struct vm_object *const o = &vm->spilled[k];
+        const uint64_t off = addr - (uintptr_t)o->base;
+
+        if (off < o->size && o->size - off >= n) return o;
+        if (o->kind != OBJECT_LOCAL) break;
+    }
+    return &vm->spilled[i - 1];
+}
+
+/* Read the readable mappings of the host into vm->host_ranges. */
+static void read_host_ranges(struct vm *vm) {
+    FILE *const f = fopen("/proc/self/maps", "r");
+    size_t max = 0;
+    uint64_t start, end;
+    char perms[8];
+
+    if (!f) {
+        vm->no_host_ranges = true;
+        return;
+    }
+    free(vm->host_ranges);
+    vm->host_ranges = NULL;
+    vm->num_host_ranges = 0;
+    while (fscanf(f, "%" SCNx64 "-%" SCNx64 " %7s%*[^\n]", &start, &end,
+                  perms) == 3) {
+        uint64_t *const last = vm->host_ranges + 2 * vm->num_host_ranges;
+
+        if (perms[0] != 'r') continue;
+        if (vm->num_host_ranges && last[-1] == start) {
+            last[-1] = end;
+            continue;
+        }
+        if (vm->num_host_ranges == max) {
+            max = max ? max * 2 : 64;
+            vm->host_ranges = realloc(vm->host_ranges,
+                                      sizeof(uint64_t) * 2 * max);
+        }
+        vm->host_ranges[2 * vm->num_host_ranges] = start;
+        vm->host_ranges[2 * vm->num_host_ranges + 1] = end;
+        vm->num_host_ranges++;
+    }
+    fclose(f);
+}
+
+/* Whether the n bytes at addr are in readable memory of the host, by its
+   mappings as last read, or as read again if they are not. */
+static bool host_mapped(struct vm *vm, uint64_t addr, uint64_t n) {
+    for (int read = 0; read < 2; read++) {
+        const uint64_t *const ranges = vm->host_ranges;
+        size_t lo = 0;
+
+        if (vm->no_host_ranges) return true;
+        /* The first range ending past addr. */
+        for (size_t hi = vm->num_host_ranges; lo < hi;) {
+            const size_t mid = lo + (hi - lo) / 2;
+
+            if (ranges[2 * mid + 1] <= addr) lo = mid + 1;
+            else hi = mid;
+        }
+        if (lo < vm->num_host_ranges && ranges[2 * lo] <= addr
+            && ranges[2 * lo + 1] - addr >= n)
+            return true;
+        if (!read) read_host_ranges(vm);
+    }
+    return false;
+}
+
+/* Check an access of n bytes at p, which has failed the quick check, and
+   report it: out of bounds, through a dangling or null pointer, or to an
+   address the host has not mapped, as an error, and, if it is of a
+   scalar, misaligned or to an object of scalars of another size, as a
+   warning, once per instruction. Returns -1 if the program is to stop. */
+static int check_access(struct vm *vm, const struct insn *ip, uint64_t p,
+                        uint64_t n, bool scalar) {
+    const uint64_t addr = p & VM_ADDRESS_MASK;
+    const struct vm_object *const o = object_of(vm, p, n);
+    const uint64_t off = addr - (uintptr_t)o->base;
+    const size_t index = ip - vm->prog->code;
+    char what[64];
+
+    if (!n) return 0;
+    if (o == vm->objects) {
+        if (addr < 4096) {
+            runtime_error(vm, ip, "null pointer dereference");
+            return -1;
+        }
+        if (!host_mapped(vm, addr, n)) {
+            runtime_error(vm, ip, "access of %" PRIu64 " bytes at address "
+                                  "0x%" PRIx64 ", which is not memory of the "
+                                  "program or of the host", n, addr);
+            return -1;
+        }
+        if (!scalar || !(addr & (n - 1))
+            || vm->warned[index / 8] & 1 << index % 8)
+            return 0;
+        vm->warned[index / 8] |= 1 << index % 8;
+        runtime_warning(vm, ip, "misaligned access of %" PRIu64 " bytes",
+                        n);
+        return 0;
+    }
+    if (o->kind == OBJECT_SPILLED) {
+        runtime_error(vm, ip, "access of %" PRIu64 " bytes to no live "
+                              "object", n);
+        return -1;
+    }
+    if (o->kind == OBJECT_RETURNED) {
+        runtime_error(vm, ip, "access to a local variable of a function "
+                              "that has returned");
+        return -1;
+    }
+    if (o->kind == OBJECT_FREED) {
+        runtime_error(vm, ip, "access to freed memory");
+        return -1;
+    }
+    describe_object(o, what, sizeof(what));
+    if (off >= o->size || o->size - off < n) {
+        runtime_error(vm, ip, "out of bounds access of %" PRIu64 " bytes at "
+                              "offset %" PRId64 " of %s, of %" PRIu64
+                              " bytes", n, (int64_t)off, what, o->size);
+        return -1;
+    }
+    /* A spilled object fails the quick check even if it is sound. */
+    if (!scalar || vm->warned[index / 8] & 1 << index % 8
+        || !(addr & (n - 1) || (n > 1 && o->elem_size && o->elem_size != n)))
+        return 0;
+    vm->warned[index / 8] |= 1 << index % 8;
+    if (addr & (n - 1))
+        runtime_warning(vm, ip, "misaligned access of %" PRIu64 " bytes",
+                        n);
+    else
+        runtime_warning(vm, ip, "access of %" PRIu64 " bytes to %s, made of "
+                                "%u-byte elements", n, what, o->elem_size);
+    return 0;
+}
+
+/* Call the VM's version of a heap function, with the arguments and result
+   in args. Returns -1 if the program is to stop. */
+static int call_builtin(struct vm *vm, const struct insn *ip,
+                        enum builtin builtin, union reg *args) {
+    const uint64_t p = args[0].u;
+    const struct vm_object *const o = object_of(vm, p, 0);
+    uint64_t size;
+    void *block;
+
+    switch (builtin) {
+    case BUILTIN_MALLOC:
+        block = malloc(args[0].u);
+        args[0].u = block ? (uintptr_t)block
+                            | new_object(vm, OBJECT_HEAP, block, args[0].u,
+                                         0, ATOM_NONE)
+                          : 0;
+        return 0;
+    case BUILTIN_CALLOC:
+        block = calloc(args[0].u, args[1].u);
+        args[0].u = block ? (uintptr_t)block
+                            | new_object(vm, OBJECT_HEAP, block,
+                                         args[0].u * args[1].u, 0,
+                                         ATOM_NONE)
+                          : 0;
+        return 0;
+    case BUILTIN_STRDUP:
+        if (check_access(vm, ip, p, 1, false)) return -1;
+        size = string_size(vm, p);
+        if (!size) {
+            runtime_error(vm, ip, "passing a string with no terminating null "
+                                  "character to 'strdup'");
+            return -1;
+        }
+        block = malloc(size);
+        if (block)
+            memcpy(block, (void *)(uintptr_t)(p & VM_ADDRESS_MASK), size);
+        args[0].u = block ? (uintptr_t)block
+                            | new_object(vm, OBJECT_HEAP, block, size, 0,
+                                         ATOM_NONE)
+                          : 0;
+        return 0;
+    case BUILTIN_REALLOC:
+        if (!p) {
+            args[0].u = args[1].u;
+            return call_builtin(vm, ip, BUILTIN_MALLOC, args);
+        }
+        if (o == vm->objects && host_mapped(vm, p, 1)) {
+            args[0].p = realloc((void *)(uintptr_t)p, args[1].u);
+            return 0;
+        }
+        break;
+    default:
+        if (!p) return 0;
+        if (o == vm->objects && host_mapped(vm, p, 1)) {
+            free((void *)(uintptr_t)p);
+            return 0;
+        }
+        break;
+    }
+    if (o == vm->objects) {
+        runtime_error(vm, ip, "%s of a pointer to address 0x%" PRIx64
+                              ", which is not memory of the program or of "
+                              "the host",
+                      builtin == BUILTIN_FREE ? "free" : "realloc", p);
+        return -1;
+    }
+
+    /* realloc or free of a tagged pointer, which must be to the start of a
+       live block. */
+    if (o->kind == OBJECT_FREED) {
+        runtime_error(vm, ip, builtin == BUILTIN_FREE ? "double free"
+                              : "realloc of freed memory");
+        return -1;
+    }
+    if (o->kind != OBJECT_HEAP) {
+        char what[64];
+
+        describe_object(o, what, sizeof(what));
+        runtime_error(vm, ip, "%s of a pointer to %s, not to a heap block",
+                      builtin == BUILTIN_FREE ? "free" : "realloc", what);
+        return -1;
+    }
+    if ((p & VM_ADDRESS_MASK) != (uintptr_t)o->base) {
+        runtime_error(vm, ip, "%s of a pointer into a heap block, past its "
+                              "start",
+                      builtin == BUILTIN_FREE ? "free" : "realloc");
+        return -1;
+    }
+    if (builtin == BUILTIN_FREE) {
+        free(o->base);
+        kill_object(vm, p, OBJECT_FREED);
+        return 0;
+    }
+    block = realloc(o->base, args[1].u);
+    if (!block && args[1].u) {
+        args[0].u = 0;
+        return 0;
+    }
+    kill_object(vm, p, OBJECT_FREED);
+    args[0].u = block ? (uintptr_t)block
+                        | new_object(vm, OBJECT_HEAP, block, args[1].u, 0,
+                                     ATOM_NONE)
+                      : 0;
+    return 0;
+}
+
+/* Run fn to completion, on registers from regs, whose first are its
+   arguments, a frame at sp, frame slots from lp, and return addresses from
+   vm->frames[depth]: the tops of the stacks, below which are the
+   activations of the host call fn is a callback of, if any. */
+static int execute(struct vm *vm, const struct function *fn,
+                   union reg *regs, uint8_t *sp, uint64_t *lp, size_t depth,
+                   union reg *result) {
+#ifdef VM_COMPUTED_GOTO
+    static const void *const labels[NUM_OPCODES] = {
+#define OPCODE_LABEL(name, format) &&L_##name,
+        OPCODES(OPCODE_LABEL)
+#undef OPCODE_LABEL
+    };
+#define CASE(name) L_##name:
+#define DISPATCH() do { steps++; goto *labels[ip->op]; } while (0)
+#else
+#define CASE(name) case OP_##name:
+#define DISPATCH() do { steps++; goto dispatch; } while (0)
+#endif
+#define NEXT() do { ip++; DISPATCH(); } while (0)
+/* A superinstruction runs the instructions of its sequence in turn, going
+   from one to the next with STEP(), so that ip is at each for its operands
+   and diagnostics. After an overflow or an access that is only warned
+   about, the rest of the sequence is dispatched one by one. */
+#define STEP() do { ip++; steps++; } while (0)
+/* Jump by offset; a backward jump is to a loop header, which the second
+   tier may compile. */
+#define JUMP(offset)                                                        \
+    do {                                                                    \
+        const int32_t o_ = (offset);                                        \
+                                                                            \
+        ip += o_;                                                           \
+        if (o_ < 0 && entries) {                                            \
+            count = &vm->jump_counts[ip - code];                            \
+            goto hot;                                                       \
+        }                                                                   \
+        DISPATCH();                                                         \
+    } while (0)
+/* Set a to the result of a compare, and take the branch after it if the
+   result is taken_if. */
+#define COMPARE_BRANCH(test, taken_if)                                      \
+    do {                                                                    \
+        const bool t_ = (test);                                             \
+                                                                            \
+        A.u = t_;                                                           \
+        STEP();                                                             \
+        JUMP(t_ == (taken_if) ? ip->imm : 1);                               \
+    } while (0)
+#define A regs[ip->a]
+#define B regs[ip->b]
+#define C regs[ip->c]
+#define IMM16 ((int64_t)(int16_t)ip->c)
+
+    const struct program *const prog = vm->prog;
+    const struct insn *const code = prog->code;
+    const struct function *const functions = prog->functions;
+    const struct vm_object *const objects = vm->objects;
+    const uint8_t *const builtins = vm->builtins;
+    const struct function **const callees = vm->callees;
+    const struct tier_node **const entries = vm->entries;
+    union reg *const regs_end = vm->regs + vm->num_regs;
+    uint8_t *const memory_end = vm->memory + vm->memory_size;
+    uint64_t *const locals_end = vm->locals + vm->max_locals;
+    const size_t bottom = depth;
+    const struct insn *ip;
+    uint8_t *fp = sp;
+    uint64_t *locals = lp;
+    uint64_t steps = 0;
+    const struct function *callee;
+    const struct call_site *site;
+    const struct switch_table *table;
+    const struct switch_case *sc;
+    uint32_t base;
+    /* Counter of the function or loop header the second tier may
+       compile. */
+    uint32_t *count;
+    /* Wrapped result and direction of an overflow. */
+    uint64_t wrapped;
+    int dir;
+    int status = 0;
+
+    if (fn->num_regs > (size_t)(regs_end - regs)
+        || fn->frame_size > (size_t)(memory_end - sp)
+        || (objects && fn->num_slots > (size_t)(locals_end - lp))) {
+        fprintf(stderr, "cisc: runtime error: stack overflow\n");
+        return -1;
+    }
+    sp = fp + fn->frame_size;
+    if (objects) {
+        new_locals(vm, fn, fp, lp);
+        lp += fn->num_slots;
+        if (fn->frame_size)
+            fp = (uint8_t *)((uintptr_t)fp
+                             | new_object(vm, OBJECT_FRAME, fp,
+                                          fn->frame_size, 0, ATOM_NONE));
+    }
+    ip = code + fn->code;
+    DISPATCH();
+
+#ifndef VM_COMPUTED_GOTO
+dispatch:
+    switch ((enum opcode)ip->op) {
+#endif
+
+#define ARITH(name, expr)                                                   \
+    CASE(name) A = (expr); NEXT();
+#define INT_GROUP(name, op)                                                 \
+    CASE(name##_I32) A.i = (int32_t)(uint32_t)(B.u op C.u); NEXT();         \
+    CASE(name##_U32) A.u = (uint32_t)(B.u op C.u); NEXT();                  \
+    CASE(name##_I64) A.u = B.u op C.u; NEXT();                              \
+    CASE(name##_U64) A.u = B.u op C.u; NEXT();
+#define FLOAT_GROUP(name, op)                                               \
+    CASE(name##_F32) A = f32(B.f op C.f); NEXT();                           \
+    CASE(name##_F64) A = f64(B.d op C.d); NEXT();
+
+    CASE(NOP) NEXT();
+    CASE(MOV) A = B; NEXT();
+    CASE(LOADI) A.i = ip->imm; NEXT();
+    CASE(LOADK) A.u = prog->constants[ip->imm]; NEXT();
+    CASE(ADDR_LOCAL) A.p = fp + ip->imm; NEXT();
+    CASE(ADDR_GLOBAL) A.p = vm->globals[ip->imm]; NEXT();
+    CASE(ADDR_FUNC) A.p = (void *)&functions[ip->imm]; NEXT();
+    CASE(ADDRC_LOCAL) A.u = locals[ip->b] + IMM16; NEXT();
+
+    INT_GROUP(ADD, +)
+    FLOAT_GROUP(ADD, +)
+    INT_GROUP(SUB, -)
+    FLOAT_GROUP(SUB, -)
+    INT_GROUP(MUL, *)
+    FLOAT_GROUP(MUL, *)
+
+    /* Division by zero is an error, and the quotient of the most negative
+       value by -1 wraps, instead of trapping. */
+    CASE(DIV_I32)
+        if (!C.u) goto divide_by_zero;
+        A.i = C.i == -1 ? (int32_t)(0u - (uint32_t)B.u)
+              : (int32_t)B.i / (int32_t)C.i;
+        NEXT();
+    CASE(DIV_U32)
+        if (!C.u) goto divide_by_zero;
+        A.u = (uint32_t)B.u / (uint32_t)C.u;
+        NEXT();
+    CASE(DIV_I64)
+        if (!C.u) goto divide_by_zero;
+        A.i = C.i == -1 ? (int64_t)(0 - B.u) : B.i / C.i;
+        NEXT();
+    CASE(DIV_U64)
+        if (!C.u) goto divide_by_zero;
+        A.u = B.u / C.u;
+        NEXT();
+    FLOAT_GROUP(DIV, /)
+    CASE(MOD_I32)
+        if (!C.u) goto divide_by_zero;
+        A.i = C.i == -1 ? 0 : (int32_t)B.i % (int32_t)C.i;
+        NEXT();
+    CASE(MOD_U32)
+        if (!C.u) goto divide_by_zero;
+        A.u = (uint32_t)B.u % (uint32_t)C.u;
+        NEXT();
+    CASE(MOD_I64)
+        if (!C.u) goto divide_by_zero;
+        A.i = C.i == -1 ? 0 : B.i % C.i;
+        NEXT();
+    CASE(MOD_U64)
+        if (!C.u) goto divide_by_zero;
+        A.u = B.u % C.u;
+        NEXT();
+
+    CASE(NEG_I32) A.i = (int32_t)(0u - (uint32_t)B.u); NEXT();
+    CASE(NEG_U32) A.u = (uint32_t)(0u - (uint32_t)B.u); NEXT();
+    CASE(NEG_I64) A.u = 0 - B.u; NEXT();
+    CASE(NEG_U64) A.u = 0 - B.u; NEXT();
+    CASE(NEG_F32) A = f32(-B.f); NEXT();
+    CASE(NEG_F64) A = f64(-B.d); NEXT();
+
+    /* Shift counts are taken modulo the width. */
+    CASE(SHL_I32) A.i = (int32_t)((uint32_t)B.u << (C.u & 31)); NEXT();
+    CASE(SHL_U32) A.u = (uint32_t)((uint32_t)B.u << (C.u & 31)); NEXT();
+    CASE(SHL_I64) A.u = B.u << (C.u & 63); NEXT();
+    CASE(SHL_U64) A.u = B.u << (C.u & 63); NEXT();
+    CASE(SHR_I32) A.i = (int32_t)B.i >> (C.u & 31); NEXT();
+    CASE(SHR_U32) A.u = (uint32_t)B.u >> (C.u & 31); NEXT();
+    CASE(SHR_I64) A.i = B.i >> (C.u & 63); NEXT();
+    CASE(SHR_U64) A.u = B.u >> (C.u & 63); NEXT();
+
+    CASE(BNOT_I32) A.i = (int32_t)~(uint32_t)B.u; NEXT();
+    CASE(BNOT_U32) A.u = (uint32_t)~B.u; NEXT();
+    CASE(BNOT_I64) A.u = ~B.u; NEXT();
+    CASE(BNOT_U64) A.u = ~B.u; NEXT();
+
+    CASE(ADDI_I32) A.i = (int32_t)(uint32_t)(B.u + IMM16); NEXT();
+    CASE(ADDI_U32) A.u = (uint32_t)(B.u + IMM16); NEXT();
+    CASE(ADDI_I64) A.u = B.u + IMM16; NEXT();
+    CASE(ADDI_U64) A.u = B.u + IMM16; NEXT();
+    CASE(MULI_I64) A.u = B.u * IMM16; NEXT();
+
+    /* Checked arithmetic computes the exact result with the overflow
+       builtins, and leaves the fast path only when it does not fit. */
+#define CHECKED(type, builtin, y, direction)                                \
+    do {                                                                    \
+        type r;                                                             \
+        if (__builtin_expect(builtin((type)B.u, y, &r), 0)) {               \
+            wrapped = (uint64_t)(int64_t)r;                                 \
+            dir = (direction);                                              \
+            goto overflow;                                                  \
+        }                                                                   \
+        A.i = r;                                                            \
+    } while (0)
+#define CHECKED_OP(name, type, builtin, y, direction)                       \
+    CASE(name) CHECKED(type, builtin, y, direction); NEXT();
+    CHECKED_OP(ADDC_I32, int32_t, __builtin_add_overflow, (int32_t)C.i,
+               C.i < 0 ? -1 : 1)
+    CHECKED_OP(ADDC_U32, uint32_t, __builtin_add_overflow, (uint32_t)C.u, 1)
+    CHECKED_OP(ADDC_I64, int64_t, __builtin_add_overflow, C.i,
+               C.i < 0 ? -1 : 1)
+    CHECKED_OP(ADDC_U64, uint64_t, __builtin_add_overflow, C.u, 1)
+    CHECKED_OP(SUBC_I32, int32_t, __builtin_sub_overflow, (int32_t)C.i,
+               C.i < 0 ? 1 : -1)
+    CHECKED_OP(SUBC_U32, uint32_t, __builtin_sub_overflow, (uint32_t)C.u, -1)
+    CHECKED_OP(SUBC_I64, int64_t, __builtin_sub_overflow, C.i,
+               C.i < 0 ? 1 : -1)
+    CHECKED_OP(SUBC_U64, uint64_t, __builtin_sub_overflow, C.u, -1)
+    CHECKED_OP(MULC_I32, int32_t, __builtin_mul_overflow, (int32_t)C.i,
+               (B.i < 0) != (C.i < 0) ? -1 : 1)
+    CHECKED_OP(MULC_U32, uint32_t, __builtin_mul_overflow, (uint32_t)C.u, 1)
+    CHECKED_OP(MULC_I64, int64_t, __builtin_mul_overflow, C.i,
+               (B.i < 0) != (C.i < 0) ? -1 : 1)
+    CHECKED_OP(MULC_U64, uint64_t, __builtin_mul_overflow, C.u, 1)
+    /* The immediate is added as a signed number, whatever the type. */
+    CHECKED_OP(ADDIC_I32, int32_t, __builtin_add_overflow, IMM16,
+               IMM16 < 0 ? -1 : 1)
+    CHECKED_OP(ADDIC_U32, uint32_t, __builtin_add_overflow, IMM16,
+               IMM16 < 0 ? -1 : 1)
+    CHECKED_OP(ADDIC_I64, int64_t, __builtin_add_overflow, IMM16,
+               IMM16 < 0 ? -1 : 1)
+    CHECKED_OP(ADDIC_U64, uint64_t, __builtin_add_overflow, IMM16,
+               IMM16 < 0 ? -1 : 1)
+#undef CHECKED_OP
+    CASE(NEGC_I32)
+        if (__builtin_expect(B.i == INT32_MIN, 0)) {
+            wrapped = B.u;
+            dir = 1;
+            goto overflow;
+        }
+        A.i = -B.i;
+        NEXT();
+    CASE(NEGC_I64)
+        if (__builtin_expect(B.i == INT64_MIN, 0)) {
+            wrapped = B.u;
+            dir = 1;
+            goto overflow;
+        }
+        A.i = -B.i;
+        NEXT();
+    CASE(DIVC_I32)
+        if (!C.u) goto divide_by_zero;
+        if (__builtin_expect(C.i == -1 && B.i == INT32_MIN, 0)) {
+            wrapped = B.u;
+            dir = 1;
+            goto overflow;
+        }
+        A.i = (int32_t)B.i / (int32_t)C.i;
+        NEXT();
+    CASE(DIVC_I64)
+        if (!C.u) goto divide_by_zero;
+        if (__builtin_expect(C.i == -1 && B.i == INT64_MIN, 0)) {
+            wrapped = B.u;
+            dir = 1;
+            goto overflow;
+        }
+        A.i = B.i / C.i;
+        NEXT();
+    /* A left shift overflows if bits are lost, or the count is not less
+       than the width. */
+    CASE(SHLC_I32) {
+        const int32_t r = (int32_t)((uint32_t)B.u << (C.u & 31));
+
+        if (__builtin_expect(C.u >= 32 ? B.i != 0 : r >> C.u != B.i, 0)) {
+            wrapped = (uint64_t)(int64_t)r;
+            dir = B.i < 0 ? -1 : 1;
+            goto overflow;
+        }
+        A.i = r;
+        NEXT();
+    }
+    CASE(SHLC_I64) {
+        const int64_t r = (int64_t)(B.u << (C.u & 63));
+
+        if (__builtin_expect(C.u >= 64 ? B.i != 0 : r >> C.u != B.i, 0)) {
+            wrapped = (uint64_t)r;
+            dir = B.i < 0 ? -1 : 1;
+            goto overflow;
+        }
+        A.i = r;
+        NEXT();
+    }
+
+    CASE(AND) A.u = B.u & C.u; NEXT();
+    CASE(OR) A.u = B.u | C.u; NEXT();
+    CASE(XOR) A.u = B.u ^ C.u; NEXT();
+
+    /* A compare, and the superinstructions of it and a branch on its
+       result, and of loading a constant, it, and a branch. */
+#define COMPARE(name, test)                                                 \
+    CASE(name) A.u = (test); NEXT();                                        \
+    CASE(name##_JZ) COMPARE_BRANCH(test, false);                            \
+    CASE(name##_JNZ) COMPARE_BRANCH(test, true);
+#define CONSTANT_COMPARE(name, test)                                        \
+    COMPARE(name, test)                                                     \
+    CASE(LOADI_##name##_JZ) A.i = ip->imm; STEP();                          \
+        COMPARE_BRANCH(test, false);                                        \
+    CASE(LOADI_##name##_JNZ) A.i = ip->imm; STEP();                         \
+        COMPARE_BRANCH(test, true);
+    CONSTANT_COMPARE(EQ_I, B.u == C.u)
+    ARITH(EQ_U, (union reg){.u = B.u == C.u})
+    ARITH(EQ_F32, (union reg){.u = B.f == C.f})
+    ARITH(EQ_F64, (union reg){.u = B.d == C.d})
+    CONSTANT_COMPARE(NE_I, B.u != C.u)
+    ARITH(NE_U, (union reg){.u = B.u != C.u})
+    ARITH(NE_F32, (union reg){.u = B.f != C.f})
+    ARITH(NE_F64, (union reg){.u = B.d != C.d})
+    CONSTANT_COMPARE(LT_I, B.i < C.i)
+    CONSTANT_COMPARE(LT_U, B.u < C.u)
+    ARITH(LT_F32, (union reg){.u = B.f < C.f})
+    ARITH(LT_F64, (union reg){.u = B.d < C.d})
+    CONSTANT_COMPARE(LE_I, B.i <= C.i)
+    CONSTANT_COMPARE(LE_U, B.u <= C.u)
+    ARITH(LE_F32, (union reg){.u = B.f <= C.f})
+    ARITH(LE_F64, (union reg){.u = B.d <= C.d})
+#undef CONSTANT_COMPARE
+
+    CASE(NOT) A.u = !B.u; NEXT();
+    CASE(BOOL) A.u = B.u != 0; NEXT();
+    CASE(BOOL_F32) A.u = B.f != 0; NEXT();
+    CASE(BOOL_F64) A.u = B.d != 0; NEXT();
+
+    CASE(SEXT8) A.i = (int8_t)B.u; NEXT();
+    CASE(SEXT16) A.i = (int16_t)B.u; NEXT();
+    CASE(SEXT32) A.i = (int32_t)B.u; NEXT();
+    CASE(ZEXT8) A.u = (uint8_t)B.u; NEXT();
+    CASE(ZEXT16) A.u = (uint16_t)B.u; NEXT();
+    CASE(ZEXT32) A.u = (uint32_t)B.u; NEXT();
+
+    CASE(I64_TO_F32) A = f32((float)B.i); NEXT();
+    CASE(U64_TO_F32) A = f32((float)B.u); NEXT();
+    CASE(I64_TO_F64) A = f64((double)B.i); NEXT();
+    CASE(U64_TO_F64) A = f64((double)B.u); NEXT();
+    CASE(F32_TO_I64) A.i = (int64_t)B.f; NEXT();
+    CASE(F32_TO_U64) A.u = (uint64_t)B.f; NEXT();
+    CASE(F64_TO_I64) A.i = (int64_t)B.d; NEXT();
+    CASE(F64_TO_U64) A.u = (uint64_t)B.d; NEXT();
+    CASE(F32_TO_F64) A = f64(B.f); NEXT();
+    CASE(F64_TO_F32) A = f32((float)B.d); NEXT();
+
+#define LOAD(type, field)                                                   \
+    do {                                                                    \
+        type x;                                                             \
+        memcpy(&x, (uint8_t *)B.p + IMM16, sizeof(x));                      \
+        A.field = x;                                                        \
+    } while (0)
+#define STORE(type)                                                         \
+    do {                                                                    \
+        const type x = (type)A.u;                                           \
+        memcpy((uint8_t *)B.p + IMM16, &x, sizeof(x));                      \
+    } while (0)
+    /* An access, and the superinstruction of adding an index to a pointer
+       and the access. */
+#define ACCESS(name, ...)                                                   \
+    CASE(name) __VA_ARGS__; NEXT();                                         \
+    CASE(ADD_U64_##name) A.u = B.u + C.u; STEP(); __VA_ARGS__; NEXT();
+    ACCESS(LOAD_I8, LOAD(int8_t, i))
+    ACCESS(LOAD_U8, LOAD(uint8_t, u))
+    ACCESS(LOAD_I16, LOAD(int16_t, i))
+    ACCESS(LOAD_U16, LOAD(uint16_t, u))
+    ACCESS(LOAD_I32, LOAD(int32_t, i))
+    ACCESS(LOAD_U32, LOAD(uint32_t, u))
+    ACCESS(LOAD_64, LOAD(uint64_t, u))
+    ACCESS(STORE_8, STORE(uint8_t))
+    ACCESS(STORE_16, STORE(uint16_t))
+    ACCESS(STORE_32, STORE(uint32_t))
+    ACCESS(STORE_64, STORE(uint64_t))
+
+    /* The quick check of an access of n bytes at p, through the entry of
+       its tag, or entry 0 if it has none, which, like that of VM_SPILLED,
+       fails it always. */
+#define CHECK(p, n, scalar)                                                 \
+    do {                                                                    \
+        const struct vm_object *const o_ = &objects[(p) >> VM_TAG_SHIFT];   \
+        const uint64_t off_ = ((p) & VM_ADDRESS_MASK) - (uintptr_t)o_->base; \
+                                                                            \
+        if (__builtin_expect(off_ >= o_->size || o_->size - off_ < (n)      \
+                             || ((scalar) && (((p) & ((n) - 1))            \
+                                              || ((n) > 1 && o_->elem_size \
+                                                  && o_->elem_size != (n)))), \
+                             0)                                             \
+            && check_access(vm, ip, (p), (n), (scalar)))                    \
+            goto fail;                                                      \
+    } while (0)
+#define CHECKED_LOAD(type, field)                                           \
+    do {                                                                    \
+        const uint64_t p = B.u + IMM16;                                     \
+        type x;                                                             \
+        CHECK(p, sizeof(type), true);                                       \
+        memcpy(&x, (void *)(uintptr_t)(p & VM_ADDRESS_MASK), sizeof(x));    \
+        A.field = x;                                                        \
+    } while (0)
+#define CHECKED_STORE(type)                                                 \
+    do {                                                                    \
+        const uint64_t p = B.u + IMM16;                                     \
+        const type x = (type)A.u;                                           \
+        CHECK(p, sizeof(type), true);                                       \
+        memcpy((void *)(uintptr_t)(p & VM_ADDRESS_MASK), &x, sizeof(x));    \
+    } while (0)
+    ACCESS(LOADC_I8, CHECKED_LOAD(int8_t, i))
+    ACCESS(LOADC_U8, CHECKED_LOAD(uint8_t, u))
+    ACCESS(LOADC_I16, CHECKED_LOAD(int16_t, i))
+    ACCESS(LOADC_U16, CHECKED_LOAD(uint16_t, u))
+    ACCESS(LOADC_I32, CHECKED_LOAD(int32_t, i))
+    ACCESS(LOADC_U32, CHECKED_LOAD(uint32_t, u))
+    ACCESS(LOADC_64, CHECKED_LOAD(uint64_t, u))
+    ACCESS(STOREC_8, CHECKED_STORE(uint8_t))
+    ACCESS(STOREC_16, CHECKED_STORE(uint16_t))
+    ACCESS(STOREC_32, CHECKED_STORE(uint32_t))
+    ACCESS(STOREC_64, CHECKED_STORE(uint64_t))
+#undef ACCESS
+    CASE(SUB_P) A.u = (B.u & VM_ADDRESS_MASK) - (C.u & VM_ADDRESS_MASK);
+        NEXT();
+    COMPARE(EQ_P, (B.u & VM_ADDRESS_MASK) == (C.u & VM_ADDRESS_MASK))
+    COMPARE(NE_P, (B.u & VM_ADDRESS_MASK) != (C.u & VM_ADDRESS_MASK))
+    COMPARE(LT_P, (B.u & VM_ADDRESS_MASK) < (C.u & VM_ADDRESS_MASK))
+    COMPARE(LE_P, (B.u & VM_ADDRESS_MASK) <= (C.u & VM_ADDRESS_MASK))
+#undef COMPARE
+
+    /* Pointers have tags only if memory is checked. */
+    CASE(COPY)
+        if (objects) {
+            CHECK(A.u, (uint64_t)ip[1].imm, false);
+            CHECK(B.u, (uint64_t)ip[1].imm, false);
+        }
+        memmove((void *)(uintptr_t)(A.u & VM_ADDRESS_MASK),
+                (void *)(uintptr_t)(B.u & VM_ADDRESS_MASK), ip[1].imm);
+        ip += 2;
+        DISPATCH();
+    CASE(ZERO)
+        if (objects) CHECK(A.u, (uint64_t)ip->imm, false);
+        memset((void *)(uintptr_t)(A.u & VM_ADDRESS_MASK), 0, ip->imm);
+        NEXT();
+
+    CASE(JMP) JUMP(ip->imm);
+    CASE(JZ) JUMP(A.u ? 1 : ip->imm);
+    CASE(JNZ) JUMP(A.u ? ip->imm : 1);
+    CASE(SWITCH)
+        table = &prog->switches[ip->imm];
+        sc = find_case(prog->switch_cases + table->cases, table->num_cases,
+                       A.i);
+        ip += sc ? sc->target : table->default_target;
+        DISPATCH();
+
+    CASE(CALL)
+        callee = &functions[ip->imm];
+        base = ip->a;
+        ip++;
+        goto call;
+    CASE(CALL_HOST)
+        site = &prog->call_sites[ip->imm];
+        if (builtins && builtins[site->function]) {
+            if (call_builtin(vm, ip, builtins[site->function], &A))
+                goto fail;
+            NEXT();
+        }
+        if (host_call(vm, ip, &functions[site->function], site, &A, sp, lp,
+                      depth))
+            goto fail;
+        NEXT();
+    CASE(CALL_PTR)
+        callee = B.p;
+        base = ip->a;
+        if (callees && callee && callee == callees[ip[1].imm]) {
+            ip += 2;
+            goto call;
+        }
+        if ((uintptr_t)callee - (uintptr_t)functions
+            >= prog->num_functions * sizeof(struct function)
+            || ((uintptr_t)callee - (uintptr_t)functions)
+               % sizeof(struct function)) {
+            runtime_error(vm, ip, "call through an invalid function "
+                                  "pointer");
+            goto fail;
+        }
+        ip += 2;
+        if (!callee->defined) {
+            site = &prog->call_sites[ip[-1].imm];
+            if (builtins && builtins[callee - functions]) {
+                if (call_builtin(vm, ip - 2, builtins[callee - functions],
+                                 &regs[base]))
+                    goto fail;
+                DISPATCH();
+            }
+            if (host_call(vm, ip - 2, callee, site, &regs[base], sp, lp,
+                          depth))
+                goto fail;
+            DISPATCH();
+        }
+        if (callees) callees[ip[-1].imm] = callee;
+        goto call;
+
+    CASE(RET)
+        regs[0] = A;
+        goto ret;
+    CASE(RET_VOID)
+        goto ret;
+    CASE(HALT)
+        *result = A;
+        goto done;
+
+    /* The other superinstructions: the step and test of a for loop over an
+       int, and updates of a variable in memory. */
+    CASE(ADDI_I32_LT_I_JNZ)
+        A.i = (int32_t)(uint32_t)(B.u + IMM16);
+        STEP();
+        COMPARE_BRANCH(B.i < C.i, true);
+    CASE(ADDIC_I32_LT_I_JNZ)
+        CHECKED(int32_t, __builtin_add_overflow, IMM16, IMM16 < 0 ? -1 : 1);
+        STEP();
+        COMPARE_BRANCH(B.i < C.i, true);
+    CASE(ADDI_I32_LOADI_LT_I_JNZ)
+        A.i = (int32_t)(uint32_t)(B.u + IMM16);
+        STEP();
+        A.i = ip->imm;
+        STEP();
+        COMPARE_BRANCH(B.i < C.i, true);
+    CASE(ADDIC_I32_LOADI_LT_I_JNZ)
+        CHECKED(int32_t, __builtin_add_overflow, IMM16, IMM16 < 0 ? -1 : 1);
+        STEP();
+        A.i = ip->imm;
+        STEP();
+        COMPARE_BRANCH(B.i < C.i, true);
+
+    CASE(LOAD_I32_ADD_I32_STORE_32)
+        LOAD(int32_t, i);
+        STEP();
+        A.i = (int32_t)(uint32_t)(B.u + C.u);
+        STEP();
+        STORE(uint32_t);
+        NEXT();
+    CASE(LOAD_I32_ADDI_I32_STORE_32)
+        LOAD(int32_t, i);
+        STEP();
+        A.i = (int32_t)(uint32_t)(B.u + IMM16);
+        STEP();
+        STORE(uint32_t);
+        NEXT();
+    CASE(LOAD_64_ADD_I64_STORE_64)
+        LOAD(uint64_t, u);
+        STEP();
+        A.u = B.u + C.u;
+        STEP();
+        STORE(uint64_t);
+        NEXT();
+    CASE(LOAD_64_ADDI_I64_STORE_64)
+        LOAD(uint64_t, u);
+        STEP();
+        A.u = B.u + IMM16;
+        STEP();
+        STORE(uint64_t);
+        NEXT();
+    CASE(LOADC_I32_ADDC_I32_STOREC_32)
+        CHECKED_LOAD(int32_t, i);
+        STEP();
+        CHECKED(int32_t, __builtin_add_overflow, (int32_t)C.i,
+                C.i < 0 ? -1 : 1);
+        STEP();
+        CHECKED_STORE(uint32_t);
+        NEXT();
+    CASE(LOADC_I32_ADDIC_I32_STOREC_32)
+        CHECKED_LOAD(int32_t, i);
+        STEP();
+        CHECKED(int32_t, __builtin_add_overflow, IMM16, IMM16 < 0 ? -1 : 1);
+        STEP();
+        CHECKED_STORE(uint32_t);
+        NEXT();
+    CASE(LOADC_64_ADDC_I64_STOREC_64)
+        CHECKED_LOAD(uint64_t, u);
+        STEP();
+        CHECKED(int64_t, __builtin_add_overflow, C.i, C.i < 0 ? -1 : 1);
+        STEP();
+        CHECKED_STORE(uint64_t);
+        NEXT();
+    CASE(LOADC_64_ADDIC_I64_STOREC_64)
+        CHECKED_LOAD(uint64_t, u);
+        STEP();
+        CHECKED(int64_t, __builtin_add_overflow, IMM16, IMM16 < 0 ? -1 : 1);
+        STEP();
+        CHECKED_STORE(uint64_t);
+        NEXT();
+#undef CHECKED
+#undef LOAD
+#undef STORE
+#undef CHECKED_LOAD
+#undef CHECKED_STORE
+
+#ifndef VM_COMPUTED_GOTO
+    default:
+        runtime_error(vm, ip, "invalid instruction");
+        goto fail;
+    }
+#endif
+
+/* The return address is ip; the arguments are at regs[base]. */
+call:
+    STATS_INC(calls);
+    if (depth == vm->max_frames
+        || regs + base + callee->num_regs > regs_end
+        || callee->frame_size > (size_t)(memory_end - sp)
+        || (objects && callee->num_slots > (size_t)(locals_end - lp))) {
+        runtime_error(vm, ip - 1, "stack overflow");
+        goto fail;
+    }
+    vm->frames[depth].ret = ip;
+    vm->frames[depth].regs = regs;
+    vm->frames[depth].fp = fp;
+    vm->frames[depth].locals = locals;
+    depth++;
+    regs += base;
+    fp = sp;
+    sp += callee->frame_size;
+    if (objects) {
+        new_locals(vm, callee, fp, lp);
+        locals = lp;
+        lp += callee->num_slots;
+        if (callee->frame_size)
+            fp = (uint8_t *)((uintptr_t)fp
+                             | new_object(vm, OBJECT_FRAME, fp,
+                                          callee->frame_size, 0, ATOM_NONE));
+    }
+    ip = code + callee->code;
+    if (entries) {
+        count = &vm->call_counts[callee - functions];
+        goto hot;
+    }
+    DISPATCH();
+
+ret:
+    if ((uintptr_t)fp >> VM_TAG_SHIFT)
+        kill_object(vm, (uintptr_t)fp, OBJECT_RETURNED);
+    while (lp > locals)
+        if (*--lp >> VM_TAG_SHIFT) kill_object(vm, *lp, OBJECT_RETURNED);
+    if (depth == bottom) {
+        *result = regs[0];
+        goto done;
+    }
+    depth--;
+    sp = (uint8_t *)((uintptr_t)fp & VM_ADDRESS_MASK);
+    ip = vm->frames[depth].ret;
+    regs = vm->frames[depth].regs;
+    fp = vm->frames[depth].fp;
+    locals = vm->frames[depth].locals;
+    if (entries && entries[ip - code]) goto tier;
+    DISPATCH();
+
+/* ip is at the start of a function or a loop header, run so far *count
+   times: enter the second tier there if it is compiled, or compile it if
+   hot. */
+hot:
+    if (entries[ip - code]) goto tier;
+    if (++*count == TIER_THRESHOLD) {
+        tier_compile(vm, ip - code);
+        if (entries[ip - code]) goto tier;
+    }
+    DISPATCH();
+
+tier:
+    ip = tier_run(vm, entries[ip - code], regs, fp, locals, &steps);
+    DISPATCH();
+
+overflow:
+    if (handle_overflow(vm, ip, &A, wrapped, dir)) goto fail;
+    NEXT();
+
+divide_by_zero:
+    runtime_error(vm, ip, "division by zero");
+fail:
+    status = -1;
+    result->u = 0;
+done:
+    vm->steps += steps;
+    return status;
+
+#undef CASE
+#undef DISPATCH
+#undef NEXT
+#undef STEP
+#undef JUMP
+#undef COMPARE_BRANCH
+#undef A
+#undef B
+#undef C
+#undef IMM16
+}
+
+/* Call host function host with the arguments args of a call site at ip,
+   storing its result into args[0]. A function of the program passed to it
+   is passed as run_callback(), or as itself if of the host; sp and depth
+   are the tops of the stacks, which a callback runs above. Returns -1 if
+   the program is to stop. */
+static int host_call(struct vm *vm, const struct insn *ip,
+                     const struct function *host,
+                     const struct call_site *site, union reg *args,
+                     uint8_t *sp, uint64_t *lp, size_t depth) {
+    const struct program *const prog = vm->prog;
+    struct vm_callback *const outer = callback;
+    const uint8_t format = vm->formats[host - prog->functions];
+    const struct host_signature *sig;
+    struct vm_callback cb;
+    char buf[256];
+    char *fmt = NULL;
+    uint64_t saved = 0;
+    int k = -1;
+    int status = 0;
+
+    if (site->signature == NO_SIGNATURE) {
+        runtime_error(vm, ip, "cannot pass a structure or so many arguments "
+                              "to host function '%s'",
+                      atom_spelling(host->name));
+        return -1;
+    }
+    sig = &prog->host_signatures[site->signature];
+    cb.fn = NULL;
+    for (uint32_t set = sig->functions; set; set &= set - 1) {
+        union reg *const arg = &args[__builtin_ctz(set)];
+        const uintptr_t offset = (uintptr_t)arg->p
+                                 - (uintptr_t)prog->functions;
+        const struct function *fn;
+
+        if (offset >= prog->num_functions * sizeof(struct function)
+            || offset % sizeof(struct function))
+            continue;
+        fn = arg->p;
+        if (!fn->defined) {
+            arg->p = fn->host;
+            continue;
+        }
+        if ((cb.fn && cb.fn != fn) || fn->num_params > 6) {
+            runtime_error(vm, ip, "cannot pass function '%s' to host "
+                                  "function '%s'", atom_spelling(fn->name),
+                          atom_spelling(host->name));
+            return -1;
+        }
+        cb.fn = fn;
+        arg->u = (uintptr_t)run_callback;
+    }
+
+    /* A format, once known to end within its object, is passed as a copy
+       if it converts a long double. */
+    if (format) k = host_formats[format - 1].format;
+    if (k >= 0 && (uint32_t)k < sig->num_args && sig->pointers >> k & 1
+        && args[k].u && (!vm->objects || string_size(vm, args[k].u))) {
+        fmt = double_format((const char *)(uintptr_t)(args[k].u
+                                                      & VM_ADDRESS_MASK),
+                            buf, sizeof(buf));
+        saved = args[k].u;
+        if (fmt) args[k].p = fmt;
+    }
+
+    if (vm->objects && check_host_call(vm, ip, host, sig, args)) {
+        status = -1;
+    } else {
+        if (cb.fn) {
+            cb.vm = vm;
+            cb.ip = ip;
+            cb.regs = args + sig->num_args;
+            cb.sp = sp;
+            cb.lp = lp;
+            cb.depth = depth;
+            cb.status = 0;
+            callback = &cb;
+        }
+        args[0] = sig->stub(sig, host->host, args);
+        callback = outer;
+        status = cb.fn ? cb.status : 0;
+    }
+    if (fmt) {
+        if (k) args[k].u = saved;
+        if (fmt != buf) free(fmt);
+    }
+    return status;
+}
+
+/* Check the pointers passed to a host function: each must be null, to
+   host memory, or into a live object or just past its end, and one to a
+   buffer the function accesses must be to as many bytes as it accesses.
+   Reports an error and returns -1 if one is not. */
+static int check_host_call(struct vm *vm, const struct insn *ip,
+                           const struct function *host,
+                           const struct host_signature *sig,
+                           union reg *args) {
+    const char *const name = atom_spelling(host->name);
+    const uint8_t buffers = vm->buffers[host - vm->prog->functions];
+    uint64_t n = 0;
+    int8_t size;
+    char what[64];
+
+    for (uint32_t set = sig->pointers; set; set &= set - 1) {
+        const uint64_t p = args[__builtin_ctz(set)].u;
+        const struct vm_object *const o = object_of(vm, p, 0);
+        const uint64_t off = (p & VM_ADDRESS_MASK) - (uintptr_t)o->base;
+
+        /* One without a tag may be null, or just past the end of host
+           memory. */
+        if (o == vm->objects) {
+            if (!p || host_mapped(vm, p, 1) || host_mapped(vm, p - 1, 1))
+                continue;
+            runtime_error(vm, ip, "passing a pointer to address 0x%" PRIx64
+                                  ", which is not memory of the program or "
+                                  "of the host, to '%s'", p, name);
+            return -1;
+        }
+        if (o->kind == OBJECT_SPILLED) {
+            runtime_error(vm, ip, "passing a pointer to no live object to "
+                                  "'%s'", name);
+            return -1;
+        }
+        if (o->kind == OBJECT_RETURNED) {
+            runtime_error(vm, ip, "passing a pointer to a local variable of "
+                                  "a function that has returned to '%s'",
+                          name);
+            return -1;
+        }
+        if (o->kind == OBJECT_FREED) {
+            runtime_error(vm, ip, "passing a pointer to freed memory to "
+                                  "'%s'", name);
+            return -1;
+        }
+        if (off > o->size) {
+            describe_object(o, what, sizeof(what));
+            runtime_error(vm, ip, "passing a pointer out of bounds, at "
+                                  "offset %" PRId64 " of %s, of %" PRIu64
+                                  " bytes, to '%s'", (int64_t)off, what,
+                          o->size, name);
+            return -1;
+        }
+    }
+    if (vm->strings[host - vm->prog->functions]
+        && check_strings(vm, ip, host, sig, args))
+        return -1;
+    if (!buffers) return 0;
+
+    size = host_buffers[buffers - 1].size;
+    switch (host_buffers[buffers - 1].length) {
+    case LENGTH_ARG:
+        n = args[size].u;
+        break;
+    case LENGTH_ARRAY:
+        if (__builtin_mul_overflow(args[size].u, args[size + 1].u, &n))
+            n = UINT64_MAX;
+        break;
+    case LENGTH_COPY:
+        n = string_size(vm, args[size].u);
+        break;
+    case LENGTH_APPEND:
+        n = string_size(vm, args[0].u);
+        if (n) n += string_size(vm, args[size].u) - 1;
+        break;
+    case LENGTH_FORMAT:
+        n = (uint64_t)sig->stub(sig, (void *)format_length, args).i + 1;
+        break;
+    }
+    if (!n && host_buffers[buffers - 1].length > LENGTH_ARRAY) {
+        runtime_error(vm, ip, "passing a string with no terminating null "
+                              "character to '%s'", name);
+        return -1;
+    }
+    for (int i = 0; i < 2; i++) {
+        const int k = host_buffers[buffers - 1].buffers[i];
+        const uint64_t p = k < 0 ? 0 : args[k].u;
+        const struct vm_object *const o = object_of(vm, p, n);
+        const uint64_t off = (p & VM_ADDRESS_MASK) - (uintptr_t)o->base;
+
+        if (o == vm->objects || !(sig->pointers >> k & 1)) continue;
+        if (o->size - off < n) {
+            describe_object(o, what, sizeof(what));
+            runtime_error(vm, ip, "out of bounds access of %" PRIu64
+                                  " bytes by '%s' at offset %" PRId64
+                                  " of %s, of %" PRIu64 " bytes", n, name,
+                          (int64_t)off, what, o->size);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Check the strings passed to a host function of host_strings, and the
+   strings of the %s conversions of its format, without a precision, which
+   may be of an array with no null character. Reports an error and returns
+   -1 if one has none within its object. */
+static int check_strings(struct vm *vm, const struct insn *ip,
+                         const struct function *host,
+                         const struct host_signature *sig,
+                         const union reg *args) {
+    const uint8_t entry = vm->strings[host - vm->prog->functions] - 1;
+    const int format = host_strings[entry].format;
+    const char *f;
+    uint32_t k;
+
+    for (uint32_t set = host_strings[entry].strings & sig->pointers; set;
+         set &= set - 1) {
+        const uint64_t p = args[__builtin_ctz(set)].u;
+
+        if (p && !string_size(vm, p)) goto unterminated;
+    }
+    if (format < 0 || !(sig->pointers >> format & 1) || !args[format].u)
+        return 0;
+
+    /* The arguments the format takes follow it, one for each conversion
+       and for each * of its width and precision. */
+    k = format + 1;
+    for (f = (const char *)(uintptr_t)(args[format].u & VM_ADDRESS_MASK);
+         *f; f++) {
+        bool precision = false;
+
+        if (*f != '%') continue;
+        while (*++f && strchr("-+ #0'123456789.*hlLjztq", *f)) {
+            if (*f == '.') precision = true;
+            if (*f == '*') k++;
+        }
+        if (!*f) break;
+        if (*f == '%') continue;
+        /* Arguments by position are not followed. */
+        if (*f == '$' || k >= sig->num_args) break;
+        if (*f == 's' && !precision && sig->pointers >> k & 1 && args[k].u
+            && !string_size(vm, args[k].u))
+            goto unterminated;
+        k++;
+    }
+    return 0;
+
+unterminated:
+    runtime_error(vm, ip, "passing a string with no terminating null "
+                          "character to '%s'", atom_spelling(host->name));
+    return -1;
+}
+
+/* Size of the string at p with its terminating null character, which
+   must be within the object p points into, or 0 if it is not, or if p is
+   to no memory. */
+static uint64_t string_size(struct vm *vm, uint64_t p) {
+    const struct vm_object *const o = object_of(vm, p, 1);
+    const char *const s = (const char *)(uintptr_t)(p & VM_ADDRESS_MASK);
+    const char *end;
+
+    if (o == vm->objects)
+        return s && host_mapped(vm, p, 1) ? strlen(s) + 1 : 0;
+    end = memchr(s, 0, o->size - (uint64_t)(s - (const char *)o->base));
+    return end ? (uint64_t)(end - s) + 1 : 0;
+}
+
+/* Copy of format fmt, into buf of size bytes if it fits, with the length
+   L of each floating conversion made l, so that it converts a double,
+   which for printf is the same; or NULL if fmt has none. A copy not in
+   buf is to be freed. */
+static char *double_format(const char *fmt, char *buf, size_t size) {
+    char *copy = NULL;
+
+    for (const char *f = fmt; *f; f++) {
+        const char *length = NULL;
+
+        if (*f != '%') continue;
+        while (*++f && strchr("-+ #0'123456789.*$hlLjztq", *f))
+            if (*f == 'L') length = f;
+        if (!*f) break;
+        if (!length || !strchr("aAeEfFgG", *f)) continue;
+        if (!copy) {
+            const size_t len = strlen(fmt) + 1;
+
+            copy = len <= size ? buf : malloc(len);
+            memcpy(copy, fmt, len);
+        }
+        copy[length - fmt] = 'l';
+    }
+    return copy;
+}
+
+/* Length of the string sprintf would write with format fmt, called in
+   its place with the same arguments. */
+static int format_length(char *buf, const char *fmt, ...) {
+    va_list ap;
+    int n;
+
+    (void)buf;
+    va_start(ap, fmt);
+    n = vsnprintf(NULL, 0, fmt, ap);
+    va_end(ap);
+    return n;
+}
+
+/* Entry of the host to the function of the program of the callback of
+   the host call in progress, with its arguments as integers or
+   pointers. */
+static uint64_t run_callback(uint64_t a0, uint64_t a1, uint64_t a2,
+                             uint64_t a3, uint64_t a4, uint64_t a5) {
+    struct vm_callback *const cb = callback;
+    const uint64_t args[6] = {a0, a1, a2, a3, a4, a5};
+    union reg result;
+
+    if (!cb) {
+        fprintf(stderr, "cisc: runtime error: function of the program "
+                        "called by the host after returning to it\n");
+        return 0;
+    }
+    if (cb->status) return 0;
+    for (uint32_t i = 0; i < cb->fn->num_params; i++)
+        cb->regs[i].u = args[i];
+    if (execute(cb->vm, cb->fn, cb->regs, cb->sp, cb->lp, cb->depth,
+                &result)) {
+        cb->status = -1;
+        return 0;
+    }
+    return result.u;
+}
+
+static const struct switch_case *find_case(const struct switch_case *cases,
+                                           uint32_t n, int64_t value) {
+    uint32_t lo = 0;
+    uint32_t hi = n;
+
+    while (lo < hi) {
+        const uint32_t mid = lo + (hi - lo) / 2;
+
+        if (cases[mid].value < value) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo < n && cases[lo].value == value ? &cases[lo] : NULL;
+}
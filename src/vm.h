@@ -0,0 +1,165 @@
+#ifndef VM_H
+#define VM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bytecode.h"
+
+struct preprocessor;
+struct tier;
+struct tier_node;
+
+/* Memory checks. A pointer to an object whose extent the VM knows, a
+   global, an object in the frame of a call, or a block from malloc,
+   calloc or realloc, carries a tag in its high 16 bits, above the 48 bits
+   of a user address: the index of the object in a table of bounds.
+   Checking an access through it takes a load from the table and a few
+   compares. A pointer without a tag, to memory of the host, fails the
+   quick check, through entry 0, which has no bounds, and is checked not
+   to be null and to be to memory the host has mapped, by a table of its
+   mappings read from /proc/self/maps again whenever an access misses it.
+
+   Each slot of a frame, a variable whose address is taken, an array, a
+   structure or a temporary, is an object of its own, so that an access
+   through a pointer to one is checked against its bounds and not those of
+   the frame. The frame is one object too, for the accesses the compiled
+   code makes to it directly.
+
+   An object that dies stays in the table with no bounds, so that accesses
+   through dangling pointers are found, and its entry goes to the back of a
+   queue of free entries, to be reused as late as possible. The memory of
+   the object is freed at once.
+
+   When all entries are in use, new objects take the tag of the last
+   entry, VM_SPILLED, which has no bounds either, and go in a second table
+   ordered by address instead, where an access through a pointer with
+   that tag looks up the object holding its address, or the one before:
+   one past the end of an object into the next is not found. An object
+   that dies stays in that table with no bounds until a new one covers its
+   address. */
+#define VM_TAG_SHIFT 48
+#define VM_ADDRESS_MASK ((UINT64_C(1) << VM_TAG_SHIFT) - 1)
+#define VM_MAX_OBJECTS (1 << (64 - VM_TAG_SHIFT))
+#define VM_SPILLED (VM_MAX_OBJECTS - 1)
+
+#if defined(__GNUC__) && !defined(VM_SWITCH_DISPATCH)
+#define VM_COMPUTED_GOTO
+#endif
+
+enum vm_object_kind {
+    OBJECT_NONE,
+    OBJECT_GLOBAL,
+    OBJECT_FRAME,
+    OBJECT_LOCAL,
+    OBJECT_HEAP,
+    /* A frame whose function returned, and a heap block freed. */
+    OBJECT_RETURNED,
+    OBJECT_FREED,
+    /* The entry of VM_SPILLED, for an address in no spilled object. */
+    OBJECT_SPILLED,
+};
+
+/* Object at [base, base + size), made of scalars of elem_size bytes if not
+   0; name is the atom of a global, or ATOM_NONE. */
+struct vm_object {
+    uint8_t *base;
+    uint64_t size;
+    uint8_t kind;
+    uint8_t elem_size;
+    uint32_t name;
+};
+
+/* Return address and registers of a caller, the start of its frame, and
+   the addresses of its frame slots. */
+struct vm_frame {
+    const struct insn *ret;
+    union reg *regs;
+    uint8_t *fp;
+    uint64_t *locals;
+};
+
+/* Interpreter of a linked program. Registers of the active functions are
+   windows of one stack of registers, a callee's starting at the argument
+   registers of its caller; frames are allocated from a stack of memory,
+   and return addresses from a third stack. If memory is checked, the
+   tagged addresses of the frame slots of each function, which ADDRC_LOCAL
+   loads, are on a fourth.
+
+   Dispatch jumps through a table of labels where the compiler supports it,
+   and is a switch otherwise, or if VM_SWITCH_DISPATCH is defined; so does
+   that of the second tier. */
+struct vm {
+    const struct program *prog;
+
+    /* Initial data of the program, with pointers relocated, and the
+       address of each global. */
+    uint8_t *data;
+    void **globals;
+
+    union reg *regs;
+    size_t num_regs;
+    uint8_t *memory;
+    size_t memory_size;
+    struct vm_frame *frames;
+    size_t max_frames;
+    uint64_t *locals;
+    size_t max_locals;
+
+    /* Table of objects, if memory is checked, and queue of free entries
+       [head, tail), modulo VM_MAX_OBJECTS. */
+    struct vm_object *objects;
+    uint16_t *free_objects;
+    size_t free_head;
+    size_t free_tail;
+    /* Objects tagged VM_SPILLED, by increasing base, the larger first at
+       the same base, so that a frame comes before its slots. */
+    struct vm_object *spilled;
+    size_t num_spilled;
+    size_t max_spilled;
+    /* Ranges [start, end) of readable memory of the host, merged where
+       they touch, by increasing address, as last read; and whether they
+       cannot be read, in which case every address is taken as mapped. */
+    uint64_t *host_ranges;
+    size_t num_host_ranges;
+    bool no_host_ranges;
+    /* The heap functions of the program are those of the VM instead of
+       the host's, by function index, if memory is checked; and the entry
+       of host_buffers and of host_strings of each host function, plus
+       one, or 0. */
+    uint8_t *builtins;
+    uint8_t *buffers;
+    uint8_t *strings;
+    /* The entry of host_formats of each host function, plus one, or 0. */
+    uint8_t *formats;
+
+    /* Instructions executed. */
+    uint64_t steps;
+    /* Bit set of the instructions that have warned, of an overflow or of
+       an access. */
+    uint8_t *warned;
+    /* Inline caches of indirect calls, if the program is specialized: the
+       callee of the last call of each call site to a function defined in
+       the program, or NULL. A call to it skips checking the pointer. */
+    const struct function **callees;
+
+    /* Second tier, if the program is tiered, as described in tier.h: the
+       calls of each function and the backward jumps to each instruction so
+       far, the compiled code of each function, or NULL if it has not been
+       tried, and the node each instruction enters it at, or NULL. */
+    uint32_t *call_counts;
+    uint32_t *jump_counts;
+    struct tier **tiers;
+    const struct tier_node **entries;
+};
+
+/* Prepare to run prog, which must be linked. */
+void vm_init(struct vm *vm, const struct program *prog);
+void vm_destroy(struct vm *vm);
+
+/* Call main with the arguments argc and argv, storing what it returns into
+   *status. Runtime errors are reported on stderr, and stop the program.
+   Returns 0 on success and -1 on an error. */
+int vm_run(struct vm *vm, int argc, char **argv, int *status);
+
+#endif
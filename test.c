@@ -1,5 +1,5 @@
 
-int printf(const char *, ...);
+#include <stdio.h>
 char t[] = "012345678";
 
 int main(void)